@@ -0,0 +1,11 @@
+#!/bin/sh
+
+if gcc -O2 ./src/image_bench.c -Iinclude -o image_bench -lpthread -lm; then
+
+./image_bench "$@"
+
+else
+
+echo "Compilation Error :("
+
+fi
@@ -0,0 +1,11 @@
+#!/bin/sh
+
+if gcc -O2 ./src/mesh_cooker.c ./include/GLAD/glad.c -Iinclude -o mesh_cooker -lpthread -lm -ldl; then
+
+./mesh_cooker "$@"
+
+else
+
+echo "Compilation Error :("
+
+fi
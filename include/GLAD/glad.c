@@ -169,11 +169,110 @@ static const char *exts = NULL;
 static int num_exts_i = 0;
 static char **exts_i = NULL;
 
+/* exts_i again as an open addressing hash set, so has_ext is a lookup
+ * rather than a strcmp against every extension the driver has */
+static const char **exts_set = NULL;
+static unsigned int exts_set_mask = 0;
+
+static unsigned int hash_ext(const char *ext) {
+    /* FNV-1a */
+    unsigned int hash = 2166136261u;
+    while(*ext != '\0') {
+        hash ^= (unsigned char)*ext++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void free_exts(void) {
+    if (exts_i != NULL) {
+        int index;
+        for(index = 0; index < num_exts_i; index++) {
+            free((char *)exts_i[index]);
+        }
+        free((void *)exts_i);
+        exts_i = NULL;
+    }
+    num_exts_i = 0;
+
+    free((void *)exts_set);
+    exts_set = NULL;
+    exts_set_mask = 0;
+}
+
+static char *copy_ext(const char *ext, size_t len) {
+    char *local_str = (char*)malloc((len+1) * sizeof(char));
+    if(local_str != NULL) {
+        memcpy(local_str, ext, len * sizeof(char));
+        local_str[len] = '\0';
+    }
+    return local_str;
+}
+
+static int build_exts_set(void) {
+    unsigned int capacity = 16;
+    int index;
+
+    /* at most half full, so probes stay short */
+    while(capacity < (unsigned int)num_exts_i * 2) {
+        capacity *= 2;
+    }
+
+    exts_set = (const char **)calloc(capacity, sizeof *exts_set);
+    if(exts_set == NULL) {
+        return 0;
+    }
+    exts_set_mask = capacity - 1;
+
+    for(index = 0; index < num_exts_i; index++) {
+        unsigned int slot;
+        if(exts_i[index] == NULL) continue;
+
+        slot = hash_ext(exts_i[index]) & exts_set_mask;
+        while(exts_set[slot] != NULL) {
+            if(strcmp(exts_set[slot], exts_i[index]) == 0) break;
+            slot = (slot + 1) & exts_set_mask;
+        }
+        exts_set[slot] = exts_i[index];
+    }
+    return 1;
+}
+
 static int get_exts(void) {
+    /* a reload gets the new context's list */
+    free_exts();
+
 #ifdef _GLAD_IS_SOME_NEW_VERSION
     if(max_loaded_major < 3) {
 #endif
+        const char *ext;
+        int count = 0;
+
         exts = (const char *)glGetString(GL_EXTENSIONS);
+        if(exts == NULL) {
+            return 0;
+        }
+
+        /* split the one string up so both paths share the set */
+        for(ext = exts; *ext != '\0'; ext++) {
+            if(*ext != ' ' && (ext == exts || *(ext - 1) == ' ')) count++;
+        }
+        exts_i = (char **)calloc(count > 0 ? (size_t)count : 1, sizeof *exts_i);
+        if (exts_i == NULL) {
+            return 0;
+        }
+
+        ext = exts;
+        while(*ext != '\0') {
+            const char *end;
+            while(*ext == ' ') ext++;
+            if(*ext == '\0') break;
+
+            end = ext;
+            while(*end != ' ' && *end != '\0') end++;
+            exts_i[num_exts_i++] = copy_ext(ext, (size_t)(end - ext));
+            ext = end;
+        }
 #ifdef _GLAD_IS_SOME_NEW_VERSION
     } else {
         unsigned int index;
@@ -190,71 +289,34 @@ static int get_exts(void) {
 
         for(index = 0; index < (unsigned)num_exts_i; index++) {
             const char *gl_str_tmp = (const char*)glGetStringi(GL_EXTENSIONS, index);
-            size_t len = strlen(gl_str_tmp);
-
-            char *local_str = (char*)malloc((len+1) * sizeof(char));
-            if(local_str != NULL) {
-                memcpy(local_str, gl_str_tmp, (len+1) * sizeof(char));
-            }
-            exts_i[index] = local_str;
+            exts_i[index] = gl_str_tmp != NULL ? copy_ext(gl_str_tmp, strlen(gl_str_tmp)) : NULL;
         }
     }
 #endif
-    return 1;
-}
-
-static void free_exts(void) {
-    if (exts_i != NULL) {
-        int index;
-        for(index = 0; index < num_exts_i; index++) {
-            free((char *)exts_i[index]);
-        }
-        free((void *)exts_i);
-        exts_i = NULL;
-    }
+    return build_exts_set();
 }
 
 static int has_ext(const char *ext) {
-#ifdef _GLAD_IS_SOME_NEW_VERSION
-    if(max_loaded_major < 3) {
-#endif
-        const char *extensions;
-        const char *loc;
-        const char *terminator;
-        extensions = exts;
-        if(extensions == NULL || ext == NULL) {
-            return 0;
-        }
-
-        while(1) {
-            loc = strstr(extensions, ext);
-            if(loc == NULL) {
-                return 0;
-            }
-
-            terminator = loc + strlen(ext);
-            if((loc == extensions || *(loc - 1) == ' ') &&
-                (*terminator == ' ' || *terminator == '\0')) {
-                return 1;
-            }
-            extensions = terminator;
-        }
-#ifdef _GLAD_IS_SOME_NEW_VERSION
-    } else {
-        int index;
-        if(exts_i == NULL) return 0;
-        for(index = 0; index < num_exts_i; index++) {
-            const char *e = exts_i[index];
+    unsigned int slot;
+    if(exts_set == NULL || ext == NULL) {
+        return 0;
+    }
 
-            if(exts_i[index] != NULL && strcmp(e, ext) == 0) {
-                return 1;
-            }
+    slot = hash_ext(ext) & exts_set_mask;
+    while(exts_set[slot] != NULL) {
+        if(strcmp(exts_set[slot], ext) == 0) {
+            return 1;
         }
+        slot = (slot + 1) & exts_set_mask;
     }
-#endif
 
     return 0;
 }
+
+/* the set is kept after loading, so this is cheap enough to call any time */
+int gladHasExtension(const char *ext) {
+    return has_ext(ext);
+}
 int GLAD_GL_VERSION_1_0 = 0;
 int GLAD_GL_VERSION_1_1 = 0;
 int GLAD_GL_VERSION_1_2 = 0;
@@ -1736,7 +1798,6 @@ static void load_GL_VERSION_4_6(GLADloadproc load) {
 static int find_extensionsGL(void) {
 	if (!get_exts()) return 0;
 	(void)&has_ext;
-	free_exts();
 	return 1;
 }
 
@@ -1831,3 +1892,18 @@ int gladLoadGLLoader(GLADloadproc load) {
 	return GLVersion.major != 0 || GLVersion.minor != 0;
 }
 
+/* just the version and extensions, for callers that load the entry points
+ * they use themselves rather than all of GL 4.6 */
+int gladLoadGLVersion(GLADloadproc load) {
+	GLVersion.major = 0; GLVersion.minor = 0;
+	glGetString = (PFNGLGETSTRINGPROC)load("glGetString");
+	if(glGetString == NULL) return 0;
+	if(glGetString(GL_VERSION) == NULL) return 0;
+	find_coreGL();
+
+	/* what find_extensionsGL needs */
+	glGetIntegerv = (PFNGLGETINTEGERVPROC)load("glGetIntegerv");
+	glGetStringi = (PFNGLGETSTRINGIPROC)load("glGetStringi");
+	if (!find_extensionsGL()) return 0;
+	return GLVersion.major != 0 || GLVersion.minor != 0;
+}
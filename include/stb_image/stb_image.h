@@ -335,6 +335,12 @@ RECENT REVISION HISTORY:
 //    huge block of memory and spend disproportionate time decoding it. By
 //    default this is set to (1 << 24), which is 16777216, but that's still
 //    very big.
+//
+//  - If you define STBI_JPEG_THREADS (and link with pthreads), baseline JPEGs
+//    can be decoded on several threads, see stbi_set_jpeg_threads(). Work is
+//    split at restart markers when the file has them; otherwise one thread
+//    does the Huffman decode and hands rows of MCUs to the others for the IDCT.
+//    Color conversion and upsampling are split into bands of rows either way.
 
 #ifndef STBI_NO_STDIO
 #include <stdio.h>
@@ -491,6 +497,75 @@ STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip);
 // calling it will fail to link if your compiler doesn't
 STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_flip);
 
+// decode large JPEGs on up to this many threads; 0 or 1 keeps the single
+// threaded decoder. has no effect unless the implementation was compiled with
+// STBI_JPEG_THREADS. with threads on, callback and FILE* sources are read to
+// the end before decoding, so a FILE* is left at EOF rather than just past
+// the image; not while a rows callback is set, which decodes on one thread
+STBIDEF void stbi_set_jpeg_threads(int thread_count);
+// as above, but only applies to images loaded on the thread that calls the
+// function, so loaders running on a job system can stay single threaded while
+// the main thread fans out; needs thread-local variables like the flip above
+STBIDEF void stbi_set_jpeg_threads_thread(int thread_count);
+
+enum
+{
+   STBI_simd_auto = 0, // the widest kernels the CPU supports
+   STBI_simd_none,
+   STBI_simd_sse2,     // NEON on ARM
+   STBI_simd_avx2
+};
+
+// pick the JPEG IDCT, upsampling and color conversion kernels, mainly for
+// testing and benchmarking. levels the build or the CPU doesn't support fall
+// back to the next one down. stbi_jpeg_simd returns the level in use. every
+// level decodes to the same bytes except STBI_simd_none, whose color
+// conversion rounds slightly differently
+STBIDEF void stbi_set_jpeg_simd(int level);
+STBIDEF int  stbi_jpeg_simd(void);
+
+// get rows as soon as the decoder has finished them, so they can be used
+// before the rest of the image has been read (when loading from callbacks)
+// or decoded. rows are 8-bit with comp channels, in file order before any
+// vertical flip, and the load still returns the whole image as usual.
+//   - baseline JPEGs hand out bands as their MCU rows are decoded
+//   - progressive JPEGs hand out the whole image after each scan with
+//     is_preview set, then the final rows
+//   - 8-bit non-interlaced PNGs without a palette or tRNS hand out rows as
+//     they're unfiltered, if req_comp is 0 or matches the file. the zlib
+//     stream still has to be read whole first
+// nothing else calls back. set per thread where thread-locals are available,
+// pass NULL to turn it off
+typedef void stbi_rows_callback(void *user, const stbi_uc *rows, int first_row, int row_count, int width, int height, int comp, int is_preview);
+STBIDEF void stbi_set_rows_callback(stbi_rows_callback *callback, void *user);
+
+#ifndef STBI_NO_JPEG
+// JPEG only: the Y, Cb and Cr planes as decoded, at the file's own chroma
+// subsampling and before any upsampling or color conversion, for doing
+// those on the GPU. greyscale files have just the Y plane. RGB and CMYK
+// JPEGs aren't YCbCr and fail. planes are tightly packed 8-bit rows; a plane
+// sample covers plane_hs x plane_vs image pixels, and chroma samples sit
+// centered on the pixels they cover, as in JFIF. the planes are never
+// flipped, since a subsampled plane of odd height can't be flipped exactly;
+// flip while converting instead. all planes share one allocation, free them
+// with stbi_jpeg_planes_free
+typedef struct
+{
+   int width, height;   // of the image
+   int plane_count;     // 1 or 3
+   int plane_w[3], plane_h[3];
+   int plane_hs[3], plane_vs[3];
+   stbi_uc *plane[3];
+} stbi_jpeg_planes;
+
+STBIDEF int  stbi_load_jpeg_planes_from_memory(stbi_uc const *buffer, int len, stbi_jpeg_planes *planes);
+STBIDEF int  stbi_load_jpeg_planes_from_callbacks(stbi_io_callbacks const *clbk, void *user, stbi_jpeg_planes *planes);
+#ifndef STBI_NO_STDIO
+STBIDEF int  stbi_load_jpeg_planes(char const *filename, stbi_jpeg_planes *planes);
+#endif
+STBIDEF void stbi_jpeg_planes_free(stbi_jpeg_planes *planes);
+#endif
+
 // ZLIB client - used by PNG, available for other purposes
 
 STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int initial_size, int *outlen);
@@ -565,6 +640,14 @@ STBIDEF int   stbi_zlib_decode_noheader_buffer(char *obuffer, int olen, const ch
 #include <stdio.h>
 #endif
 
+#if defined(STBI_JPEG_THREADS) && defined(STBI_NO_JPEG)
+#undef STBI_JPEG_THREADS
+#endif
+
+#ifdef STBI_JPEG_THREADS
+#include <pthread.h>
+#endif
+
 #ifndef STBI_ASSERT
 #include <assert.h>
 #define STBI_ASSERT(x) assert(x)
@@ -610,12 +693,14 @@ typedef unsigned short stbi__uint16;
 typedef   signed short stbi__int16;
 typedef unsigned int   stbi__uint32;
 typedef   signed int   stbi__int32;
+typedef unsigned __int64 stbi__uint64;
 #else
 #include <stdint.h>
 typedef uint16_t stbi__uint16;
 typedef int16_t  stbi__int16;
 typedef uint32_t stbi__uint32;
 typedef int32_t  stbi__int32;
+typedef uint64_t stbi__uint64;
 #endif
 
 // should produce compiler error if size is wrong
@@ -741,6 +826,39 @@ static int stbi__sse2_available(void)
 #endif
 #endif
 
+// AVX2 kernels are compiled next to the SSE2 ones with a per-function target
+// and picked at runtime, so nothing else needs to be built with -mavx2.
+// #define STBI_NO_AVX2 to leave them out
+#if defined(STBI_SSE2) && !defined(STBI_NO_AVX2) && !defined(STBI_NO_JPEG)
+#if defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))) || (defined(_MSC_VER) && _MSC_VER >= 1700)
+#define STBI_AVX2
+#endif
+#endif
+
+#ifdef STBI_AVX2
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#define STBI__AVX2_TARGET
+static int stbi__avx2_available(void)
+{
+   int info[4];
+   __cpuid(info,1);
+   // needs AVX, and the OS has to save the ymm registers
+   if (((info[2] >> 27) & 1) == 0 || ((info[2] >> 28) & 1) == 0) return 0;
+   if ((_xgetbv(0) & 6) != 6) return 0;
+   __cpuidex(info,7,0);
+   return ((info[1] >> 5) & 1) != 0;
+}
+#else
+#define STBI__AVX2_TARGET __attribute__((target("avx2")))
+static int stbi__avx2_available(void)
+{
+   return __builtin_cpu_supports("avx2");
+}
+#endif
+#endif
+
 // ARM NEON
 #if defined(STBI_NO_SIMD) && defined(STBI_NEON)
 #undef STBI_NEON
@@ -1080,6 +1198,43 @@ STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_fli
                                          : stbi__vertically_flip_on_load_global)
 #endif // STBI_THREAD_LOCAL
 
+static int stbi__jpeg_threads_global = 1;
+
+STBIDEF void stbi_set_jpeg_threads(int thread_count)
+{
+   stbi__jpeg_threads_global = thread_count;
+}
+
+#ifndef STBI_THREAD_LOCAL
+#define stbi__jpeg_threads  stbi__jpeg_threads_global
+#else
+static STBI_THREAD_LOCAL int stbi__jpeg_threads_local, stbi__jpeg_threads_set;
+
+STBIDEF void stbi_set_jpeg_threads_thread(int thread_count)
+{
+   stbi__jpeg_threads_local = thread_count;
+   stbi__jpeg_threads_set = 1;
+}
+
+#define stbi__jpeg_threads  (stbi__jpeg_threads_set         \
+                              ? stbi__jpeg_threads_local    \
+                              : stbi__jpeg_threads_global)
+#endif // STBI_THREAD_LOCAL
+
+#ifdef STBI_THREAD_LOCAL
+static STBI_THREAD_LOCAL stbi_rows_callback *stbi__rows_callback;
+static STBI_THREAD_LOCAL void *stbi__rows_user;
+#else
+static stbi_rows_callback *stbi__rows_callback;
+static void *stbi__rows_user;
+#endif
+
+STBIDEF void stbi_set_rows_callback(stbi_rows_callback *callback, void *user)
+{
+   stbi__rows_callback = callback;
+   stbi__rows_user = user;
+}
+
 static void *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri, int bpc)
 {
    memset(ri, 0, sizeof(*ri)); // make sure it's initialized if we add new fields
@@ -1885,6 +2040,8 @@ typedef struct
    int    delta[17];   // old 'firstsymbol' - old 'firstcode'
 } stbi__huffman;
 
+typedef struct stbi__jpeg_convert stbi__jpeg_convert;
+
 typedef struct
 {
    stbi__context *s;
@@ -1933,6 +2090,9 @@ typedef struct
    int scan_n, order[4];
    int restart_interval, todo;
 
+   // set while a rows callback is handing out rows as they're decoded
+   stbi__jpeg_convert *stream;
+
 // kernels
    void (*idct_block_kernel)(stbi_uc *out, int out_stride, short data[64]);
    void (*YCbCr_to_RGB_kernel)(stbi_uc *out, const stbi_uc *y, const stbi_uc *pcb, const stbi_uc *pcr, int count, int step);
@@ -2630,6 +2790,182 @@ static void stbi__idct_simd(stbi_uc *out, int out_stride, short data[64])
 
 #endif // STBI_SSE2
 
+#ifdef STBI_AVX2
+// the sse2 IDCT with each row's 32-bit intermediates in one ymm register
+// instead of two xmm halves. same arithmetic, so still bit-identical to the
+// generic C version
+STBI__AVX2_TARGET
+static void stbi__idct_avx2(stbi_uc *out, int out_stride, short data[64])
+{
+   __m128i row0, row1, row2, row3, row4, row5, row6, row7;
+   __m128i tmp;
+
+   // dot product constant: even elems=x, odd elems=y
+   #define dct_const(x,y)  _mm256_setr_epi16((x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y))
+
+   // out(0) = c0[even]*x + c0[odd]*y   (c0, x, y 16-bit, out 32-bit)
+   // out(1) = c1[even]*x + c1[odd]*y
+   #define dct_rot(out0,out1, x,y,c0,c1) \
+      __m256i c0##xy = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi16((x),(y))), _mm_unpackhi_epi16((x),(y)), 1); \
+      __m256i out0 = _mm256_madd_epi16(c0##xy, c0); \
+      __m256i out1 = _mm256_madd_epi16(c0##xy, c1)
+
+   // out = in << 12  (in 16-bit, out 32-bit)
+   #define dct_widen(out, in) \
+      __m256i out = _mm256_slli_epi32(_mm256_cvtepi16_epi32(in), 12)
+
+   // wide add
+   #define dct_wadd(out, a, b) \
+      __m256i out = _mm256_add_epi32(a, b)
+
+   // wide sub
+   #define dct_wsub(out, a, b) \
+      __m256i out = _mm256_sub_epi32(a, b)
+
+   // butterfly a/b, add bias, then shift by "s" and pack. the pack works
+   // per 128-bit lane, so put the quarters back in order before splitting
+   #define dct_bfly32o(out0, out1, a,b,bias,s) \
+      { \
+         __m256i abiased = _mm256_add_epi32(a, bias); \
+         dct_wadd(sum, abiased, b); \
+         dct_wsub(dif, abiased, b); \
+         __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(_mm256_srai_epi32(sum, s), _mm256_srai_epi32(dif, s)), 0xd8); \
+         out0 = _mm256_castsi256_si128(packed); \
+         out1 = _mm256_extracti128_si256(packed, 1); \
+      }
+
+   // 8-bit interleave step (for transposes)
+   #define dct_interleave8(a, b) \
+      tmp = a; \
+      a = _mm_unpacklo_epi8(a, b); \
+      b = _mm_unpackhi_epi8(tmp, b)
+
+   // 16-bit interleave step (for transposes)
+   #define dct_interleave16(a, b) \
+      tmp = a; \
+      a = _mm_unpacklo_epi16(a, b); \
+      b = _mm_unpackhi_epi16(tmp, b)
+
+   #define dct_pass(bias,shift) \
+      { \
+         /* even part */ \
+         dct_rot(t2e,t3e, row2,row6, rot0_0,rot0_1); \
+         __m128i sum04 = _mm_add_epi16(row0, row4); \
+         __m128i dif04 = _mm_sub_epi16(row0, row4); \
+         dct_widen(t0e, sum04); \
+         dct_widen(t1e, dif04); \
+         dct_wadd(x0, t0e, t3e); \
+         dct_wsub(x3, t0e, t3e); \
+         dct_wadd(x1, t1e, t2e); \
+         dct_wsub(x2, t1e, t2e); \
+         /* odd part */ \
+         dct_rot(y0o,y2o, row7,row3, rot2_0,rot2_1); \
+         dct_rot(y1o,y3o, row5,row1, rot3_0,rot3_1); \
+         __m128i sum17 = _mm_add_epi16(row1, row7); \
+         __m128i sum35 = _mm_add_epi16(row3, row5); \
+         dct_rot(y4o,y5o, sum17,sum35, rot1_0,rot1_1); \
+         dct_wadd(x4, y0o, y4o); \
+         dct_wadd(x5, y1o, y5o); \
+         dct_wadd(x6, y2o, y5o); \
+         dct_wadd(x7, y3o, y4o); \
+         dct_bfly32o(row0,row7, x0,x7,bias,shift); \
+         dct_bfly32o(row1,row6, x1,x6,bias,shift); \
+         dct_bfly32o(row2,row5, x2,x5,bias,shift); \
+         dct_bfly32o(row3,row4, x3,x4,bias,shift); \
+      }
+
+   __m256i rot0_0 = dct_const(stbi__f2f(0.5411961f), stbi__f2f(0.5411961f) + stbi__f2f(-1.847759065f));
+   __m256i rot0_1 = dct_const(stbi__f2f(0.5411961f) + stbi__f2f( 0.765366865f), stbi__f2f(0.5411961f));
+   __m256i rot1_0 = dct_const(stbi__f2f(1.175875602f) + stbi__f2f(-0.899976223f), stbi__f2f(1.175875602f));
+   __m256i rot1_1 = dct_const(stbi__f2f(1.175875602f), stbi__f2f(1.175875602f) + stbi__f2f(-2.562915447f));
+   __m256i rot2_0 = dct_const(stbi__f2f(-1.961570560f) + stbi__f2f( 0.298631336f), stbi__f2f(-1.961570560f));
+   __m256i rot2_1 = dct_const(stbi__f2f(-1.961570560f), stbi__f2f(-1.961570560f) + stbi__f2f( 3.072711026f));
+   __m256i rot3_0 = dct_const(stbi__f2f(-0.390180644f) + stbi__f2f( 2.053119869f), stbi__f2f(-0.390180644f));
+   __m256i rot3_1 = dct_const(stbi__f2f(-0.390180644f), stbi__f2f(-0.390180644f) + stbi__f2f( 1.501321110f));
+
+   // rounding biases in column/row passes, see stbi__idct_block for explanation.
+   __m256i bias_0 = _mm256_set1_epi32(512);
+   __m256i bias_1 = _mm256_set1_epi32(65536 + (128<<17));
+
+   // load
+   row0 = _mm_load_si128((const __m128i *) (data + 0*8));
+   row1 = _mm_load_si128((const __m128i *) (data + 1*8));
+   row2 = _mm_load_si128((const __m128i *) (data + 2*8));
+   row3 = _mm_load_si128((const __m128i *) (data + 3*8));
+   row4 = _mm_load_si128((const __m128i *) (data + 4*8));
+   row5 = _mm_load_si128((const __m128i *) (data + 5*8));
+   row6 = _mm_load_si128((const __m128i *) (data + 6*8));
+   row7 = _mm_load_si128((const __m128i *) (data + 7*8));
+
+   // column pass
+   dct_pass(bias_0, 10);
+
+   {
+      // 16bit 8x8 transpose pass 1
+      dct_interleave16(row0, row4);
+      dct_interleave16(row1, row5);
+      dct_interleave16(row2, row6);
+      dct_interleave16(row3, row7);
+
+      // transpose pass 2
+      dct_interleave16(row0, row2);
+      dct_interleave16(row1, row3);
+      dct_interleave16(row4, row6);
+      dct_interleave16(row5, row7);
+
+      // transpose pass 3
+      dct_interleave16(row0, row1);
+      dct_interleave16(row2, row3);
+      dct_interleave16(row4, row5);
+      dct_interleave16(row6, row7);
+   }
+
+   // row pass
+   dct_pass(bias_1, 17);
+
+   {
+      // pack
+      __m128i p0 = _mm_packus_epi16(row0, row1); // a0a1a2a3...a7b0b1b2b3...b7
+      __m128i p1 = _mm_packus_epi16(row2, row3);
+      __m128i p2 = _mm_packus_epi16(row4, row5);
+      __m128i p3 = _mm_packus_epi16(row6, row7);
+
+      // 8bit 8x8 transpose pass 1
+      dct_interleave8(p0, p2); // a0e0a1e1...
+      dct_interleave8(p1, p3); // c0g0c1g1...
+
+      // transpose pass 2
+      dct_interleave8(p0, p1); // a0c0e0g0...
+      dct_interleave8(p2, p3); // b0d0f0h0...
+
+      // transpose pass 3
+      dct_interleave8(p0, p2); // a0b0c0d0...
+      dct_interleave8(p1, p3); // a4b4c4d4...
+
+      // store
+      _mm_storel_epi64((__m128i *) out, p0); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p0, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p2); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p2, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p1); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p1, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p3); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p3, 0x4e));
+   }
+
+#undef dct_const
+#undef dct_rot
+#undef dct_widen
+#undef dct_wadd
+#undef dct_wsub
+#undef dct_bfly32o
+#undef dct_interleave8
+#undef dct_interleave16
+#undef dct_pass
+}
+
+#endif // STBI_AVX2
+
 #ifdef STBI_NEON
 
 // NEON integer IDCT. should produce bit-identical
@@ -2872,49 +3208,379 @@ static void stbi__jpeg_reset(stbi__jpeg *j)
    // since we don't even allow 1<<30 pixels
 }
 
-static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
+#ifdef STBI_JPEG_THREADS
+// threaded baseline decode. with restart markers, each thread decodes its
+// own run of restart intervals from start to finish. without them the calling
+// thread does the Huffman decode a row of MCUs at a time and the other threads
+// run the IDCT on finished rows. progressive scans always take the serial path
+
+#ifndef STBI_JPEG_THREAD_MIN_PIXELS
+#define STBI_JPEG_THREAD_MIN_PIXELS  (512*512)
+#endif
+#define STBI__JPEG_MAX_THREADS       32
+#define STBI__JPEG_RING_ROWS         4    // MCU rows in flight per IDCT thread
+
+static int stbi__jpeg_thread_count(stbi__jpeg *z)
 {
-   stbi__jpeg_reset(z);
-   if (!z->progressive) {
-      if (z->scan_n == 1) {
-         int i,j;
-         STBI_SIMD_ALIGN(short, data[64]);
-         int n = z->order[0];
-         // non-interleaved data, we just need to process one block at a time,
-         // in trivial scanline order
-         // number of blocks to do just depends on how many actual "pixels" this
-         // component has, independent of interleaved MCU blocking and such
-         int w = (z->img_comp[n].x+7) >> 3;
-         int h = (z->img_comp[n].y+7) >> 3;
-         for (j=0; j < h; ++j) {
-            for (i=0; i < w; ++i) {
-               int ha = z->img_comp[n].ha;
-               if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
-               // every data block is an MCU, so countdown the restart interval
-               if (--z->todo <= 0) {
-                  if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
-                  // if it's NOT a restart, then just bail, so we get corrupt data
-                  // rather than no data
-                  if (!STBI__RESTART(z->marker)) return 1;
-                  stbi__jpeg_reset(z);
-               }
-            }
+   int n = stbi__jpeg_threads;
+   if (n > STBI__JPEG_MAX_THREADS) n = STBI__JPEG_MAX_THREADS;
+   // not worth starting threads for small images
+   if (n < 2 || z->s->img_x * z->s->img_y < STBI_JPEG_THREAD_MIN_PIXELS) return 1;
+   return n;
+}
+
+// run fn on count jobs, the calling thread takes the first one. a job whose
+// thread fails to start runs on the calling thread afterwards
+static void stbi__jpeg_run_threads(int count, void *(*fn)(void *), void *jobs, size_t job_size)
+{
+   pthread_t thread[STBI__JPEG_MAX_THREADS];
+   int started[STBI__JPEG_MAX_THREADS];
+   int i;
+   for (i=1; i < count; ++i)
+      started[i] = pthread_create(&thread[i], NULL, fn, (char *) jobs + i*job_size) == 0;
+   fn(jobs);
+   for (i=1; i < count; ++i) {
+      if (started[i]) pthread_join(thread[i], NULL);
+      else fn((char *) jobs + i*job_size);
+   }
+}
+
+// a scan is a grid of units: interleaved MCUs, or single blocks when the
+// scan has one component
+static void stbi__jpeg_scan_units(stbi__jpeg *z, int *units_x, int *units_y, int *blocks)
+{
+   int k;
+   if (z->scan_n == 1) {
+      int n = z->order[0];
+      *units_x = (z->img_comp[n].x+7) >> 3;
+      *units_y = (z->img_comp[n].y+7) >> 3;
+      *blocks = 1;
+   } else {
+      *units_x = z->img_mcu_x;
+      *units_y = z->img_mcu_y;
+      *blocks = 0;
+      for (k=0; k < z->scan_n; ++k)
+         *blocks += z->img_comp[z->order[k]].h * z->img_comp[z->order[k]].v;
+   }
+}
+
+// Huffman decode one unit into consecutive 64-coefficient blocks
+static int stbi__jpeg_decode_unit(stbi__jpeg *z, short *coeff)
+{
+   int k,x,y;
+   for (k=0; k < z->scan_n; ++k) {
+      int n = z->order[k];
+      int h = z->scan_n == 1 ? 1 : z->img_comp[n].h;
+      int v = z->scan_n == 1 ? 1 : z->img_comp[n].v;
+      int ha = z->img_comp[n].ha;
+      for (y=0; y < v; ++y) {
+         for (x=0; x < h; ++x, coeff += 64) {
+            if (!stbi__jpeg_decode_block(z, coeff, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
          }
-         return 1;
-      } else { // interleaved
-         int i,j,k,x,y;
-         STBI_SIMD_ALIGN(short, data[64]);
-         for (j=0; j < z->img_mcu_y; ++j) {
-            for (i=0; i < z->img_mcu_x; ++i) {
-               // scan an interleaved mcu... process scan_n components in order
-               for (k=0; k < z->scan_n; ++k) {
-                  int n = z->order[k];
-                  // scan out an mcu's worth of this component; that's just determined
-                  // by the basic H and V specified for the component
-                  for (y=0; y < z->img_comp[n].v; ++y) {
-                     for (x=0; x < z->img_comp[n].h; ++x) {
-                        int x2 = (i*z->img_comp[n].h + x)*8;
+      }
+   }
+   return 1;
+}
+
+// IDCT a decoded unit into the component planes
+static void stbi__jpeg_idct_unit(stbi__jpeg *z, int i, int j, short *coeff)
+{
+   int k,x,y;
+   for (k=0; k < z->scan_n; ++k) {
+      int n = z->order[k];
+      int h = z->scan_n == 1 ? 1 : z->img_comp[n].h;
+      int v = z->scan_n == 1 ? 1 : z->img_comp[n].v;
+      for (y=0; y < v; ++y) {
+         for (x=0; x < h; ++x, coeff += 64) {
+            int x2 = (i*h + x)*8;
+            int y2 = (j*v + y)*8;
+            z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, coeff);
+         }
+      }
+   }
+}
+
+typedef struct
+{
+   stbi__jpeg *z;
+   stbi_uc **interval;   // start of each restart interval's entropy data
+   stbi_uc *end;
+   int first, last;      // intervals this thread decodes
+   // allocated by the calling thread, so allocator hooks that keep per-thread
+   // state see every allocation of a decode
+   stbi__jpeg *copy;
+   void *raw;
+   int ok;
+} stbi__jpeg_interval_job;
+
+static void *stbi__jpeg_interval_worker(void *arg)
+{
+   stbi__jpeg_interval_job *job = (stbi__jpeg_interval_job *) arg;
+   stbi__context s;
+   stbi__jpeg *z = job->copy;
+   short *coeff = (short *) (((size_t) job->raw + 15) & ~15);
+   int units_x, units_y, blocks, total, k, u;
+
+   job->ok = 0;
+   // each thread needs its own bit reader and dc predictors
+   memcpy(z, job->z, sizeof(stbi__jpeg));
+   z->s = &s;
+   stbi__jpeg_scan_units(z, &units_x, &units_y, &blocks);
+   total = units_x * units_y;
+
+   for (k=job->first; k < job->last; ++k) {
+      int u0 = k * z->restart_interval;
+      int u1 = u0 + z->restart_interval < total ? u0 + z->restart_interval : total;
+      stbi__start_mem(&s, job->interval[k], (int) (job->end - job->interval[k]));
+      stbi__jpeg_reset(z);
+      for (u=u0; u < u1; ++u) {
+         if (!stbi__jpeg_decode_unit(z, coeff)) return NULL;
+         stbi__jpeg_idct_unit(z, u % units_x, u / units_x, coeff);
+      }
+   }
+   job->ok = 1;
+   return NULL;
+}
+
+// returns -1 if the restart markers don't line up with the restart interval,
+// so the caller can fall back to another path
+static int stbi__jpeg_decode_intervals(stbi__jpeg *z, int threads)
+{
+   stbi__jpeg_interval_job job[STBI__JPEG_MAX_THREADS];
+   stbi_uc **interval;
+   stbi_uc *p = z->s->img_buffer, *end = z->s->img_buffer_end;
+   int units_x, units_y, blocks, count, found, t, ok;
+
+   stbi__jpeg_scan_units(z, &units_x, &units_y, &blocks);
+   count = (units_x * units_y + z->restart_interval-1) / z->restart_interval;
+   if (count < 2) return -1;
+   interval = (stbi_uc **) stbi__malloc_mad2(count, sizeof(stbi_uc *), 0);
+   if (!interval) return -1;
+
+   // find where every interval starts and where the scan ends. 0xff00 is a
+   // stuffed data byte and 0xffff is fill before a marker
+   found = 0;
+   interval[found++] = p;
+   for (;;) {
+      p = (stbi_uc *) memchr(p, 0xff, end - p);
+      if (!p || p+1 >= end) { p = end; break; }
+      if (p[1] == 0x00) { p += 2; continue; }
+      if (p[1] == 0xff) { ++p; continue; }
+      if (!STBI__RESTART(p[1])) break;
+      p += 2;
+      if (found < count) interval[found++] = p;
+   }
+   if (found != count) { STBI_FREE(interval); return -1; }
+
+   if (threads > count) threads = count;
+   for (t=0; t < threads; ++t) {
+      job[t].z = z;
+      job[t].interval = interval;
+      job[t].end = p;
+      job[t].first = count * t / threads;
+      job[t].last = count * (t+1) / threads;
+      job[t].copy = (stbi__jpeg *) stbi__malloc(sizeof(stbi__jpeg));
+      job[t].raw = stbi__malloc_mad2(blocks, 64*sizeof(short), 15);
+   }
+   ok = 1;
+   for (t=0; t < threads; ++t)
+      if (!job[t].copy || !job[t].raw) ok = 0;
+   if (ok)
+      stbi__jpeg_run_threads(threads, stbi__jpeg_interval_worker, job, sizeof(job[0]));
+   STBI_FREE(interval);
+   for (t=0; t < threads; ++t) {
+      if (job[t].copy) STBI_FREE(job[t].copy);
+      if (job[t].raw) STBI_FREE(job[t].raw);
+   }
+   if (!ok) return -1;
+   for (t=0; t < threads; ++t)
+      if (!job[t].ok) return stbi__err("bad huffman code","Corrupt JPEG");
+
+   // leave the stream where the serial decoder would have, at the marker
+   // after the scan
+   z->s->img_buffer = p;
+   stbi__jpeg_reset(z);
+   return 1;
+}
+
+typedef struct
+{
+   stbi__jpeg *z;
+   short *coeff;          // ring of decoded MCU rows
+   int *busy;             // per ring slot, set until its row has been IDCT'd
+   int ring, row_coeffs;
+   int units_x, blocks;
+   int decoded, next;     // rows handed over by the decoder, rows taken for IDCT
+   int done;
+   pthread_mutex_t lock;
+   pthread_cond_t row_ready, row_free;
+} stbi__jpeg_pipeline;
+
+static void *stbi__jpeg_idct_worker(void *arg)
+{
+   stbi__jpeg_pipeline *p = (stbi__jpeg_pipeline *) arg;
+   for (;;) {
+      short *coeff;
+      int row, i;
+      pthread_mutex_lock(&p->lock);
+      while (p->next >= p->decoded && !p->done)
+         pthread_cond_wait(&p->row_ready, &p->lock);
+      if (p->next >= p->decoded) {
+         pthread_mutex_unlock(&p->lock);
+         return NULL;
+      }
+      row = p->next++;
+      pthread_mutex_unlock(&p->lock);
+
+      coeff = p->coeff + (size_t) (row % p->ring) * p->row_coeffs;
+      for (i=0; i < p->units_x; ++i)
+         stbi__jpeg_idct_unit(p->z, i, row, coeff + i*p->blocks*64);
+
+      pthread_mutex_lock(&p->lock);
+      p->busy[row % p->ring] = 0;
+      pthread_cond_signal(&p->row_free);
+      pthread_mutex_unlock(&p->lock);
+   }
+}
+
+// returns -1 if no IDCT thread could be started
+static int stbi__jpeg_decode_pipelined(stbi__jpeg *z, int threads)
+{
+   stbi__jpeg_pipeline p;
+   pthread_t thread[STBI__JPEG_MAX_THREADS];
+   void *raw;
+   int units_y, started, stop, ok, i, j, t;
+
+   stbi__jpeg_scan_units(z, &p.units_x, &units_y, &p.blocks);
+   p.z = z;
+   p.ring = (threads-1) * STBI__JPEG_RING_ROWS;
+   if (p.ring > units_y) p.ring = units_y;
+   p.row_coeffs = p.units_x * p.blocks * 64;
+   raw = stbi__malloc_mad3(p.ring, p.row_coeffs, sizeof(short), 15);
+   p.busy = (int *) stbi__malloc_mad2(p.ring, sizeof(int), 0);
+   if (!raw || !p.busy) {
+      if (raw) STBI_FREE(raw);
+      if (p.busy) STBI_FREE(p.busy);
+      return -1;
+   }
+   p.coeff = (short *) (((size_t) raw + 15) & ~15);
+   memset(p.busy, 0, p.ring * sizeof(int));
+   p.decoded = p.next = p.done = 0;
+   pthread_mutex_init(&p.lock, NULL);
+   pthread_cond_init(&p.row_ready, NULL);
+   pthread_cond_init(&p.row_free, NULL);
+
+   started = 0;
+   for (t=0; t < threads-1; ++t)
+      if (pthread_create(&thread[started], NULL, stbi__jpeg_idct_worker, &p) == 0)
+         ++started;
+
+   ok = 1;
+   if (started) {
+      stbi__jpeg_reset(z);
+      for (j=0, stop=0; j < units_y && !stop; ++j) {
+         short *coeff = p.coeff + (size_t) (j % p.ring) * p.row_coeffs;
+         pthread_mutex_lock(&p.lock);
+         while (p.busy[j % p.ring])
+            pthread_cond_wait(&p.row_free, &p.lock);
+         p.busy[j % p.ring] = 1;
+         pthread_mutex_unlock(&p.lock);
+
+         for (i=0; i < p.units_x; ++i) {
+            if (!stbi__jpeg_decode_unit(z, coeff + i*p.blocks*64)) { ok = 0; break; }
+            if (--z->todo <= 0) {
+               if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
+               // same as the serial decoder, a missing restart marker ends
+               // the scan early rather than failing it
+               if (!STBI__RESTART(z->marker)) { stop = 1; ++i; break; }
+               stbi__jpeg_reset(z);
+            }
+         }
+         if (!ok) break;
+         if (stop)
+            memset(coeff + i*p.blocks*64, 0, (size_t) (p.units_x - i) * p.blocks * 64 * sizeof(short));
+
+         pthread_mutex_lock(&p.lock);
+         p.decoded = j+1;
+         pthread_cond_signal(&p.row_ready);
+         pthread_mutex_unlock(&p.lock);
+      }
+   }
+
+   pthread_mutex_lock(&p.lock);
+   p.done = 1;
+   pthread_cond_broadcast(&p.row_ready);
+   pthread_mutex_unlock(&p.lock);
+   for (t=0; t < started; ++t)
+      pthread_join(thread[t], NULL);
+
+   pthread_cond_destroy(&p.row_free);
+   pthread_cond_destroy(&p.row_ready);
+   pthread_mutex_destroy(&p.lock);
+   STBI_FREE(p.busy);
+   STBI_FREE(raw);
+   if (!started) return -1;
+   return ok;
+}
+#endif // STBI_JPEG_THREADS
+
+static void stbi__jpeg_rows_decoded(stbi__jpeg *z, int rows);
+static void stbi__jpeg_preview(stbi__jpeg *z);
+
+static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
+{
+#ifdef STBI_JPEG_THREADS
+   // the threaded paths scan ahead in the entropy data, so need it in memory.
+   // streaming wants rows in order as the data comes in, so stays serial
+   if (!z->progressive && !z->s->read_from_callbacks && !z->stream && stbi__jpeg_thread_count(z) > 1) {
+      int r = z->restart_interval ? stbi__jpeg_decode_intervals(z, stbi__jpeg_thread_count(z)) : -1;
+      if (r < 0) r = stbi__jpeg_decode_pipelined(z, stbi__jpeg_thread_count(z));
+      if (r >= 0) return r;
+   }
+#endif
+   stbi__jpeg_reset(z);
+   if (!z->progressive) {
+      if (z->scan_n == 1) {
+         int i,j;
+         STBI_SIMD_ALIGN(short, data[64]);
+         int n = z->order[0];
+         // non-interleaved data, we just need to process one block at a time,
+         // in trivial scanline order
+         // number of blocks to do just depends on how many actual "pixels" this
+         // component has, independent of interleaved MCU blocking and such
+         int w = (z->img_comp[n].x+7) >> 3;
+         int h = (z->img_comp[n].y+7) >> 3;
+         for (j=0; j < h; ++j) {
+            for (i=0; i < w; ++i) {
+               int ha = z->img_comp[n].ha;
+               if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
+               // every data block is an MCU, so countdown the restart interval
+               if (--z->todo <= 0) {
+                  if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
+                  // if it's NOT a restart, then just bail, so we get corrupt data
+                  // rather than no data
+                  if (!STBI__RESTART(z->marker)) return 1;
+                  stbi__jpeg_reset(z);
+               }
+            }
+            // a greyscale image is done once its only scan is
+            if (z->stream && z->s->img_n == 1) stbi__jpeg_rows_decoded(z, (j+1) * 8);
+         }
+         return 1;
+      } else { // interleaved
+         int i,j,k,x,y;
+         STBI_SIMD_ALIGN(short, data[64]);
+         for (j=0; j < z->img_mcu_y; ++j) {
+            for (i=0; i < z->img_mcu_x; ++i) {
+               // scan an interleaved mcu... process scan_n components in order
+               for (k=0; k < z->scan_n; ++k) {
+                  int n = z->order[k];
+                  // scan out an mcu's worth of this component; that's just determined
+                  // by the basic H and V specified for the component
+                  for (y=0; y < z->img_comp[n].v; ++y) {
+                     for (x=0; x < z->img_comp[n].h; ++x) {
+                        int x2 = (i*z->img_comp[n].h + x)*8;
                         int y2 = (j*z->img_comp[n].v + y)*8;
                         int ha = z->img_comp[n].ha;
                         if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
@@ -2930,6 +3596,7 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
                   stbi__jpeg_reset(z);
                }
             }
+            if (z->stream && z->scan_n == z->s->img_n) stbi__jpeg_rows_decoded(z, (j+1) * z->img_mcu_h);
          }
          return 1;
       }
@@ -3319,6 +3986,7 @@ static int stbi__decode_jpeg_image(stbi__jpeg *j)
       if (stbi__SOS(m)) {
          if (!stbi__process_scan_header(j)) return 0;
          if (!stbi__parse_entropy_coded_data(j)) return 0;
+         if (j->stream && j->progressive) stbi__jpeg_preview(j);
          if (j->marker == STBI__MARKER_none ) {
             // handle 0s at the end of image data from IP Kamera 9060
             while (!stbi__at_eof(j->s)) {
@@ -3542,6 +4210,83 @@ static stbi_uc *stbi__resample_row_hv_2_simd(stbi_uc *out, stbi_uc *in_near, stb
 }
 #endif
 
+#ifdef STBI_AVX2
+// same filter as the sse2 version, 16 pixels at a time
+STBI__AVX2_TARGET
+static stbi_uc *stbi__resample_row_hv_2_avx2(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
+{
+   // need to generate 2x2 samples for every one in input
+   int i=0,t0,t1;
+
+   if (w == 1) {
+      out[0] = out[1] = stbi__div4(3*in_near[0] + in_far[0] + 2);
+      return out;
+   }
+
+   t1 = 3*in_near[0] + in_far[0];
+   // the last pixel in a row is left to the scalar loop below, because of
+   // the filter boundary conditions
+   for (; i < ((w-1) & ~15); i += 16) {
+      // vertical filtering pass, 3*x + y = 4*x + (y - x)
+      __m256i farw  = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_far + i)));
+      __m256i nearw = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_near + i)));
+      __m256i diff  = _mm256_sub_epi16(farw, nearw);
+      __m256i nears = _mm256_slli_epi16(nearw, 2);
+      __m256i curr  = _mm256_add_epi16(nears, diff); // current row
+
+      // "prev" is current row shifted right by 1 pixel and "next" shifted
+      // left by 1. the shifts have to carry across the 128-bit lanes, hence
+      // the permutes
+      __m256i prv0 = _mm256_alignr_epi8(curr, _mm256_permute2x128_si256(curr, curr, 0x08), 14);
+      __m256i nxt0 = _mm256_alignr_epi8(_mm256_permute2x128_si256(curr, curr, 0x81), curr, 2);
+      __m256i prev = _mm256_insert_epi16(prv0, t1, 0);
+      __m256i next = _mm256_insert_epi16(nxt0, 3*in_near[i+16] + in_far[i+16], 15);
+
+      // horizontal filter, polyphase implementation since it's convenient:
+      // even pixels = 3*cur + prev = cur*4 + (prev - cur)
+      // odd  pixels = 3*cur + next = cur*4 + (next - cur)
+      // note the shared term.
+      __m256i bias  = _mm256_set1_epi16(8);
+      __m256i curs = _mm256_slli_epi16(curr, 2);
+      __m256i prvd = _mm256_sub_epi16(prev, curr);
+      __m256i nxtd = _mm256_sub_epi16(next, curr);
+      __m256i curb = _mm256_add_epi16(curs, bias);
+      __m256i even = _mm256_add_epi16(prvd, curb);
+      __m256i odd  = _mm256_add_epi16(nxtd, curb);
+
+      // interleave even and odd pixels, then undo scaling. unpack and pack
+      // both stay within a lane, so the bytes come out in order
+      __m256i int0 = _mm256_unpacklo_epi16(even, odd);
+      __m256i int1 = _mm256_unpackhi_epi16(even, odd);
+      __m256i de0  = _mm256_srli_epi16(int0, 4);
+      __m256i de1  = _mm256_srli_epi16(int1, 4);
+
+      // pack and write output
+      __m256i outv = _mm256_packus_epi16(de0, de1);
+      _mm256_storeu_si256((__m256i *) (out + i*2), outv);
+
+      // "previous" value for next iter
+      t1 = 3*in_near[i+15] + in_far[i+15];
+   }
+
+   t0 = t1;
+   t1 = 3*in_near[i] + in_far[i];
+   out[i*2] = stbi__div16(3*t1 + t0 + 8);
+
+   for (++i; i < w; ++i) {
+      t0 = t1;
+      t1 = 3*in_near[i]+in_far[i];
+      out[i*2-1] = stbi__div16(3*t0 + t1 + 8);
+      out[i*2  ] = stbi__div16(3*t1 + t0 + 8);
+   }
+   out[w*2-1] = stbi__div4(t1+2);
+
+   STBI_NOTUSED(hs);
+
+   return out;
+}
+#endif
+
 static stbi_uc *stbi__resample_row_generic(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
 {
    // resample with nearest-neighbor
@@ -3716,25 +4461,122 @@ static void stbi__YCbCr_to_RGB_simd(stbi_uc *out, stbi_uc const *y, stbi_uc cons
 }
 #endif
 
+#ifdef STBI_AVX2
+// 16 pixels at a time with the same 16-bit math as the sse2 version, so the
+// two give identical results. anything left over goes to the sse2 version
+STBI__AVX2_TARGET
+static void stbi__YCbCr_to_RGB_avx2(stbi_uc *out, stbi_uc const *y, stbi_uc const *pcb, stbi_uc const *pcr, int count, int step)
+{
+   int i = 0;
+
+   // step == 3 isn't accelerated by the sse2 version either
+   if (step == 4) {
+      __m128i signflip  = _mm_set1_epi8(-0x80);
+      __m256i cr_const0 = _mm256_set1_epi16(   (short) ( 1.40200f*4096.0f+0.5f));
+      __m256i cr_const1 = _mm256_set1_epi16( - (short) ( 0.71414f*4096.0f+0.5f));
+      __m256i cb_const0 = _mm256_set1_epi16( - (short) ( 0.34414f*4096.0f+0.5f));
+      __m256i cb_const1 = _mm256_set1_epi16(   (short) ( 1.77200f*4096.0f+0.5f));
+      __m256i y_bias = _mm256_set1_epi16(128);
+      __m256i xw = _mm256_set1_epi16(255); // alpha channel
+
+      for (; i+15 < count; i += 16) {
+         // load
+         __m128i y_bytes = _mm_loadu_si128((__m128i *) (y+i));
+         __m128i cr_bytes = _mm_loadu_si128((__m128i *) (pcr+i));
+         __m128i cb_bytes = _mm_loadu_si128((__m128i *) (pcb+i));
+         __m128i cr_biased = _mm_xor_si128(cr_bytes, signflip); // -128
+         __m128i cb_biased = _mm_xor_si128(cb_bytes, signflip); // -128
+
+         // widen to short (and left-shift y, cr, cb by 8)
+         __m256i yw  = _mm256_or_si256(_mm256_slli_epi16(_mm256_cvtepu8_epi16(y_bytes), 8), y_bias);
+         __m256i crw = _mm256_slli_epi16(_mm256_cvtepi8_epi16(cr_biased), 8);
+         __m256i cbw = _mm256_slli_epi16(_mm256_cvtepi8_epi16(cb_biased), 8);
+
+         // color transform
+         __m256i yws = _mm256_srli_epi16(yw, 4);
+         __m256i cr0 = _mm256_mulhi_epi16(cr_const0, crw);
+         __m256i cb0 = _mm256_mulhi_epi16(cb_const0, cbw);
+         __m256i cb1 = _mm256_mulhi_epi16(cbw, cb_const1);
+         __m256i cr1 = _mm256_mulhi_epi16(crw, cr_const1);
+         __m256i rws = _mm256_add_epi16(cr0, yws);
+         __m256i gwt = _mm256_add_epi16(cb0, yws);
+         __m256i bws = _mm256_add_epi16(yws, cb1);
+         __m256i gws = _mm256_add_epi16(gwt, cr1);
+
+         // descale
+         __m256i rw = _mm256_srai_epi16(rws, 4);
+         __m256i bw = _mm256_srai_epi16(bws, 4);
+         __m256i gw = _mm256_srai_epi16(gws, 4);
+
+         // back to byte, set up for transpose
+         __m256i brb = _mm256_packus_epi16(rw, bw);
+         __m256i gxb = _mm256_packus_epi16(gw, xw);
+
+         // transpose to interleave channels. each lane ends up holding
+         // pixels 0-3/4-7 and 8-11/12-15
+         __m256i t0 = _mm256_unpacklo_epi8(brb, gxb);
+         __m256i t1 = _mm256_unpackhi_epi8(brb, gxb);
+         __m256i o0 = _mm256_unpacklo_epi16(t0, t1);
+         __m256i o1 = _mm256_unpackhi_epi16(t0, t1);
+
+         // store
+         _mm256_storeu_si256((__m256i *) (out + 0), _mm256_permute2x128_si256(o0, o1, 0x20));
+         _mm256_storeu_si256((__m256i *) (out + 32), _mm256_permute2x128_si256(o0, o1, 0x31));
+         out += 64;
+      }
+   }
+
+   stbi__YCbCr_to_RGB_simd(out, y+i, pcb+i, pcr+i, count-i, step);
+}
+#endif
+
+static int stbi__jpeg_simd_request = STBI_simd_auto;
+
+STBIDEF void stbi_set_jpeg_simd(int level)
+{
+   stbi__jpeg_simd_request = level;
+}
+
+STBIDEF int stbi_jpeg_simd(void)
+{
+   int level = stbi__jpeg_simd_request == STBI_simd_auto ? STBI_simd_avx2 : stbi__jpeg_simd_request;
+#ifdef STBI_AVX2
+   if (level >= STBI_simd_avx2 && stbi__avx2_available()) return STBI_simd_avx2;
+#endif
+#ifdef STBI_SSE2
+   if (level >= STBI_simd_sse2 && stbi__sse2_available()) return STBI_simd_sse2;
+#endif
+#ifdef STBI_NEON
+   if (level >= STBI_simd_sse2) return STBI_simd_sse2;
+#endif
+   return STBI_simd_none;
+}
+
 // set up the kernels
 static void stbi__setup_jpeg(stbi__jpeg *j)
 {
+   int level = stbi_jpeg_simd();
+   STBI_NOTUSED(level);
+
+   j->stream = NULL;
    j->idct_block_kernel = stbi__idct_block;
    j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_row;
    j->resample_row_hv_2_kernel = stbi__resample_row_hv_2;
 
-#ifdef STBI_SSE2
-   if (stbi__sse2_available()) {
+#if defined(STBI_SSE2) || defined(STBI_NEON)
+   if (level >= STBI_simd_sse2) {
       j->idct_block_kernel = stbi__idct_simd;
       j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_simd;
       j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_simd;
    }
 #endif
 
-#ifdef STBI_NEON
-   j->idct_block_kernel = stbi__idct_simd;
-   j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_simd;
-   j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_simd;
+#ifdef STBI_AVX2
+   if (level >= STBI_simd_avx2) {
+      j->idct_block_kernel = stbi__idct_avx2;
+      j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_avx2;
+      j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_avx2;
+   }
 #endif
 }
 
@@ -3761,165 +4603,392 @@ static stbi_uc stbi__blinn_8x8(stbi_uc x, stbi_uc y)
    return (stbi_uc) ((t + (t >>8)) >> 8);
 }
 
-static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp, int req_comp)
+// resample and color-convert output rows [first,last) into output, which
+// points at row first. res_comp has to be at row first already, see
+// stbi__jpeg_resample_skip. with n == 3 each row writes one byte past its end
+static void stbi__jpeg_convert_rows(stbi__jpeg *z, stbi_uc *output, int n, int decode_n, int is_rgb, stbi__resample *res_comp, stbi_uc **linebuf, unsigned int first, unsigned int last)
 {
-   int n, decode_n, is_rgb;
-   z->s->img_n = 0; // make stbi__cleanup_jpeg safe
-
-   // validate req_comp
-   if (req_comp < 0 || req_comp > 4) return stbi__errpuc("bad req_comp", "Internal error");
-
-   // load a jpeg image from whichever source, but leave in YCbCr format
-   if (!stbi__decode_jpeg_image(z)) { stbi__cleanup_jpeg(z); return NULL; }
-
-   // determine actual number of components to generate
-   n = req_comp ? req_comp : z->s->img_n >= 3 ? 3 : 1;
-
-   is_rgb = z->s->img_n == 3 && (z->rgb == 3 || (z->app14_color_transform == 0 && !z->jfif));
-
-   if (z->s->img_n == 3 && n < 3 && !is_rgb)
-      decode_n = 1;
-   else
-      decode_n = z->s->img_n;
-
-   // resample and color-convert
-   {
-      int k;
-      unsigned int i,j;
-      stbi_uc *output;
-      stbi_uc *coutput[4] = { NULL, NULL, NULL, NULL };
-
-      stbi__resample res_comp[4];
+   int k;
+   unsigned int i,j;
+   stbi_uc *coutput[4] = { NULL, NULL, NULL, NULL };
 
+   for (j=first; j < last; ++j) {
+      stbi_uc *out = output + n * z->s->img_x * (j - first);
       for (k=0; k < decode_n; ++k) {
          stbi__resample *r = &res_comp[k];
-
-         // allocate line buffer big enough for upsampling off the edges
-         // with upsample factor of 4
-         z->img_comp[k].linebuf = (stbi_uc *) stbi__malloc(z->s->img_x + 3);
-         if (!z->img_comp[k].linebuf) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
-
-         r->hs      = z->img_h_max / z->img_comp[k].h;
-         r->vs      = z->img_v_max / z->img_comp[k].v;
-         r->ystep   = r->vs >> 1;
-         r->w_lores = (z->s->img_x + r->hs-1) / r->hs;
-         r->ypos    = 0;
-         r->line0   = r->line1 = z->img_comp[k].data;
-
-         if      (r->hs == 1 && r->vs == 1) r->resample = resample_row_1;
-         else if (r->hs == 1 && r->vs == 2) r->resample = stbi__resample_row_v_2;
-         else if (r->hs == 2 && r->vs == 1) r->resample = stbi__resample_row_h_2;
-         else if (r->hs == 2 && r->vs == 2) r->resample = z->resample_row_hv_2_kernel;
-         else                               r->resample = stbi__resample_row_generic;
-      }
-
-      // can't error after this so, this is safe
-      output = (stbi_uc *) stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
-      if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
-
-      // now go ahead and resample
-      for (j=0; j < z->s->img_y; ++j) {
-         stbi_uc *out = output + n * z->s->img_x * j;
-         for (k=0; k < decode_n; ++k) {
-            stbi__resample *r = &res_comp[k];
-            int y_bot = r->ystep >= (r->vs >> 1);
-            coutput[k] = r->resample(z->img_comp[k].linebuf,
-                                     y_bot ? r->line1 : r->line0,
-                                     y_bot ? r->line0 : r->line1,
-                                     r->w_lores, r->hs);
-            if (++r->ystep >= r->vs) {
-               r->ystep = 0;
-               r->line0 = r->line1;
-               if (++r->ypos < z->img_comp[k].y)
-                  r->line1 += z->img_comp[k].w2;
-            }
+         int y_bot = r->ystep >= (r->vs >> 1);
+         coutput[k] = r->resample(linebuf[k],
+                                  y_bot ? r->line1 : r->line0,
+                                  y_bot ? r->line0 : r->line1,
+                                  r->w_lores, r->hs);
+         if (++r->ystep >= r->vs) {
+            r->ystep = 0;
+            r->line0 = r->line1;
+            if (++r->ypos < z->img_comp[k].y)
+               r->line1 += z->img_comp[k].w2;
          }
-         if (n >= 3) {
-            stbi_uc *y = coutput[0];
-            if (z->s->img_n == 3) {
-               if (is_rgb) {
-                  for (i=0; i < z->s->img_x; ++i) {
-                     out[0] = y[i];
-                     out[1] = coutput[1][i];
-                     out[2] = coutput[2][i];
-                     out[3] = 255;
-                     out += n;
-                  }
-               } else {
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-               }
-            } else if (z->s->img_n == 4) {
-               if (z->app14_color_transform == 0) { // CMYK
-                  for (i=0; i < z->s->img_x; ++i) {
-                     stbi_uc m = coutput[3][i];
-                     out[0] = stbi__blinn_8x8(coutput[0][i], m);
-                     out[1] = stbi__blinn_8x8(coutput[1][i], m);
-                     out[2] = stbi__blinn_8x8(coutput[2][i], m);
-                     out[3] = 255;
-                     out += n;
-                  }
-               } else if (z->app14_color_transform == 2) { // YCCK
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-                  for (i=0; i < z->s->img_x; ++i) {
-                     stbi_uc m = coutput[3][i];
-                     out[0] = stbi__blinn_8x8(255 - out[0], m);
-                     out[1] = stbi__blinn_8x8(255 - out[1], m);
-                     out[2] = stbi__blinn_8x8(255 - out[2], m);
-                     out += n;
-                  }
-               } else { // YCbCr + alpha?  Ignore the fourth channel for now
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-               }
-            } else
+      }
+      if (n >= 3) {
+         stbi_uc *y = coutput[0];
+         if (z->s->img_n == 3) {
+            if (is_rgb) {
                for (i=0; i < z->s->img_x; ++i) {
-                  out[0] = out[1] = out[2] = y[i];
-                  out[3] = 255; // not used if n==3
+                  out[0] = y[i];
+                  out[1] = coutput[1][i];
+                  out[2] = coutput[2][i];
+                  out[3] = 255;
                   out += n;
                }
-         } else {
-            if (is_rgb) {
-               if (n == 1)
-                  for (i=0; i < z->s->img_x; ++i)
-                     *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-               else {
-                  for (i=0; i < z->s->img_x; ++i, out += 2) {
-                     out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-                     out[1] = 255;
-                  }
-               }
-            } else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
+            } else {
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+            }
+         } else if (z->s->img_n == 4) {
+            if (z->app14_color_transform == 0) { // CMYK
                for (i=0; i < z->s->img_x; ++i) {
                   stbi_uc m = coutput[3][i];
-                  stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
-                  stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
-                  stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
-                  out[0] = stbi__compute_y(r, g, b);
-                  out[1] = 255;
+                  out[0] = stbi__blinn_8x8(coutput[0][i], m);
+                  out[1] = stbi__blinn_8x8(coutput[1][i], m);
+                  out[2] = stbi__blinn_8x8(coutput[2][i], m);
+                  out[3] = 255;
                   out += n;
                }
-            } else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
+            } else if (z->app14_color_transform == 2) { // YCCK
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
                for (i=0; i < z->s->img_x; ++i) {
-                  out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
-                  out[1] = 255;
+                  stbi_uc m = coutput[3][i];
+                  out[0] = stbi__blinn_8x8(255 - out[0], m);
+                  out[1] = stbi__blinn_8x8(255 - out[1], m);
+                  out[2] = stbi__blinn_8x8(255 - out[2], m);
                   out += n;
                }
-            } else {
-               stbi_uc *y = coutput[0];
-               if (n == 1)
-                  for (i=0; i < z->s->img_x; ++i) out[i] = y[i];
-               else
-                  for (i=0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
+            } else { // YCbCr + alpha?  Ignore the fourth channel for now
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+            }
+         } else
+            for (i=0; i < z->s->img_x; ++i) {
+               out[0] = out[1] = out[2] = y[i];
+               out[3] = 255; // not used if n==3
+               out += n;
+            }
+      } else {
+         if (is_rgb) {
+            if (n == 1)
+               for (i=0; i < z->s->img_x; ++i)
+                  *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+            else {
+               for (i=0; i < z->s->img_x; ++i, out += 2) {
+                  out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+                  out[1] = 255;
+               }
+            }
+         } else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
+            for (i=0; i < z->s->img_x; ++i) {
+               stbi_uc m = coutput[3][i];
+               stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
+               stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
+               stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
+               out[0] = stbi__compute_y(r, g, b);
+               out[1] = 255;
+               out += n;
             }
+         } else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
+            for (i=0; i < z->s->img_x; ++i) {
+               out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
+               out[1] = 255;
+               out += n;
+            }
+         } else {
+            stbi_uc *y = coutput[0];
+            if (n == 1)
+               for (i=0; i < z->s->img_x; ++i) out[i] = y[i];
+            else
+               for (i=0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
          }
       }
+   }
+}
+
+#ifdef STBI_JPEG_THREADS
+// advance a component's resampler by rows output rows, so a band of rows can
+// start partway down the image
+static void stbi__jpeg_resample_skip(stbi__jpeg *z, stbi__resample *r, int k, unsigned int rows)
+{
+   while (rows--) {
+      if (++r->ystep >= r->vs) {
+         r->ystep = 0;
+         r->line0 = r->line1;
+         if (++r->ypos < z->img_comp[k].y)
+            r->line1 += z->img_comp[k].w2;
+      }
+   }
+}
+
+typedef struct
+{
+   stbi__jpeg *z;
+   stbi_uc *output;
+   int n, decode_n, is_rgb;
+   stbi__resample res_comp[4];
+   unsigned int first, last;
+   // allocated by the calling thread, like the interval jobs' buffers
+   stbi_uc *last_row;
+   stbi_uc *linebuf[4];
+   int ok;
+} stbi__jpeg_convert_job;
+
+static void *stbi__jpeg_convert_worker(void *arg)
+{
+   stbi__jpeg_convert_job *job = (stbi__jpeg_convert_job *) arg;
+   int row_bytes = job->n * job->z->s->img_x;
+   int k;
+   for (k=0; k < job->decode_n; ++k)
+      stbi__jpeg_resample_skip(job->z, &job->res_comp[k], k, job->first);
+   // the band's last row goes through a scratch row, so the byte written
+   // past its end can't land in another thread's band
+   stbi__jpeg_convert_rows(job->z, job->output + (size_t) row_bytes * job->first, job->n, job->decode_n, job->is_rgb, job->res_comp, job->linebuf, job->first, job->last-1);
+   stbi__jpeg_convert_rows(job->z, job->last_row, job->n, job->decode_n, job->is_rgb, job->res_comp, job->linebuf, job->last-1, job->last);
+   memcpy(job->output + (size_t) row_bytes * (job->last-1), job->last_row, row_bytes);
+   job->ok = 1;
+   return NULL;
+}
+
+// returns 0 if the image should be converted on this thread instead
+static int stbi__jpeg_convert_threaded(stbi__jpeg *z, stbi_uc *output, int n, int decode_n, int is_rgb, stbi__resample *res_comp)
+{
+   stbi__jpeg_convert_job job[STBI__JPEG_MAX_THREADS];
+   int threads = stbi__jpeg_thread_count(z);
+   int t,k,ok;
+   if (threads < 2) return 0;
+   // every band needs at least one row
+   if ((stbi__uint32) threads > z->s->img_y) threads = (int) z->s->img_y;
+   ok = 1;
+   for (t=0; t < threads; ++t) {
+      job[t].z = z;
+      job[t].output = output;
+      job[t].n = n;
+      job[t].decode_n = decode_n;
+      job[t].is_rgb = is_rgb;
+      for (k=0; k < decode_n; ++k)
+         job[t].res_comp[k] = res_comp[k];
+      // img_y is at most 1<<24, so this can't overflow
+      job[t].first = z->s->img_y * t / threads;
+      job[t].last = z->s->img_y * (t+1) / threads;
+      job[t].ok = 0;
+      job[t].last_row = (stbi_uc *) stbi__malloc(n * z->s->img_x + 1);
+      if (!job[t].last_row) ok = 0;
+      for (k=0; k < 4; ++k) {
+         job[t].linebuf[k] = k < decode_n ? (stbi_uc *) stbi__malloc(z->s->img_x + 3) : NULL;
+         if (k < decode_n && !job[t].linebuf[k]) ok = 0;
+      }
+   }
+   if (ok)
+      stbi__jpeg_run_threads(threads, stbi__jpeg_convert_worker, job, sizeof(job[0]));
+
+   for (t=0; t < threads; ++t) {
+      if (!job[t].ok) ok = 0;
+      if (job[t].last_row) STBI_FREE(job[t].last_row);
+      for (k=0; k < decode_n; ++k)
+         if (job[t].linebuf[k]) STBI_FREE(job[t].linebuf[k]);
+   }
+   // if the bands' buffers couldn't be allocated, the caller converts the
+   // whole image with the line buffers it already has
+   return ok;
+}
+#endif // STBI_JPEG_THREADS
+
+// output buffer and resampling state for the whole image, set up once the
+// frame header is known. when streaming that's at the first decoded rows
+struct stbi__jpeg_convert
+{
+   int req_comp, n, decode_n, is_rgb;
+   stbi_uc *output;
+   stbi__resample res_comp[4];
+   stbi__resample res_start[4];
+   unsigned int rows; // output rows converted so far
+   int failed;
+};
+
+static int stbi__jpeg_setup_convert(stbi__jpeg *z, stbi__jpeg_convert *c)
+{
+   int k;
+
+   // determine actual number of components to generate
+   c->n = c->req_comp ? c->req_comp : z->s->img_n >= 3 ? 3 : 1;
+
+   c->is_rgb = z->s->img_n == 3 && (z->rgb == 3 || (z->app14_color_transform == 0 && !z->jfif));
+
+   if (z->s->img_n == 3 && c->n < 3 && !c->is_rgb)
+      c->decode_n = 1;
+   else
+      c->decode_n = z->s->img_n;
+
+   for (k=0; k < c->decode_n; ++k) {
+      stbi__resample *r = &c->res_comp[k];
+
+      // allocate line buffer big enough for upsampling off the edges
+      // with upsample factor of 4
+      if (!z->img_comp[k].linebuf)
+         z->img_comp[k].linebuf = (stbi_uc *) stbi__malloc(z->s->img_x + 3);
+      if (!z->img_comp[k].linebuf) return stbi__err("outofmem", "Out of memory");
+
+      r->hs      = z->img_h_max / z->img_comp[k].h;
+      r->vs      = z->img_v_max / z->img_comp[k].v;
+      r->ystep   = r->vs >> 1;
+      r->w_lores = (z->s->img_x + r->hs-1) / r->hs;
+      r->ypos    = 0;
+      r->line0   = r->line1 = z->img_comp[k].data;
+
+      if      (r->hs == 1 && r->vs == 1) r->resample = resample_row_1;
+      else if (r->hs == 1 && r->vs == 2) r->resample = stbi__resample_row_v_2;
+      else if (r->hs == 2 && r->vs == 1) r->resample = stbi__resample_row_h_2;
+      else if (r->hs == 2 && r->vs == 2) r->resample = z->resample_row_hv_2_kernel;
+      else                               r->resample = stbi__resample_row_generic;
+      c->res_start[k] = *r;
+   }
+
+   c->output = (stbi_uc *) stbi__malloc_mad3(c->n, z->s->img_x, z->s->img_y, 1);
+   if (!c->output) return stbi__err("outofmem", "Out of memory");
+   return 1;
+}
+
+static void stbi__jpeg_emit_rows(stbi__jpeg *z, stbi__jpeg_convert *c, unsigned int first, unsigned int last, int is_preview)
+{
+   if (stbi__rows_callback && last > first)
+      stbi__rows_callback(stbi__rows_user, c->output + (size_t) c->n * z->s->img_x * first, (int) first, (int) (last - first),
+                          (int) z->s->img_x, (int) z->s->img_y, c->n, is_preview);
+}
+
+// convert the rows from where the last call stopped up to last and hand them out
+static void stbi__jpeg_convert_to(stbi__jpeg *z, stbi__jpeg_convert *c, unsigned int last)
+{
+   stbi_uc *linebuf[4];
+   int k;
+   if (last <= c->rows) return;
+   for (k=0; k < c->decode_n; ++k)
+      linebuf[k] = z->img_comp[k].linebuf;
+   stbi__jpeg_convert_rows(z, c->output + (size_t) c->n * z->s->img_x * c->rows, c->n, c->decode_n, c->is_rgb, c->res_comp, linebuf, c->rows, last);
+   stbi__jpeg_emit_rows(z, c, c->rows, last, 0);
+   c->rows = last;
+}
+
+// the component planes are complete down to the given output row. the
+// upsamplers read a line past the one they're on, so stop short of it
+static void stbi__jpeg_rows_decoded(stbi__jpeg *z, int rows)
+{
+   stbi__jpeg_convert *c = z->stream;
+   int last = rows - z->img_v_max;
+   if (c->failed) return;
+   if (!c->output && !stbi__jpeg_setup_convert(z, c)) {
+      c->failed = 1;
+      return;
+   }
+   if (last > (int) z->s->img_y) last = (int) z->s->img_y;
+   if (last > 0) stbi__jpeg_convert_to(z, c, (unsigned int) last);
+}
+
+// progressive scans refine the whole image at a time, so after each one run a
+// copy of the coefficients through the idct and hand out the image so far
+static void stbi__jpeg_preview(stbi__jpeg *z)
+{
+   stbi__jpeg_convert *c = z->stream;
+   stbi__resample res_comp[4];
+   stbi_uc *linebuf[4];
+   int i,j,k;
+   if (c->failed) return;
+   if (!c->output && !stbi__jpeg_setup_convert(z, c)) {
+      c->failed = 1;
+      return;
+   }
+   for (k=0; k < c->decode_n; ++k) {
+      int w = (z->img_comp[k].x+7) >> 3;
+      int h = (z->img_comp[k].y+7) >> 3;
+      for (j=0; j < h; ++j) {
+         for (i=0; i < w; ++i) {
+            STBI_SIMD_ALIGN(short, data[64]);
+            memcpy(data, z->img_comp[k].coeff + 64 * (i + j * z->img_comp[k].coeff_w), sizeof(data));
+            stbi__jpeg_dequantize(data, z->dequant[z->img_comp[k].tq]);
+            z->idct_block_kernel(z->img_comp[k].data+z->img_comp[k].w2*j*8+i*8, z->img_comp[k].w2, data);
+         }
+      }
+      res_comp[k] = c->res_start[k];
+      linebuf[k] = z->img_comp[k].linebuf;
+   }
+   stbi__jpeg_convert_rows(z, c->output, c->n, c->decode_n, c->is_rgb, res_comp, linebuf, 0, z->s->img_y);
+   stbi__jpeg_emit_rows(z, c, 0, z->s->img_y, 1);
+}
+
+static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp, int req_comp)
+{
+   stbi__jpeg_convert c;
+   z->s->img_n = 0; // make stbi__cleanup_jpeg safe
+
+   // validate req_comp
+   if (req_comp < 0 || req_comp > 4) return stbi__errpuc("bad req_comp", "Internal error");
+
+   memset(&c, 0, sizeof(c));
+   c.req_comp = req_comp;
+   z->stream = stbi__rows_callback ? &c : NULL;
+
+   // load a jpeg image from whichever source, but leave in YCbCr format. when
+   // streaming, rows are converted as they come in
+   if (!stbi__decode_jpeg_image(z)) {
+      stbi__cleanup_jpeg(z);
+      if (c.output) STBI_FREE(c.output);
+      return NULL;
+   }
+
+   // resample and color-convert whatever is left
+   if (!c.output && !stbi__jpeg_setup_convert(z, &c)) {
       stbi__cleanup_jpeg(z);
-      *out_x = z->s->img_x;
-      *out_y = z->s->img_y;
-      if (comp) *comp = z->s->img_n >= 3 ? 3 : 1; // report original components, not output
-      return output;
+      if (c.output) STBI_FREE(c.output);
+      return NULL;
    }
+
+#ifdef STBI_JPEG_THREADS
+   if (c.rows == 0 && stbi__jpeg_convert_threaded(z, c.output, c.n, c.decode_n, c.is_rgb, c.res_comp)) {
+      stbi__jpeg_emit_rows(z, &c, 0, z->s->img_y, 0);
+      c.rows = z->s->img_y;
+   }
+#endif
+   stbi__jpeg_convert_to(z, &c, z->s->img_y);
+
+   stbi__cleanup_jpeg(z);
+   z->stream = NULL;
+   *out_x = z->s->img_x;
+   *out_y = z->s->img_y;
+   if (comp) *comp = z->s->img_n >= 3 ? 3 : 1; // report original components, not output
+   return c.output;
 }
 
+#ifdef STBI_JPEG_THREADS
+// read the rest of a callback stream into memory, the threaded decoder has to
+// be able to look ahead through the whole scan
+static stbi_uc *stbi__jpeg_read_all(stbi__context *s, int *len)
+{
+   int size = (int) (s->img_buffer_end - s->img_buffer);
+   int cap = size + 65536, n;
+   stbi_uc *data = (stbi_uc *) stbi__malloc(cap);
+   if (!data) return NULL;
+   memcpy(data, s->img_buffer, size);
+   s->img_buffer = s->img_buffer_end;
+   for (;;) {
+      if (size == cap) {
+         stbi_uc *grown;
+         if (cap > INT_MAX / 2) { STBI_FREE(data); return NULL; }
+         grown = (stbi_uc *) STBI_REALLOC_SIZED(data, cap, cap*2);
+         if (!grown) { STBI_FREE(data); return NULL; }
+         data = grown;
+         cap *= 2;
+      }
+      n = (s->io.read)(s->io_user_data, (char *) data + size, cap - size);
+      if (n <= 0) break;
+      size += n;
+   }
+   *len = size;
+   return data;
+}
+#endif
+
 static void *stbi__jpeg_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri)
 {
    unsigned char* result;
@@ -3927,6 +4996,24 @@ static void *stbi__jpeg_load(stbi__context *s, int *x, int *y, int *comp, int re
    STBI_NOTUSED(ri);
    j->s = s;
    stbi__setup_jpeg(j);
+#ifdef STBI_JPEG_THREADS
+   // streaming wants the callbacks read as the decoder goes
+   if (stbi__jpeg_threads > 1 && s->read_from_callbacks && !stbi__rows_callback) {
+      stbi__context mem;
+      int len;
+      stbi_uc *data = stbi__jpeg_read_all(s, &len);
+      if (!data) { STBI_FREE(j); return stbi__errpuc("outofmem", "Out of memory"); }
+      stbi__start_mem(&mem, data, len);
+      j->s = &mem;
+      result = load_jpeg_image(j, x,y,comp,req_comp);
+      s->img_x = mem.img_x;
+      s->img_y = mem.img_y;
+      s->img_n = mem.img_n;
+      STBI_FREE(data);
+      STBI_FREE(j);
+      return result;
+   }
+#endif
    result = load_jpeg_image(j, x,y,comp,req_comp);
    STBI_FREE(j);
    return result;
@@ -3965,6 +5052,123 @@ static int stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp)
    STBI_FREE(j);
    return result;
 }
+
+// copy the decoded components out before they're upsampled, see stbi_jpeg_planes
+static int stbi__jpeg_planes_image(stbi__jpeg *z, stbi_jpeg_planes *p)
+{
+   size_t total = 0, offset = 0;
+   stbi_uc *out;
+   int k, j, is_rgb;
+   z->s->img_n = 0; // make stbi__cleanup_jpeg safe
+   z->stream = NULL;
+
+   if (!stbi__decode_jpeg_image(z)) {
+      stbi__cleanup_jpeg(z);
+      return 0;
+   }
+
+   is_rgb = z->s->img_n == 3 && (z->rgb == 3 || (z->app14_color_transform == 0 && !z->jfif));
+   if ((z->s->img_n != 1 && z->s->img_n != 3) || is_rgb) {
+      stbi__cleanup_jpeg(z);
+      return stbi__err("not YCbCr", "JPEG isn't greyscale or YCbCr");
+   }
+
+   p->width = z->s->img_x;
+   p->height = z->s->img_y;
+   p->plane_count = z->s->img_n;
+   for (k=0; k < p->plane_count; ++k) {
+      p->plane_w[k] = z->img_comp[k].x;
+      p->plane_h[k] = z->img_comp[k].y;
+      p->plane_hs[k] = z->img_h_max / z->img_comp[k].h;
+      p->plane_vs[k] = z->img_v_max / z->img_comp[k].v;
+      total += (size_t) p->plane_w[k] * p->plane_h[k];
+   }
+
+   out = (stbi_uc *) stbi__malloc(total);
+   if (!out) {
+      stbi__cleanup_jpeg(z);
+      return stbi__err("outofmem", "Out of memory");
+   }
+
+   // the decoded components are padded out to whole MCUs
+   for (k=0; k < p->plane_count; ++k) {
+      p->plane[k] = out + offset;
+      for (j=0; j < p->plane_h[k]; ++j)
+         memcpy(p->plane[k] + (size_t) p->plane_w[k] * j, z->img_comp[k].data + (size_t) z->img_comp[k].w2 * j, p->plane_w[k]);
+      offset += (size_t) p->plane_w[k] * p->plane_h[k];
+   }
+
+   stbi__cleanup_jpeg(z);
+   return 1;
+}
+
+static int stbi__jpeg_load_planes(stbi__context *s, stbi_jpeg_planes *p)
+{
+   int result;
+   stbi__jpeg* j;
+   memset(p, 0, sizeof(*p));
+   if (!stbi__jpeg_test(s)) return stbi__err("not JPEG", "Image is not a JPEG");
+
+   j = (stbi__jpeg*) stbi__malloc(sizeof(stbi__jpeg));
+   if (!j) return stbi__err("outofmem", "Out of memory");
+   j->s = s;
+   stbi__setup_jpeg(j);
+#ifdef STBI_JPEG_THREADS
+   // like stbi__jpeg_load, the threaded decoder needs the whole file
+   if (stbi__jpeg_threads > 1 && s->read_from_callbacks) {
+      stbi__context mem;
+      int len;
+      stbi_uc *data = stbi__jpeg_read_all(s, &len);
+      if (!data) { STBI_FREE(j); return stbi__err("outofmem", "Out of memory"); }
+      stbi__start_mem(&mem, data, len);
+      j->s = &mem;
+      result = stbi__jpeg_planes_image(j, p);
+      STBI_FREE(data);
+      STBI_FREE(j);
+      return result;
+   }
+#endif
+   result = stbi__jpeg_planes_image(j, p);
+   STBI_FREE(j);
+   return result;
+}
+
+STBIDEF int stbi_load_jpeg_planes_from_memory(stbi_uc const *buffer, int len, stbi_jpeg_planes *planes)
+{
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   return stbi__jpeg_load_planes(&s, planes);
+}
+
+STBIDEF int stbi_load_jpeg_planes_from_callbacks(stbi_io_callbacks const *clbk, void *user, stbi_jpeg_planes *planes)
+{
+   stbi__context s;
+   stbi__start_callbacks(&s, (stbi_io_callbacks *) clbk, user);
+   return stbi__jpeg_load_planes(&s, planes);
+}
+
+#ifndef STBI_NO_STDIO
+STBIDEF int stbi_load_jpeg_planes(char const *filename, stbi_jpeg_planes *planes)
+{
+   FILE *f = stbi__fopen(filename, "rb");
+   stbi__context s;
+   int result;
+   if (!f) {
+      memset(planes, 0, sizeof(*planes));
+      return stbi__err("can't fopen", "Unable to open file");
+   }
+   stbi__start_file(&s,f);
+   result = stbi__jpeg_load_planes(&s, planes);
+   fclose(f);
+   return result;
+}
+#endif
+
+STBIDEF void stbi_jpeg_planes_free(stbi_jpeg_planes *planes)
+{
+   STBI_FREE(planes->plane[0]);
+   memset(planes, 0, sizeof(*planes));
+}
 #endif
 
 // public domain zlib decode    v0.2  Sean Barrett 2006-11-18
@@ -3973,12 +5177,21 @@ static int stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp)
 //      - all output is written to a single output buffer (can malloc/realloc)
 //    performance
 //      - fast huffman
+//      - literals decoded two at a time, 64-bit refills and word sized match copies
 
 #ifndef STBI_NO_ZLIB
 
 // fast-way is faster to check than jpeg huffman, but slow way is slower
 #define STBI__ZFAST_BITS  9 // accelerate all cases in default tables
 #define STBI__ZFAST_MASK  ((1 << STBI__ZFAST_BITS) - 1)
+// literal/length codes are also looked up this many bits at a time, which
+// resolves two literals at once when their codes are short enough
+#define STBI__ZPAIR_BITS  11
+#define STBI__ZPAIR_MASK  ((1 << STBI__ZPAIR_BITS) - 1)
+// the fast inflate loop refills a word at a time and copies matches a word at
+// a time, so it needs this much input left and room for the longest match
+#define STBI__ZFAST_INPUT_SLACK   8
+#define STBI__ZFAST_OUTPUT_SLACK  (258 + 8)
 
 // zlib-style huffman encoding
 // (jpegs packs from left, zlib from right, so can't share code)
@@ -4074,6 +5287,9 @@ typedef struct
    int   z_expandable;
 
    stbi__zhuffman z_length, z_distance;
+   // z_length looked up STBI__ZPAIR_BITS at a time; symbol in the low 9 bits,
+   // second literal in the next 8, code length at 24 and symbol count at 28
+   stbi__uint32 z_pairs[1 << STBI__ZPAIR_BITS];
 } stbi__zbuf;
 
 stbi_inline static int stbi__zeof(stbi__zbuf *z)
@@ -4146,6 +5362,48 @@ stbi_inline static int stbi__zhuffman_decode(stbi__zbuf *a, stbi__zhuffman *z)
    return stbi__zhuffman_decode_slowpath(a, z);
 }
 
+// decode the code at the bottom of bits if it's at most maxlen bits long;
+// returns -1 for longer or invalid codes
+static int stbi__zhuffman_lookup(const stbi__zhuffman *z, stbi__uint32 bits, int maxlen, int *len)
+{
+   int b,s,k;
+   b = z->fast[bits & STBI__ZFAST_MASK];
+   if (b) {
+      s = b >> 9;
+      if (s > maxlen) return -1;
+      *len = s;
+      return b & 511;
+   }
+   k = stbi__bit_reverse(bits & 0xffff, 16);
+   for (s=STBI__ZFAST_BITS+1; s <= maxlen && s < 16; ++s) {
+      if (k < z->maxcode[s]) {
+         b = (k >> (16-s)) - z->firstcode[s] + z->firstsymbol[s];
+         if (b >= (int) sizeof (z->size) || z->size[b] != s) return -1;
+         *len = s;
+         return z->value[b];
+      }
+   }
+   return -1;
+}
+
+static void stbi__zbuild_pairs(stbi__zbuf *a)
+{
+   int i, s1, s2, z1, z2;
+   for (i=0; i < (1 << STBI__ZPAIR_BITS); ++i) {
+      stbi__uint32 e = 0;
+      z1 = stbi__zhuffman_lookup(&a->z_length, (stbi__uint32) i, STBI__ZPAIR_BITS, &s1);
+      if (z1 >= 0) {
+         e = (stbi__uint32) z1 | ((stbi__uint32) s1 << 24) | (1u << 28);
+         if (z1 < 256 && s1 < STBI__ZPAIR_BITS) {
+            z2 = stbi__zhuffman_lookup(&a->z_length, (stbi__uint32) (i >> s1), STBI__ZPAIR_BITS - s1, &s2);
+            if (z2 >= 0 && z2 < 256)
+               e = (stbi__uint32) z1 | ((stbi__uint32) z2 << 9) | ((stbi__uint32) (s1 + s2) << 24) | (2u << 28);
+         }
+      }
+      a->z_pairs[i] = e;
+   }
+}
+
 static int stbi__zexpand(stbi__zbuf *z, char *zout, int n)  // need to make room for n bytes
 {
    char *q;
@@ -4182,11 +5440,130 @@ static const int stbi__zdist_base[32] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129
 static const int stbi__zdist_extra[32] =
 { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13};
 
+stbi_inline static stbi__uint64 stbi__zget64le(const stbi_uc *p)
+{
+   return  (stbi__uint64) p[0]        | ((stbi__uint64) p[1] <<  8) | ((stbi__uint64) p[2] << 16) | ((stbi__uint64) p[3] << 24)
+        | ((stbi__uint64) p[4] << 32) | ((stbi__uint64) p[5] << 40) | ((stbi__uint64) p[6] << 48) | ((stbi__uint64) p[7] << 56);
+}
+
+// the bulk of a block: refills 64 bits at a time, takes literals two at a
+// time from z_pairs and copies matches a word at a time, which may write up
+// to 7 bytes past the match. returns 1 at the end of the block, 0 on error,
+// and 2 once it gets within the slack of either buffer's end
+static int stbi__parse_huffman_fast(stbi__zbuf *a)
+{
+   const stbi_uc *in = a->zbuffer;
+   const stbi_uc *in_end = a->zbuffer_end - STBI__ZFAST_INPUT_SLACK;
+   char *zout = a->zout;
+   char *zout_end = a->zout_end - STBI__ZFAST_OUTPUT_SLACK;
+   stbi__uint64 bits = a->code_buffer;
+   int n = a->num_bits, result = 2;
+
+   while (in <= in_end && zout <= zout_end) {
+      stbi__uint32 e;
+      int z,s,len,dist,k;
+      char *p;
+
+      // at least 56 bits, enough for a whole length/distance pair. bits past
+      // n are the stream's next bits too, so or-ing them in again is harmless
+      bits |= stbi__zget64le(in) << n;
+      in += (63 - n) >> 3;
+      n |= 56;
+
+      e = a->z_pairs[bits & STBI__ZPAIR_MASK];
+      s = (e >> 24) & 15;
+      if ((e >> 28) == 2) {
+         zout[0] = (char) (e & 255);
+         zout[1] = (char) ((e >> 9) & 255);
+         zout += 2;
+         bits >>= s;
+         n -= s;
+         continue;
+      }
+      if (e) {
+         z = e & 511;
+      } else {
+         z = stbi__zhuffman_lookup(&a->z_length, (stbi__uint32) bits, 15, &s);
+         if (z < 0) { result = stbi__err("bad huffman code","Corrupt PNG"); break; }
+      }
+      bits >>= s;
+      n -= s;
+      if (z < 256) {
+         *zout++ = (char) z;
+         continue;
+      }
+      if (z == 256) {
+         result = 1;
+         break;
+      }
+
+      z -= 257;
+      len = stbi__zlength_base[z];
+      if (stbi__zlength_extra[z]) {
+         len += (int) (bits & ((1u << stbi__zlength_extra[z]) - 1));
+         bits >>= stbi__zlength_extra[z];
+         n -= stbi__zlength_extra[z];
+      }
+      z = a->z_distance.fast[bits & STBI__ZFAST_MASK];
+      if (z) {
+         s = z >> 9;
+         z &= 511;
+      } else {
+         z = stbi__zhuffman_lookup(&a->z_distance, (stbi__uint32) bits, 15, &s);
+         if (z < 0) { result = stbi__err("bad huffman code","Corrupt PNG"); break; }
+      }
+      bits >>= s;
+      n -= s;
+      dist = stbi__zdist_base[z];
+      if (stbi__zdist_extra[z]) {
+         dist += (int) (bits & ((1u << stbi__zdist_extra[z]) - 1));
+         bits >>= stbi__zdist_extra[z];
+         n -= stbi__zdist_extra[z];
+      }
+      if (zout - a->zout_start < dist || dist == 0) { result = stbi__err("bad dist","Corrupt PNG"); break; }
+
+      p = zout - dist;
+      if (dist == 1) { // run of one byte; common in images.
+         memset(zout, *p, len);
+      } else {
+         // short periods are written out once a byte at a time, after which
+         // whole words can come from a multiple of the period back
+         int period = dist;
+         k = 0;
+         if (dist < 8) {
+            period = dist * ((8 + dist - 1) / dist);
+            for (; k < period && k < len; ++k)
+               zout[k] = p[k];
+         }
+         for (; k < len; k += 8)
+            memcpy(zout + k, zout + k - period, 8);
+      }
+      zout += len;
+   }
+
+   // hand back whole bytes that were read ahead, the slow path keeps the rest
+   in -= n >> 3;
+   n &= 7;
+   a->zbuffer = (stbi_uc *) in;
+   a->code_buffer = (stbi__uint32) (bits & ((1u << n) - 1));
+   a->num_bits = n;
+   a->zout = zout;
+   return result;
+}
+
 static int stbi__parse_huffman_block(stbi__zbuf *a)
 {
    char *zout = a->zout;
+   stbi__zbuild_pairs(a);
    for(;;) {
-      int z = stbi__zhuffman_decode(a, &a->z_length);
+      int z;
+      if (a->zbuffer_end - a->zbuffer >= STBI__ZFAST_INPUT_SLACK && a->zout_end - zout >= STBI__ZFAST_OUTPUT_SLACK) {
+         a->zout = zout;
+         z = stbi__parse_huffman_fast(a);
+         if (z != 2) return z;
+         zout = a->zout;
+      }
+      z = stbi__zhuffman_decode(a, &a->z_length);
       if (z < 256) {
          if (z < 0) return stbi__err("bad huffman code","Corrupt PNG"); // error in huffman codes
          if (zout >= a->zout_end) {
@@ -4208,7 +5585,7 @@ static int stbi__parse_huffman_block(stbi__zbuf *a)
          if (z < 0) return stbi__err("bad huffman code","Corrupt PNG");
          dist = stbi__zdist_base[z];
          if (stbi__zdist_extra[z]) dist += stbi__zreceive(a, stbi__zdist_extra[z]);
-         if (zout - a->zout_start < dist) return stbi__err("bad dist","Corrupt PNG");
+         if (zout - a->zout_start < dist || dist == 0) return stbi__err("bad dist","Corrupt PNG");
          if (zout + len > a->zout_end) {
             if (!stbi__zexpand(a, zout, len)) return 0;
             zout = a->zout;
@@ -4533,10 +5910,109 @@ static int stbi__paeth(int a, int b, int c)
    return c;
 }
 
+#ifdef STBI_SSE2
+// the sub, avg and paeth filters depend on the pixel to the left, so these
+// go a pixel at a time but do all its channels at once
+stbi_inline static __m128i stbi__png_load_pixel(const stbi_uc *p, int n)
+{
+   stbi__uint32 v;
+   if (n == 4) memcpy(&v, p, 4);
+   else        v = p[0] | (p[1] << 8) | ((stbi__uint32) p[2] << 16);
+   return _mm_cvtsi32_si128((int) v);
+}
+
+stbi_inline static void stbi__png_store_pixel(stbi_uc *p, __m128i v, int n)
+{
+   stbi__uint32 x = (stbi__uint32) _mm_cvtsi128_si32(v);
+   if (n == 4) {
+      memcpy(p, &x, 4);
+   } else {
+      p[0] = (stbi_uc) x;
+      p[1] = (stbi_uc) (x >> 8);
+      p[2] = (stbi_uc) (x >> 16);
+   }
+}
+
+// unfilter the pixels after the first of an 8-bit row with 3 or 4 channels.
+// img_n is the channels in raw, out_n in cur and prior; when out_n is one
+// more, the extra channel is alpha and comes out as 255
+static void stbi__png_unfilter_row_simd(int filter, stbi_uc *cur, const stbi_uc *prior, const stbi_uc *raw, int pixels, int img_n, int out_n)
+{
+   __m128i zero = _mm_setzero_si128();
+   __m128i alpha = _mm_cvtsi32_si128(img_n != out_n ? (int) 0xff000000 : 0);
+   __m128i a = stbi__png_load_pixel(cur - out_n, out_n);
+   int i, w;
+
+   // 3 byte pixels are moved as 4 bytes except at the end of the row; the
+   // spare byte read is still in the buffer and the one written gets
+   // overwritten by the next pixel. the first row only has sub, avg and paeth
+   // are swapped for their _first versions, so prior is always a real row
+   if (filter == STBI__F_sub) {
+      for (i=0; i < pixels; ++i, cur += out_n, raw += img_n) {
+         w = i + 1 < pixels ? 4 : img_n;
+         a = _mm_or_si128(_mm_add_epi8(stbi__png_load_pixel(raw, w), a), alpha);
+         stbi__png_store_pixel(cur, a, i + 1 < pixels ? 4 : out_n);
+      }
+   } else if (filter == STBI__F_avg) {
+      __m128i one = _mm_set1_epi8(1);
+      for (i=0; i < pixels; ++i, cur += out_n, prior += out_n, raw += img_n) {
+         __m128i b, avg;
+         w = i + 1 < pixels ? 4 : img_n;
+         b = stbi__png_load_pixel(prior, i + 1 < pixels ? 4 : out_n);
+         // pavgb rounds up, take the carry back off to get (a+b)>>1
+         avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+         a = _mm_or_si128(_mm_add_epi8(stbi__png_load_pixel(raw, w), avg), alpha);
+         stbi__png_store_pixel(cur, a, i + 1 < pixels ? 4 : out_n);
+      }
+   } else {
+      __m128i c16 = _mm_unpacklo_epi8(stbi__png_load_pixel(prior - out_n, out_n), zero);
+      for (i=0; i < pixels; ++i, cur += out_n, prior += out_n, raw += img_n) {
+         __m128i a16, b16, pa, pb, pc, smallest, use_a, use_b, pred;
+         w = i + 1 < pixels ? 4 : img_n;
+         a16 = _mm_unpacklo_epi8(a, zero);
+         b16 = _mm_unpacklo_epi8(stbi__png_load_pixel(prior, i + 1 < pixels ? 4 : out_n), zero);
+         // p = a+b-c, so |p-a| = |b-c|, |p-b| = |a-c| and |p-c| = |b-c + a-c|
+         pa = _mm_sub_epi16(b16, c16);
+         pb = _mm_sub_epi16(a16, c16);
+         pc = _mm_add_epi16(pa, pb);
+         pa = _mm_max_epi16(pa, _mm_sub_epi16(zero, pa));
+         pb = _mm_max_epi16(pb, _mm_sub_epi16(zero, pb));
+         pc = _mm_max_epi16(pc, _mm_sub_epi16(zero, pc));
+         smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+         // ties go to a, then b, like stbi__paeth
+         use_a = _mm_cmpeq_epi16(pa, smallest);
+         use_b = _mm_andnot_si128(use_a, _mm_cmpeq_epi16(pb, smallest));
+         pred = _mm_or_si128(_mm_and_si128(use_a, a16), _mm_andnot_si128(use_a, c16));
+         pred = _mm_or_si128(_mm_and_si128(use_b, b16), _mm_andnot_si128(use_b, pred));
+         a = _mm_or_si128(_mm_add_epi8(stbi__png_load_pixel(raw, w), _mm_packus_epi16(pred, pred)), alpha);
+         stbi__png_store_pixel(cur, a, i + 1 < pixels ? 4 : out_n);
+         c16 = b16;
+      }
+   }
+}
+
+// up has no dependency along the row, so do 16 bytes at a time
+static void stbi__png_unfilter_up_simd(stbi_uc *cur, const stbi_uc *prior, const stbi_uc *raw, int n)
+{
+   int k = 0;
+   for (; k + 16 <= n; k += 16) {
+      __m128i x = _mm_loadu_si128((const __m128i *) (raw + k));
+      __m128i b = _mm_loadu_si128((const __m128i *) (prior + k));
+      _mm_storeu_si128((__m128i *) (cur + k), _mm_add_epi8(x, b));
+   }
+   for (; k < n; ++k)
+      cur[k] = STBI__BYTECAST(raw[k] + prior[k]);
+}
+#endif
+
 static const stbi_uc stbi__depth_scale_table[9] = { 0, 0xff, 0x55, 0, 0x11, 0,0,0, 0x01 };
 
-// create the png data from post-deflated data
-static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color)
+// rows handed to the rows callback at a time
+#define STBI__PNG_STREAM_ROWS 16
+
+// create the png data from post-deflated data. with stream set, finished
+// rows go to the rows callback as they're unfiltered
+static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color, int stream)
 {
    int bytes = (depth == 16? 2 : 1);
    stbi__context *s = a->s;
@@ -4567,6 +6043,9 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
       stbi_uc *prior;
       int filter = *raw++;
 
+      if (stream && j % STBI__PNG_STREAM_ROWS == 0 && j > 0)
+         stbi__rows_callback(stbi__rows_user, cur - stride*STBI__PNG_STREAM_ROWS, (int) (j - STBI__PNG_STREAM_ROWS), STBI__PNG_STREAM_ROWS, (int) x, (int) y, out_n, 0);
+
       if (filter > 4)
          return stbi__err("invalid filter","Corrupt PNG");
 
@@ -4614,6 +6093,20 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
          prior += 1;
       }
 
+#ifdef STBI_SSE2
+      if (depth == 8 && img_n >= 3 && (filter == STBI__F_sub || filter == STBI__F_avg || filter == STBI__F_paeth)) {
+         stbi__png_unfilter_row_simd(filter, cur, prior, raw, x - 1, img_n, out_n);
+         raw += (x - 1) * img_n;
+         continue;
+      }
+      if (filter == STBI__F_up && (depth < 8 || img_n == out_n)) {
+         int nk = (width - 1)*filter_bytes;
+         stbi__png_unfilter_up_simd(cur, prior, raw, nk);
+         raw += nk;
+         continue;
+      }
+#endif
+
       // this is a little gross, so that we don't switch per-pixel or per-component
       if (depth < 8 || img_n == out_n) {
          int nk = (width - 1)*filter_bytes;
@@ -4660,6 +6153,11 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
       }
    }
 
+   if (stream && y > 0) {
+      j = (y - 1) / STBI__PNG_STREAM_ROWS * STBI__PNG_STREAM_ROWS;
+      stbi__rows_callback(stbi__rows_user, a->out + stride*j, (int) j, (int) (y - j), (int) x, (int) y, out_n, 0);
+   }
+
    // we make a separate pass to expand bits to pixels; for performance,
    // this could run two scanlines behind the above code, so it won't
    // intefere with filtering but will still be in the cache.
@@ -4748,14 +6246,14 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
    return 1;
 }
 
-static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint32 image_data_len, int out_n, int depth, int color, int interlaced)
+static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint32 image_data_len, int out_n, int depth, int color, int interlaced, int stream)
 {
    int bytes = (depth == 16 ? 2 : 1);
    int out_bytes = out_n * bytes;
    stbi_uc *final;
    int p;
    if (!interlaced)
-      return stbi__create_png_image_raw(a, image_data, image_data_len, out_n, a->s->img_x, a->s->img_y, depth, color);
+      return stbi__create_png_image_raw(a, image_data, image_data_len, out_n, a->s->img_x, a->s->img_y, depth, color, stream);
 
    // de-interlacing
    final = (stbi_uc *) stbi__malloc_mad3(a->s->img_x, a->s->img_y, out_bytes, 0);
@@ -4770,7 +6268,7 @@ static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint3
       y = (a->s->img_y - yorig[p] + yspc[p]-1) / yspc[p];
       if (x && y) {
          stbi__uint32 img_len = ((((a->s->img_n * x * depth) + 7) >> 3) + 1) * y;
-         if (!stbi__create_png_image_raw(a, image_data, image_data_len, out_n, x, y, depth, color)) {
+         if (!stbi__create_png_image_raw(a, image_data, image_data_len, out_n, x, y, depth, color, 0)) {
             STBI_FREE(final);
             return 0;
          }
@@ -4943,7 +6441,7 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
    stbi_uc has_trans=0, tc[3]={0};
    stbi__uint16 tc16[3];
    stbi__uint32 ioff=0, idata_limit=0, i, pal_len=0;
-   int first=1,k,interlace=0, color=0, is_iphone=0;
+   int first=1,k,interlace=0, color=0, is_iphone=0, stream;
    stbi__context *s = z->s;
 
    z->expanded = NULL;
@@ -5064,7 +6562,10 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
                s->img_out_n = s->img_n+1;
             else
                s->img_out_n = s->img_n;
-            if (!stbi__create_png_image(z, z->expanded, raw_len, s->img_out_n, z->depth, color, interlace)) return 0;
+            // rows only go out as they're unfiltered if nothing below changes them
+            stream = stbi__rows_callback && z->depth == 8 && !interlace && !pal_img_n && !has_trans && !is_iphone
+                  && (req_comp == 0 || req_comp == s->img_out_n);
+            if (!stbi__create_png_image(z, z->expanded, raw_len, s->img_out_n, z->depth, color, interlace, stream)) return 0;
             if (has_trans) {
                if (z->depth == 16) {
                   if (!stbi__compute_transparency16(z, tc16, s->img_out_n)) return 0;
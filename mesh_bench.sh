@@ -0,0 +1,11 @@
+#!/bin/sh
+
+if gcc -O2 ./src/mesh_bench.c -Iinclude -o mesh_bench -lpthread -lm; then
+
+./mesh_bench "$@"
+
+else
+
+echo "Compilation Error :("
+
+fi
@@ -0,0 +1,357 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+
+// arena defaults
+#define ARENA_INITIAL_SIZE (16 << 20)
+#define ARENA_GRANULE (1 << 20) // arena blocks are a multiple of this
+#define ARENA_ALIGNMENT 16
+#define ARENA_HEADER_SIZE 16
+#define ARENA_NONE ((size_t) -1)
+
+// where arena blocks come from, and allocations made outside a scope or that
+// don't fit. a program that counts its heap use can point these at its own
+#ifndef ARENA_HEAP_MALLOC
+#define ARENA_HEAP_MALLOC(size) malloc(size)
+#define ARENA_HEAP_REALLOC(pointer, size) realloc(pointer, size)
+#define ARENA_HEAP_FREE(pointer) free(pointer)
+#endif
+
+// per-thread bump allocators for decode buffers, meant to sit behind
+// stb_image's STBI_MALLOC/STBI_REALLOC/STBI_FREE hooks:
+//
+//     begin_arena_scope();
+//     pixels = end_arena_scope(stbi_load(...));
+//
+// everything the decode allocates comes out of the thread's arena. at the end
+// of the scope its scratch is dropped and the result is slid down over it, so
+// results of a bulk load sit back to back. an arena goes back to empty once
+// everything in it has been freed, and grows to the most it has ever needed
+// then, so once a load has been seen nothing touches the heap. outside a
+// scope allocations go to the heap as usual, so long-lived images don't pin
+// an arena. results can be freed from any thread, but before the thread that
+// decoded them exits
+
+typedef struct Arena {
+    unsigned char *base;
+    size_t capacity;
+    size_t used;
+    // offset of the newest allocation, which can be freed or grown in place
+    size_t last;
+    // allocations not freed yet, other threads can free them too
+    atomic_long live;
+
+    int scope_depth;
+    size_t scope_start;
+    long scope_live;
+    // bytes of this scope that didn't fit and went to the heap
+    size_t overflow;
+    // the most this arena has needed, it grows past this when it next empties
+    size_t wanted;
+    size_t peak;
+} Arena;
+
+// in front of every allocation, heap ones included, so a free knows where it came from
+typedef struct ArenaHeader {
+    Arena *owner;
+    size_t size;
+} ArenaHeader;
+
+_Static_assert(sizeof(ArenaHeader) <= ARENA_HEADER_SIZE, "arena header doesn't fit");
+
+// for every thread together
+typedef struct ArenaCounters {
+    _Atomic uint64_t allocations;
+    _Atomic uint64_t arena_bytes;
+    _Atomic uint64_t grown_in_place;
+    _Atomic uint64_t copies;
+    _Atomic uint64_t compactions;
+    _Atomic uint64_t resets;
+    // heap traffic, which should stop once the arenas have grown
+    _Atomic uint64_t heap_allocations;
+    _Atomic uint64_t heap_bytes;
+    _Atomic uint64_t blocks;
+} ArenaCounters;
+
+_Thread_local Arena thread_arena;
+ArenaCounters arena_counters;
+
+void *arena_alloc(size_t size);
+void *arena_realloc(void *pointer, size_t size);
+void arena_free(void *pointer);
+void begin_arena_scope(void);
+void *end_arena_scope(void *keep);
+void release_thread_arena(void);
+void print_arena_stats(void);
+
+void count_arena(_Atomic uint64_t *counter, uint64_t amount)
+{
+    atomic_fetch_add_explicit(counter, amount, memory_order_relaxed);
+}
+
+size_t arena_round(size_t size, size_t granule)
+{
+    return (size + granule - 1) / granule * granule;
+}
+
+ArenaHeader *arena_header(void *pointer)
+{
+    return (ArenaHeader*)((unsigned char*)pointer - ARENA_HEADER_SIZE);
+}
+
+void *arena_heap_alloc(size_t size)
+{
+    ArenaHeader *header = (ArenaHeader*)ARENA_HEAP_MALLOC(ARENA_HEADER_SIZE + size);
+    if (header == NULL)
+        return NULL;
+
+    header->owner = NULL;
+    header->size = size;
+    count_arena(&arena_counters.heap_allocations, 1);
+    count_arena(&arena_counters.heap_bytes, size);
+    return (unsigned char*)header + ARENA_HEADER_SIZE;
+}
+
+// only called with nothing live. swaps the block for a bigger one if the
+// arena overflowed since it was last empty. what a decode needs depends on
+// how much of it fitted, so leave some headroom rather than growing a bit at
+// a time
+void reset_arena(Arena *arena)
+{
+    arena->used = 0;
+    arena->last = ARENA_NONE;
+    count_arena(&arena_counters.resets, 1);
+
+    if (arena->base != NULL && arena->wanted <= arena->capacity)
+        return;
+
+    size_t wanted = arena->base != NULL ? arena->wanted + arena->wanted / 2 : arena->wanted;
+    size_t capacity = arena_round(wanted > ARENA_INITIAL_SIZE ? wanted : ARENA_INITIAL_SIZE, ARENA_GRANULE);
+    unsigned char *base = (unsigned char*)ARENA_HEAP_MALLOC(capacity);
+    if (base == NULL)
+    {
+        // keep the old block, whatever doesn't fit keeps going to the heap
+        printf("Failed to grow arena to %zu bytes\n", capacity);
+        return;
+    }
+
+    ARENA_HEAP_FREE(arena->base);
+    arena->base = base;
+    arena->capacity = capacity;
+    count_arena(&arena_counters.blocks, 1);
+}
+
+void *arena_alloc_uncounted(Arena *arena, size_t size)
+{
+    if (arena->scope_depth == 0)
+        return arena_heap_alloc(size);
+
+    size_t total = ARENA_HEADER_SIZE + arena_round(size, ARENA_ALIGNMENT);
+    if (size > arena->capacity || total > arena->capacity - arena->used)
+    {
+        arena->overflow += total;
+        if (arena->used + arena->overflow > arena->wanted)
+            arena->wanted = arena->used + arena->overflow;
+        return arena_heap_alloc(size);
+    }
+
+    ArenaHeader *header = (ArenaHeader*)(arena->base + arena->used);
+    header->owner = arena;
+    header->size = size;
+    arena->last = arena->used;
+    arena->used += total;
+    atomic_fetch_add_explicit(&arena->live, 1, memory_order_relaxed);
+
+    if (arena->used > arena->peak)
+        arena->peak = arena->used;
+    if (arena->used + arena->overflow > arena->wanted)
+        arena->wanted = arena->used + arena->overflow;
+    count_arena(&arena_counters.arena_bytes, size);
+    return (unsigned char*)header + ARENA_HEADER_SIZE;
+}
+
+void *arena_alloc(size_t size)
+{
+    count_arena(&arena_counters.allocations, 1);
+    return arena_alloc_uncounted(&thread_arena, size);
+}
+
+// the newest allocation can give its space back, anything older waits for
+// the arena to empty
+void arena_free(void *pointer)
+{
+    if (pointer == NULL)
+        return;
+
+    ArenaHeader *header = arena_header(pointer);
+    Arena *arena = header->owner;
+    if (arena == NULL)
+    {
+        ARENA_HEAP_FREE(header);
+        return;
+    }
+
+    if (arena != &thread_arena)
+    {
+        // another thread's, it resets the next time that thread opens a scope
+        atomic_fetch_sub_explicit(&arena->live, 1, memory_order_relaxed);
+        return;
+    }
+
+    if ((unsigned char*)header - arena->base == (ptrdiff_t) arena->last)
+    {
+        arena->used = arena->last;
+        arena->last = ARENA_NONE;
+    }
+
+    if (atomic_fetch_sub_explicit(&arena->live, 1, memory_order_relaxed) == 1)
+    {
+        arena->used = 0;
+        arena->last = ARENA_NONE;
+        arena->scope_start = 0;
+        arena->scope_live = 0;
+    }
+}
+
+// stb_image grows its zlib output and PNG data this way, which stays in place
+// while it's the newest allocation
+void *arena_realloc(void *pointer, size_t size)
+{
+    if (pointer == NULL)
+        return arena_alloc(size);
+
+    Arena *arena = &thread_arena;
+    ArenaHeader *header = arena_header(pointer);
+    count_arena(&arena_counters.allocations, 1);
+
+    if (header->owner == NULL && arena->scope_depth == 0)
+    {
+        ArenaHeader *grown = (ArenaHeader*)ARENA_HEAP_REALLOC(header, ARENA_HEADER_SIZE + size);
+        if (grown == NULL)
+            return NULL;
+
+        grown->size = size;
+        count_arena(&arena_counters.heap_allocations, 1);
+        count_arena(&arena_counters.heap_bytes, size);
+        return (unsigned char*)grown + ARENA_HEADER_SIZE;
+    }
+
+    size_t offset = header->owner == arena ? (size_t) ((unsigned char*)header - arena->base) : ARENA_NONE;
+    if (offset != ARENA_NONE && arena->scope_depth > 0 && offset == arena->last)
+    {
+        size_t total = ARENA_HEADER_SIZE + arena_round(size, ARENA_ALIGNMENT);
+        if (size <= arena->capacity && total <= arena->capacity - offset)
+        {
+            if (size > header->size)
+                count_arena(&arena_counters.arena_bytes, size - header->size);
+            header->size = size;
+            arena->used = offset + total;
+            if (arena->used > arena->peak)
+                arena->peak = arena->used;
+            if (arena->used + arena->overflow > arena->wanted)
+                arena->wanted = arena->used + arena->overflow;
+            count_arena(&arena_counters.grown_in_place, 1);
+            return pointer;
+        }
+    }
+
+    void *moved = arena_alloc_uncounted(arena, size);
+    if (moved == NULL)
+        return NULL;
+
+    memcpy(moved, pointer, header->size < size ? header->size : size);
+    arena_free(pointer);
+    count_arena(&arena_counters.copies, 1);
+    return moved;
+}
+
+// scopes nest, only the outermost one does anything
+void begin_arena_scope(void)
+{
+    Arena *arena = &thread_arena;
+    if (arena->scope_depth++ > 0)
+        return;
+
+    if (atomic_load_explicit(&arena->live, memory_order_relaxed) == 0)
+        reset_arena(arena);
+
+    arena->scope_start = arena->used;
+    arena->scope_live = atomic_load_explicit(&arena->live, memory_order_relaxed);
+    arena->overflow = 0;
+}
+
+// keep is the scope's result, usually the decoded image. if nothing else
+// from the scope is still live, it's moved down to where the scope started
+// and the rest of the scope's space is reused. returns where keep is now
+void *end_arena_scope(void *keep)
+{
+    Arena *arena = &thread_arena;
+    if (arena->scope_depth == 0 || --arena->scope_depth > 0)
+        return keep;
+
+    ArenaHeader *header = keep != NULL ? arena_header(keep) : NULL;
+    bool kept_here = header != NULL && header->owner == arena
+        && (unsigned char*)header >= arena->base + arena->scope_start;
+
+    long live = atomic_load_explicit(&arena->live, memory_order_relaxed);
+    if (live != arena->scope_live + (kept_here ? 1 : 0))
+        return keep;
+
+    if (!kept_here)
+    {
+        arena->used = arena->scope_start;
+        arena->last = ARENA_NONE;
+        return keep;
+    }
+
+    size_t total = ARENA_HEADER_SIZE + arena_round(header->size, ARENA_ALIGNMENT);
+    unsigned char *start = arena->base + arena->scope_start;
+    if ((unsigned char*)header != start)
+    {
+        memmove(start, header, total);
+        count_arena(&arena_counters.compactions, 1);
+    }
+
+    arena->last = arena->scope_start;
+    arena->used = arena->scope_start + total;
+    return start + ARENA_HEADER_SIZE;
+}
+
+// for threads that exit, anything still live in the arena is leaked rather
+// than left pointing at freed memory
+void release_thread_arena(void)
+{
+    Arena *arena = &thread_arena;
+    long live = atomic_load_explicit(&arena->live, memory_order_relaxed);
+    if (live > 0)
+    {
+        printf("Arena released with %ld allocations live\n", live);
+        return;
+    }
+
+    ARENA_HEAP_FREE(arena->base);
+    arena->base = NULL;
+    arena->capacity = 0;
+    arena->used = 0;
+    arena->wanted = 0;
+}
+
+void print_arena_stats(void)
+{
+    ArenaCounters *c = &arena_counters;
+    printf("Arenas: %llu allocations (%.1f MB), %llu grown in place, %llu copied, %llu compacted, %llu resets\n",
+        (unsigned long long) c->allocations, c->arena_bytes / 1e6, (unsigned long long) c->grown_in_place,
+        (unsigned long long) c->copies, (unsigned long long) c->compactions, (unsigned long long) c->resets);
+    printf("Arena heap use: %llu allocations (%.1f MB), %llu blocks, this thread's peak %.1f MB\n",
+        (unsigned long long) c->heap_allocations, c->heap_bytes / 1e6, (unsigned long long) c->blocks,
+        thread_arena.peak / 1e6);
+}
+
+#endif
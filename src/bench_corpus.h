@@ -0,0 +1,805 @@
+#ifndef BENCH_CORPUS_H
+#define BENCH_CORPUS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+// encoders for the generated part of the decode benchmark's corpus. they only
+// need to write valid files with roughly the content and compression of real
+// ones, so there are no options: baseline 4:2:0 JPEG with the standard
+// Huffman tables, PNG with per-row filter choice and fixed-code deflate, and
+// run-length encoded Radiance HDR
+#define CORPUS_JPEG_QUALITY 90
+#define CORPUS_PNG_IDAT_SIZE (64 << 10)
+#define CORPUS_DEFLATE_WINDOW 32768
+#define CORPUS_DEFLATE_HASH_BITS 15
+
+// growable output for the encoders
+typedef struct CorpusBuffer {
+    unsigned char *data;
+    size_t size;
+    size_t capacity;
+    bool failed;
+    // bits not yet written, jpeg fills from the top and deflate from the bottom
+    unsigned int bits;
+    int bit_count;
+} CorpusBuffer;
+
+// the caller frees what these return with free
+unsigned char *generate_corpus_jpeg(int width, int height, int *size);
+unsigned char *generate_corpus_png(int width, int height, int channels, int depth, int *size);
+unsigned char *generate_corpus_hdr(int width, int height, int *size);
+
+// smooth gradients and rings with hard-edged tiles and a little noise, so
+// every format has both flat areas and detail to compress. values go above
+// one in the highlights for HDR
+void corpus_pixel(int x, int y, int width, int height, float *rgb)
+{
+    float fx = (float) x / width;
+    float fy = (float) y / height;
+    float rings = 0.5f + 0.5f * sinf((fx * fx + fy * fy) * 60.0f);
+    float tile = ((x >> 6) ^ (y >> 6)) & 1 ? 0.25f : 0.0f;
+
+    unsigned int hash = (unsigned int) x * 73856093u ^ (unsigned int) y * 19349663u;
+    hash ^= hash >> 13;
+    hash *= 0x5bd1e995u;
+    hash ^= hash >> 15;
+    float noise = (hash & 0xffff) / 65535.0f * 0.06f;
+
+    float highlight = expf(-((fx - 0.7f) * (fx - 0.7f) + (fy - 0.3f) * (fy - 0.3f)) * 40.0f) * 12.0f;
+
+    rgb[0] = 0.55f * fx + 0.2f * rings + tile + noise + highlight;
+    rgb[1] = 0.45f * fy + 0.3f * rings + noise + highlight * 0.9f;
+    rgb[2] = 0.35f * (1.0f - fx) + 0.2f * (1.0f - rings) + tile * 0.5f + noise + highlight * 0.7f;
+}
+
+float corpus_clamp(float value)
+{
+    return value < 0.0f ? 0.0f : value > 1.0f ? 1.0f : value;
+}
+
+void corpus_put(CorpusBuffer *buffer, const void *data, size_t size)
+{
+    if (buffer->failed || size == 0)
+        return;
+
+    if (buffer->size + size > buffer->capacity)
+    {
+        size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+        while (capacity < buffer->size + size)
+            capacity *= 2;
+
+        unsigned char *grown = (unsigned char*)realloc(buffer->data, capacity);
+        if (grown == NULL)
+        {
+            buffer->failed = true;
+            return;
+        }
+        buffer->data = grown;
+        buffer->capacity = capacity;
+    }
+
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+}
+
+void corpus_put_byte(CorpusBuffer *buffer, unsigned char value)
+{
+    corpus_put(buffer, &value, 1);
+}
+
+void corpus_put_be16(CorpusBuffer *buffer, unsigned int value)
+{
+    corpus_put_byte(buffer, (unsigned char) (value >> 8));
+    corpus_put_byte(buffer, (unsigned char) value);
+}
+
+void corpus_put_be32(CorpusBuffer *buffer, unsigned int value)
+{
+    corpus_put_be16(buffer, value >> 16);
+    corpus_put_be16(buffer, value & 0xffff);
+}
+
+unsigned char *corpus_finish(CorpusBuffer *buffer, int *size)
+{
+    if (buffer->failed)
+    {
+        printf("Failed to allocate a generated image\n");
+        free(buffer->data);
+        return NULL;
+    }
+
+    *size = (int) buffer->size;
+    return buffer->data;
+}
+
+// jpeg
+
+static const unsigned char corpus_zigzag[64] = {
+     0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+};
+
+// the example tables from annex K of the spec, which most encoders use as is
+static const unsigned char corpus_luma_quant[64] = {
+    16, 11, 10, 16,  24,  40,  51,  61,
+    12, 12, 14, 19,  26,  58,  60,  55,
+    14, 13, 16, 24,  40,  57,  69,  56,
+    14, 17, 22, 29,  51,  87,  80,  62,
+    18, 22, 37, 56,  68, 109, 103,  77,
+    24, 35, 55, 64,  81, 104, 113,  92,
+    49, 64, 78, 87, 103, 121, 120, 101,
+    72, 92, 95, 98, 112, 100, 103,  99
+};
+
+static const unsigned char corpus_chroma_quant[64] = {
+    17, 18, 24, 47, 99, 99, 99, 99,
+    18, 21, 26, 66, 99, 99, 99, 99,
+    24, 26, 56, 99, 99, 99, 99, 99,
+    47, 66, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99
+};
+
+static const unsigned char corpus_dc_luma_bits[16] = { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+static const unsigned char corpus_dc_chroma_bits[16] = { 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 };
+static const unsigned char corpus_dc_values[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+static const unsigned char corpus_ac_luma_bits[16] = { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
+static const unsigned char corpus_ac_luma_values[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+    0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa
+};
+
+static const unsigned char corpus_ac_chroma_bits[16] = { 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 };
+static const unsigned char corpus_ac_chroma_values[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+    0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+    0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+    0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+    0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+    0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+    0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa
+};
+
+// code and length for each symbol, built from a table's counts per length
+typedef struct CorpusHuffman {
+    unsigned short code[256];
+    unsigned char length[256];
+} CorpusHuffman;
+
+typedef struct CorpusJpegComponent {
+    const float *plane;
+    int width;
+    int height;
+    const unsigned char *quant;
+    const CorpusHuffman *dc;
+    const CorpusHuffman *ac;
+    int previous_dc;
+} CorpusJpegComponent;
+
+void build_corpus_huffman(CorpusHuffman *table, const unsigned char *bits, const unsigned char *values)
+{
+    unsigned int code = 0;
+    int k = 0;
+    memset(table, 0, sizeof(CorpusHuffman));
+    for (int length = 1; length <= 16; length++)
+    {
+        for (int i = 0; i < bits[length - 1]; i++, k++)
+        {
+            table->code[values[k]] = (unsigned short) code++;
+            table->length[values[k]] = (unsigned char) length;
+        }
+        code <<= 1;
+    }
+}
+
+// entropy coded data is written from the top bit down, with a zero stuffed
+// after every 0xff so it can't be read as a marker
+void corpus_jpeg_bits(CorpusBuffer *buffer, unsigned int value, int count)
+{
+    buffer->bits |= (value & ((1u << count) - 1)) << (24 - buffer->bit_count - count);
+    buffer->bit_count += count;
+    while (buffer->bit_count >= 8)
+    {
+        unsigned char byte = (unsigned char) (buffer->bits >> 16);
+        corpus_put_byte(buffer, byte);
+        if (byte == 0xff)
+            corpus_put_byte(buffer, 0);
+        buffer->bits <<= 8;
+        buffer->bits &= 0xffffff;
+        buffer->bit_count -= 8;
+    }
+}
+
+// magnitude category and the bits that follow it, negative values are sent
+// as one less than their two's complement
+int corpus_jpeg_category(int value, unsigned int *bits)
+{
+    int magnitude = value < 0 ? -value : value;
+    int category = 0;
+    while (magnitude >> category)
+        category++;
+    *bits = (unsigned int) (value < 0 ? value - 1 : value);
+    return category;
+}
+
+void corpus_jpeg_scale_quant(const unsigned char *base, int quality, unsigned char *quant)
+{
+    int scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+    for (int i = 0; i < 64; i++)
+    {
+        int value = (base[i] * scale + 50) / 100;
+        quant[i] = (unsigned char) (value < 1 ? 1 : value > 255 ? 255 : value);
+    }
+}
+
+void corpus_fdct(float *block)
+{
+    static float basis[8][8];
+    static bool basis_ready = false;
+    if (!basis_ready)
+    {
+        for (int u = 0; u < 8; u++)
+            for (int x = 0; x < 8; x++)
+                basis[u][x] = (u == 0 ? sqrtf(0.5f) : 1.0f) * 0.5f * cosf((2 * x + 1) * u * 3.14159265f / 16.0f);
+        basis_ready = true;
+    }
+
+    float rows[64];
+    for (int y = 0; y < 8; y++)
+        for (int u = 0; u < 8; u++)
+        {
+            float sum = 0.0f;
+            for (int x = 0; x < 8; x++)
+                sum += basis[u][x] * block[y * 8 + x];
+            rows[y * 8 + u] = sum;
+        }
+
+    for (int u = 0; u < 8; u++)
+        for (int v = 0; v < 8; v++)
+        {
+            float sum = 0.0f;
+            for (int y = 0; y < 8; y++)
+                sum += basis[v][y] * rows[y * 8 + u];
+            block[v * 8 + u] = sum;
+        }
+}
+
+// one 8x8 block at x, y of the component's plane, edges repeat outwards
+void corpus_jpeg_block(CorpusBuffer *buffer, CorpusJpegComponent *component, int x, int y)
+{
+    float block[64];
+    for (int j = 0; j < 8; j++)
+    {
+        int sy = y + j < component->height ? y + j : component->height - 1;
+        for (int i = 0; i < 8; i++)
+        {
+            int sx = x + i < component->width ? x + i : component->width - 1;
+            block[j * 8 + i] = component->plane[sy * component->width + sx] - 128.0f;
+        }
+    }
+    corpus_fdct(block);
+
+    int coefficients[64];
+    for (int k = 0; k < 64; k++)
+    {
+        int natural = corpus_zigzag[k];
+        coefficients[k] = (int) lrintf(block[natural] / component->quant[natural]);
+    }
+
+    unsigned int bits;
+    int category = corpus_jpeg_category(coefficients[0] - component->previous_dc, &bits);
+    component->previous_dc = coefficients[0];
+    corpus_jpeg_bits(buffer, component->dc->code[category], component->dc->length[category]);
+    corpus_jpeg_bits(buffer, bits, category);
+
+    int run = 0;
+    for (int k = 1; k < 64; k++)
+    {
+        if (coefficients[k] == 0)
+        {
+            run++;
+            continue;
+        }
+
+        // sixteen zeros at a time have their own symbol
+        for (; run >= 16; run -= 16)
+            corpus_jpeg_bits(buffer, component->ac->code[0xf0], component->ac->length[0xf0]);
+
+        category = corpus_jpeg_category(coefficients[k], &bits);
+        int symbol = run << 4 | category;
+        corpus_jpeg_bits(buffer, component->ac->code[symbol], component->ac->length[symbol]);
+        corpus_jpeg_bits(buffer, bits, category);
+        run = 0;
+    }
+
+    if (run > 0)
+        corpus_jpeg_bits(buffer, component->ac->code[0x00], component->ac->length[0x00]);
+}
+
+void corpus_jpeg_marker(CorpusBuffer *buffer, int marker, int length)
+{
+    corpus_put_byte(buffer, 0xff);
+    corpus_put_byte(buffer, (unsigned char) marker);
+    corpus_put_be16(buffer, length + 2);
+}
+
+void corpus_jpeg_huffman_table(CorpusBuffer *buffer, int id, const unsigned char *bits, const unsigned char *values, int count)
+{
+    corpus_put_byte(buffer, (unsigned char) id);
+    corpus_put(buffer, bits, 16);
+    corpus_put(buffer, values, count);
+}
+
+unsigned char *generate_corpus_jpeg(int width, int height, int *size)
+{
+    // full resolution luma, chroma averaged over 2x2 pixels
+    int chroma_width = (width + 1) / 2, chroma_height = (height + 1) / 2;
+    float *luma = (float*)malloc(sizeof(float) * width * height);
+    float *cb = (float*)calloc((size_t) chroma_width * chroma_height, sizeof(float));
+    float *cr = (float*)calloc((size_t) chroma_width * chroma_height, sizeof(float));
+    if (luma == NULL || cb == NULL || cr == NULL)
+    {
+        printf("Failed to allocate a generated JPEG\n");
+        free(luma);
+        free(cb);
+        free(cr);
+        return NULL;
+    }
+
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+        {
+            float rgb[3];
+            corpus_pixel(x, y, width, height, rgb);
+            float r = corpus_clamp(rgb[0]) * 255.0f, g = corpus_clamp(rgb[1]) * 255.0f, b = corpus_clamp(rgb[2]) * 255.0f;
+
+            int c = (y / 2) * chroma_width + x / 2;
+            int samples = ((x | 1) < width ? 2 : 1) * ((y | 1) < height ? 2 : 1);
+            luma[y * width + x] = 0.299f * r + 0.587f * g + 0.114f * b;
+            cb[c] += (128.0f - 0.168736f * r - 0.331264f * g + 0.5f * b) / samples;
+            cr[c] += (128.0f + 0.5f * r - 0.418688f * g - 0.081312f * b) / samples;
+        }
+
+    unsigned char luma_quant[64], chroma_quant[64];
+    corpus_jpeg_scale_quant(corpus_luma_quant, CORPUS_JPEG_QUALITY, luma_quant);
+    corpus_jpeg_scale_quant(corpus_chroma_quant, CORPUS_JPEG_QUALITY, chroma_quant);
+
+    CorpusHuffman dc_luma, dc_chroma, ac_luma, ac_chroma;
+    build_corpus_huffman(&dc_luma, corpus_dc_luma_bits, corpus_dc_values);
+    build_corpus_huffman(&dc_chroma, corpus_dc_chroma_bits, corpus_dc_values);
+    build_corpus_huffman(&ac_luma, corpus_ac_luma_bits, corpus_ac_luma_values);
+    build_corpus_huffman(&ac_chroma, corpus_ac_chroma_bits, corpus_ac_chroma_values);
+
+    CorpusBuffer buffer = { 0 };
+    corpus_put_be16(&buffer, 0xffd8);
+
+    corpus_jpeg_marker(&buffer, 0xdb, 2 * 65);
+    corpus_put_byte(&buffer, 0);
+    for (int k = 0; k < 64; k++)
+        corpus_put_byte(&buffer, luma_quant[corpus_zigzag[k]]);
+    corpus_put_byte(&buffer, 1);
+    for (int k = 0; k < 64; k++)
+        corpus_put_byte(&buffer, chroma_quant[corpus_zigzag[k]]);
+
+    // baseline frame, luma sampled 2x2 against the chroma's 1x1
+    corpus_jpeg_marker(&buffer, 0xc0, 6 + 3 * 3);
+    corpus_put_byte(&buffer, 8);
+    corpus_put_be16(&buffer, height);
+    corpus_put_be16(&buffer, width);
+    corpus_put_byte(&buffer, 3);
+    for (int i = 0; i < 3; i++)
+    {
+        corpus_put_byte(&buffer, (unsigned char) (i + 1));
+        corpus_put_byte(&buffer, i == 0 ? 0x22 : 0x11);
+        corpus_put_byte(&buffer, i == 0 ? 0 : 1);
+    }
+
+    corpus_jpeg_marker(&buffer, 0xc4, 2 * (17 + 12) + 2 * (17 + 162));
+    corpus_jpeg_huffman_table(&buffer, 0x00, corpus_dc_luma_bits, corpus_dc_values, 12);
+    corpus_jpeg_huffman_table(&buffer, 0x01, corpus_dc_chroma_bits, corpus_dc_values, 12);
+    corpus_jpeg_huffman_table(&buffer, 0x10, corpus_ac_luma_bits, corpus_ac_luma_values, 162);
+    corpus_jpeg_huffman_table(&buffer, 0x11, corpus_ac_chroma_bits, corpus_ac_chroma_values, 162);
+
+    corpus_jpeg_marker(&buffer, 0xda, 4 + 2 * 3);
+    corpus_put_byte(&buffer, 3);
+    for (int i = 0; i < 3; i++)
+    {
+        corpus_put_byte(&buffer, (unsigned char) (i + 1));
+        corpus_put_byte(&buffer, i == 0 ? 0x00 : 0x11);
+    }
+    corpus_put_byte(&buffer, 0);
+    corpus_put_byte(&buffer, 63);
+    corpus_put_byte(&buffer, 0);
+
+    CorpusJpegComponent components[3] = {
+        { luma, width, height, luma_quant, &dc_luma, &ac_luma, 0 },
+        { cb, chroma_width, chroma_height, chroma_quant, &dc_chroma, &ac_chroma, 0 },
+        { cr, chroma_width, chroma_height, chroma_quant, &dc_chroma, &ac_chroma, 0 }
+    };
+
+    for (int y = 0; y < height; y += 16)
+        for (int x = 0; x < width; x += 16)
+        {
+            corpus_jpeg_block(&buffer, &components[0], x, y);
+            corpus_jpeg_block(&buffer, &components[0], x + 8, y);
+            corpus_jpeg_block(&buffer, &components[0], x, y + 8);
+            corpus_jpeg_block(&buffer, &components[0], x + 8, y + 8);
+            corpus_jpeg_block(&buffer, &components[1], x / 2, y / 2);
+            corpus_jpeg_block(&buffer, &components[2], x / 2, y / 2);
+        }
+
+    // pad the last byte with ones
+    if (buffer.bit_count > 0)
+        corpus_jpeg_bits(&buffer, 0x7f, 8 - buffer.bit_count);
+    corpus_put_be16(&buffer, 0xffd9);
+
+    free(luma);
+    free(cb);
+    free(cr);
+    return corpus_finish(&buffer, size);
+}
+
+// png
+
+unsigned int corpus_crc32(unsigned int crc, const unsigned char *data, size_t size)
+{
+    static unsigned int table[256];
+    if (table[1] == 0)
+    {
+        for (unsigned int i = 0; i < 256; i++)
+        {
+            unsigned int value = i;
+            for (int k = 0; k < 8; k++)
+                value = value & 1 ? 0xedb88320u ^ (value >> 1) : value >> 1;
+            table[i] = value;
+        }
+    }
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+void corpus_png_chunk(CorpusBuffer *buffer, const char *type, const unsigned char *data, size_t size)
+{
+    corpus_put_be32(buffer, (unsigned int) size);
+    size_t start = buffer->size;
+    corpus_put(buffer, type, 4);
+    corpus_put(buffer, data, size);
+    if (!buffer->failed)
+        corpus_put_be32(buffer, corpus_crc32(0, buffer->data + start, size + 4));
+}
+
+// deflate is written from the bottom bit up, with huffman codes reversed
+void corpus_deflate_bits(CorpusBuffer *buffer, unsigned int value, int count)
+{
+    buffer->bits |= value << buffer->bit_count;
+    buffer->bit_count += count;
+    while (buffer->bit_count >= 8)
+    {
+        corpus_put_byte(buffer, (unsigned char) buffer->bits);
+        buffer->bits >>= 8;
+        buffer->bit_count -= 8;
+    }
+}
+
+void corpus_deflate_code(CorpusBuffer *buffer, unsigned int code, int length)
+{
+    unsigned int reversed = 0;
+    for (int i = 0; i < length; i++)
+        reversed |= ((code >> i) & 1) << (length - 1 - i);
+    corpus_deflate_bits(buffer, reversed, length);
+}
+
+// the fixed literal/length code from the deflate spec
+void corpus_deflate_symbol(CorpusBuffer *buffer, int symbol)
+{
+    if (symbol < 144)
+        corpus_deflate_code(buffer, 0x30 + symbol, 8);
+    else if (symbol < 256)
+        corpus_deflate_code(buffer, 0x190 + symbol - 144, 9);
+    else if (symbol < 280)
+        corpus_deflate_code(buffer, symbol - 256, 7);
+    else
+        corpus_deflate_code(buffer, 0xc0 + symbol - 280, 8);
+}
+
+void corpus_deflate_match(CorpusBuffer *buffer, int length, int distance)
+{
+    static const unsigned short length_base[29] = {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+    };
+    static const unsigned char length_extra[29] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+    };
+    static const unsigned short distance_base[30] = {
+        1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+        1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+    };
+    static const unsigned char distance_extra[30] = {
+        0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+    };
+
+    int code = 28;
+    while (length_base[code] > length)
+        code--;
+    corpus_deflate_symbol(buffer, 257 + code);
+    corpus_deflate_bits(buffer, length - length_base[code], length_extra[code]);
+
+    code = 29;
+    while (distance_base[code] > distance)
+        code--;
+    corpus_deflate_code(buffer, code, 5);
+    corpus_deflate_bits(buffer, distance - distance_base[code], distance_extra[code]);
+}
+
+// one fixed-code block with greedy matches from a single-entry hash, which is
+// about what a fast zlib level gets on image data
+void corpus_zlib(CorpusBuffer *buffer, const unsigned char *data, size_t size)
+{
+    int *head = (int*)malloc(sizeof(int) << CORPUS_DEFLATE_HASH_BITS);
+    if (head == NULL)
+    {
+        buffer->failed = true;
+        return;
+    }
+    for (int i = 0; i < 1 << CORPUS_DEFLATE_HASH_BITS; i++)
+        head[i] = -CORPUS_DEFLATE_WINDOW - 1;
+
+    corpus_put_be16(buffer, 0x7801);
+    buffer->bits = 0;
+    buffer->bit_count = 0;
+    corpus_deflate_bits(buffer, 1, 1);
+    corpus_deflate_bits(buffer, 1, 2);
+
+    size_t i = 0;
+    while (i < size)
+    {
+        int length = 0;
+        int distance = 0;
+        if (i + 3 <= size)
+        {
+            unsigned int key = (data[i] | data[i + 1] << 8 | data[i + 2] << 16) * 2654435761u >> (32 - CORPUS_DEFLATE_HASH_BITS);
+            long candidate = head[key];
+            head[key] = (int) i;
+
+            if ((long) i - candidate <= CORPUS_DEFLATE_WINDOW)
+            {
+                size_t limit = size - i < 258 ? size - i : 258;
+                while ((size_t) length < limit && data[candidate + length] == data[i + length])
+                    length++;
+                distance = (int) (i - candidate);
+            }
+        }
+
+        if (length >= 3)
+        {
+            corpus_deflate_match(buffer, length, distance);
+            i += length;
+        }
+        else
+            corpus_deflate_symbol(buffer, data[i++]);
+    }
+
+    corpus_deflate_symbol(buffer, 256);
+    if (buffer->bit_count > 0)
+        corpus_deflate_bits(buffer, 0, 8 - buffer->bit_count);
+
+    unsigned int a = 1, b = 0;
+    for (size_t k = 0; k < size; k++)
+    {
+        a = (a + data[k]) % 65521;
+        b = (b + a) % 65521;
+    }
+    corpus_put_be32(buffer, b << 16 | a);
+    free(head);
+}
+
+unsigned char corpus_paeth(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    return (unsigned char) (pa <= pb && pa <= pc ? a : pb <= pc ? b : c);
+}
+
+// channels is 3 or 4 and depth 8 or 16. each row takes whichever filter
+// leaves the smallest sum of signed bytes, like libpng's default
+unsigned char *generate_corpus_png(int width, int height, int channels, int depth, int *size)
+{
+    int pixel_bytes = channels * depth / 8;
+    size_t stride = (size_t) width * pixel_bytes;
+    unsigned char *raw = (unsigned char*)malloc(stride * height);
+    unsigned char *filtered = (unsigned char*)malloc((stride + 1) * height);
+    unsigned char *candidate = (unsigned char*)malloc(stride);
+    if (raw == NULL || filtered == NULL || candidate == NULL)
+    {
+        printf("Failed to allocate a generated PNG\n");
+        free(raw);
+        free(filtered);
+        free(candidate);
+        return NULL;
+    }
+
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+        {
+            float rgba[4];
+            corpus_pixel(x, y, width, height, rgba);
+            rgba[3] = corpus_clamp(1.2f - rgba[1]);
+
+            unsigned char *pixel = raw + y * stride + (size_t) x * pixel_bytes;
+            for (int c = 0; c < channels; c++)
+            {
+                unsigned int value = (unsigned int) (corpus_clamp(rgba[c]) * (depth == 16 ? 65535.0f : 255.0f) + 0.5f);
+                if (depth == 16)
+                {
+                    pixel[c * 2] = (unsigned char) (value >> 8);
+                    pixel[c * 2 + 1] = (unsigned char) value;
+                }
+                else
+                    pixel[c] = (unsigned char) value;
+            }
+        }
+
+    for (int y = 0; y < height; y++)
+    {
+        const unsigned char *row = raw + y * stride;
+        const unsigned char *prior = y > 0 ? row - stride : NULL;
+        unsigned char *out = filtered + y * (stride + 1);
+        long best_cost = -1;
+
+        for (int filter = 0; filter < 5; filter++)
+        {
+            long cost = 0;
+            for (size_t i = 0; i < stride; i++)
+            {
+                int a = i >= (size_t) pixel_bytes ? row[i - pixel_bytes] : 0;
+                int b = prior != NULL ? prior[i] : 0;
+                int c = prior != NULL && i >= (size_t) pixel_bytes ? prior[i - pixel_bytes] : 0;
+                int predicted = filter == 0 ? 0 : filter == 1 ? a : filter == 2 ? b : filter == 3 ? (a + b) / 2 : corpus_paeth(a, b, c);
+                candidate[i] = (unsigned char) (row[i] - predicted);
+                cost += abs((signed char) candidate[i]);
+            }
+
+            if (best_cost < 0 || cost < best_cost)
+            {
+                best_cost = cost;
+                out[0] = (unsigned char) filter;
+                memcpy(out + 1, candidate, stride);
+            }
+        }
+    }
+
+    CorpusBuffer compressed = { 0 };
+    corpus_zlib(&compressed, filtered, (stride + 1) * height);
+
+    CorpusBuffer buffer = { 0 };
+    corpus_put(&buffer, "\x89PNG\r\n\x1a\n", 8);
+
+    unsigned char header[13];
+    for (int i = 0; i < 4; i++)
+    {
+        header[i] = (unsigned char) (width >> (24 - i * 8));
+        header[4 + i] = (unsigned char) (height >> (24 - i * 8));
+    }
+    header[8] = (unsigned char) depth;
+    header[9] = channels == 4 ? 6 : 2;
+    header[10] = header[11] = header[12] = 0;
+    corpus_png_chunk(&buffer, "IHDR", header, sizeof(header));
+
+    // split the stream like real encoders do, so chunk boundaries get crossed
+    for (size_t offset = 0; offset < compressed.size; offset += CORPUS_PNG_IDAT_SIZE)
+    {
+        size_t count = compressed.size - offset < CORPUS_PNG_IDAT_SIZE ? compressed.size - offset : CORPUS_PNG_IDAT_SIZE;
+        corpus_png_chunk(&buffer, "IDAT", compressed.data + offset, count);
+    }
+    corpus_png_chunk(&buffer, "IEND", NULL, 0);
+
+    buffer.failed |= compressed.failed;
+    free(compressed.data);
+    free(raw);
+    free(filtered);
+    free(candidate);
+    return corpus_finish(&buffer, size);
+}
+
+// hdr
+
+// runs of three or more repeats are sent as a count over 128 and the value,
+// anything else as a count up to 128 and that many values
+void corpus_hdr_component(CorpusBuffer *buffer, const unsigned char *values, int width)
+{
+    int i = 0;
+    while (i < width)
+    {
+        int run = 1;
+        while (i + run < width && run < 127 && values[i + run] == values[i])
+            run++;
+
+        if (run >= 3)
+        {
+            corpus_put_byte(buffer, (unsigned char) (128 + run));
+            corpus_put_byte(buffer, values[i]);
+            i += run;
+            continue;
+        }
+
+        int start = i;
+        while (i < width && i - start < 128)
+        {
+            if (i + 2 < width && values[i] == values[i + 1] && values[i] == values[i + 2])
+                break;
+            i++;
+        }
+        corpus_put_byte(buffer, (unsigned char) (i - start));
+        corpus_put(buffer, values + start, i - start);
+    }
+}
+
+// width has to be within 8 to 32767 for run-length scanlines
+unsigned char *generate_corpus_hdr(int width, int height, int *size)
+{
+    unsigned char *scanline = (unsigned char*)malloc((size_t) width * 4);
+    if (scanline == NULL)
+    {
+        printf("Failed to allocate a generated HDR\n");
+        return NULL;
+    }
+
+    CorpusBuffer buffer = { 0 };
+    char header[128];
+    int header_size = snprintf(header, sizeof(header), "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y %d +X %d\n", height, width);
+    corpus_put(&buffer, header, header_size);
+
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            float rgb[3];
+            corpus_pixel(x, y, width, height, rgb);
+            float largest = rgb[0] > rgb[1] ? rgb[0] : rgb[1];
+            largest = largest > rgb[2] ? largest : rgb[2];
+
+            // shared exponent with each channel's mantissa scaled to a byte
+            int exponent;
+            float scale = largest < 1e-32f ? 0.0f : frexpf(largest, &exponent) * 256.0f / largest;
+            for (int c = 0; c < 3; c++)
+                scanline[c * width + x] = (unsigned char) (rgb[c] * scale);
+            scanline[3 * width + x] = scale == 0.0f ? 0 : (unsigned char) (exponent + 128);
+        }
+
+        corpus_put_byte(&buffer, 2);
+        corpus_put_byte(&buffer, 2);
+        corpus_put_be16(&buffer, width);
+        for (int c = 0; c < 4; c++)
+            corpus_hdr_component(&buffer, scanline + c * width, width);
+    }
+
+    free(scanline);
+    return corpus_finish(&buffer, size);
+}
+
+#endif
@@ -0,0 +1,322 @@
+#ifndef COOKED_MESH_H
+#define COOKED_MESH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <glad/glad.h>
+
+#include <cglm/cglm.h>
+
+#include "gl_resources.h"
+#include "mesh.h"
+#include "mesh_import.h"
+#include "render_stats.h"
+#include "vertex_compress.h"
+
+// cooked mesh defaults
+#define COOKED_MESH_MAGIC 0x4853454Du // "MESH"
+#define COOKED_MESH_VERSION 2
+#define COOKED_MESH_ALIGNMENT 4096 // vertices and indices start on page boundaries
+#define COOKED_MESH_MAX_ATTRIBS 8
+
+// meshes packed ahead of time by mesh_cooker into a file that is loaded by
+// mapping it and handing the vertex and index blocks straight to
+// glNamedBufferStorage, nothing is parsed or converted. the structs below are
+// the file: the cooker writes them and the loader reads them in place, so any
+// change to them, to PackedVertex or to Meshlet needs COOKED_MESH_VERSION bumped, and old
+// files recooking. little endian, all offsets from the start of the file
+//
+//   CookedMeshHeader
+//   CookedLod[lod_count]
+//   CookedSubmesh[lod_count][submesh_count]
+//   Meshlet[meshlet_count], LOD by LOD
+//   vertices, aligned to COOKED_MESH_ALIGNMENT, vertex_stride bytes each
+//   indices, aligned to COOKED_MESH_ALIGNMENT, 32 bit
+
+// one VertexAttrib, at fixed widths
+typedef struct CookedAttrib {
+    uint32_t location;
+    uint32_t size;
+    uint32_t type;
+    uint32_t normalized;
+    uint32_t offset;
+} CookedAttrib;
+
+typedef struct CookedMeshHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t file_size;
+
+    // how the vertex block reads, the VAO is made from this
+    uint32_t vertex_stride;
+    uint32_t attrib_count;
+    CookedAttrib attribs[COOKED_MESH_MAX_ATTRIBS];
+
+    // positions decode as position_offset + unorm * position_scale
+    float position_offset[3];
+    float position_scale[3];
+    float bounds[2][3];
+
+    uint32_t vertex_count;
+    uint32_t index_count;
+    uint32_t lod_count;
+    // per LOD, every LOD has the same submeshes
+    uint32_t submesh_count;
+    uint32_t meshlet_count;
+    uint32_t reserved;
+
+    uint64_t lod_offset;
+    uint64_t submesh_offset;
+    uint64_t meshlet_offset;
+    uint64_t vertex_offset;
+    uint64_t index_offset;
+} CookedMeshHeader;
+
+// a level of detail is its own run of indices into the shared vertices.
+// error is how far, in mesh units, it strays from LOD 0
+typedef struct CookedLod {
+    float error;
+    uint32_t first_index;
+    uint32_t index_count;
+    uint32_t first_meshlet;
+    uint32_t meshlet_count;
+    uint32_t reserved[3];
+} CookedLod;
+
+typedef struct CookedSubmesh {
+    uint32_t first_index;
+    uint32_t index_count;
+    int32_t material;
+    uint32_t reserved;
+    float bounds[2][3];
+} CookedSubmesh;
+
+// the layout is the file format, this catches padding creeping in
+_Static_assert(sizeof(CookedMeshHeader) == 296, "cooked mesh header changed size");
+_Static_assert(sizeof(CookedLod) == 32, "cooked LOD changed size");
+_Static_assert(sizeof(Meshlet) == 64, "meshlet changed size");
+_Static_assert(sizeof(CookedSubmesh) == 40, "cooked submesh changed size");
+
+// a mapped file and where its tables and blocks are
+typedef struct CookedMesh {
+    MappedFile file;
+    const CookedMeshHeader *header;
+    const CookedLod *lods;
+    const CookedSubmesh *submeshes;
+    const Meshlet *meshlets;
+    const void *vertices;
+    const uint32_t *indices;
+} CookedMesh;
+
+bool cook_mesh(const char *path, const Mesh *mesh, const PackedMesh *packed);
+bool map_cooked_mesh(const char *path, CookedMesh *cooked);
+void upload_cooked_mesh(const CookedMesh *cooked, GpuMesh *gpu);
+void unmap_cooked_mesh(CookedMesh *cooked);
+
+static uint64_t align_cooked_offset(uint64_t offset)
+{
+    return (offset + COOKED_MESH_ALIGNMENT - 1) / COOKED_MESH_ALIGNMENT * COOKED_MESH_ALIGNMENT;
+}
+
+static bool write_cooked_padding(FILE *file, uint64_t *written, uint64_t to)
+{
+    static const unsigned char zeros[COOKED_MESH_ALIGNMENT];
+    uint64_t padding = to - *written;
+    *written = to;
+    return fwrite(zeros, 1, (size_t) padding, file) == padding;
+}
+
+static void cooked_submesh_bounds(const Mesh *mesh, unsigned int first_index, unsigned int index_count, float bounds[2][3])
+{
+    if (index_count == 0)
+    {
+        memset(bounds, 0, sizeof(float) * 6);
+        return;
+    }
+
+    glm_vec3_copy(mesh->vertices[mesh->indices[first_index]].position, bounds[0]);
+    glm_vec3_copy(mesh->vertices[mesh->indices[first_index]].position, bounds[1]);
+    for (unsigned int i = first_index; i < first_index + index_count; i++)
+    {
+        glm_vec3_minv(bounds[0], mesh->vertices[mesh->indices[i]].position, bounds[0]);
+        glm_vec3_maxv(bounds[1], mesh->vertices[mesh->indices[i]].position, bounds[1]);
+    }
+}
+
+// writes the packed mesh, with the LODs, submeshes, meshlets and bounds from
+// the mesh it was packed from. a mesh without LODs is all LOD 0
+bool cook_mesh(const char *path, const Mesh *mesh, const PackedMesh *packed)
+{
+    // a mesh without submeshes is one covering everything
+    MeshSubmesh whole = { 0, mesh->index_count, -1 };
+    MeshLod all = { 0, mesh->index_count, 0.0f, 0, 0 };
+    const MeshSubmesh *submeshes = mesh->submesh_count > 0 ? mesh->submeshes : &whole;
+    unsigned int submesh_count = mesh->submesh_count > 0 ? mesh->submesh_count : 1;
+    const MeshLod *lods = mesh->lod_count > 0 ? mesh->lods : &all;
+    unsigned int lod_count = mesh->lod_count > 0 ? mesh->lod_count : 1;
+
+    CookedMeshHeader header;
+    memset(&header, 0, sizeof(CookedMeshHeader));
+    header.magic = COOKED_MESH_MAGIC;
+    header.version = COOKED_MESH_VERSION;
+    header.vertex_stride = sizeof(PackedVertex);
+    header.attrib_count = PACKED_VERTEX_ATTRIBS;
+    for (int k = 0; k < PACKED_VERTEX_ATTRIBS; k++)
+    {
+        const VertexAttrib *attrib = &packed_vertex_attribs[k];
+        header.attribs[k] = (CookedAttrib) { attrib->location, (uint32_t) attrib->size, attrib->type, attrib->normalized, attrib->offset };
+    }
+    memcpy(header.position_offset, packed->position_offset, sizeof(float) * 3);
+    memcpy(header.position_scale, packed->position_scale, sizeof(float) * 3);
+    memcpy(header.bounds, mesh->bounds, sizeof(float) * 6);
+    header.vertex_count = packed->vertex_count;
+    header.index_count = packed->index_count;
+    header.lod_count = lod_count;
+    header.submesh_count = submesh_count;
+    header.meshlet_count = mesh->meshlet_count;
+
+    header.lod_offset = sizeof(CookedMeshHeader);
+    header.submesh_offset = header.lod_offset + sizeof(CookedLod) * header.lod_count;
+    header.meshlet_offset = header.submesh_offset + sizeof(CookedSubmesh) * header.lod_count * submesh_count;
+    header.vertex_offset = align_cooked_offset(header.meshlet_offset + sizeof(Meshlet) * header.meshlet_count);
+    header.index_offset = align_cooked_offset(header.vertex_offset + (uint64_t) sizeof(PackedVertex) * packed->vertex_count);
+    header.file_size = header.index_offset + (uint64_t) sizeof(uint32_t) * packed->index_count;
+
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        printf("Failed to create cooked mesh %s\n", path);
+        return false;
+    }
+
+    uint64_t written = header.submesh_offset;
+    bool ok = fwrite(&header, sizeof(CookedMeshHeader), 1, file) == 1;
+    for (unsigned int k = 0; k < lod_count && ok; k++)
+    {
+        CookedLod lod = { lods[k].error, lods[k].first_index, lods[k].index_count, lods[k].first_meshlet, lods[k].meshlet_count, { 0 } };
+        ok = fwrite(&lod, sizeof(CookedLod), 1, file) == 1;
+    }
+
+    for (unsigned int s = 0; s < lod_count * submesh_count && ok; s++)
+    {
+        CookedSubmesh submesh;
+        memset(&submesh, 0, sizeof(CookedSubmesh));
+        submesh.first_index = submeshes[s].first_index;
+        submesh.index_count = submeshes[s].index_count;
+        submesh.material = submeshes[s].material;
+        cooked_submesh_bounds(mesh, submesh.first_index, submesh.index_count, submesh.bounds);
+        ok = fwrite(&submesh, sizeof(CookedSubmesh), 1, file) == 1;
+        written += sizeof(CookedSubmesh);
+    }
+
+    ok = ok && fwrite(mesh->meshlets, sizeof(Meshlet), mesh->meshlet_count, file) == mesh->meshlet_count;
+    written += sizeof(Meshlet) * mesh->meshlet_count;
+    ok = ok && write_cooked_padding(file, &written, header.vertex_offset) &&
+        fwrite(packed->vertices, sizeof(PackedVertex), packed->vertex_count, file) == packed->vertex_count;
+    written += (uint64_t) sizeof(PackedVertex) * packed->vertex_count;
+    ok = ok && write_cooked_padding(file, &written, header.index_offset) &&
+        fwrite(packed->indices, sizeof(uint32_t), packed->index_count, file) == packed->index_count;
+
+    ok &= fclose(file) == 0;
+    if (!ok)
+        printf("Failed to write cooked mesh %s\n", path);
+    return ok;
+}
+
+static bool cooked_block_fits(const CookedMeshHeader *header, uint64_t offset, uint64_t size)
+{
+    return offset <= header->file_size && size <= header->file_size - offset;
+}
+
+// only the header and tables are checked, the blocks go to the GPU as they are
+bool map_cooked_mesh(const char *path, CookedMesh *cooked)
+{
+    memset(cooked, 0, sizeof(CookedMesh));
+    if (!map_file(path, &cooked->file))
+        return false;
+
+    const CookedMeshHeader *header = (const CookedMeshHeader*)cooked->file.data;
+    if (cooked->file.size < sizeof(CookedMeshHeader) || header->magic != COOKED_MESH_MAGIC)
+    {
+        printf("%s isn't a cooked mesh\n", path);
+        unmap_cooked_mesh(cooked);
+        return false;
+    }
+    if (header->version != COOKED_MESH_VERSION)
+    {
+        printf("Cooked mesh %s is version %u, this build reads %u, it needs recooking\n", path, header->version, COOKED_MESH_VERSION);
+        unmap_cooked_mesh(cooked);
+        return false;
+    }
+
+    uint64_t submesh_entries = (uint64_t) header->lod_count * header->submesh_count;
+    bool valid = header->file_size == cooked->file.size && header->attrib_count <= COOKED_MESH_MAX_ATTRIBS &&
+        header->lod_count > 0 && header->submesh_count > 0 &&
+        header->lod_offset % 8 == 0 && header->submesh_offset % 8 == 0 && header->meshlet_offset % 8 == 0 &&
+        header->vertex_offset % COOKED_MESH_ALIGNMENT == 0 && header->index_offset % COOKED_MESH_ALIGNMENT == 0 &&
+        cooked_block_fits(header, header->lod_offset, (uint64_t) sizeof(CookedLod) * header->lod_count) &&
+        cooked_block_fits(header, header->submesh_offset, sizeof(CookedSubmesh) * submesh_entries) &&
+        cooked_block_fits(header, header->meshlet_offset, (uint64_t) sizeof(Meshlet) * header->meshlet_count) &&
+        cooked_block_fits(header, header->vertex_offset, (uint64_t) header->vertex_stride * header->vertex_count) &&
+        cooked_block_fits(header, header->index_offset, (uint64_t) sizeof(uint32_t) * header->index_count);
+
+    cooked->header = header;
+    cooked->lods = (const CookedLod*)(cooked->file.data + header->lod_offset);
+    cooked->submeshes = (const CookedSubmesh*)(cooked->file.data + header->submesh_offset);
+    cooked->meshlets = (const Meshlet*)(cooked->file.data + header->meshlet_offset);
+    cooked->vertices = cooked->file.data + header->vertex_offset;
+    cooked->indices = (const uint32_t*)(cooked->file.data + header->index_offset);
+
+    for (uint32_t k = 0; k < header->lod_count && valid; k++)
+        valid = (uint64_t) cooked->lods[k].first_index + cooked->lods[k].index_count <= header->index_count &&
+            (uint64_t) cooked->lods[k].first_meshlet + cooked->lods[k].meshlet_count <= header->meshlet_count;
+    for (uint64_t k = 0; k < submesh_entries && valid; k++)
+        valid = (uint64_t) cooked->submeshes[k].first_index + cooked->submeshes[k].index_count <= header->index_count;
+    for (uint32_t k = 0; k < header->meshlet_count && valid; k++)
+        valid = (uint64_t) cooked->meshlets[k].first_index + cooked->meshlets[k].index_count <= header->index_count;
+
+    if (!valid)
+    {
+        printf("Cooked mesh %s is damaged\n", path);
+        unmap_cooked_mesh(cooked);
+        return false;
+    }
+    return true;
+}
+
+// the vertex and index blocks are copied by the driver straight out of the
+// mapping, so the file can be unmapped as soon as this returns
+void upload_cooked_mesh(const CookedMesh *cooked, GpuMesh *gpu)
+{
+    const CookedMeshHeader *header = cooked->header;
+    GLsizeiptr vertex_bytes = (GLsizeiptr) header->vertex_stride * header->vertex_count;
+    GLsizeiptr index_bytes = (GLsizeiptr) sizeof(uint32_t) * header->index_count;
+
+    VertexAttrib attribs[COOKED_MESH_MAX_ATTRIBS];
+    for (uint32_t k = 0; k < header->attrib_count; k++)
+    {
+        const CookedAttrib *attrib = &header->attribs[k];
+        attribs[k] = (VertexAttrib) { attrib->location, (GLint) attrib->size, attrib->type, (GLboolean) attrib->normalized, attrib->offset };
+    }
+
+    gpu->vertex_buffer = create_buffer(vertex_bytes, cooked->vertices, 0);
+    gpu->index_buffer = create_buffer(index_bytes, cooked->indices, 0);
+    gpu->vao = create_vertex_array(gpu->vertex_buffer, (GLsizei) header->vertex_stride, attribs, (int) header->attrib_count, gpu->index_buffer);
+    gpu->index_count = header->index_count;
+    glm_vec3_copy((float*)header->position_offset, gpu->position_offset);
+    glm_vec3_copy((float*)header->position_scale, gpu->position_scale);
+
+    render_stats.frame.buffer_bytes += (uint64_t) vertex_bytes + (uint64_t) index_bytes;
+}
+
+void unmap_cooked_mesh(CookedMesh *cooked)
+{
+    unmap_file(&cooked->file);
+    memset(cooked, 0, sizeof(CookedMesh));
+}
+
+#endif
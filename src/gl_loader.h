@@ -0,0 +1,181 @@
+#ifndef GL_LOADER_H
+#define GL_LOADER_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#include <glad/glad.h>
+
+// gladLoadGLLoader looks up all ~700 GL 4.6 entry points, the renderer calls
+// about 90 of them. this loads just those, so a short lived process isn't
+// mostly spent in glfwGetProcAddress. anything not in the table stays NULL,
+// so a new gl* call in src/ needs its line here. regenerate the table with
+//   grep -ohE '\bgl[A-Z][A-Za-z0-9_]*\b' src/*.c src/*.h | sort -u
+// keeping the names glad.c has a glad_ pointer for (extension entry points
+// like the bindless ones are loaded by whoever uses them)
+
+// in glad.c, our additions to it
+int gladLoadGLVersion(GLADloadproc load);
+int gladHasExtension(const char *ext);
+
+typedef struct GLProc {
+    const char *name;
+    void **proc;
+} GLProc;
+
+#define GL_PROC(name) { #name, (void**)&glad_##name }
+
+GLProc gl_procs[] = {
+    GL_PROC(glActiveTexture),
+    GL_PROC(glAttachShader),
+    GL_PROC(glBindBuffer),
+    GL_PROC(glBindBufferBase),
+    GL_PROC(glBindBufferRange),
+    GL_PROC(glBindFramebuffer),
+    GL_PROC(glBindImageTexture),
+    GL_PROC(glBindRenderbuffer),
+    GL_PROC(glBindSampler),
+    GL_PROC(glBindTexture),
+    GL_PROC(glBindTextureUnit),
+    GL_PROC(glBindVertexArray),
+    GL_PROC(glBufferData),
+    GL_PROC(glBufferStorage),
+    GL_PROC(glBufferSubData),
+    GL_PROC(glCheckFramebufferStatus),
+    GL_PROC(glCheckNamedFramebufferStatus),
+    GL_PROC(glClear),
+    GL_PROC(glClearBufferuiv),
+    GL_PROC(glClearColor),
+    GL_PROC(glClearNamedBufferData),
+    GL_PROC(glClientWaitSync),
+    GL_PROC(glCompileShader),
+    GL_PROC(glCopyImageSubData),
+    GL_PROC(glCreateBuffers),
+    GL_PROC(glCreateFramebuffers),
+    GL_PROC(glCreateProgram),
+    GL_PROC(glCreateRenderbuffers),
+    GL_PROC(glCreateShader),
+    GL_PROC(glCreateTextures),
+    GL_PROC(glCreateVertexArrays),
+    GL_PROC(glDeleteBuffers),
+    GL_PROC(glDeleteFramebuffers),
+    GL_PROC(glDeleteProgram),
+    GL_PROC(glDeleteQueries),
+    GL_PROC(glDeleteRenderbuffers),
+    GL_PROC(glDeleteSamplers),
+    GL_PROC(glDeleteShader),
+    GL_PROC(glDeleteSync),
+    GL_PROC(glDeleteTextures),
+    GL_PROC(glDeleteVertexArrays),
+    GL_PROC(glDispatchCompute),
+    GL_PROC(glDrawArrays),
+    GL_PROC(glDrawElements),
+    GL_PROC(glEnable),
+    GL_PROC(glEnableVertexArrayAttrib),
+    GL_PROC(glEnableVertexAttribArray),
+    GL_PROC(glFenceSync),
+    GL_PROC(glFramebufferRenderbuffer),
+    GL_PROC(glFramebufferTexture2D),
+    GL_PROC(glGenBuffers),
+    GL_PROC(glGenFramebuffers),
+    GL_PROC(glGenQueries),
+    GL_PROC(glGenRenderbuffers),
+    GL_PROC(glGenSamplers),
+    GL_PROC(glGenTextures),
+    GL_PROC(glGenVertexArrays),
+    GL_PROC(glGenerateMipmap),
+    GL_PROC(glGenerateTextureMipmap),
+    GL_PROC(glGetFloatv),
+    GL_PROC(glGetInteger64v),
+    GL_PROC(glGetIntegerv),
+    GL_PROC(glGetInternalformativ),
+    GL_PROC(glGetProgramInfoLog),
+    GL_PROC(glGetProgramiv),
+    GL_PROC(glGetQueryObjectiv),
+    GL_PROC(glGetQueryObjectui64v),
+    GL_PROC(glGetShaderInfoLog),
+    GL_PROC(glGetShaderiv),
+    GL_PROC(glGetTexParameteriv),
+    GL_PROC(glGetTextureParameteriv),
+    GL_PROC(glGetUniformLocation),
+    GL_PROC(glLinkProgram),
+    GL_PROC(glMapBufferRange),
+    GL_PROC(glMapNamedBufferRange),
+    GL_PROC(glMemoryBarrier),
+    GL_PROC(glMultiDrawArraysIndirect),
+    GL_PROC(glMultiDrawElementsIndirect),
+    GL_PROC(glMultiDrawElementsIndirectCount),
+    GL_PROC(glNamedBufferStorage),
+    GL_PROC(glNamedBufferSubData),
+    GL_PROC(glNamedFramebufferRenderbuffer),
+    GL_PROC(glNamedFramebufferTexture),
+    GL_PROC(glNamedRenderbufferStorage),
+    GL_PROC(glPixelStorei),
+    GL_PROC(glPolygonMode),
+    GL_PROC(glPopDebugGroup),
+    GL_PROC(glPushDebugGroup),
+    GL_PROC(glQueryCounter),
+    GL_PROC(glReadPixels),
+    GL_PROC(glRenderbufferStorage),
+    GL_PROC(glSamplerParameterf),
+    GL_PROC(glSamplerParameteri),
+    GL_PROC(glShaderSource),
+    GL_PROC(glTexParameteri),
+    GL_PROC(glTexParameteriv),
+    GL_PROC(glTexStorage2D),
+    GL_PROC(glTexStorage3D),
+    GL_PROC(glTexSubImage2D),
+    GL_PROC(glTexSubImage3D),
+    GL_PROC(glTextureParameteri),
+    GL_PROC(glTextureParameteriv),
+    GL_PROC(glTextureStorage2D),
+    GL_PROC(glTextureStorage3D),
+    GL_PROC(glTextureSubImage2D),
+    GL_PROC(glTextureSubImage3D),
+    GL_PROC(glTextureView),
+    GL_PROC(glUniform1f),
+    GL_PROC(glUniform1i),
+    GL_PROC(glUniform1iv),
+    GL_PROC(glUniform1ui),
+    GL_PROC(glUniform2fv),
+    GL_PROC(glUniform3fv),
+    GL_PROC(glUniform4f),
+    GL_PROC(glUniform4fv),
+    GL_PROC(glUniformMatrix4fv),
+    GL_PROC(glUnmapBuffer),
+    GL_PROC(glUnmapNamedBuffer),
+    GL_PROC(glUseProgram),
+    GL_PROC(glVertexArrayAttribBinding),
+    GL_PROC(glVertexArrayAttribFormat),
+    GL_PROC(glVertexArrayElementBuffer),
+    GL_PROC(glVertexArrayVertexBuffer),
+    GL_PROC(glVertexAttribPointer),
+    GL_PROC(glViewport),
+};
+
+#undef GL_PROC
+
+bool load_gl(GLADloadproc load);
+
+// version and extensions through glad, then the table. false if anything
+// the renderer calls is missing, after naming all of it
+bool load_gl(GLADloadproc load)
+{
+    if (!gladLoadGLVersion(load))
+        return false;
+
+    int missing = 0;
+    for (size_t i = 0; i < sizeof(gl_procs) / sizeof(gl_procs[0]); i++)
+    {
+        *gl_procs[i].proc = load(gl_procs[i].name);
+        if (*gl_procs[i].proc == NULL)
+        {
+            printf("Missing GL entry point %s\n", gl_procs[i].name);
+            missing++;
+        }
+    }
+
+    return missing == 0;
+}
+
+#endif
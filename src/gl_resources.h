@@ -0,0 +1,166 @@
+#ifndef GL_RESOURCES_H
+#define GL_RESOURCES_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <glad/glad.h>
+
+// stream buffer defaults
+#define STREAM_BUFFER_FRAMES 3
+#define STREAM_BUFFER_ALIGNMENT 256 // covers every driver's SSBO/UBO offset alignment
+#define STREAM_BUFFER_WAIT_NS 1000000000ull
+
+// buffers, textures and vertex arrays made through GL 4.5 direct state access.
+// nothing here binds, so setting an object up never disturbs what a draw has
+// bound, and all storage is immutable: sized once, never reallocated, so the
+// driver skips the checks glBufferData and glTexImage need
+
+// vertex layout, one per attribute, all read from buffer binding 0
+typedef struct VertexAttrib {
+    GLuint location;
+    GLint size;
+    GLenum type;
+    GLboolean normalized;
+    GLuint offset;
+} VertexAttrib;
+
+// immutable storage can't be orphaned, so per-frame data goes round a
+// persistently mapped ring instead, a fence per frame keeping the CPU off
+// whatever the GPU is still reading
+typedef struct StreamBuffer {
+    GLuint id;
+    unsigned char *memory;
+    // one frame's slice, rounded up to STREAM_BUFFER_ALIGNMENT
+    GLsizeiptr frame_size;
+    int frame;
+    GLsync fences[STREAM_BUFFER_FRAMES];
+} StreamBuffer;
+
+GLuint create_buffer(GLsizeiptr size, const void *data, GLbitfield flags);
+GLuint create_texture(GLenum target, GLsizei levels, GLenum internal_format, GLsizei width, GLsizei height, GLsizei depth);
+void set_texture_sampling(GLuint texture, GLenum min_filter, GLenum mag_filter, GLenum wrap);
+GLuint create_vertex_array(GLuint vertex_buffer, GLsizei stride, const VertexAttrib *attribs, int attrib_count, GLuint index_buffer);
+void init_stream_buffer(StreamBuffer *buffer, GLsizeiptr frame_size);
+void *next_stream_frame(StreamBuffer *buffer);
+GLintptr stream_frame_offset(const StreamBuffer *buffer);
+void destroy_stream_buffer(StreamBuffer *buffer);
+
+// flags are glBufferStorage's, 0 for data only the GPU touches from now on
+GLuint create_buffer(GLsizeiptr size, const void *data, GLbitfield flags)
+{
+    GLuint buffer;
+    glCreateBuffers(1, &buffer);
+    glNamedBufferStorage(buffer, size > 0 ? size : 1, data, flags);
+    return buffer;
+}
+
+// depth is the layer count for arrays and ignored for 2D textures
+GLuint create_texture(GLenum target, GLsizei levels, GLenum internal_format, GLsizei width, GLsizei height, GLsizei depth)
+{
+    GLuint texture;
+    glCreateTextures(target, 1, &texture);
+
+    if (target == GL_TEXTURE_2D_ARRAY || target == GL_TEXTURE_3D)
+        glTextureStorage3D(texture, levels, internal_format, width, height, depth);
+    else
+        glTextureStorage2D(texture, levels, internal_format, width, height);
+    return texture;
+}
+
+// for textures sampled without a sampler object bound next to them
+void set_texture_sampling(GLuint texture, GLenum min_filter, GLenum mag_filter, GLenum wrap)
+{
+    glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, (GLint) min_filter);
+    glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, (GLint) mag_filter);
+    glTextureParameteri(texture, GL_TEXTURE_WRAP_S, (GLint) wrap);
+    glTextureParameteri(texture, GL_TEXTURE_WRAP_T, (GLint) wrap);
+}
+
+// index_buffer may be 0 for unindexed draws
+GLuint create_vertex_array(GLuint vertex_buffer, GLsizei stride, const VertexAttrib *attribs, int attrib_count, GLuint index_buffer)
+{
+    GLuint vao;
+    glCreateVertexArrays(1, &vao);
+    glVertexArrayVertexBuffer(vao, 0, vertex_buffer, 0, stride);
+
+    for (int i = 0; i < attrib_count; i++)
+    {
+        const VertexAttrib *attrib = &attribs[i];
+        glEnableVertexArrayAttrib(vao, attrib->location);
+        glVertexArrayAttribFormat(vao, attrib->location, attrib->size, attrib->type, attrib->normalized, attrib->offset);
+        glVertexArrayAttribBinding(vao, attrib->location, 0);
+    }
+
+    if (index_buffer != 0)
+        glVertexArrayElementBuffer(vao, index_buffer);
+    return vao;
+}
+
+void init_stream_buffer(StreamBuffer *buffer, GLsizeiptr frame_size)
+{
+    buffer->frame_size = (frame_size + STREAM_BUFFER_ALIGNMENT - 1) / STREAM_BUFFER_ALIGNMENT * STREAM_BUFFER_ALIGNMENT;
+    buffer->frame = 0;
+    for (int i = 0; i < STREAM_BUFFER_FRAMES; i++)
+        buffer->fences[i] = NULL;
+
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    GLsizeiptr size = buffer->frame_size * STREAM_BUFFER_FRAMES;
+    buffer->id = create_buffer(size, NULL, flags);
+    buffer->memory = (unsigned char*)glMapNamedBufferRange(buffer->id, 0, size, flags);
+}
+
+// fences off the slice the last frame used and moves on to the next one,
+// waiting if the GPU hasn't finished with it yet. anything drawn from the
+// old slice has to be submitted before this is called
+void *next_stream_frame(StreamBuffer *buffer)
+{
+    if (buffer->fences[buffer->frame] != NULL)
+        glDeleteSync(buffer->fences[buffer->frame]);
+    buffer->fences[buffer->frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    buffer->frame = (buffer->frame + 1) % STREAM_BUFFER_FRAMES;
+    GLsync fence = buffer->fences[buffer->frame];
+    if (fence != NULL)
+    {
+        // a timeout only means the GPU is slow, the slice can't be reused until
+        // the fence has signaled. the flush only has to happen once
+        GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+        GLenum status;
+        while ((status = glClientWaitSync(fence, flags, STREAM_BUFFER_WAIT_NS)) == GL_TIMEOUT_EXPIRED)
+            flags = 0;
+        if (status == GL_WAIT_FAILED)
+            printf("Failed waiting on stream buffer %u\n", buffer->id);
+        glDeleteSync(fence);
+        buffer->fences[buffer->frame] = NULL;
+    }
+
+    return buffer->memory + stream_frame_offset(buffer);
+}
+
+// where the current slice starts, for binding ranges and indirect offsets
+GLintptr stream_frame_offset(const StreamBuffer *buffer)
+{
+    return (GLintptr) buffer->frame * buffer->frame_size;
+}
+
+void destroy_stream_buffer(StreamBuffer *buffer)
+{
+    for (int i = 0; i < STREAM_BUFFER_FRAMES; i++)
+    {
+        if (buffer->fences[i] != NULL)
+            glDeleteSync(buffer->fences[i]);
+        buffer->fences[i] = NULL;
+    }
+
+    if (buffer->id != 0)
+    {
+        glUnmapNamedBuffer(buffer->id);
+        glDeleteBuffers(1, &buffer->id);
+    }
+    buffer->id = 0;
+    buffer->memory = NULL;
+}
+
+#endif
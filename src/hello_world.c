@@ -1,16 +1,38 @@
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 
-// image loading
+// image loading, decode buffers come out of per-thread arenas
+#include "arena.h"
+#define STBI_MALLOC(size) arena_alloc(size)
+#define STBI_REALLOC(pointer, size) arena_realloc(pointer, size)
+#define STBI_FREE(pointer) arena_free(pointer)
 #define STB_IMAGE_IMPLEMENTATION
+#define STBI_JPEG_THREADS
 #include "stb_image/stb_image.h"
 
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
+#include "gl_loader.h"
+#include "gl_resources.h"
 #include "shader.h"
 #include "camera.h"
+#include "cooked_mesh.h"
+#include "profiler.h"
+#include "timestep.h"
+#include "jobs.h"
+#include "render_queue.h"
+#include "render_stats.h"
+#include "materials.h"
+#include "mesh.h"
+#include "mesh_import.h"
+#include "mesh_simplify.h"
+#include "meshlet.h"
+#include "texture_manager.h"
+#include "vertex_compress.h"
+#include "virtual_texture.h"
 
 #include <cglm/cglm.h>
 
@@ -33,11 +55,78 @@ float last_y = SCR_HEIGHT / 2.0f;
 bool first_mouse = true;
 
 // timing
-float delta = 0.0f;
-float last_frame = 0.0f;
-
-int main()
+double delta = 0.0;
+double last_frame = 0.0;
+
+// fixed timestep simulation, optionally on its own thread (--threaded-sim)
+Simulation sim;
+bool threaded_sim = false;
+
+// every texture and material in the scene (--no-bindless forces the texture array path,
+// --cpu-ycbcr decodes JPEGs to RGB on the CPU instead of converting their planes on the GPU)
+TextureLibrary texture_library;
+bool no_bindless = false;
+bool cpu_ycbcr = false;
+
+// keeps texture memory under budget (--texture-budget-mb N)
+TextureManager texture_manager;
+uint64_t texture_budget = TEXTURE_BUDGET_DEFAULT;
+
+// paged textures streamed by what's on screen (--virtual-texture IMAGE or
+// --virtual-tiles DIR WIDTH HEIGHT, --sparse for the ARB_sparse_texture backend)
+VirtualTextureSystem virtual_textures;
+Shader feedback_shader;
+const char *virtual_texture_path = NULL;
+const char *virtual_tiles_path = NULL;
+int virtual_tiles_width = 0;
+int virtual_tiles_height = 0;
+bool sparse_textures = false;
+
+// per-frame CPU work is spread over all cores, the main thread is worker 0
+JobSystem job_system;
+RenderQueue render_queue;
+
+// press P to dump a chrome://tracing capture of the last few seconds
+const char *TRACE_PATH = "profile_trace.json";
+bool trace_key_down = false;
+
+// rolling per-frame counters, appended to this file every few seconds
+const char *STATS_PATH = "render_stats.csv";
+
+// only the GL entry points the renderer calls are loaded (--full-gl-load for all of them)
+bool full_gl_load = false;
+
+// an OBJ, glTF, GLB or cooked .mesh drawn in place of the cube (--mesh)
+const char *mesh_path = NULL;
+
+int main(int argc, char **argv)
 {
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--threaded-sim") == 0)
+            threaded_sim = true;
+        if (strcmp(argv[i], "--no-bindless") == 0)
+            no_bindless = true;
+        if (strcmp(argv[i], "--cpu-ycbcr") == 0)
+            cpu_ycbcr = true;
+        if (strcmp(argv[i], "--texture-budget-mb") == 0 && i + 1 < argc)
+            texture_budget = strtoull(argv[++i], NULL, 10) << 20;
+        if (strcmp(argv[i], "--virtual-texture") == 0 && i + 1 < argc)
+            virtual_texture_path = argv[++i];
+        if (strcmp(argv[i], "--virtual-tiles") == 0 && i + 3 < argc)
+        {
+            virtual_tiles_path = argv[++i];
+            virtual_tiles_width = atoi(argv[++i]);
+            virtual_tiles_height = atoi(argv[++i]);
+        }
+        if (strcmp(argv[i], "--full-gl-load") == 0)
+            full_gl_load = true;
+        if (strcmp(argv[i], "--sparse") == 0)
+            sparse_textures = true;
+        if (strcmp(argv[i], "--mesh") == 0 && i + 1 < argc)
+            mesh_path = argv[++i];
+    }
+
     vec3 pos = { 0.0f, 0.0f, 10.0f };
     vec3 world_up = { 0.0f, 1.0f, 0.0f };
 
@@ -59,7 +148,10 @@ int main()
     glfwMakeContextCurrent(window);
  
     // initialize GLAD
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    bool gl_loaded = full_gl_load
+        ? gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)
+        : load_gl((GLADloadproc)glfwGetProcAddress);
+    if (!gl_loaded)
     {
         printf("Failed to initialize GLAD");
         return -1;
@@ -68,6 +160,10 @@ int main()
     // set viewport
     glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
 
+    // cpu scopes plus gpu timestamp queries
+    init_profiler(true);
+    init_render_stats(STATS_PATH);
+
     // capture cursor
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
@@ -94,11 +190,11 @@ int main()
 
     float vertices[] = {
         -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
-        0.5f, -0.5f, -0.5f,  1.0f, 0.0f,
         0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
+        0.5f, -0.5f, -0.5f,  1.0f, 0.0f,
         0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-        -0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
         -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
+        -0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
 
         -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
         0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
@@ -115,11 +211,11 @@ int main()
         -0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
 
         0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-        0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
         0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
+        0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
         0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-        0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
         0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
+        0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
 
         -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
         0.5f, -0.5f, -0.5f,  1.0f, 1.0f,
@@ -129,11 +225,11 @@ int main()
         -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
 
         -0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
-        0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
         0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
+        0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
         0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-        -0.5f,  0.5f,  0.5f,  0.0f, 0.0f,
-        -0.5f,  0.5f, -0.5f,  0.0f, 1.0f
+        -0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
+        -0.5f,  0.5f,  0.5f,  0.0f, 0.0f
     };
 
     vec3 cubePositions[] = {
@@ -149,152 +245,164 @@ int main()
         { -1.3f,  1.0f, -1.5f }  
     };
 
-    Shader shader;
-    init_shader(&shader, "src/shaders/vertex_shader.glsl", "src/shaders/fragment_shader.glsl");
-
-    // create a texture
-    unsigned int texture, texture2;
-    glGenTextures(1, &texture);
-
-    // bind the texture
-    glBindTexture(GL_TEXTURE_2D, texture);  
-
-    // set texture wrapping/filtering options on bound texture object
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-    // texture loading
-    int width, height, nrChannels;
-    stbi_set_flip_vertically_on_load(true);  
-    unsigned char *data = stbi_load("src/assets/grass.jpg", &width, &height, &nrChannels, 0);
-
-    if (data)
-    {
-        // generate the bound texture
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-
-        // generate mipmapped texture
-        glGenerateMipmap(GL_TEXTURE_2D);
-    }
-    else
+    // initial simulation state, cubes spin at a fixed rate instead of
+    // being driven straight off the wall clock
+    static SimState initial_state;
+    glm_vec3_copy(pos, initial_state.camera_position);
+    initial_state.object_count = 10;
+    for (unsigned int i = 0; i < 10; i++)
     {
-        printf("Failed to load texture!\n");
+        float angle = 20.0f * i;
+        initial_state.angles[i] = 0.0f;
+        initial_state.angular_velocity[i] = glm_rad(angle + 10);
     }
 
-    // free loaded image data
-    stbi_image_free(data);
-
-    // create a second texture
-    glGenTextures(1, &texture2);
+    init_job_system(&job_system, 0);
+    // big JPEGs loaded from here decode on as many threads as the job system
+    // has workers. only for this thread, loads on the workers and the loader
+    // threads stay on one so they never start threads of their own
+    stbi_set_jpeg_threads_thread((int) job_system.worker_count);
+    init_render_queue(&render_queue, SIM_MAX_OBJECTS);
+
+    init_simulation(&sim, &initial_state, SIM_TICK_RATE, glfwGetTime);
+    if (threaded_sim)
+        start_sim_thread(&sim);
+
+    // load every texture up front, the library decides between bindless
+    // handles and a texture array depending on what the driver supports
+    init_texture_library(&texture_library, !no_bindless, !cpu_ycbcr, (GLADloadproc)glfwGetProcAddress);
+
+    int grass = add_library_texture(&texture_library, "src/assets/grass.jpg");
+    int container = add_library_texture(&texture_library, "src/assets/container.jpg");
+    int pete = add_library_texture(&texture_library, "src/assets/pete.png");
+    int awesomeface = add_library_texture(&texture_library, "src/assets/awesomeface.png");
+    build_texture_library(&texture_library);
+
+    // filtering is picked per material, textures are shared between them
+    SamplerDesc pixelated = make_sampler_desc(SAMPLER_FILTER_NEAREST, GL_REPEAT, 1.0f);
+    SamplerDesc smooth = make_sampler_desc(SAMPLER_FILTER_ANISOTROPIC, GL_REPEAT, 8.0f);
+
+    unsigned int materials[] = {
+        add_material(&texture_library, grass, pete, 0.3f, &pixelated),
+        add_material(&texture_library, container, awesomeface, 0.3f, &smooth),
+        add_material(&texture_library, grass, awesomeface, 0.3f, &pixelated),
+        add_material(&texture_library, container, pete, 0.3f, &smooth)
+    };
 
-    // bind the texture
-    glBindTexture(GL_TEXTURE_2D, texture2);  
+    // a virtual texture stands in for the container on its material
+    if (virtual_texture_path != NULL || virtual_tiles_path != NULL)
+    {
+        init_virtual_textures(&virtual_textures, sparse_textures, SCR_WIDTH, SCR_HEIGHT, (GLADloadproc)glfwGetProcAddress);
+        int virtual_texture = virtual_tiles_path != NULL
+            ? add_virtual_texture_tiles(&virtual_textures, virtual_tiles_path, virtual_tiles_width, virtual_tiles_height)
+            : add_virtual_texture_image(&virtual_textures, virtual_texture_path);
+        set_material_virtual_texture(&texture_library, materials[1], virtual_texture);
+        init_shader(&feedback_shader, "src/shaders/vertex_shader.glsl", "src/shaders/vt_feedback_fragment_shader.glsl");
+    }
 
-    // set texture wrapping/filtering options on bound texture object
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    upload_materials(&texture_library);
+    init_texture_manager(&texture_manager, &texture_library, texture_budget);
 
-    // texture loading
-    // flip image vertically
-    stbi_set_flip_vertically_on_load(true);  
-    data = stbi_load("src/assets/pete.png", &width, &height, &nrChannels, 0);
+    // material per cube
+    unsigned int object_materials[10];
+    for (unsigned int i = 0; i < 10; i++)
+        object_materials[i] = materials[i % 4];
 
-    if (data)
+    Shader shader;
+    init_shader(&shader, "src/shaders/vertex_shader.glsl",
+        texture_library.bindless ? "src/shaders/fragment_shader_bindless.glsl" : "src/shaders/fragment_shader.glsl");
+
+    // the cube as an indexed mesh, welded from the triangles above and packed
+    // down to 20 bytes a vertex, see vertex_compress.h. uploaded into
+    // immutable buffers, with the index buffer recorded in the VAO. a mesh
+    // passed with --mesh takes its place: cooked .mesh files are mapped and
+    // uploaded as they are, anything else is imported on the job system.
+    // either way the render queue picks between its LODs per object, and the
+    // GPU culls each LOD meshlet by meshlet, see meshlet.h
+    GpuMesh cube;
+    bool loaded = false;
+    double load_start = glfwGetTime();
+    if (mesh_path != NULL && path_has_extension(mesh_path, ".mesh"))
     {
-        // generate the bound texture
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-
-        // generate mipmapped texture
-        glGenerateMipmap(GL_TEXTURE_2D);
+        CookedMesh cooked;
+        loaded = map_cooked_mesh(mesh_path, &cooked);
+        if (loaded)
+        {
+            upload_cooked_mesh(&cooked, &cube);
+            set_render_queue_mesh(&render_queue, cooked.lods[0].first_index, cooked.lods[0].index_count, (vec3*)cooked.header->bounds);
+            for (uint32_t lod = 1; lod < cooked.header->lod_count; lod++)
+                add_render_queue_lod(&render_queue, cooked.lods[lod].first_index, cooked.lods[lod].index_count, cooked.lods[lod].error);
+            for (uint32_t lod = 0; lod < cooked.header->lod_count; lod++)
+                set_render_queue_lod_meshlets(&render_queue, lod, cooked.lods[lod].first_meshlet, cooked.lods[lod].meshlet_count);
+            upload_render_queue_meshlets(&render_queue, cooked.meshlets, cooked.header->meshlet_count);
+            printf("Loaded %s in %.1f ms, %u vertices, %u triangles\n", mesh_path, (glfwGetTime() - load_start) * 1000.0,
+                cooked.header->vertex_count, cooked.lods[0].index_count / 3);
+            unmap_cooked_mesh(&cooked);
+        }
     }
-    else
+
+    if (!loaded)
     {
-        printf("Failed to load texture!\n");
+        Mesh cube_mesh;
+        PackedMesh packed_cube;
+        VertexCompressionError cube_error;
+        bool imported = mesh_path != NULL && !path_has_extension(mesh_path, ".mesh") && import_mesh(mesh_path, &cube_mesh);
+        if (imported)
+            printf("Imported %s in %.1f ms, %u vertices, %u triangles\n", mesh_path, (glfwGetTime() - load_start) * 1000.0,
+                cube_mesh.vertex_count, cube_mesh.index_count / 3);
+        else
+            mesh_from_triangle_soup(&cube_mesh, vertices, sizeof(vertices) / (5 * sizeof(float)));
+
+        unsigned int full_detail = cube_mesh.index_count;
+        build_mesh_lods(&cube_mesh);
+        build_mesh_meshlets(&cube_mesh);
+        print_mesh_lods(imported ? mesh_path : "cube", &cube_mesh);
+        print_mesh_meshlets(imported ? mesh_path : "cube", &cube_mesh);
+        compress_mesh(&cube_mesh, &packed_cube, &cube_error);
+        print_vertex_compression(imported ? mesh_path : "cube", &packed_cube, &cube_error);
+        upload_packed_mesh(&packed_cube, &cube);
+        set_render_queue_mesh(&render_queue, 0, full_detail, cube_mesh.bounds);
+        for (unsigned int lod = 1; lod < cube_mesh.lod_count; lod++)
+            add_render_queue_lod(&render_queue, cube_mesh.lods[lod].first_index, cube_mesh.lods[lod].index_count, cube_mesh.lods[lod].error);
+        for (unsigned int lod = 0; lod < cube_mesh.lod_count; lod++)
+            set_render_queue_lod_meshlets(&render_queue, lod, cube_mesh.lods[lod].first_meshlet, cube_mesh.lods[lod].meshlet_count);
+        upload_render_queue_meshlets(&render_queue, cube_mesh.meshlets, cube_mesh.meshlet_count);
+        free_packed_mesh(&packed_cube);
+        free_mesh(&cube_mesh);
     }
 
-    // free loaded image data
-    stbi_image_free(data);
-
-    unsigned int VBO, VAO, EBO;
-    // Vertex Buffer Object:
-    // store vertices in GPU memory for fast access
-    // create buffer with buffer ID of 1
-    glGenBuffers(1, &VBO); 
-
-    // bind the VBO to GL_ARRAY_BUFFER
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);  
-    // copy buffer into GPU memory
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-
-    // Element Buffer Object:
-    // store indices (draw order)
-    // will reduce overhead by not including duplicate vertices
-    // glGenBuffers(1, &EBO);
-
-    // bind the EBO to GL_ELEMENT_ARRAY_BUFFER
-    // glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-
-    // copy buffer into GPU memory
-    // glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW); 
-
-    // Vertex Array Object:
-    // used to store vertex attribute calls
-    // create VAO with ID of 1
-    glGenVertexArrays(1, &VAO);
-
-    // bind the VAO 
-    glBindVertexArray(VAO);
-
-    // position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-
-    // texture coord attribute
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(2);
-
-    // // specify how to interpret position in vertex shader
-    // // attribute params: location, size, data type, normalized (t/f), stride, offset
-    // glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    // // enable vertex attribute at position 0
-    // glEnableVertexAttribArray(0);
-
-    // // specify how to interpret color in vertex shader
-    // glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-    // // glEnableVertexAttribArray(1);
-
-    // // specify how to interpret texture coordinates
-    // glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-    // glEnableVertexAttribArray(2);
-
-    // call to glVertexAttribPointer registered VBO as the vertex attribute's bound
-    // therefore we can safely unbind VBO
-    glBindBuffer(GL_ARRAY_BUFFER, 0); 
-
-    // unbind the VAO to not accidentally modify it
-    // usually not needed since you need to call glBindVertexArray for this 
-    glBindVertexArray(0);
-
     // enable depth testing 
     glEnable(GL_DEPTH_TEST);
 
     // render loop
+    static SimState frame;
     while (!glfwWindowShouldClose(window))
     {
-        float current_frame = glfwGetTime();
+        profile_frame();
+        PROFILE_SCOPE("frame");
+
+        double current_frame = glfwGetTime();
         delta = current_frame - last_frame;
         last_frame = current_frame;
 
         // process inputs
+        profile_begin("input");
         process_input(window);
+        profile_end();
+
+        // run fixed ticks (no-op when the simulation has its own thread)
+        // and blend the last two states for this frame
+        profile_begin("simulation");
+        sim_update(&sim);
+        sim_interpolate(&sim, &frame);
+        glm_vec3_copy(frame.camera_position, camera.position);
+        profile_end();
 
         // perform rendering commands
+        gpu_profile_begin("clear");
         glClearColor(1.0f, 0.2f, 0.5f, 1.0);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        gpu_profile_end();
 
         // apply simple transformation
         // mat4 trans;
@@ -309,76 +417,108 @@ int main()
         // get clip coordinates using the formula:
         // vec_clip = mat_projection * mat_view * mat_model * vec_local
 
-        for(unsigned int i = 0; i < 10; i++)
-        {
-            mat4 model;
-            glm_mat4_identity(model);
-            glm_translate(model, cubePositions[i]);
-
-            float angle = 20.0f * i; 
-            glm_rotate(model, glm_rad(angle+10) * (float) glfwGetTime(), (vec3) { 1.0f, 0.3f, 0.5f });
-            
-            set_mat4(&shader, "model", model);
-            
-            glDrawArrays(GL_TRIANGLES, 0, 36);
-        }
-
-
-        mat4 model, view, projection;
-
-        // model matrix
-        glm_mat4_identity(model);
-        // glm_rotate(model, glm_rad(-55.0f), (vec3) { 1.0f, 0.0f, 0.0f }); 
-        glm_rotate(model, (float) glfwGetTime() * glm_rad(90.0f), (vec3) { 0.0f, 1.0f, 0.0f });  
+        mat4 view, projection, view_projection;
 
         // old view matrix
         // glm_mat4_identity(view);
         // glm_translate(view, (vec3) { 0.0f, 0.0f, -3.0f });
 
         // projection matrix
-        glm_perspective(glm_rad(camera.zoom), (float) width / (float) (height), 0.1f, 100.0f, projection);
-
-        // set uniforms
-        int model_loc = glGetUniformLocation(shader.ID, "model");
-        glUniformMatrix4fv(model_loc, 1, GL_FALSE, *model);
+        glm_perspective(glm_rad(camera.zoom), (float) SCR_WIDTH / (float) SCR_HEIGHT, 0.1f, 100.0f, projection);
 
         // use camera for view
         get_view_matrix(&camera, view);
+        glm_mat4_mul(projection, view, view_projection);
+
+        // transforms, culling and command recording run on the job system
+        build_render_queue(&render_queue, &frame, cubePositions, object_materials, view_projection, &camera, (float) SCR_HEIGHT);
+        render_stats.frame.visible += render_queue.count;
+        render_stats.frame.culled += render_queue.culled;
+
+        // evict and stream texture mips against what's on screen
+        update_texture_manager(&texture_manager, &render_queue, &camera, (float) SCR_HEIGHT);
+
+        profile_begin("submit");
+        gpu_profile_begin("scene");
+
+        // use shaders
+        use_shader(&shader);
+        render_stats.frame.shader_switches++;
+        render_stats.frame.state_changes++;
+
+        // set uniforms
         int view_loc = glGetUniformLocation(shader.ID, "view");
         glUniformMatrix4fv(view_loc, 1, GL_FALSE, view[0]);
 
         int projection_loc = glGetUniformLocation(shader.ID, "projection");
         glUniformMatrix4fv(projection_loc, 1, GL_FALSE, *projection);
 
-        // use shaders
-        use_shader(&shader);
-
-        glUniform1i(glGetUniformLocation(shader.ID, "texture1"), 0); // setting uniform manually
-        set_int(&shader, "texture2", 1); // or with using the header function
+        // glUniform1i(glGetUniformLocation(shader.ID, "texture1"), 0); // setting uniform manually
+        // set_int(&shader, "texture2", 1); // or with using the header function
 
-        // bind textures
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texture);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, texture2);
+        // materials are looked up per draw, nothing to bind per texture
+        bind_texture_library(&texture_library, shader.ID);
+        bind_virtual_textures(&virtual_textures, shader.ID, texture_library.bindless ? 0 : texture_library.slot_count);
 
-        // bind VAO
-        glBindVertexArray(VAO);
+        // bind the VAO and the bounds its positions decode against
+        bind_gpu_mesh(&cube, shader.ID);
 
         // draw wireframe
         // glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
-        // do indexed drawing with new bound EBO
-        // glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        // glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+        // do indexed drawing, the EBO is part of the VAO
+        // glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+
+        // only GL submission is left on the main thread, all visible cubes
+        // go out in one multi-draw
+        submit_render_queue(&render_queue);
+
+        gpu_profile_end();
+        profile_end();
 
-        // glDrawArrays(GL_TRIANGLES, 0, 36);
+        // same draws again at low resolution, recording which pages they need
+        if (virtual_textures.count > 0)
+        {
+            gpu_profile_begin("vt_feedback");
+            begin_vt_feedback(&virtual_textures);
+
+            use_shader(&feedback_shader);
+            render_stats.frame.shader_switches++;
+            glUniformMatrix4fv(glGetUniformLocation(feedback_shader.ID, "view"), 1, GL_FALSE, view[0]);
+            glUniformMatrix4fv(glGetUniformLocation(feedback_shader.ID, "projection"), 1, GL_FALSE, *projection);
+            set_float(&feedback_shader, "vt_lod_bias", -log2f((float) VT_FEEDBACK_DIVISOR));
+            bind_virtual_textures(&virtual_textures, feedback_shader.ID, 0);
+            bind_gpu_mesh(&cube, feedback_shader.ID);
+            draw_render_queue(&render_queue);
+
+            end_vt_feedback(&virtual_textures);
+            gpu_profile_end();
+
+            update_virtual_textures(&virtual_textures);
+        }
 
         // swap buffers and poll events
+        profile_begin("swap");
         glfwPollEvents();
         glfwSwapBuffers(window);
+        profile_end();
+
+        end_stats_frame(delta, current_frame);
     }
 
+    stop_sim_thread(&sim);
+    finish_texture_streams(&texture_manager);
+    destroy_profiler();
+    destroy_render_stats();
+    destroy_render_queue(&render_queue);
+    destroy_gpu_mesh(&cube);
+    destroy_texture_library(&texture_library);
+    if (virtual_texture_path != NULL || virtual_tiles_path != NULL)
+        destroy_virtual_textures(&virtual_textures);
+    destroy_job_system(&job_system);
+    print_arena_stats();
+    release_thread_arena();
+
     glfwTerminate();
     return 0;
 }
@@ -413,14 +553,28 @@ void process_input(GLFWwindow *window)
         destroy_camera(&camera);
     }
 
-    // process WASD
+    // dump a trace once per key press
+    bool trace_key = glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS;
+    if (trace_key && !trace_key_down)
+        write_chrome_trace(TRACE_PATH);
+    trace_key_down = trace_key;
+
+    // process WASD, movement itself happens on the simulation tick
+    SimInput input;
+    input.keys = 0;
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-        process_keyboard(&camera, FORWARD, delta);
+        input.keys |= SIM_KEY_FORWARD;
     if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-        process_keyboard(&camera, BACKWARD, delta);
+        input.keys |= SIM_KEY_BACKWARD;
     if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-        process_keyboard(&camera, LEFT, delta);
+        input.keys |= SIM_KEY_LEFT;
     if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-        process_keyboard(&camera, RIGHT, delta);
+        input.keys |= SIM_KEY_RIGHT;
+
+    glm_vec3_copy(camera.front, input.front);
+    glm_vec3_copy(camera.right, input.right);
+    input.movement_speed = camera.movement_speed;
+
+    sim_set_input(&sim, &input);
 }
 
@@ -0,0 +1,913 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+// every heap allocation stb_image makes goes through these so each decode's
+// heap use can be counted. the size is kept in front of the block to track
+// what's live. the counts are atomic in case a decode thread allocates
+#define BENCH_ALLOC_HEADER 16
+
+typedef struct AllocCounters {
+    long allocations;
+    size_t live;
+    size_t peak;
+} AllocCounters;
+
+static AllocCounters alloc_counters;
+
+void count_allocation(size_t size)
+{
+    __atomic_add_fetch(&alloc_counters.allocations, 1, __ATOMIC_RELAXED);
+    size_t live = __atomic_add_fetch(&alloc_counters.live, size, __ATOMIC_RELAXED);
+    size_t peak = __atomic_load_n(&alloc_counters.peak, __ATOMIC_RELAXED);
+    while (live > peak && !__atomic_compare_exchange_n(&alloc_counters.peak, &peak, live, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+void *counted_malloc(size_t size)
+{
+    unsigned char *block = (unsigned char*)malloc(size + BENCH_ALLOC_HEADER);
+    if (block == NULL)
+        return NULL;
+
+    *(size_t*)block = size;
+    count_allocation(size);
+    return block + BENCH_ALLOC_HEADER;
+}
+
+void counted_free(void *pointer)
+{
+    if (pointer == NULL)
+        return;
+
+    unsigned char *block = (unsigned char*)pointer - BENCH_ALLOC_HEADER;
+    __atomic_sub_fetch(&alloc_counters.live, *(size_t*)block, __ATOMIC_RELAXED);
+    free(block);
+}
+
+// counted as a new allocation, stb_image mostly grows its buffers this way
+void *counted_realloc(void *pointer, size_t size)
+{
+    if (pointer == NULL)
+        return counted_malloc(size);
+
+    unsigned char *block = (unsigned char*)pointer - BENCH_ALLOC_HEADER;
+    size_t old_size = *(size_t*)block;
+    unsigned char *grown = (unsigned char*)realloc(block, size + BENCH_ALLOC_HEADER);
+    if (grown == NULL)
+        return NULL;
+
+    *(size_t*)grown = size;
+    __atomic_sub_fetch(&alloc_counters.live, old_size, __ATOMIC_RELAXED);
+    count_allocation(size);
+    return grown + BENCH_ALLOC_HEADER;
+}
+
+// the same arenas as the scene's loads, with their heap use counted
+#define ARENA_HEAP_MALLOC(size) counted_malloc(size)
+#define ARENA_HEAP_REALLOC(pointer, size) counted_realloc(pointer, size)
+#define ARENA_HEAP_FREE(pointer) counted_free(pointer)
+#include "arena.h"
+
+// image loading
+#define STBI_MALLOC(size) arena_alloc(size)
+#define STBI_REALLOC(pointer, size) arena_realloc(pointer, size)
+#define STBI_FREE(pointer) arena_free(pointer)
+#define STB_IMAGE_IMPLEMENTATION
+#define STBI_JPEG_THREADS
+#include "stb_image/stb_image.h"
+
+#include "image_stream.h"
+#include "bench_corpus.h"
+
+// benchmark defaults
+#define BENCH_ITERATIONS 10
+// stop repeating a decode once it's taken this long in total
+#define BENCH_MODE_SECONDS 2.0
+#define BENCH_KERNEL_ROUNDS 100000
+// dequantized coefficients of a well-formed 8-bit JPEG stay within this
+#define BENCH_COEFF_RANGE 1024
+#define BENCH_MAX_FILES 256
+#define BENCH_STREAM_CHUNK 4096
+// width and height of the generated images, 0 leaves them out
+#define BENCH_GENERATED_SIZE 2048
+#define BENCH_GENERATED_COUNT 4
+// decodes in arena scopes per file. the first can overflow and the second grow
+// the arena, the last should stay off the heap
+#define BENCH_ARENA_DECODES 3
+
+// decodes each file from memory through stbi_load, stbi_load_16 and
+// stbi_loadf and reports the throughput, peak heap use and allocation count
+// of each, with totals per format at the end. JPEGs are also decoded with
+// every kernel level the CPU has and then on several threads, and checked to
+// match, and their raw YCbCr planes are timed against a full decode. every
+// file is also streamed in small chunks to check the bands add up to the
+// normal decode, and decoded in arena scopes to check repeat loads stay off
+// the heap. pass files or directories of them to decode, or run it from the
+// repo root to use the scene's textures. large generated JPEG, PNG and HDR
+// images are added unless --size is 0, and --json writes the results out for
+// comparing runs
+
+static const char *simd_names[] = { "auto", "none", "sse2", "avx2" };
+
+typedef enum BenchMode {
+    BENCH_LOAD_8,
+    BENCH_LOAD_16,
+    BENCH_LOAD_FLOAT,
+    BENCH_MODE_COUNT
+} BenchMode;
+
+static const char *mode_names[] = { "load_8", "load_16", "loadf" };
+
+typedef enum BenchFormat {
+    BENCH_JPEG,
+    BENCH_PNG,
+    BENCH_HDR,
+    BENCH_OTHER,
+    BENCH_FORMAT_COUNT
+} BenchFormat;
+
+static const char *format_names[] = { "jpeg", "png", "hdr", "other" };
+
+// allocations and peak are from one decode, the time is the best of all of them
+typedef struct ModeResult {
+    double seconds;
+    size_t peak_bytes;
+    long allocations;
+} ModeResult;
+
+typedef struct FileResult {
+    const char *name;
+    BenchFormat format;
+    int width;
+    int height;
+    int size;
+    bool ok;
+    ModeResult modes[BENCH_MODE_COUNT];
+    long arena_heap_allocations;
+} FileResult;
+
+// peak is the largest of any file, allocations are summed
+typedef struct FormatTotals {
+    int files;
+    double pixels;
+    double bytes;
+    double seconds[BENCH_MODE_COUNT];
+    size_t peak_bytes[BENCH_MODE_COUNT];
+    long allocations[BENCH_MODE_COUNT];
+} FormatTotals;
+
+double bench_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+unsigned char *read_file(const char *path, int *size)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return NULL;
+
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    unsigned char *data = (unsigned char*)malloc(length > 0 ? length : 1);
+    if (data != NULL && fread(data, 1, length, file) != (size_t) length)
+    {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+
+    *size = (int) length;
+    return data;
+}
+
+// best of a few runs, so one slow decode doesn't skew the result
+double time_decode(const unsigned char *data, int size, int threads, int iterations, unsigned char **pixels, int *width, int *height)
+{
+    double best = 1e30;
+    stbi_set_jpeg_threads(threads);
+
+    for (int i = 0; i < iterations; i++)
+    {
+        int channels;
+        double start = bench_time();
+        unsigned char *decoded = stbi_load_from_memory(data, size, width, height, &channels, 4);
+        double elapsed = bench_time() - start;
+
+        if (decoded == NULL)
+            return -1.0;
+
+        if (elapsed < best)
+            best = elapsed;
+
+        if (i == 0 && pixels != NULL)
+            *pixels = decoded;
+        else
+            stbi_image_free(decoded);
+    }
+
+    return best;
+}
+
+// levels that exist on this machine, lowest first
+int available_simd_levels(int *levels)
+{
+    int count = 0;
+    for (int level = STBI_simd_none; level <= STBI_simd_avx2; level++)
+    {
+        stbi_set_jpeg_simd(level);
+        if (stbi_jpeg_simd() == level)
+            levels[count++] = level;
+    }
+    stbi_set_jpeg_simd(STBI_simd_auto);
+    return count;
+}
+
+bool bench_jpeg_file(const char *path, const unsigned char *data, int size, int threads, int iterations)
+{
+    int levels[4];
+    int level_count = available_simd_levels(levels);
+
+    unsigned char *pixels[4] = { NULL, NULL, NULL, NULL };
+    double times[4];
+    unsigned char *threaded = NULL;
+    int width = 0, height = 0;
+    bool ok = true;
+
+    for (int i = 0; i < level_count; i++)
+    {
+        stbi_set_jpeg_simd(levels[i]);
+        times[i] = time_decode(data, size, 1, iterations, &pixels[i], &width, &height);
+        ok &= times[i] > 0.0;
+    }
+
+    stbi_set_jpeg_simd(STBI_simd_auto);
+    double threaded_time = time_decode(data, size, threads, iterations, &threaded, &width, &height);
+    ok &= threaded_time > 0.0;
+
+    if (!ok)
+        printf("%s: decode failed: %s\n", path, stbi_failure_reason());
+
+    // every SIMD level has to agree exactly, and so does the threaded decode.
+    // the scalar color conversion rounds differently so it's only timed
+    bool match = ok;
+    size_t bytes = (size_t) width * height * 4;
+    for (int i = 0; ok && i < level_count; i++)
+    {
+        if (levels[i] != STBI_simd_none && memcmp(pixels[i], pixels[level_count - 1], bytes) != 0)
+            match = false;
+    }
+    if (ok && memcmp(threaded, pixels[level_count - 1], bytes) != 0)
+        match = false;
+
+    if (ok)
+    {
+        double mpix = (double) width * height / 1e6;
+        printf("%-36s %5dx%-5d", path, width, height);
+        for (int i = 0; i < level_count; i++)
+            printf("  %s %7.1f", simd_names[levels[i]], mpix / times[i]);
+        printf("  %d threads %7.1f MPix/s  %s\n", threads, mpix / threaded_time, match ? "match" : "MISMATCH");
+    }
+
+    for (int i = 0; i < level_count; i++)
+    {
+        if (pixels[i] != NULL)
+            stbi_image_free(pixels[i]);
+    }
+    if (threaded != NULL)
+        stbi_image_free(threaded);
+
+    return match;
+}
+
+// raw planes for converting on the GPU against a full decode. the luma plane
+// has to be what a greyscale decode gives
+bool bench_jpeg_planes(const char *path, const unsigned char *data, int size, int threads, int iterations)
+{
+    stbi_set_jpeg_threads(threads);
+    double best = 1e30;
+    stbi_jpeg_planes planes;
+    memset(&planes, 0, sizeof(planes));
+
+    for (int i = 0; i < iterations; i++)
+    {
+        stbi_jpeg_planes_free(&planes);
+        double start = bench_time();
+        bool loaded = stbi_load_jpeg_planes_from_memory(data, size, &planes);
+        double elapsed = bench_time() - start;
+
+        if (!loaded)
+        {
+            // RGB and CMYK files have nothing to hand to the GPU
+            printf("%-36s planes  %s\n", path, stbi_failure_reason());
+            return true;
+        }
+        if (elapsed < best)
+            best = elapsed;
+    }
+
+    int width, height, channels;
+    double rgba_time = time_decode(data, size, threads, iterations, NULL, &width, &height);
+    unsigned char *grey = stbi_load_from_memory(data, size, &width, &height, &channels, 1);
+    bool match = grey != NULL && width == planes.plane_w[0] && height == planes.plane_h[0]
+        && memcmp(grey, planes.plane[0], (size_t) width * height) == 0;
+
+    size_t plane_bytes = 0;
+    for (int k = 0; k < planes.plane_count; k++)
+        plane_bytes += (size_t) planes.plane_w[k] * planes.plane_h[k];
+
+    double mpix = (double) planes.width * planes.height / 1e6;
+    printf("%-36s planes %7.1f MPix/s (rgba %7.1f), %.2f bytes per pixel to upload  %s\n", path, mpix / best,
+        rgba_time > 0.0 ? mpix / rgba_time : 0.0, plane_bytes / (mpix * 1e6), match ? "match" : "MISMATCH");
+
+    if (grey != NULL)
+        stbi_image_free(grey);
+    stbi_jpeg_planes_free(&planes);
+    return match;
+}
+
+BenchFormat image_format(const unsigned char *data, int size)
+{
+    if (size >= 2 && data[0] == 0xFF && data[1] == 0xD8)
+        return BENCH_JPEG;
+    if (size >= 8 && memcmp(data, "\x89PNG\r\n\x1a\n", 8) == 0)
+        return BENCH_PNG;
+    if ((size >= 10 && memcmp(data, "#?RADIANCE", 10) == 0) || (size >= 6 && memcmp(data, "#?RGBE", 6) == 0))
+        return BENCH_HDR;
+    return BENCH_OTHER;
+}
+
+// single threaded, so the counts are the same from run to run. slow paths
+// like float loads of JPEGs get fewer runs
+bool measure_mode(const unsigned char *data, int size, BenchMode mode, int iterations, ModeResult *result, int *width, int *height)
+{
+    stbi_set_jpeg_threads(1);
+    result->seconds = 1e30;
+    double total = 0.0;
+
+    for (int i = 0; i < iterations && total < BENCH_MODE_SECONDS; i++)
+    {
+        size_t live = __atomic_load_n(&alloc_counters.live, __ATOMIC_RELAXED);
+        long allocations = __atomic_load_n(&alloc_counters.allocations, __ATOMIC_RELAXED);
+        __atomic_store_n(&alloc_counters.peak, live, __ATOMIC_RELAXED);
+
+        int channels;
+        void *decoded;
+        double start = bench_time();
+        if (mode == BENCH_LOAD_8)
+            decoded = stbi_load_from_memory(data, size, width, height, &channels, 4);
+        else if (mode == BENCH_LOAD_16)
+            decoded = stbi_load_16_from_memory(data, size, width, height, &channels, 4);
+        else
+            decoded = stbi_loadf_from_memory(data, size, width, height, &channels, 4);
+        double elapsed = bench_time() - start;
+
+        if (decoded == NULL)
+            return false;
+
+        if (i == 0)
+        {
+            result->peak_bytes = __atomic_load_n(&alloc_counters.peak, __ATOMIC_RELAXED) - live;
+            result->allocations = __atomic_load_n(&alloc_counters.allocations, __ATOMIC_RELAXED) - allocations;
+        }
+        if (elapsed < result->seconds)
+            result->seconds = elapsed;
+        total += elapsed;
+
+        stbi_image_free(decoded);
+    }
+
+    return true;
+}
+
+// PNG and HDR decode is mostly unpacking, so report the compressed rate too
+bool bench_modes(const unsigned char *data, int size, int iterations, FileResult *result)
+{
+    for (int mode = 0; mode < BENCH_MODE_COUNT; mode++)
+    {
+        ModeResult *measured = &result->modes[mode];
+        if (!measure_mode(data, size, (BenchMode) mode, iterations, measured, &result->width, &result->height))
+        {
+            printf("%s: %s failed: %s\n", result->name, mode_names[mode], stbi_failure_reason());
+            return false;
+        }
+
+        double mpix = (double) result->width * result->height / 1e6;
+        printf("%-36s %5dx%-5d  %-7s %7.1f MPix/s  %7.1f MB/s in  peak %7.2f MB  %4ld allocs\n", result->name,
+            result->width, result->height, mode_names[mode], mpix / measured->seconds, size / 1e6 / measured->seconds,
+            measured->peak_bytes / 1e6, measured->allocations);
+    }
+    return true;
+}
+
+bool check_stream(const char *path, const unsigned char *data, int size, bool flip)
+{
+    ImageStream stream;
+    if (!begin_image_stream(&stream, 0, flip))
+        return false;
+
+    unsigned char *canvas = NULL;
+    int bands = 0, previews = 0, first_band_bytes = -1;
+    bool ok = true;
+
+    int fed = 0;
+    while (!image_stream_finished(&stream))
+    {
+        if (fed < size)
+        {
+            int chunk = size - fed < BENCH_STREAM_CHUNK ? size - fed : BENCH_STREAM_CHUNK;
+            feed_image_stream(&stream, data + fed, chunk);
+            fed += chunk;
+            if (fed == size)
+                end_image_stream_input(&stream);
+        }
+
+        // takes every band the decoder gets out of what's been fed, so the
+        // first band can be pinned to how much of the file it took
+        ImageBand band;
+        while (wait_image_band(&stream, &band))
+        {
+            size_t row_bytes = (size_t) band.width * band.channels;
+            if (canvas == NULL)
+                canvas = (unsigned char*)calloc(row_bytes, band.height);
+            if (first_band_bytes < 0)
+                first_band_bytes = fed;
+
+            if (canvas != NULL && band.first_row >= 0 && band.first_row + band.row_count <= band.height)
+                memcpy(canvas + row_bytes * band.first_row, band.pixels, row_bytes * band.row_count);
+            else
+                ok = false;
+
+            bands++;
+            previews += band.preview;
+            free_image_band(&band);
+        }
+    }
+
+    int width, height, channels;
+    unsigned char *pixels = finish_image_stream(&stream, &width, &height, &channels);
+
+    stbi_set_flip_vertically_on_load(flip);
+    int expected_width, expected_height, expected_channels;
+    unsigned char *expected = stbi_load_from_memory(data, size, &expected_width, &expected_height, &expected_channels, 0);
+    stbi_set_flip_vertically_on_load(false);
+
+    size_t bytes = (size_t) width * height * channels;
+    ok &= pixels != NULL && expected != NULL && canvas != NULL && width == expected_width && height == expected_height;
+    ok &= ok && memcmp(pixels, expected, bytes) == 0 && memcmp(canvas, expected, bytes) == 0;
+
+    if (!flip)
+        printf("%-36s stream %4d bands (%d previews), first after %3d%% of the file  %s\n", path, bands, previews,
+            size > 0 && first_band_bytes >= 0 ? (int) (100.0 * first_band_bytes / size) : 100, ok ? "match" : "MISMATCH");
+
+    if (pixels != NULL)
+        stbi_image_free(pixels);
+    if (expected != NULL)
+        stbi_image_free(expected);
+    free(canvas);
+    return ok;
+}
+
+// threaded like the scene's loads, so the JPEG workers' buffers are covered
+bool check_arena(const unsigned char *data, int size, int threads, FileResult *result)
+{
+    int width, height, channels;
+    stbi_set_jpeg_threads(threads);
+    unsigned char *expected = stbi_load_from_memory(data, size, &width, &height, &channels, 4);
+    if (expected == NULL)
+        return false;
+
+    bool match = true;
+    long heap_start = 0;
+    for (int i = 0; i < BENCH_ARENA_DECODES; i++)
+    {
+        if (i == BENCH_ARENA_DECODES - 1)
+            heap_start = __atomic_load_n(&alloc_counters.allocations, __ATOMIC_RELAXED);
+
+        begin_arena_scope();
+        unsigned char *pixels = (unsigned char*)end_arena_scope(stbi_load_from_memory(data, size, &width, &height, &channels, 4));
+        match &= pixels != NULL && memcmp(pixels, expected, (size_t) width * height * 4) == 0;
+        stbi_image_free(pixels);
+    }
+    stbi_image_free(expected);
+
+    result->arena_heap_allocations = __atomic_load_n(&alloc_counters.allocations, __ATOMIC_RELAXED) - heap_start;
+    printf("%-36s arena  %ld heap allocations once warm  %s\n", result->name, result->arena_heap_allocations,
+        match ? "match" : "MISMATCH");
+    return match;
+}
+
+bool bench_data(const char *name, const unsigned char *data, int size, int threads, int iterations, FileResult *result)
+{
+    memset(result, 0, sizeof(FileResult));
+    result->name = name;
+    result->format = image_format(data, size);
+    result->size = size;
+
+    bool ok = true;
+    if (result->format == BENCH_JPEG)
+        ok = bench_jpeg_file(name, data, size, threads, iterations)
+            && bench_jpeg_planes(name, data, size, threads, iterations);
+
+    ok = bench_modes(data, size, iterations, result) && ok;
+    if (ok)
+        ok = check_stream(name, data, size, false) && check_stream(name, data, size, true);
+    if (ok)
+        ok = check_arena(data, size, threads, result);
+
+    result->ok = ok;
+    return ok;
+}
+
+bool bench_path(const char *path, int threads, int iterations, FileResult *result)
+{
+    int size;
+    unsigned char *data = read_file(path, &size);
+    if (data == NULL)
+    {
+        printf("Failed to read %s\n", path);
+        memset(result, 0, sizeof(FileResult));
+        result->name = path;
+        result->format = BENCH_OTHER;
+        return false;
+    }
+
+    bool ok = bench_data(path, data, size, threads, iterations, result);
+    free(data);
+    return ok;
+}
+
+// the same image made by each encoder, big enough that per-file overhead
+// doesn't hide the decoder's throughput
+bool bench_generated(int index, int generated_size, int threads, int iterations, FileResult *result)
+{
+    static const char *names[BENCH_GENERATED_COUNT] = {
+        "generated/ycbcr420.jpg",
+        "generated/rgba8.png",
+        "generated/rgb16.png",
+        "generated/rgbe.hdr"
+    };
+
+    int size = 0;
+    unsigned char *data;
+    if (index == 0)
+        data = generate_corpus_jpeg(generated_size, generated_size, &size);
+    else if (index == 1)
+        data = generate_corpus_png(generated_size, generated_size, 4, 8, &size);
+    else if (index == 2)
+        data = generate_corpus_png(generated_size, generated_size, 3, 16, &size);
+    else
+        data = generate_corpus_hdr(generated_size, generated_size, &size);
+
+    if (data == NULL)
+    {
+        memset(result, 0, sizeof(FileResult));
+        result->name = names[index];
+        result->format = BENCH_OTHER;
+        return false;
+    }
+
+    bool ok = bench_data(names[index], data, size, threads, iterations, result);
+    free(data);
+    return ok;
+}
+
+// the bench is also the file with the stb_image implementation, so it can
+// call the kernels directly and check them against each other on random input
+bool validate_kernels(void)
+{
+    int idct_failures = 0, upsample_failures = 0, color_failures = 0, unfilter_failures = 0;
+    srand(1);
+
+    for (int round = 0; round < BENCH_KERNEL_ROUNDS; round++)
+    {
+        STBI_SIMD_ALIGN(short, coeffs[64]);
+        STBI_SIMD_ALIGN(short, block[64]);
+        unsigned char reference[64], result[64];
+
+        // mostly zeros past the low frequencies, like real blocks
+        for (int i = 0; i < 64; i++)
+            coeffs[i] = (i < 10 || rand() % 8 == 0) ? (short) (rand() % (2 * BENCH_COEFF_RANGE + 1) - BENCH_COEFF_RANGE) : 0;
+
+        memcpy(block, coeffs, sizeof(block));
+        stbi__idct_block(reference, 8, block);
+#ifdef STBI_SSE2
+        memcpy(block, coeffs, sizeof(block));
+        stbi__idct_simd(result, 8, block);
+        idct_failures += memcmp(reference, result, 64) != 0;
+#endif
+#ifdef STBI_AVX2
+        if (stbi__avx2_available())
+        {
+            memcpy(block, coeffs, sizeof(block));
+            stbi__idct_avx2(result, 8, block);
+            idct_failures += memcmp(reference, result, 64) != 0;
+        }
+#endif
+    }
+
+    for (int round = 0; round < BENCH_KERNEL_ROUNDS / 10; round++)
+    {
+        stbi_uc near[256], far[256], y[256], cb[256], cr[256];
+        stbi_uc reference[1024], result[1024];
+        int w = 1 + rand() % 200;
+
+        // the upsamplers read one pixel past the end, like the decoder's padded rows
+        for (int i = 0; i < 256; i++)
+        {
+            near[i] = (stbi_uc) rand();
+            far[i] = (stbi_uc) rand();
+            y[i] = (stbi_uc) rand();
+            cb[i] = (stbi_uc) rand();
+            cr[i] = (stbi_uc) rand();
+        }
+
+        stbi__resample_row_hv_2(reference, near, far, w, 2);
+#ifdef STBI_SSE2
+        stbi__resample_row_hv_2_simd(result, near, far, w, 2);
+        upsample_failures += memcmp(reference, result, w * 2) != 0;
+#endif
+#ifdef STBI_AVX2
+        if (stbi__avx2_available())
+        {
+            stbi__resample_row_hv_2_avx2(result, near, far, w, 2);
+            upsample_failures += memcmp(reference, result, w * 2) != 0;
+
+            // checked against sse2, the scalar version rounds differently
+            for (int step = 3; step <= 4; step++)
+            {
+                stbi__YCbCr_to_RGB_simd(reference, y, cb, cr, w, step);
+                stbi__YCbCr_to_RGB_avx2(result, y, cb, cr, w, step);
+                color_failures += memcmp(reference, result, w * step) != 0;
+            }
+        }
+#endif
+    }
+
+#ifdef STBI_SSE2
+    for (int round = 0; round < BENCH_KERNEL_ROUNDS / 10; round++)
+    {
+        // 8-bit RGB or RGBA rows, optionally RGB expanded to RGBA
+        stbi_uc prior[4 * 65], raw[4 * 65], reference[4 * 65], result[4 * 65];
+        int img_n = 3 + rand() % 2;
+        int out_n = img_n == 3 && rand() % 2 ? 4 : img_n;
+        int filter = STBI__F_sub + rand() % 4;
+        int pixels = 1 + rand() % 64;
+        if (filter == STBI__F_up)
+            out_n = img_n;
+
+        for (int i = 0; i < 4 * 65; i++)
+        {
+            prior[i] = (stbi_uc) rand();
+            raw[i] = (stbi_uc) rand();
+            reference[i] = result[i] = (stbi_uc) rand();
+        }
+        if (out_n != img_n)
+            reference[3] = result[3] = 255;
+
+        for (int i = 1; i <= pixels; i++)
+        {
+            for (int k = 0; k < img_n; k++)
+            {
+                int left = reference[(i - 1) * out_n + k];
+                int up = prior[i * out_n + k];
+                int corner = prior[(i - 1) * out_n + k];
+                int predicted = filter == STBI__F_sub ? left
+                    : filter == STBI__F_up ? up
+                    : filter == STBI__F_avg ? (left + up) >> 1
+                    : stbi__paeth(left, up, corner);
+                reference[i * out_n + k] = (stbi_uc) (raw[(i - 1) * img_n + k] + predicted);
+            }
+            if (out_n != img_n)
+                reference[i * out_n + 3] = 255;
+        }
+
+        if (filter == STBI__F_up)
+            stbi__png_unfilter_up_simd(result + out_n, prior + out_n, raw, pixels * img_n);
+        else
+            stbi__png_unfilter_row_simd(filter, result + out_n, prior + out_n, raw, pixels, img_n, out_n);
+        unfilter_failures += memcmp(reference, result, (size_t) (pixels + 1) * out_n) != 0;
+    }
+#endif
+
+    printf("kernels (%s): idct %s, upsample %s, color %s, png unfilter %s\n", simd_names[stbi_jpeg_simd()],
+        idct_failures ? "MISMATCH" : "ok", upsample_failures ? "MISMATCH" : "ok", color_failures ? "MISMATCH" : "ok",
+        unfilter_failures ? "MISMATCH" : "ok");
+    return idct_failures == 0 && upsample_failures == 0 && color_failures == 0 && unfilter_failures == 0;
+}
+
+// a directory adds every file in it, so a whole corpus can be passed at once
+void add_path(const char *path, char **files, int *file_count)
+{
+    struct stat info;
+    DIR *dir = stat(path, &info) == 0 && S_ISDIR(info.st_mode) ? opendir(path) : NULL;
+    if (dir == NULL)
+    {
+        if (*file_count < BENCH_MAX_FILES)
+            files[(*file_count)++] = strdup(path);
+        return;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL && *file_count < BENCH_MAX_FILES)
+    {
+        if (entry->d_name[0] == '.')
+            continue;
+
+        char *file = (char*)malloc(strlen(path) + strlen(entry->d_name) + 2);
+        sprintf(file, "%s/%s", path, entry->d_name);
+        if (stat(file, &info) == 0 && S_ISREG(info.st_mode))
+            files[(*file_count)++] = file;
+        else
+            free(file);
+    }
+    closedir(dir);
+}
+
+void add_format_totals(FormatTotals *totals, const FileResult *result)
+{
+    if (!result->ok)
+        return;
+
+    FormatTotals *format = &totals[result->format];
+    format->files++;
+    format->pixels += (double) result->width * result->height;
+    format->bytes += result->size;
+    for (int mode = 0; mode < BENCH_MODE_COUNT; mode++)
+    {
+        format->seconds[mode] += result->modes[mode].seconds;
+        if (result->modes[mode].peak_bytes > format->peak_bytes[mode])
+            format->peak_bytes[mode] = result->modes[mode].peak_bytes;
+        format->allocations[mode] += result->modes[mode].allocations;
+    }
+}
+
+void print_format_totals(const FormatTotals *totals)
+{
+    for (int format = 0; format < BENCH_FORMAT_COUNT; format++)
+    {
+        const FormatTotals *total = &totals[format];
+        for (int mode = 0; mode < BENCH_MODE_COUNT && total->files > 0; mode++)
+            printf("%-5s %3d files  %-7s %7.1f MPix/s  %7.1f MB/s in  peak %7.2f MB  %6.1f allocs per decode\n",
+                format_names[format], total->files, mode_names[mode], total->pixels / 1e6 / total->seconds[mode],
+                total->bytes / 1e6 / total->seconds[mode], total->peak_bytes[mode] / 1e6,
+                (double) total->allocations[mode] / total->files);
+    }
+}
+
+void write_json_string(FILE *file, const char *text)
+{
+    fputc('"', file);
+    for (; *text; text++)
+    {
+        if (*text == '"' || *text == '\\')
+            fprintf(file, "\\%c", *text);
+        else if ((unsigned char) *text < 0x20)
+            fprintf(file, "\\u%04x", *text);
+        else
+            fputc(*text, file);
+    }
+    fputc('"', file);
+}
+
+// one line per file and format so runs can be diffed, the counts are exact
+// and only the rates should move between runs on the same machine
+bool write_bench_json(const char *path, const FileResult *results, int result_count, const FormatTotals *totals,
+    int iterations, int generated_size, bool ok)
+{
+    FILE *file = fopen(path, "w");
+    if (file == NULL)
+    {
+        printf("Failed to open %s\n", path);
+        return false;
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    fprintf(file, "{\n  \"simd\": \"%s\",\n  \"iterations\": %d,\n  \"generated_size\": %d,\n", simd_names[stbi_jpeg_simd()],
+        iterations, generated_size);
+    fprintf(file, "  \"max_rss_kb\": %ld,\n  \"ok\": %s,\n  \"files\": [\n", usage.ru_maxrss, ok ? "true" : "false");
+
+    for (int i = 0; i < result_count; i++)
+    {
+        const FileResult *result = &results[i];
+        double mpix = (double) result->width * result->height / 1e6;
+        fprintf(file, "    { \"name\": ");
+        write_json_string(file, result->name);
+        fprintf(file, ", \"format\": \"%s\", \"width\": %d, \"height\": %d, \"bytes\": %d, \"ok\": %s", format_names[result->format],
+            result->width, result->height, result->size, result->ok ? "true" : "false");
+        for (int mode = 0; mode < BENCH_MODE_COUNT; mode++)
+        {
+            const ModeResult *measured = &result->modes[mode];
+            fprintf(file, ", \"%s\": { \"mpix_per_s\": %.1f, \"peak_bytes\": %zu, \"allocations\": %ld }", mode_names[mode],
+                measured->seconds > 0.0 ? mpix / measured->seconds : 0.0, measured->peak_bytes, measured->allocations);
+        }
+        fprintf(file, ", \"arena_heap_allocations\": %ld }%s\n", result->arena_heap_allocations, i + 1 < result_count ? "," : "");
+    }
+
+    fprintf(file, "  ],\n  \"formats\": {\n");
+    bool first = true;
+    for (int format = 0; format < BENCH_FORMAT_COUNT; format++)
+    {
+        const FormatTotals *total = &totals[format];
+        if (total->files == 0)
+            continue;
+
+        fprintf(file, "%s    \"%s\": { \"files\": %d", first ? "" : ",\n", format_names[format], total->files);
+        for (int mode = 0; mode < BENCH_MODE_COUNT; mode++)
+            fprintf(file, ", \"%s\": { \"mpix_per_s\": %.1f, \"mb_per_s_in\": %.1f, \"peak_bytes\": %zu, \"allocations\": %ld }",
+                mode_names[mode], total->pixels / 1e6 / total->seconds[mode], total->bytes / 1e6 / total->seconds[mode],
+                total->peak_bytes[mode], total->allocations[mode]);
+        fprintf(file, " }");
+        first = false;
+    }
+    fprintf(file, "%s  }\n}\n", first ? "" : "\n");
+
+    fclose(file);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    static const char *default_files[] = {
+        "src/assets/container.jpg",
+        "src/assets/grass.jpg",
+        "src/assets/awesomeface.png",
+        "src/assets/pete.png"
+    };
+
+    int threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    int iterations = BENCH_ITERATIONS;
+    int generated_size = BENCH_GENERATED_SIZE;
+    const char *json_path = NULL;
+    char *files[BENCH_MAX_FILES];
+    int file_count = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc)
+            iterations = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+            generated_size = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+            json_path = argv[++i];
+        else
+            add_path(argv[i], files, &file_count);
+    }
+
+    if (file_count == 0)
+    {
+        for (int i = 0; i < 4; i++)
+            add_path(default_files[i], files, &file_count);
+    }
+
+    if (threads < 2)
+        threads = 2;
+    if (iterations < 1)
+        iterations = 1;
+    // run-length HDR scanlines have to be 8 to 32767 wide
+    if (generated_size < 0)
+        generated_size = 0;
+    if (generated_size > 0 && generated_size < 8)
+        generated_size = 8;
+    if (generated_size > 16384)
+        generated_size = 16384;
+
+    static FileResult results[BENCH_MAX_FILES + BENCH_GENERATED_COUNT];
+    int result_count = 0;
+    bool ok = validate_kernels();
+
+    for (int i = 0; i < file_count; i++)
+        ok &= bench_path(files[i], threads, iterations, &results[result_count++]);
+    for (int i = 0; i < BENCH_GENERATED_COUNT && generated_size > 0; i++)
+        ok &= bench_generated(i, generated_size, threads, iterations, &results[result_count++]);
+
+    FormatTotals totals[BENCH_FORMAT_COUNT];
+    memset(totals, 0, sizeof(totals));
+    for (int i = 0; i < result_count; i++)
+        add_format_totals(totals, &results[i]);
+    print_format_totals(totals);
+    print_arena_stats();
+
+    if (json_path != NULL)
+        ok &= write_bench_json(json_path, results, result_count, totals, iterations, generated_size, ok);
+
+    for (int i = 0; i < file_count; i++)
+        free(files[i]);
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,406 @@
+#ifndef IMAGE_STREAM_H
+#define IMAGE_STREAM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+
+// the implementation is pulled in once by hello_world.c
+#ifndef STBI_INCLUDE_STB_IMAGE_H
+#include "stb_image/stb_image.h"
+#endif
+
+// bytes feed_image_stream_file reads at a time
+#define IMAGE_STREAM_READ_SIZE (64 << 10)
+
+// a run of finished rows, in the final image's row order so counted from the
+// bottom when the stream flips. a preview is a whole progressive JPEG scan
+// and gets painted over by the bands after it
+typedef struct ImageBand {
+    unsigned char *pixels;
+    int first_row;
+    int row_count;
+    int width;
+    int height;
+    int channels;
+    bool preview;
+} ImageBand;
+
+// decodes an image on its own thread as bytes are fed in and hands out rows
+// as soon as stb_image has finished them, so uploads can start before the
+// file has all been read. formats that don't stream come out as one band at
+// the end. feed it from one thread:
+//
+//     while (!image_stream_finished(&stream))
+//     {
+//         feed_image_stream_file(&stream, file);
+//         while (wait_image_band(&stream, &band)) { upload; free_image_band(&band); }
+//     }
+//     finish_image_stream(&stream, ...);
+//
+// or poll_image_band from a frame loop, which never blocks
+typedef struct ImageStream {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+
+    int desired_channels;
+    bool flip;
+
+    // bytes fed so far that the decoder hasn't read yet start at input_read
+    unsigned char *input;
+    size_t input_size;
+    size_t input_capacity;
+    size_t input_read;
+    bool input_done;
+    // the decoder is waiting for more input
+    bool starved;
+
+    ImageBand *bands;
+    unsigned int band_first;
+    unsigned int band_count;
+    unsigned int band_capacity;
+    // rows of the final image handed out while decoding
+    int final_rows;
+
+    bool finished;
+    unsigned char *pixels;
+    int width;
+    int height;
+    int channels;
+} ImageStream;
+
+bool begin_image_stream(ImageStream *stream, int desired_channels, bool flip);
+void feed_image_stream(ImageStream *stream, const void *data, size_t size);
+bool feed_image_stream_file(ImageStream *stream, FILE *file);
+void end_image_stream_input(ImageStream *stream);
+bool poll_image_band(ImageStream *stream, ImageBand *band);
+bool wait_image_band(ImageStream *stream, ImageBand *band);
+void free_image_band(ImageBand *band);
+bool image_stream_finished(ImageStream *stream);
+unsigned char *finish_image_stream(ImageStream *stream, int *width, int *height, int *channels);
+
+// lock held. tells wait_image_band the decoder has used up its input
+void wait_for_image_input(ImageStream *stream)
+{
+    if (!stream->starved)
+    {
+        stream->starved = true;
+        pthread_cond_broadcast(&stream->changed);
+    }
+    pthread_cond_wait(&stream->changed, &stream->lock);
+}
+
+// stb_image callbacks, these run on the decode thread and block until the
+// bytes they need have been fed. a short read means the end of the file to
+// stb_image, so reads wait for all of it
+int image_stream_read(void *user, char *data, int size)
+{
+    ImageStream *stream = (ImageStream*)user;
+    pthread_mutex_lock(&stream->lock);
+    while (stream->input_size - stream->input_read < (size_t) size && !stream->input_done)
+    {
+        wait_for_image_input(stream);
+    }
+    stream->starved = false;
+
+    size_t available = stream->input_size - stream->input_read;
+    int count = available < (size_t) size ? (int) available : size;
+    memcpy(data, stream->input + stream->input_read, count);
+    stream->input_read += count;
+    pthread_mutex_unlock(&stream->lock);
+    return count;
+}
+
+void image_stream_skip(void *user, int count)
+{
+    ImageStream *stream = (ImageStream*)user;
+    pthread_mutex_lock(&stream->lock);
+    while (count > 0)
+    {
+        while (stream->input_read == stream->input_size && !stream->input_done)
+        {
+            wait_for_image_input(stream);
+        }
+        stream->starved = false;
+
+        size_t available = stream->input_size - stream->input_read;
+        if (available == 0)
+            break;
+
+        size_t skipped = available < (size_t) count ? available : (size_t) count;
+        stream->input_read += skipped;
+        count -= (int) skipped;
+    }
+    pthread_mutex_unlock(&stream->lock);
+}
+
+int image_stream_eof(void *user)
+{
+    ImageStream *stream = (ImageStream*)user;
+    pthread_mutex_lock(&stream->lock);
+    while (stream->input_read == stream->input_size && !stream->input_done)
+    {
+        wait_for_image_input(stream);
+    }
+    stream->starved = false;
+
+    int eof = stream->input_read == stream->input_size;
+    pthread_mutex_unlock(&stream->lock);
+    return eof;
+}
+
+// takes a copy, stb_image keeps writing over its buffer
+void push_image_band(ImageStream *stream, const unsigned char *rows, int first_row, int row_count, int width, int height, int channels, bool preview, bool flip)
+{
+    size_t row_bytes = (size_t) width * channels;
+    unsigned char *pixels = (unsigned char*)malloc(row_bytes * row_count);
+    if (pixels == NULL)
+    {
+        printf("Failed to allocate an image band\n");
+        return;
+    }
+
+    if (flip)
+    {
+        for (int i = 0; i < row_count; i++)
+            memcpy(pixels + row_bytes * (row_count - 1 - i), rows + row_bytes * i, row_bytes);
+        first_row = height - first_row - row_count;
+    }
+    else
+        memcpy(pixels, rows, row_bytes * row_count);
+
+    pthread_mutex_lock(&stream->lock);
+    if (stream->band_first + stream->band_count == stream->band_capacity)
+    {
+        // slide what's left to the front before growing
+        if (stream->band_first > 0)
+            memmove(stream->bands, stream->bands + stream->band_first, stream->band_count * sizeof(ImageBand));
+        stream->band_first = 0;
+        if (stream->band_count == stream->band_capacity)
+        {
+            unsigned int capacity = stream->band_capacity ? stream->band_capacity * 2 : 16;
+            ImageBand *bands = (ImageBand*)realloc(stream->bands, capacity * sizeof(ImageBand));
+            if (bands == NULL)
+            {
+                pthread_mutex_unlock(&stream->lock);
+                free(pixels);
+                printf("Failed to queue an image band\n");
+                return;
+            }
+            stream->bands = bands;
+            stream->band_capacity = capacity;
+        }
+    }
+
+    ImageBand *band = &stream->bands[stream->band_first + stream->band_count++];
+    band->pixels = pixels;
+    band->first_row = first_row;
+    band->row_count = row_count;
+    band->width = width;
+    band->height = height;
+    band->channels = channels;
+    band->preview = preview;
+    if (!preview)
+        stream->final_rows += row_count;
+    pthread_cond_broadcast(&stream->changed);
+    pthread_mutex_unlock(&stream->lock);
+}
+
+void image_stream_rows(void *user, const stbi_uc *rows, int first_row, int row_count, int width, int height, int comp, int is_preview)
+{
+    ImageStream *stream = (ImageStream*)user;
+    push_image_band(stream, rows, first_row, row_count, width, height, comp, is_preview != 0, stream->flip);
+}
+
+void *image_stream_worker(void *arg)
+{
+    ImageStream *stream = (ImageStream*)arg;
+    stbi_io_callbacks callbacks = { image_stream_read, image_stream_skip, image_stream_eof };
+
+    // both settings are per thread, so other loads aren't affected
+    stbi_set_flip_vertically_on_load_thread(stream->flip);
+    stbi_set_rows_callback(image_stream_rows, stream);
+
+    int width = 0, height = 0, channels = 0;
+    unsigned char *pixels = stbi_load_from_callbacks(&callbacks, stream, &width, &height, &channels, stream->desired_channels);
+    stbi_set_rows_callback(NULL, NULL);
+
+    if (pixels == NULL)
+        printf("Failed to decode streamed image: %s\n", stbi_failure_reason());
+
+    // whatever didn't come out while decoding goes out whole. it's already
+    // flipped, so don't flip it again
+    int output_channels = stream->desired_channels ? stream->desired_channels : channels;
+    if (pixels != NULL && stream->final_rows < height)
+        push_image_band(stream, pixels, 0, height, width, height, output_channels, false, false);
+
+    pthread_mutex_lock(&stream->lock);
+    stream->pixels = pixels;
+    stream->width = width;
+    stream->height = height;
+    stream->channels = output_channels;
+    stream->finished = true;
+    pthread_cond_broadcast(&stream->changed);
+    pthread_mutex_unlock(&stream->lock);
+    return NULL;
+}
+
+// desired_channels works like stbi_load's, flip like stbi_set_flip_vertically_on_load
+bool begin_image_stream(ImageStream *stream, int desired_channels, bool flip)
+{
+    memset(stream, 0, sizeof(ImageStream));
+    stream->desired_channels = desired_channels;
+    stream->flip = flip;
+    pthread_mutex_init(&stream->lock, NULL);
+    pthread_cond_init(&stream->changed, NULL);
+
+    if (pthread_create(&stream->thread, NULL, image_stream_worker, stream) != 0)
+    {
+        printf("Failed to start image stream thread\n");
+        pthread_mutex_destroy(&stream->lock);
+        pthread_cond_destroy(&stream->changed);
+        return false;
+    }
+    return true;
+}
+
+void feed_image_stream(ImageStream *stream, const void *data, size_t size)
+{
+    pthread_mutex_lock(&stream->lock);
+
+    // drop what the decoder has read before making room
+    if (stream->input_read > 0)
+    {
+        memmove(stream->input, stream->input + stream->input_read, stream->input_size - stream->input_read);
+        stream->input_size -= stream->input_read;
+        stream->input_read = 0;
+    }
+
+    if (stream->input_size + size > stream->input_capacity)
+    {
+        size_t capacity = stream->input_capacity ? stream->input_capacity : IMAGE_STREAM_READ_SIZE;
+        while (capacity < stream->input_size + size)
+            capacity *= 2;
+
+        unsigned char *input = (unsigned char*)realloc(stream->input, capacity);
+        if (input == NULL)
+        {
+            // the decoder sees the end of the file and fails
+            printf("Failed to grow image stream input\n");
+            stream->input_done = true;
+            pthread_cond_broadcast(&stream->changed);
+            pthread_mutex_unlock(&stream->lock);
+            return;
+        }
+        stream->input = input;
+        stream->input_capacity = capacity;
+    }
+
+    memcpy(stream->input + stream->input_size, data, size);
+    stream->input_size += size;
+    stream->starved = false;
+    pthread_cond_broadcast(&stream->changed);
+    pthread_mutex_unlock(&stream->lock);
+}
+
+// feeds the next chunk of the file, false once it's all been fed
+bool feed_image_stream_file(ImageStream *stream, FILE *file)
+{
+    unsigned char chunk[IMAGE_STREAM_READ_SIZE];
+    size_t count = fread(chunk, 1, sizeof(chunk), file);
+    if (count > 0)
+        feed_image_stream(stream, chunk, count);
+
+    if (count < sizeof(chunk))
+    {
+        end_image_stream_input(stream);
+        return false;
+    }
+    return true;
+}
+
+void end_image_stream_input(ImageStream *stream)
+{
+    pthread_mutex_lock(&stream->lock);
+    stream->input_done = true;
+    pthread_cond_broadcast(&stream->changed);
+    pthread_mutex_unlock(&stream->lock);
+}
+
+// lock held
+bool take_image_band(ImageStream *stream, ImageBand *band)
+{
+    if (stream->band_count == 0)
+        return false;
+
+    *band = stream->bands[stream->band_first++];
+    if (--stream->band_count == 0)
+        stream->band_first = 0;
+    return true;
+}
+
+// the band's pixels are the caller's, free them with free_image_band
+bool poll_image_band(ImageStream *stream, ImageBand *band)
+{
+    pthread_mutex_lock(&stream->lock);
+    bool found = take_image_band(stream, band);
+    pthread_mutex_unlock(&stream->lock);
+    return found;
+}
+
+// like poll_image_band, but blocks until there is a band. false once the
+// decoder needs more input to make one, or the stream has finished and
+// every band has been taken
+bool wait_image_band(ImageStream *stream, ImageBand *band)
+{
+    pthread_mutex_lock(&stream->lock);
+    while (stream->band_count == 0 && !stream->finished && !(stream->starved && !stream->input_done))
+        pthread_cond_wait(&stream->changed, &stream->lock);
+    bool found = take_image_band(stream, band);
+    pthread_mutex_unlock(&stream->lock);
+    return found;
+}
+
+void free_image_band(ImageBand *band)
+{
+    free(band->pixels);
+    band->pixels = NULL;
+}
+
+// true once the decode is done and every band has been taken
+bool image_stream_finished(ImageStream *stream)
+{
+    pthread_mutex_lock(&stream->lock);
+    bool finished = stream->finished && stream->band_count == 0;
+    pthread_mutex_unlock(&stream->lock);
+    return finished;
+}
+
+// waits for the decode, ending the input if the caller hasn't, and drops any
+// bands that weren't polled. returns the whole image for stbi_image_free, or
+// NULL if it failed
+unsigned char *finish_image_stream(ImageStream *stream, int *width, int *height, int *channels)
+{
+    end_image_stream_input(stream);
+    pthread_join(stream->thread, NULL);
+
+    for (unsigned int i = 0; i < stream->band_count; i++)
+        free_image_band(&stream->bands[stream->band_first + i]);
+    free(stream->bands);
+    free(stream->input);
+    pthread_mutex_destroy(&stream->lock);
+    pthread_cond_destroy(&stream->changed);
+
+    if (width != NULL)
+        *width = stream->width;
+    if (height != NULL)
+        *height = stream->height;
+    if (channels != NULL)
+        *channels = stream->channels;
+    return stream->pixels;
+}
+
+#endif
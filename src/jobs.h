@@ -0,0 +1,410 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+// job system defaults
+#define JOB_DEQUE_SIZE 4096 // must be a power of two
+#define JOB_POOL_SIZE 4096  // jobs in flight per thread, must be a power of two
+#define JOB_MAX_WORKERS 64
+#define JOB_SPIN_COUNT 64   // failed steal attempts before a worker goes to sleep
+
+struct Job;
+
+// every job runs over an index range, single jobs just use [0, 1)
+typedef void (*JobFunction)(void *data, unsigned int begin, unsigned int end);
+
+// counts unfinished jobs, runs the continuation (if any) when it reaches zero
+typedef struct JobCounter {
+    atomic_int pending;
+    struct Job *continuation;
+} JobCounter;
+
+typedef struct Job {
+    JobFunction function;
+    void *data;
+    unsigned int begin;
+    unsigned int end;
+    // ranges larger than this are split in half before running
+    unsigned int grain;
+    JobCounter *counter;
+} Job;
+
+// Chase-Lev work-stealing deque: the owner pushes and takes at the bottom,
+// thieves steal from the top
+typedef struct JobDeque {
+    atomic_long top;
+    char pad0[64 - sizeof(atomic_long)];
+    atomic_long bottom;
+    char pad1[64 - sizeof(atomic_long)];
+    _Atomic(Job*) jobs[JOB_DEQUE_SIZE];
+} JobDeque;
+
+typedef struct JobWorker {
+    _Alignas(64) JobDeque deque;
+    Job pool[JOB_POOL_SIZE];
+    unsigned int pool_next;
+    unsigned int index;
+    unsigned int steal_seed;
+    pthread_t thread;
+    struct JobSystem *system;
+} JobWorker;
+
+typedef struct JobSystem {
+    // worker 0 is the thread that called init_job_system
+    unsigned int worker_count;
+    JobWorker *workers;
+
+    atomic_bool running;
+
+    // idle workers sleep here until new work is pushed
+    pthread_mutex_t sleep_lock;
+    pthread_cond_t wake;
+    atomic_int sleeping;
+} JobSystem;
+
+// the worker owned by the current thread, NULL on threads outside the system
+_Thread_local JobWorker *current_worker = NULL;
+
+void init_job_system(JobSystem *js, unsigned int worker_count);
+void destroy_job_system(JobSystem *js);
+Job *create_job(JobFunction function, void *data, unsigned int begin, unsigned int end, unsigned int grain, JobCounter *counter);
+void init_job_counter(JobCounter *counter, Job *continuation);
+void run_job(Job *job);
+void wait_for_counter(JobCounter *counter);
+void parallel_for(unsigned int count, unsigned int grain, JobFunction function, void *data);
+
+bool job_deque_push(JobDeque *deque, Job *job);
+Job *job_deque_take(JobDeque *deque);
+Job *job_deque_steal(JobDeque *deque);
+void execute_job(Job *job);
+
+bool job_deque_push(JobDeque *deque, Job *job)
+{
+    long b = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    long t = atomic_load_explicit(&deque->top, memory_order_acquire);
+
+    // full, caller runs the job inline
+    if (b - t > JOB_DEQUE_SIZE - 1)
+        return false;
+
+    atomic_store_explicit(&deque->jobs[b & (JOB_DEQUE_SIZE - 1)], job, memory_order_relaxed);
+    // publishes the job's fields to thieves that acquire bottom
+    atomic_store_explicit(&deque->bottom, b + 1, memory_order_release);
+    return true;
+}
+
+Job *job_deque_take(JobDeque *deque)
+{
+    long b = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&deque->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long t = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+    Job *job = NULL;
+    if (t <= b)
+    {
+        job = atomic_load_explicit(&deque->jobs[b & (JOB_DEQUE_SIZE - 1)], memory_order_relaxed);
+        if (t == b)
+        {
+            // last job, race against thieves for it
+            if (!atomic_compare_exchange_strong_explicit(&deque->top, &t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+                job = NULL;
+            atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+        }
+    }
+    else
+    {
+        // empty
+        atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+    }
+
+    return job;
+}
+
+Job *job_deque_steal(JobDeque *deque)
+{
+    long t = atomic_load_explicit(&deque->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long b = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+
+    if (t >= b)
+        return NULL;
+
+    Job *job = atomic_load_explicit(&deque->jobs[t & (JOB_DEQUE_SIZE - 1)], memory_order_relaxed);
+
+    // lost the race to the owner or another thief
+    if (!atomic_compare_exchange_strong_explicit(&deque->top, &t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+        return NULL;
+
+    return job;
+}
+
+void wake_workers(JobSystem *js)
+{
+    if (atomic_load_explicit(&js->sleeping, memory_order_acquire) > 0)
+    {
+        pthread_mutex_lock(&js->sleep_lock);
+        pthread_cond_broadcast(&js->wake);
+        pthread_mutex_unlock(&js->sleep_lock);
+    }
+}
+
+void finish_job(Job *job)
+{
+    JobCounter *counter = job->counter;
+    if (counter == NULL)
+        return;
+
+    // read before decrementing, a waiter may free the counter as soon as it drains
+    Job *continuation = counter->continuation;
+    if (atomic_fetch_sub_explicit(&counter->pending, 1, memory_order_acq_rel) == 1 && continuation != NULL)
+        run_job(continuation);
+}
+
+void execute_job(Job *job)
+{
+    // split big ranges, keep the lower half and leave the upper half for thieves
+    while (job->end - job->begin > job->grain)
+    {
+        unsigned int mid = job->begin + (job->end - job->begin) / 2;
+        Job *upper = create_job(job->function, job->data, mid, job->end, job->grain, job->counter);
+        if (upper == NULL)
+            break;
+
+        job->end = mid;
+        run_job(upper);
+    }
+
+    job->function(job->data, job->begin, job->end);
+    finish_job(job);
+}
+
+// find something to do: own deque first, then steal from a random victim
+Job *find_job(JobWorker *worker)
+{
+    Job *job = job_deque_take(&worker->deque);
+    if (job != NULL)
+        return job;
+
+    JobSystem *js = worker->system;
+    if (js->worker_count < 2)
+        return NULL;
+
+    // xorshift to pick the first victim
+    worker->steal_seed ^= worker->steal_seed << 13;
+    worker->steal_seed ^= worker->steal_seed >> 17;
+    worker->steal_seed ^= worker->steal_seed << 5;
+
+    unsigned int start = worker->steal_seed % js->worker_count;
+    for (unsigned int i = 0; i < js->worker_count; i++)
+    {
+        unsigned int victim = (start + i) % js->worker_count;
+        if (victim == worker->index)
+            continue;
+
+        job = job_deque_steal(&js->workers[victim].deque);
+        if (job != NULL)
+            return job;
+    }
+
+    return NULL;
+}
+
+void *job_worker_main(void *arg)
+{
+    JobWorker *worker = (JobWorker*)arg;
+    JobSystem *js = worker->system;
+    current_worker = worker;
+
+    unsigned int idle = 0;
+    while (atomic_load_explicit(&js->running, memory_order_acquire))
+    {
+        Job *job = find_job(worker);
+        if (job != NULL)
+        {
+            execute_job(job);
+            idle = 0;
+            continue;
+        }
+
+        if (++idle < JOB_SPIN_COUNT)
+        {
+            sched_yield();
+            continue;
+        }
+
+        // nothing to steal for a while, sleep until someone pushes work
+        pthread_mutex_lock(&js->sleep_lock);
+        atomic_fetch_add(&js->sleeping, 1);
+        if (atomic_load(&js->running))
+        {
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_nsec += 1000000;
+            if (ts.tv_nsec >= 1000000000)
+            {
+                ts.tv_sec++;
+                ts.tv_nsec -= 1000000000;
+            }
+            // timed so a wakeup racing with the sleeping count is never lost for long
+            pthread_cond_timedwait(&js->wake, &js->sleep_lock, &ts);
+        }
+        atomic_fetch_sub(&js->sleeping, 1);
+        pthread_mutex_unlock(&js->sleep_lock);
+        idle = 0;
+    }
+
+    current_worker = NULL;
+    return NULL;
+}
+
+// worker_count of 0 uses one worker per online core
+void init_job_system(JobSystem *js, unsigned int worker_count)
+{
+    if (worker_count == 0)
+    {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        worker_count = cores > 0 ? (unsigned int) cores : 1;
+    }
+    if (worker_count > JOB_MAX_WORKERS)
+        worker_count = JOB_MAX_WORKERS;
+
+    js->worker_count = worker_count;
+    js->workers = (JobWorker*)aligned_alloc(64, sizeof(JobWorker) * worker_count);
+    memset(js->workers, 0, sizeof(JobWorker) * worker_count);
+
+    atomic_init(&js->running, true);
+    atomic_init(&js->sleeping, 0);
+    pthread_mutex_init(&js->sleep_lock, NULL);
+    pthread_cond_init(&js->wake, NULL);
+
+    for (unsigned int i = 0; i < worker_count; i++)
+    {
+        JobWorker *worker = &js->workers[i];
+        worker->index = i;
+        worker->system = js;
+        worker->steal_seed = 2463534242u + i * 7919u;
+        atomic_init(&worker->deque.top, 0);
+        atomic_init(&worker->deque.bottom, 0);
+    }
+
+    // the calling thread takes part as worker 0
+    current_worker = &js->workers[0];
+
+    for (unsigned int i = 1; i < worker_count; i++)
+    {
+        if (pthread_create(&js->workers[i].thread, NULL, job_worker_main, &js->workers[i]) != 0)
+        {
+            printf("Failed to start job worker %u\n", i);
+            js->worker_count = i;
+            break;
+        }
+    }
+}
+
+void destroy_job_system(JobSystem *js)
+{
+    atomic_store(&js->running, false);
+
+    pthread_mutex_lock(&js->sleep_lock);
+    pthread_cond_broadcast(&js->wake);
+    pthread_mutex_unlock(&js->sleep_lock);
+
+    for (unsigned int i = 1; i < js->worker_count; i++)
+        pthread_join(js->workers[i].thread, NULL);
+
+    current_worker = NULL;
+    pthread_cond_destroy(&js->wake);
+    pthread_mutex_destroy(&js->sleep_lock);
+    free(js->workers);
+    js->workers = NULL;
+}
+
+// jobs come from a per-thread ring, so a thread may have at most
+// JOB_POOL_SIZE jobs in flight. returns NULL outside the job system
+Job *create_job(JobFunction function, void *data, unsigned int begin, unsigned int end, unsigned int grain, JobCounter *counter)
+{
+    JobWorker *worker = current_worker;
+    if (worker == NULL)
+        return NULL;
+
+    Job *job = &worker->pool[worker->pool_next++ & (JOB_POOL_SIZE - 1)];
+    job->function = function;
+    job->data = data;
+    job->begin = begin;
+    job->end = end;
+    job->grain = grain > 0 ? grain : 1;
+    job->counter = counter;
+
+    if (counter != NULL)
+        atomic_fetch_add_explicit(&counter->pending, 1, memory_order_relaxed);
+
+    return job;
+}
+
+// the continuation is scheduled by whichever thread finishes the last job
+void init_job_counter(JobCounter *counter, Job *continuation)
+{
+    atomic_init(&counter->pending, 0);
+    counter->continuation = continuation;
+}
+
+void run_job(Job *job)
+{
+    JobWorker *worker = current_worker;
+
+    // outside the system or deque full: just do it here
+    if (worker == NULL || !job_deque_push(&worker->deque, job))
+    {
+        execute_job(job);
+        return;
+    }
+
+    wake_workers(worker->system);
+}
+
+// help out with other jobs until the counter drains
+void wait_for_counter(JobCounter *counter)
+{
+    JobWorker *worker = current_worker;
+
+    while (atomic_load_explicit(&counter->pending, memory_order_acquire) > 0)
+    {
+        Job *job = worker != NULL ? find_job(worker) : NULL;
+        if (job != NULL)
+            execute_job(job);
+        else
+            sched_yield();
+    }
+}
+
+// run function over [0, count) in chunks of about grain indices and wait
+void parallel_for(unsigned int count, unsigned int grain, JobFunction function, void *data)
+{
+    if (count == 0)
+        return;
+
+    JobCounter counter;
+    init_job_counter(&counter, NULL);
+
+    Job *job = create_job(function, data, 0, count, grain, &counter);
+    if (job == NULL)
+    {
+        function(data, 0, count);
+        return;
+    }
+
+    run_job(job);
+    wait_for_counter(&counter);
+}
+
+#endif
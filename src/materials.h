@@ -0,0 +1,492 @@
+#ifndef MATERIALS_H
+#define MATERIALS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <glad/glad.h>
+
+#include <cglm/cglm.h>
+
+// the implementation is pulled in once by hello_world.c
+#ifndef STBI_INCLUDE_STB_IMAGE_H
+#include "stb_image/stb_image.h"
+#endif
+
+#include "arena.h"
+#include "gl_extensions.h"
+#include "gl_resources.h"
+#include "mipmap.h"
+#include "render_stats.h"
+#include "sampler_cache.h"
+#include "texture_atlas.h"
+#include "texture_format.h"
+#include "ycbcr_texture.h"
+
+// material defaults
+#define MAX_TEXTURES 4096
+#define MAX_MATERIALS 4096
+#define MAX_TEXTURE_HANDLES 4096
+#define MAX_TEXTURE_SLOTS 8 // must match `textures` in fragment_shader.glsl, 8 more units go to virtual textures
+#define MATERIAL_BUFFER_BINDING 0
+
+// ARB_bindless_texture entry points, glad doesn't load these for us
+typedef GLuint64 (APIENTRYP GetTextureHandleProc)(GLuint texture);
+typedef GLuint64 (APIENTRYP GetTextureSamplerHandleProc)(GLuint texture, GLuint sampler);
+typedef void (APIENTRYP MakeTextureHandleResidentProc)(GLuint64 handle);
+typedef void (APIENTRYP MakeTextureHandleNonResidentProc)(GLuint64 handle);
+
+typedef struct BindlessProcs {
+    GetTextureHandleProc get_texture_handle;
+    GetTextureSamplerHandleProc get_texture_sampler_handle;
+    MakeTextureHandleResidentProc make_resident;
+    MakeTextureHandleNonResidentProc make_non_resident;
+} BindlessProcs;
+
+// matches `struct Material` in the fragment shaders (std430)
+typedef struct GpuMaterial {
+    GLuint64 base;
+    GLuint64 overlay;
+    // xy = scale, zw = offset applied to the mesh uvs
+    vec4 base_uv;
+    vec4 overlay_uv;
+    GLuint base_layer;
+    GLuint overlay_layer;
+    // index into TextureLibrary.slots, fallback path only
+    GLuint base_slot;
+    GLuint overlay_slot;
+    float mix_factor;
+    // 1 + virtual texture index sampled instead of base, 0 for none
+    GLuint virtual_texture;
+    float pad[2];
+} GpuMaterial;
+
+typedef struct LibraryTexture {
+    const char *path;
+    int width;
+    int height;
+    int channels;
+    // decoded pixels, only kept until the library is built
+    unsigned char *pixels;
+    // or the raw planes of a JPEG the GPU converts, plane_count is 0 otherwise
+    stbi_jpeg_planes planes;
+
+    unsigned int id;
+    GLuint array;
+    GLuint layer;
+    vec4 uv;
+} LibraryTexture;
+
+// what a material was built from, so its handles can be rebuilt when a
+// texture is replaced
+typedef struct MaterialTextures {
+    int base;
+    int overlay;
+    GLuint sampler;
+} MaterialTextures;
+
+// a texture unit in the fallback path, one array seen through one sampler
+typedef struct TextureSlot {
+    GLuint array;
+    GLuint sampler;
+} TextureSlot;
+
+// every texture the scene uses, exposed either as resident bindless
+// handles or as layers of one texture array
+typedef struct TextureLibrary {
+    bool bindless;
+    BindlessProcs procs;
+
+    // JPEGs go up as YCbCr planes and are converted on the GPU, bindless only
+    // since the arrays are packed from decoded pixels
+    bool gpu_ycbcr;
+    YcbcrConverter ycbcr;
+
+    LibraryTexture textures[MAX_TEXTURES];
+    unsigned int texture_count;
+
+    // filtering is per material, textures carry no sampler state of their own
+    SamplerCache samplers;
+
+    // bindless path, every texture + sampler pair made resident so far
+    GLuint64 handles[MAX_TEXTURE_HANDLES];
+    unsigned int handle_count;
+
+    // fallback path, the whole library lives in a few arrays and atlases
+    TextureArraySet arrays;
+    TextureSlot slots[MAX_TEXTURE_SLOTS];
+    unsigned int slot_count;
+
+    GpuMaterial materials[MAX_MATERIALS];
+    MaterialTextures material_textures[MAX_MATERIALS];
+    unsigned int material_count;
+    unsigned int material_buffer;
+} TextureLibrary;
+
+bool load_bindless_procs(BindlessProcs *procs, GLADloadproc load);
+void init_texture_library(TextureLibrary *library, bool allow_bindless, bool allow_gpu_ycbcr, GLADloadproc load);
+int add_library_texture(TextureLibrary *library, const char *path);
+void build_texture_library(TextureLibrary *library);
+unsigned int add_material(TextureLibrary *library, int base, int overlay, float mix_factor, const SamplerDesc *sampler);
+void upload_materials(TextureLibrary *library);
+void bind_texture_library(TextureLibrary *library, unsigned int program);
+void replace_library_texture(TextureLibrary *library, unsigned int index, GLuint id);
+void set_material_virtual_texture(TextureLibrary *library, unsigned int material, int virtual_texture);
+void destroy_texture_library(TextureLibrary *library);
+
+bool load_bindless_procs(BindlessProcs *procs, GLADloadproc load)
+{
+    procs->get_texture_handle = (GetTextureHandleProc) load("glGetTextureHandleARB");
+    procs->get_texture_sampler_handle = (GetTextureSamplerHandleProc) load("glGetTextureSamplerHandleARB");
+    procs->make_resident = (MakeTextureHandleResidentProc) load("glMakeTextureHandleResidentARB");
+    procs->make_non_resident = (MakeTextureHandleNonResidentProc) load("glMakeTextureHandleNonResidentARB");
+
+    return procs->get_texture_handle != NULL && procs->get_texture_sampler_handle != NULL
+        && procs->make_resident != NULL && procs->make_non_resident != NULL;
+}
+
+void init_texture_library(TextureLibrary *library, bool allow_bindless, bool allow_gpu_ycbcr, GLADloadproc load)
+{
+    memset(library, 0, sizeof(TextureLibrary));
+
+    library->bindless = allow_bindless
+        && has_gl_extension("GL_ARB_bindless_texture")
+        && load_bindless_procs(&library->procs, load);
+
+    if (!library->bindless)
+        printf("Bindless textures unavailable, falling back to a texture array\n");
+
+    library->gpu_ycbcr = library->bindless && allow_gpu_ycbcr && init_ycbcr_converter(&library->ycbcr);
+
+    init_sampler_cache(&library->samplers);
+}
+
+// decode now, the GL objects are made in build_texture_library
+int add_library_texture(TextureLibrary *library, const char *path)
+{
+    if (library->texture_count == MAX_TEXTURES)
+    {
+        printf("Texture library is full, skipping %s\n", path);
+        return -1;
+    }
+
+    LibraryTexture *texture = &library->textures[library->texture_count];
+    memset(texture, 0, sizeof(LibraryTexture));
+    texture->path = path;
+
+    if (library->gpu_ycbcr && load_ycbcr_planes(path, &texture->planes))
+    {
+        texture->width = texture->planes.width;
+        texture->height = texture->planes.height;
+        texture->channels = 4;
+        return (int) library->texture_count++;
+    }
+
+    // libraries load their textures back to back and free them together once
+    // they're uploaded, so they pack into the arena. texture arrays are
+    // always RGBA8, so decode straight to that for them
+    stbi_set_flip_vertically_on_load(true);
+    begin_arena_scope();
+    texture->pixels = end_arena_scope(load_texture_pixels(path, library->bindless ? 0 : 4,
+        &texture->width, &texture->height, &texture->channels));
+    if (texture->pixels == NULL)
+    {
+        printf("Failed to load texture %s!\n", path);
+        return -1;
+    }
+
+    return (int) library->texture_count++;
+}
+
+void build_bindless_textures(TextureLibrary *library)
+{
+    for (unsigned int i = 0; i < library->texture_count; i++)
+    {
+        LibraryTexture *texture = &library->textures[i];
+        // whole texture, no remapping needed
+        glm_vec4_copy((vec4) { 1.0f, 1.0f, 0.0f, 0.0f }, texture->uv);
+
+        // library textures are flipped on load like everything else
+        if (texture->planes.plane_count > 0)
+        {
+            texture->id = convert_ycbcr_texture(&library->ycbcr, &texture->planes, true,
+                mip_count(texture->width, texture->height));
+            continue;
+        }
+
+        TextureFormat format = choose_texture_format(texture->channels, texture->width);
+        check_texture_format(GL_TEXTURE_2D, &format);
+
+        // sampling state comes from the sampler baked into each material's handle
+        texture->id = create_texture(GL_TEXTURE_2D, mip_count(texture->width, texture->height), format.internal_format,
+            texture->width, texture->height, 1);
+        set_texture_swizzle(texture->id, &format);
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, format.alignment);
+        glTextureSubImage2D(texture->id, 0, 0, 0, texture->width, texture->height,
+            format.format, format.type, texture->pixels);
+        render_stats.frame.texture_bytes += (uint64_t) texture->width * texture->height * texture->channels;
+
+        MipChain chain;
+        if (generate_mip_chain(texture->pixels, texture->width, texture->height, texture->channels, true, MIP_DEFAULT_FILTER, 0, &chain))
+        {
+            upload_mip_chain(texture->id, GL_TEXTURE_2D, 0, &chain);
+            free_mip_chain(&chain);
+        }
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+// same-size textures share an array, the rest are packed into atlas pages
+void build_texture_array(TextureLibrary *library)
+{
+    AtlasImage *images = (AtlasImage*)malloc(sizeof(AtlasImage) * (library->texture_count + 1));
+    AtlasPlacement *placements = (AtlasPlacement*)calloc(library->texture_count + 1, sizeof(AtlasPlacement));
+
+    for (unsigned int i = 0; i < library->texture_count; i++)
+    {
+        LibraryTexture *texture = &library->textures[i];
+        images[i].pixels = texture->pixels;
+        images[i].width = texture->width;
+        images[i].height = texture->height;
+        images[i].channels = texture->channels;
+    }
+
+    bool ok = build_texture_arrays(images, library->texture_count, &library->arrays, placements);
+
+    for (unsigned int i = 0; i < library->texture_count; i++)
+    {
+        LibraryTexture *texture = &library->textures[i];
+        // whatever didn't fit keeps MAX_TEXTURE_ARRAYS and samples as black
+        if (!ok && placements[i].array == MAX_TEXTURE_ARRAYS)
+            printf("No texture array for %s\n", texture->path);
+
+        texture->array = placements[i].array;
+        texture->layer = placements[i].layer;
+        glm_vec4_copy(placements[i].uv, texture->uv);
+    }
+
+    free(images);
+    free(placements);
+}
+
+// upload every decoded texture and drop the CPU copies
+void build_texture_library(TextureLibrary *library)
+{
+    if (library->bindless)
+        build_bindless_textures(library);
+    else
+        build_texture_array(library);
+
+    for (unsigned int i = 0; i < library->texture_count; i++)
+    {
+        stbi_image_free(library->textures[i].pixels);
+        library->textures[i].pixels = NULL;
+        stbi_jpeg_planes_free(&library->textures[i].planes);
+    }
+}
+
+// handle for a texture seen through a sampler, made resident the first time it's asked for
+GLuint64 get_texture_handle(TextureLibrary *library, const LibraryTexture *texture, GLuint sampler)
+{
+    GLuint64 handle = library->procs.get_texture_sampler_handle(texture->id, sampler);
+
+    for (unsigned int i = 0; i < library->handle_count; i++)
+    {
+        if (library->handles[i] == handle)
+            return handle;
+    }
+
+    if (library->handle_count == MAX_TEXTURE_HANDLES)
+    {
+        printf("Too many texture handles\n");
+        return 0;
+    }
+
+    // a handle freezes the texture and sampler state, both are final by now
+    library->procs.make_resident(handle);
+    library->handles[library->handle_count++] = handle;
+    return handle;
+}
+
+// texture unit slot for an array + sampler pair, shared between materials
+GLuint get_texture_slot(TextureLibrary *library, const LibraryTexture *texture, GLuint sampler)
+{
+    // a texture left out of the arrays gets a slot with nothing bound
+    GLuint array = texture->array < library->arrays.count ? library->arrays.arrays[texture->array].id : 0;
+
+    for (unsigned int i = 0; i < library->slot_count; i++)
+    {
+        if (library->slots[i].array == array && library->slots[i].sampler == sampler)
+            return i;
+    }
+
+    if (library->slot_count == MAX_TEXTURE_SLOTS)
+    {
+        printf("Out of texture slots, reusing the first one\n");
+        return 0;
+    }
+
+    library->slots[library->slot_count].array = array;
+    library->slots[library->slot_count].sampler = sampler;
+    return library->slot_count++;
+}
+
+// textures must already be built, returns the material index
+unsigned int add_material(TextureLibrary *library, int base, int overlay, float mix_factor, const SamplerDesc *sampler)
+{
+    if (library->material_count == MAX_MATERIALS || base < 0 || overlay < 0)
+    {
+        printf("Failed to add material\n");
+        return 0;
+    }
+
+    LibraryTexture *base_texture = &library->textures[base];
+    LibraryTexture *overlay_texture = &library->textures[overlay];
+    GLuint sampler_id = get_sampler(&library->samplers, sampler);
+
+    GpuMaterial *material = &library->materials[library->material_count];
+    memset(material, 0, sizeof(GpuMaterial));
+    glm_vec4_copy(base_texture->uv, material->base_uv);
+    glm_vec4_copy(overlay_texture->uv, material->overlay_uv);
+    material->base_layer = base_texture->layer;
+    material->overlay_layer = overlay_texture->layer;
+
+    if (library->bindless)
+    {
+        material->base = get_texture_handle(library, base_texture, sampler_id);
+        material->overlay = get_texture_handle(library, overlay_texture, sampler_id);
+    }
+    else
+    {
+        material->base_slot = get_texture_slot(library, base_texture, sampler_id);
+        material->overlay_slot = get_texture_slot(library, overlay_texture, sampler_id);
+    }
+
+    material->mix_factor = mix_factor;
+
+    MaterialTextures *source = &library->material_textures[library->material_count];
+    source->base = base;
+    source->overlay = overlay;
+    source->sampler = sampler_id;
+
+    return library->material_count++;
+}
+
+// takes effect on the next upload_materials
+void set_material_virtual_texture(TextureLibrary *library, unsigned int material, int virtual_texture)
+{
+    if (material < library->material_count)
+        library->materials[material].virtual_texture = virtual_texture >= 0 ? (GLuint) virtual_texture + 1 : 0;
+}
+
+void upload_materials(TextureLibrary *library)
+{
+    // room for every material there can be, so later uploads never reallocate
+    if (library->material_buffer == 0)
+        library->material_buffer = create_buffer(sizeof(GpuMaterial) * MAX_MATERIALS, NULL, GL_DYNAMIC_STORAGE_BIT);
+
+    if (library->material_count > 0)
+        glNamedBufferSubData(library->material_buffer, 0, sizeof(GpuMaterial) * library->material_count, library->materials);
+
+    render_stats.frame.buffer_bytes += sizeof(GpuMaterial) * library->material_count;
+}
+
+// the only per-frame binding left: the material table (and the array slots when not bindless)
+void bind_texture_library(TextureLibrary *library, unsigned int program)
+{
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MATERIAL_BUFFER_BINDING, library->material_buffer);
+    render_stats.frame.state_changes++;
+
+    if (library->bindless)
+        return;
+
+    for (unsigned int i = 0; i < library->slot_count; i++)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "textures[%u]", i);
+
+        glBindTextureUnit(i, library->slots[i].array);
+        bind_sampler(&library->samplers, i, library->slots[i].sampler);
+        glUniform1i(glGetUniformLocation(program, name), (GLint) i);
+        render_stats.frame.state_changes += 2;
+    }
+}
+
+void release_texture_handle(TextureLibrary *library, GLuint64 handle)
+{
+    for (unsigned int i = 0; i < library->handle_count; i++)
+    {
+        if (library->handles[i] != handle)
+            continue;
+
+        library->procs.make_non_resident(handle);
+        library->handles[i] = library->handles[--library->handle_count];
+        return;
+    }
+}
+
+// swap the GL texture behind a library texture and repoint every material
+// that samples it, bindless path only
+void replace_library_texture(TextureLibrary *library, unsigned int index, GLuint id)
+{
+    LibraryTexture *texture = &library->textures[index];
+
+    // the old handles have to go before the texture does
+    for (unsigned int i = 0; i < library->material_count; i++)
+    {
+        MaterialTextures *source = &library->material_textures[i];
+        if (source->base == (int) index)
+            release_texture_handle(library, library->materials[i].base);
+        if (source->overlay == (int) index)
+            release_texture_handle(library, library->materials[i].overlay);
+    }
+
+    glDeleteTextures(1, &texture->id);
+    texture->id = id;
+
+    for (unsigned int i = 0; i < library->material_count; i++)
+    {
+        MaterialTextures *source = &library->material_textures[i];
+        if (source->base == (int) index)
+            library->materials[i].base = get_texture_handle(library, texture, source->sampler);
+        if (source->overlay == (int) index)
+            library->materials[i].overlay = get_texture_handle(library, texture, source->sampler);
+    }
+
+    upload_materials(library);
+}
+
+void destroy_texture_library(TextureLibrary *library)
+{
+    for (unsigned int i = 0; i < library->handle_count; i++)
+        library->procs.make_non_resident(library->handles[i]);
+    library->handle_count = 0;
+
+    for (unsigned int i = 0; i < library->texture_count; i++)
+    {
+        LibraryTexture *texture = &library->textures[i];
+
+        if (texture->id != 0)
+            glDeleteTextures(1, &texture->id);
+        if (texture->pixels != NULL)
+            stbi_image_free(texture->pixels);
+        stbi_jpeg_planes_free(&texture->planes);
+    }
+
+    destroy_ycbcr_converter(&library->ycbcr);
+    destroy_texture_arrays(&library->arrays);
+    destroy_sampler_cache(&library->samplers);
+    library->slot_count = 0;
+    if (library->material_buffer != 0)
+        glDeleteBuffers(1, &library->material_buffer);
+
+    library->texture_count = 0;
+    library->material_count = 0;
+}
+
+#endif
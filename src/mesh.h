@@ -0,0 +1,345 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include <cglm/cglm.h>
+
+// a vertex as importers produce it, full precision. what goes to the GPU is
+// the packed form from vertex_compress.h. the tangent comes first so the
+// 16 byte aligned vec4 leaves no padding, welding compares bytes
+typedef struct MeshVertex {
+    // w is the bitangent sign, bitangent = cross(normal, tangent) * w
+    vec4 tangent;
+    vec3 position;
+    vec3 normal;
+    vec2 uv;
+} MeshVertex;
+
+// a run of indices drawn with one material, -1 when the source had none
+typedef struct MeshSubmesh {
+    unsigned int first_index;
+    unsigned int index_count;
+    int material;
+} MeshSubmesh;
+
+// a coarser copy of the whole mesh in its own run of indices, error is how
+// far it strays from LOD 0 in mesh units. its meshlets cover the same run
+typedef struct MeshLod {
+    unsigned int first_index;
+    unsigned int index_count;
+    float error;
+    unsigned int first_meshlet;
+    unsigned int meshlet_count;
+} MeshLod;
+
+// a small cluster of triangles in its own run of indices, see meshlet.h.
+// uploaded as is, matches `struct Meshlet` in the meshlet culling shader (std430)
+typedef struct Meshlet {
+    float center[3];
+    float radius;
+    // every triangle faces away from an eye where
+    // dot(normalize(cone_apex - eye), cone_axis) >= cone_cutoff
+    float cone_axis[3];
+    float cone_cutoff;
+    float cone_apex[3];
+    uint32_t first_index;
+    uint32_t index_count;
+    uint32_t reserved[3];
+} Meshlet;
+
+// indexed triangles, counter-clockwise front faces. a mesh without
+// submeshes is drawn as one. with LODs from mesh_simplify.h the submeshes
+// repeat once per LOD, submesh_count of them each, and a mesh without LODs
+// is all LOD 0. meshlets are listed LOD by LOD
+typedef struct Mesh {
+    MeshVertex *vertices;
+    unsigned int vertex_count;
+    unsigned int *indices;
+    unsigned int index_count;
+    MeshSubmesh *submeshes;
+    unsigned int submesh_count;
+    MeshLod *lods;
+    unsigned int lod_count;
+    Meshlet *meshlets;
+    unsigned int meshlet_count;
+    vec3 bounds[2];
+} Mesh;
+
+bool init_mesh(Mesh *mesh, unsigned int vertex_count, unsigned int index_count);
+void free_mesh(Mesh *mesh);
+bool add_mesh_submesh(Mesh *mesh, unsigned int first_index, unsigned int index_count, int material);
+void compute_mesh_bounds(Mesh *mesh);
+void compute_mesh_normals(Mesh *mesh);
+void compute_mesh_tangents(Mesh *mesh);
+unsigned int weld_mesh(Mesh *mesh);
+bool mesh_from_triangle_soup(Mesh *mesh, const float *data, unsigned int vertex_count);
+
+bool init_mesh(Mesh *mesh, unsigned int vertex_count, unsigned int index_count)
+{
+    memset(mesh, 0, sizeof(Mesh));
+    mesh->vertices = (MeshVertex*)calloc(vertex_count > 0 ? vertex_count : 1, sizeof(MeshVertex));
+    mesh->indices = (unsigned int*)malloc(sizeof(unsigned int) * (index_count > 0 ? index_count : 1));
+    if (mesh->vertices == NULL || mesh->indices == NULL)
+    {
+        free_mesh(mesh);
+        return false;
+    }
+
+    mesh->vertex_count = vertex_count;
+    mesh->index_count = index_count;
+    return true;
+}
+
+void free_mesh(Mesh *mesh)
+{
+    free(mesh->vertices);
+    free(mesh->indices);
+    free(mesh->submeshes);
+    free(mesh->lods);
+    free(mesh->meshlets);
+    mesh->vertices = NULL;
+    mesh->indices = NULL;
+    mesh->submeshes = NULL;
+    mesh->lods = NULL;
+    mesh->meshlets = NULL;
+    mesh->vertex_count = 0;
+    mesh->index_count = 0;
+    mesh->submesh_count = 0;
+    mesh->lod_count = 0;
+    mesh->meshlet_count = 0;
+}
+
+bool add_mesh_submesh(Mesh *mesh, unsigned int first_index, unsigned int index_count, int material)
+{
+    MeshSubmesh *submeshes = (MeshSubmesh*)realloc(mesh->submeshes, sizeof(MeshSubmesh) * (mesh->submesh_count + 1));
+    if (submeshes == NULL)
+        return false;
+
+    mesh->submeshes = submeshes;
+    mesh->submeshes[mesh->submesh_count++] = (MeshSubmesh) { first_index, index_count, material };
+    return true;
+}
+
+void compute_mesh_bounds(Mesh *mesh)
+{
+    if (mesh->vertex_count == 0)
+    {
+        glm_vec3_zero(mesh->bounds[0]);
+        glm_vec3_zero(mesh->bounds[1]);
+        return;
+    }
+
+    glm_vec3_copy(mesh->vertices[0].position, mesh->bounds[0]);
+    glm_vec3_copy(mesh->vertices[0].position, mesh->bounds[1]);
+    for (unsigned int i = 1; i < mesh->vertex_count; i++)
+    {
+        glm_vec3_minv(mesh->bounds[0], mesh->vertices[i].position, mesh->bounds[0]);
+        glm_vec3_maxv(mesh->bounds[1], mesh->vertices[i].position, mesh->bounds[1]);
+    }
+}
+
+// smooth normals, each face weighted by its area, for meshes that came
+// without any. hard edges need the vertices split beforehand
+void compute_mesh_normals(Mesh *mesh)
+{
+    for (unsigned int i = 0; i < mesh->vertex_count; i++)
+        glm_vec3_zero(mesh->vertices[i].normal);
+
+    for (unsigned int i = 0; i + 2 < mesh->index_count; i += 3)
+    {
+        MeshVertex *a = &mesh->vertices[mesh->indices[i]];
+        MeshVertex *b = &mesh->vertices[mesh->indices[i + 1]];
+        MeshVertex *c = &mesh->vertices[mesh->indices[i + 2]];
+
+        // unnormalized, its length is twice the area
+        vec3 ab, ac, face;
+        glm_vec3_sub(b->position, a->position, ab);
+        glm_vec3_sub(c->position, a->position, ac);
+        glm_vec3_cross(ab, ac, face);
+
+        glm_vec3_add(a->normal, face, a->normal);
+        glm_vec3_add(b->normal, face, b->normal);
+        glm_vec3_add(c->normal, face, c->normal);
+    }
+
+    for (unsigned int i = 0; i < mesh->vertex_count; i++)
+    {
+        if (glm_vec3_norm2(mesh->vertices[i].normal) > 0.0f)
+            glm_vec3_normalize(mesh->vertices[i].normal);
+        else
+            glm_vec3_copy((vec3) { 0.0f, 0.0f, 1.0f }, mesh->vertices[i].normal);
+    }
+}
+
+// per-vertex tangent frames from the uv layout, accumulated over every face
+// and made orthogonal to the normal. needs normals first
+void compute_mesh_tangents(Mesh *mesh)
+{
+    vec3 *bitangents = (vec3*)calloc(mesh->vertex_count > 0 ? mesh->vertex_count : 1, sizeof(vec3));
+    for (unsigned int i = 0; i < mesh->vertex_count; i++)
+        glm_vec4_zero(mesh->vertices[i].tangent);
+
+    for (unsigned int i = 0; i + 2 < mesh->index_count; i += 3)
+    {
+        unsigned int corner[3] = { mesh->indices[i], mesh->indices[i + 1], mesh->indices[i + 2] };
+        MeshVertex *a = &mesh->vertices[corner[0]];
+        MeshVertex *b = &mesh->vertices[corner[1]];
+        MeshVertex *c = &mesh->vertices[corner[2]];
+
+        vec3 e1, e2;
+        glm_vec3_sub(b->position, a->position, e1);
+        glm_vec3_sub(c->position, a->position, e2);
+        float du1 = b->uv[0] - a->uv[0], dv1 = b->uv[1] - a->uv[1];
+        float du2 = c->uv[0] - a->uv[0], dv2 = c->uv[1] - a->uv[1];
+
+        float det = du1 * dv2 - du2 * dv1;
+        if (fabsf(det) < 1e-12f)
+            continue;
+        float r = 1.0f / det;
+
+        vec3 t, bt;
+        for (int k = 0; k < 3; k++)
+        {
+            t[k] = (e1[k] * dv2 - e2[k] * dv1) * r;
+            bt[k] = (e2[k] * du1 - e1[k] * du2) * r;
+        }
+
+        for (int k = 0; k < 3; k++)
+        {
+            MeshVertex *v = &mesh->vertices[corner[k]];
+            glm_vec3_add(v->tangent, t, v->tangent);
+            glm_vec3_add(bitangents[corner[k]], bt, bitangents[corner[k]]);
+        }
+    }
+
+    for (unsigned int i = 0; i < mesh->vertex_count; i++)
+    {
+        MeshVertex *v = &mesh->vertices[i];
+
+        // Gram-Schmidt against the normal
+        vec3 t;
+        glm_vec3_copy(v->tangent, t);
+        glm_vec3_muladds(v->normal, -glm_vec3_dot(v->normal, t), t);
+
+        if (glm_vec3_norm2(t) < 1e-20f)
+        {
+            // no usable uvs here, any vector perpendicular to the normal will do
+            vec3 axis = { 1.0f, 0.0f, 0.0f };
+            if (fabsf(v->normal[0]) > 0.9f)
+                glm_vec3_copy((vec3) { 0.0f, 1.0f, 0.0f }, axis);
+            glm_vec3_cross(axis, v->normal, t);
+        }
+        glm_vec3_normalize(t);
+
+        vec3 cross;
+        glm_vec3_cross(v->normal, t, cross);
+        float sign = glm_vec3_dot(cross, bitangents[i]) < 0.0f ? -1.0f : 1.0f;
+        glm_vec4(t, sign, v->tangent);
+    }
+
+    free(bitangents);
+}
+
+static uint32_t hash_mesh_vertex(const MeshVertex *vertex)
+{
+    // FNV-1a over the bytes, identical vertices have identical bytes
+    const unsigned char *bytes = (const unsigned char*)vertex;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < sizeof(MeshVertex); i++)
+    {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// merges vertices that are exactly the same and remaps the indices to
+// match, returns how many are left
+unsigned int weld_mesh(Mesh *mesh)
+{
+    uint32_t capacity = 16;
+    while (capacity < mesh->vertex_count * 2)
+        capacity <<= 1;
+
+    // open addressing, slots hold 1 + the vertex they were claimed by
+    uint32_t *slots = (uint32_t*)calloc(capacity, sizeof(uint32_t));
+    unsigned int *remap = (unsigned int*)malloc(sizeof(unsigned int) * (mesh->vertex_count > 0 ? mesh->vertex_count : 1));
+    if (slots == NULL || remap == NULL)
+    {
+        free(slots);
+        free(remap);
+        return mesh->vertex_count;
+    }
+
+    unsigned int unique = 0;
+    for (unsigned int i = 0; i < mesh->vertex_count; i++)
+    {
+        // -0 and 0 are the same vertex but not the same bytes, adding 0 turns one into the other
+        float *components = (float*)&mesh->vertices[i];
+        for (size_t k = 0; k < sizeof(MeshVertex) / sizeof(float); k++)
+            components[k] += 0.0f;
+
+        uint32_t slot = hash_mesh_vertex(&mesh->vertices[i]) & (capacity - 1);
+        while (slots[slot] != 0 && memcmp(&mesh->vertices[slots[slot] - 1], &mesh->vertices[i], sizeof(MeshVertex)) != 0)
+            slot = (slot + 1) & (capacity - 1);
+
+        if (slots[slot] == 0)
+        {
+            // first time, keep it in order where the welded copy will end up
+            mesh->vertices[unique] = mesh->vertices[i];
+            slots[slot] = unique + 1;
+            unique++;
+        }
+        remap[i] = slots[slot] - 1;
+    }
+
+    for (unsigned int i = 0; i < mesh->index_count; i++)
+        mesh->indices[i] = remap[mesh->indices[i]];
+    mesh->vertex_count = unique;
+
+    free(slots);
+    free(remap);
+    return unique;
+}
+
+// unindexed position + uv triangles, 5 floats a vertex like the cube's
+// vertices[]. faces get flat normals, which keeps hard edges apart when
+// identical corners are welded together
+bool mesh_from_triangle_soup(Mesh *mesh, const float *data, unsigned int vertex_count)
+{
+    if (!init_mesh(mesh, vertex_count, vertex_count))
+        return false;
+
+    for (unsigned int i = 0; i < vertex_count; i++)
+    {
+        MeshVertex *v = &mesh->vertices[i];
+        const float *src = &data[i * 5];
+        glm_vec3_copy((vec3) { src[0], src[1], src[2] }, v->position);
+        v->uv[0] = src[3];
+        v->uv[1] = src[4];
+        mesh->indices[i] = i;
+    }
+
+    for (unsigned int i = 0; i + 2 < vertex_count; i += 3)
+    {
+        vec3 ab, ac, normal;
+        glm_vec3_sub(mesh->vertices[i + 1].position, mesh->vertices[i].position, ab);
+        glm_vec3_sub(mesh->vertices[i + 2].position, mesh->vertices[i].position, ac);
+        glm_vec3_crossn(ab, ac, normal);
+        for (int k = 0; k < 3; k++)
+            glm_vec3_copy(normal, mesh->vertices[i + k].normal);
+    }
+
+    weld_mesh(mesh);
+    compute_mesh_tangents(mesh);
+    compute_mesh_bounds(mesh);
+    return true;
+}
+
+#endif
@@ -0,0 +1,493 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "jobs.h"
+#include "mesh.h"
+#include "mesh_import.h"
+
+// benchmark defaults
+#define MESH_BENCH_ITERATIONS 5
+#define MESH_BENCH_MAX_FILES 64
+// size of the generated OBJ, 0 leaves it and the GLB made from it out
+#define MESH_BENCH_GENERATED_MB 64
+#define MESH_BENCH_FLOAT_ROUNDS 1000000
+
+// imports each mesh through import_mesh, on one thread and then on the job
+// system, and reports the throughput in MB/s of file read along with how many
+// vertices and triangles came out. the threaded result has to match the single
+// threaded one exactly. the float parser is checked against strtof first,
+// then a GLB mixing primitives with and without normals and tangents, and
+// unless --size is 0 a large OBJ and a GLB of the same mesh are generated, so
+// the two formats can be compared and checked against each other
+
+typedef struct MeshBenchResult {
+    double seconds[2];
+    size_t size;
+    unsigned int vertices;
+    unsigned int triangles;
+} MeshBenchResult;
+
+typedef struct TextBuffer {
+    char *data;
+    size_t size;
+    size_t capacity;
+} TextBuffer;
+
+double bench_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint32_t bench_seed = 2463534242u;
+
+uint32_t bench_random(void)
+{
+    bench_seed ^= bench_seed << 13;
+    bench_seed ^= bench_seed >> 17;
+    bench_seed ^= bench_seed << 5;
+    return bench_seed;
+}
+
+void append_bytes(TextBuffer *buffer, const void *data, size_t size)
+{
+    if (buffer->size + size > buffer->capacity)
+    {
+        size_t capacity = buffer->capacity > 0 ? buffer->capacity : 1 << 16;
+        while (buffer->size + size > capacity)
+            capacity *= 2;
+        buffer->data = (char*)realloc(buffer->data, capacity);
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+}
+
+void append_text(TextBuffer *buffer, const char *format, ...) __attribute__((format(printf, 2, 3)));
+void append_text(TextBuffer *buffer, const char *format, ...)
+{
+    char line[256];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    append_bytes(buffer, line, (size_t) length);
+}
+
+// how far apart two floats are in representable steps
+unsigned int ulp_distance(float a, float b)
+{
+    int32_t x, y;
+    memcpy(&x, &a, 4);
+    memcpy(&y, &b, 4);
+    if (x < 0)
+        x = (int32_t) 0x80000000 - x;
+    if (y < 0)
+        y = (int32_t) 0x80000000 - y;
+    return (unsigned int) (x > y ? (int64_t) x - y : (int64_t) y - x);
+}
+
+// random values written the ways exporters write them, parsed back and
+// compared with strtof. a difference of one ulp is allowed, more is a bug
+bool validate_float_parser(void)
+{
+    static const char *formats[] = { "%.6f", "%.9g", "%e", "%.3f", "%.0f", "%.17g" };
+    int format_count = sizeof(formats) / sizeof(formats[0]);
+    long differing = 0;
+    unsigned int worst = 0;
+    char text[64];
+
+    for (int i = 0; i < MESH_BENCH_FLOAT_ROUNDS; i++)
+    {
+        // a spread of magnitudes with both signs
+        double mantissa = (double) bench_random() / 4294967296.0;
+        int exponent = (int) (bench_random() % 24) - 12;
+        double value = (bench_random() & 1 ? -1.0 : 1.0) * mantissa * pow(10.0, exponent);
+        int length = snprintf(text, sizeof(text), formats[i % format_count], value);
+
+        float expected = strtof(text, NULL), parsed;
+        const char *end = parse_obj_float(text, text + length, &parsed);
+        if (end != text + length)
+        {
+            printf("Float parser stopped early on %s\n", text);
+            return false;
+        }
+
+        unsigned int distance = ulp_distance(expected, parsed);
+        differing += distance != 0;
+        if (distance > worst)
+            worst = distance;
+    }
+
+    printf("Float parser: %ld of %d differ from strtof, worst by %u ulp\n", differing, MESH_BENCH_FLOAT_ROUNDS, worst);
+    return worst <= 1;
+}
+
+// a torus, with a uv seam where the grid wraps so the corners don't all weld
+// into one vertex per position. odd rows use relative indices and triangles
+// so both ways of writing faces are parsed
+bool generate_obj(const char *path, size_t target_size)
+{
+    // about 190 bytes of text a grid cell
+    int n = (int) sqrt((double) target_size / 190.0);
+    if (n < 4)
+        n = 4;
+
+    TextBuffer obj = { NULL, 0, 0 };
+    append_text(&obj, "# generated by mesh_bench\no torus\n");
+    for (int r = 0; r < n; r++)
+    {
+        for (int c = 0; c < n; c++)
+        {
+            float u = 2.0f * (float) M_PI * r / n, v = 2.0f * (float) M_PI * c / n;
+            append_text(&obj, "v %.6f %.6f %.6f\n", (1.0f + 0.3f * cosf(v)) * cosf(u), 0.3f * sinf(v), (1.0f + 0.3f * cosf(v)) * sinf(u));
+            append_text(&obj, "vn %.6f %.6f %.6f\n", cosf(v) * cosf(u), sinf(v), cosf(v) * sinf(u));
+        }
+    }
+    for (int r = 0; r <= n; r++)
+    {
+        for (int c = 0; c <= n; c++)
+            append_text(&obj, "vt %.6f %.6f\n", (float) r / n, (float) c / n);
+    }
+
+    int positions = n * n, uvs = (n + 1) * (n + 1);
+    for (int r = 0; r < n; r++)
+    {
+        for (int c = 0; c < n; c++)
+        {
+            int p[4] = { r * n + c, ((r + 1) % n) * n + c, ((r + 1) % n) * n + (c + 1) % n, r * n + (c + 1) % n };
+            int t[4] = { r * (n + 1) + c, (r + 1) * (n + 1) + c, (r + 1) * (n + 1) + c + 1, r * (n + 1) + c + 1 };
+            if (r % 2 == 0)
+            {
+                append_text(&obj, "f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d\n", p[0] + 1, t[0] + 1, p[0] + 1, p[1] + 1, t[1] + 1, p[1] + 1,
+                    p[2] + 1, t[2] + 1, p[2] + 1, p[3] + 1, t[3] + 1, p[3] + 1);
+                continue;
+            }
+
+            for (int k = 0; k < 2; k++)
+            {
+                int a = 0, b = k + 1, d = k + 2;
+                append_text(&obj, "f %d/%d/%d %d/%d/%d %d/%d/%d\n", p[a] - positions, t[a] - uvs, p[a] - positions,
+                    p[b] - positions, t[b] - uvs, p[b] - positions, p[d] - positions, t[d] - uvs, p[d] - positions);
+            }
+        }
+    }
+
+    FILE *file = fopen(path, "wb");
+    bool written = file != NULL && fwrite(obj.data, 1, obj.size, file) == obj.size;
+    if (file != NULL)
+        fclose(file);
+    free(obj.data);
+    return written;
+}
+
+// a GLB of the two chunks, frees them
+bool write_glb(const char *path, TextBuffer *json, TextBuffer *binary)
+{
+    // chunks are padded to 4 bytes, JSON with spaces
+    while (json->size % 4 != 0)
+        append_bytes(json, " ", 1);
+    uint32_t header[5] = { GLB_MAGIC, 2, (uint32_t) (12 + 8 + json->size + 8 + binary->size), (uint32_t) json->size, GLB_CHUNK_JSON };
+    uint32_t binary_header[2] = { (uint32_t) binary->size, GLB_CHUNK_BIN };
+
+    FILE *file = fopen(path, "wb");
+    bool written = file != NULL &&
+        fwrite(header, sizeof(header), 1, file) == 1 &&
+        fwrite(json->data, 1, json->size, file) == json->size &&
+        fwrite(binary_header, sizeof(binary_header), 1, file) == 1 &&
+        fwrite(binary->data, 1, binary->size, file) == binary->size;
+    if (file != NULL)
+        fclose(file);
+    free(json->data);
+    free(binary->data);
+    return written;
+}
+
+// the mesh as one GLB primitive with every attribute, the uvs and tangent
+// signs flipped to glTF's convention so importing flips them back
+bool generate_glb(const char *path, const Mesh *mesh)
+{
+    TextBuffer binary = { NULL, 0, 0 };
+    size_t offsets[5];
+
+    offsets[0] = binary.size;
+    for (unsigned int i = 0; i < mesh->vertex_count; i++)
+        append_bytes(&binary, mesh->vertices[i].position, sizeof(float) * 3);
+    offsets[1] = binary.size;
+    for (unsigned int i = 0; i < mesh->vertex_count; i++)
+        append_bytes(&binary, mesh->vertices[i].normal, sizeof(float) * 3);
+    offsets[2] = binary.size;
+    for (unsigned int i = 0; i < mesh->vertex_count; i++)
+    {
+        float tangent[4] = { mesh->vertices[i].tangent[0], mesh->vertices[i].tangent[1], mesh->vertices[i].tangent[2], -mesh->vertices[i].tangent[3] };
+        append_bytes(&binary, tangent, sizeof(tangent));
+    }
+    offsets[3] = binary.size;
+    for (unsigned int i = 0; i < mesh->vertex_count; i++)
+    {
+        float uv[2] = { mesh->vertices[i].uv[0], 1.0f - mesh->vertices[i].uv[1] };
+        append_bytes(&binary, uv, sizeof(uv));
+    }
+    offsets[4] = binary.size;
+    append_bytes(&binary, mesh->indices, sizeof(unsigned int) * mesh->index_count);
+    size_t binary_size = binary.size;
+
+    static const char *types[] = { "VEC3", "VEC3", "VEC4", "VEC2", "SCALAR" };
+    TextBuffer json = { NULL, 0, 0 };
+    append_text(&json, "{\"asset\":{\"version\":\"2.0\"},\"buffers\":[{\"byteLength\":%zu}],\"bufferViews\":[", binary_size);
+    for (int k = 0; k < 5; k++)
+    {
+        size_t end = k < 4 ? offsets[k + 1] : binary_size;
+        append_text(&json, "%s{\"buffer\":0,\"byteOffset\":%zu,\"byteLength\":%zu}", k > 0 ? "," : "", offsets[k], end - offsets[k]);
+    }
+    append_text(&json, "],\"accessors\":[");
+    for (int k = 0; k < 5; k++)
+    {
+        unsigned int count = k < 4 ? mesh->vertex_count : mesh->index_count;
+        append_text(&json, "%s{\"bufferView\":%d,\"componentType\":%d,\"count\":%u,\"type\":\"%s\"}", k > 0 ? "," : "",
+            k, k < 4 ? GLTF_FLOAT : GLTF_UNSIGNED_INT, count, types[k]);
+    }
+    append_text(&json, "],\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":0,\"NORMAL\":1,\"TANGENT\":2,\"TEXCOORD_0\":3},\"indices\":4}]}]}");
+
+    return write_glb(path, &json, &binary);
+}
+
+// a GLB of two primitives, the first with normals and tangents no smoothing
+// would give, the second with neither. the first's have to come through as
+// they were while the second's are made up
+bool check_mixed_glb(const char *path)
+{
+    static const float positions[] = { 0, 0, 0,  1, 0, 0,  1, 0, 1,  0, 0, 1,  3, 0, 0,  4, 1, 0,  3, 1, 1 };
+    static const float normals[] = { 1, 0, 0,  0, 0, 1,  0, 1, 0,  0.6f, 0.8f, 0 };
+    static const float tangents[] = { 0, 0, 1, 1,  0, 0, 1, 1,  1, 0, 0, -1,  1, 0, 0, -1 };
+    static const unsigned int indices[] = { 0, 2, 1, 0, 3, 2,  0, 1, 2 };
+
+    TextBuffer binary = { NULL, 0, 0 };
+    append_bytes(&binary, positions, sizeof(positions));
+    append_bytes(&binary, normals, sizeof(normals));
+    append_bytes(&binary, tangents, sizeof(tangents));
+    append_bytes(&binary, indices, sizeof(indices));
+
+    // positions of both, normals, tangents, indices of both
+    static const size_t views[] = { 0, 48, 84, 132, 196, 220, 232 };
+    static const int accessors[][3] = { { 0, 4, 3 }, { 1, 3, 3 }, { 2, 4, 3 }, { 3, 4, 4 }, { 4, 6, 1 }, { 5, 3, 1 } };
+    static const char *types[] = { "", "SCALAR", "", "VEC3", "VEC4" };
+
+    TextBuffer json = { NULL, 0, 0 };
+    append_text(&json, "{\"asset\":{\"version\":\"2.0\"},\"buffers\":[{\"byteLength\":%zu}],\"bufferViews\":[", binary.size);
+    for (int k = 0; k < 6; k++)
+        append_text(&json, "%s{\"buffer\":0,\"byteOffset\":%zu,\"byteLength\":%zu}", k > 0 ? "," : "", views[k], views[k + 1] - views[k]);
+    append_text(&json, "],\"accessors\":[");
+    for (int k = 0; k < 6; k++)
+        append_text(&json, "%s{\"bufferView\":%d,\"componentType\":%d,\"count\":%d,\"type\":\"%s\"}", k > 0 ? "," : "",
+            accessors[k][0], k < 4 ? GLTF_FLOAT : GLTF_UNSIGNED_INT, accessors[k][1], types[accessors[k][2]]);
+    append_text(&json, "],\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":0,\"NORMAL\":2,\"TANGENT\":3},\"indices\":4},");
+    append_text(&json, "{\"attributes\":{\"POSITION\":1},\"indices\":5}]}]}");
+
+    Mesh mesh;
+    if (!write_glb(path, &json, &binary) || !import_mesh(path, &mesh))
+    {
+        printf("Failed to make or import the mixed attribute GLB\n");
+        return false;
+    }
+
+    bool kept = mesh.vertex_count == 7;
+    for (unsigned int i = 0; i < 4 && kept; i++)
+    {
+        // glTF's tangent sign is the other way round to ours
+        const MeshVertex *v = &mesh.vertices[i];
+        kept = v->normal[0] == normals[i * 3] && v->normal[1] == normals[i * 3 + 1] && v->normal[2] == normals[i * 3 + 2] &&
+            v->tangent[0] == tangents[i * 4] && v->tangent[1] == tangents[i * 4 + 1] && v->tangent[2] == tangents[i * 4 + 2] &&
+            v->tangent[3] == -tangents[i * 4 + 3];
+    }
+    bool filled = kept;
+    for (unsigned int i = 4; i < 7 && filled; i++)
+        filled = fabsf(glm_vec3_norm(mesh.vertices[i].normal) - 1.0f) < 1e-4f && fabsf(mesh.vertices[i].tangent[3]) == 1.0f;
+    free_mesh(&mesh);
+
+    if (!kept)
+        printf("Authored glTF normals or tangents were lost to a primitive without them\n");
+    else if (!filled)
+        printf("A glTF primitive without normals or tangents didn't get them\n");
+    return kept && filled;
+}
+
+bool same_mesh(const Mesh *a, const Mesh *b)
+{
+    return a->vertex_count == b->vertex_count && a->index_count == b->index_count &&
+        memcmp(a->vertices, b->vertices, sizeof(MeshVertex) * a->vertex_count) == 0 &&
+        memcmp(a->indices, b->indices, sizeof(unsigned int) * a->index_count) == 0;
+}
+
+// close enough for meshes that went through another format, 1 - (1 - v) isn't always v
+bool similar_mesh(const Mesh *a, const Mesh *b)
+{
+    if (a->vertex_count != b->vertex_count || a->index_count != b->index_count ||
+        memcmp(a->indices, b->indices, sizeof(unsigned int) * a->index_count) != 0)
+        return false;
+
+    const float *x = (const float*)a->vertices, *y = (const float*)b->vertices;
+    for (size_t k = 0; k < (size_t) a->vertex_count * sizeof(MeshVertex) / sizeof(float); k++)
+    {
+        if (fabsf(x[k] - y[k]) > 1e-6f)
+            return false;
+    }
+    return true;
+}
+
+// best of a few imports, the first one's mesh is kept for checking
+double time_import(const char *path, int iterations, Mesh *mesh)
+{
+    double best = 1e30;
+    for (int i = 0; i < iterations; i++)
+    {
+        Mesh imported;
+        double start = bench_time();
+        bool ok = import_mesh(path, &imported);
+        double elapsed = bench_time() - start;
+        if (!ok)
+            return -1.0;
+
+        if (elapsed < best)
+            best = elapsed;
+        if (i == 0)
+            *mesh = imported;
+        else
+            free_mesh(&imported);
+    }
+    return best;
+}
+
+// one thread with no job system, then all of them. the threaded import's
+// mesh is kept in single, for comparing formats
+bool bench_file(const char *path, int threads, int iterations, MeshBenchResult *result, Mesh *single)
+{
+    struct stat info;
+    memset(result, 0, sizeof(MeshBenchResult));
+    if (stat(path, &info) != 0)
+    {
+        printf("Failed to read %s\n", path);
+        return false;
+    }
+    result->size = (size_t) info.st_size;
+
+    Mesh threaded;
+    result->seconds[0] = time_import(path, iterations, single);
+    if (result->seconds[0] < 0.0)
+        return false;
+
+    JobSystem job_system;
+    init_job_system(&job_system, (unsigned int) threads);
+    result->seconds[1] = time_import(path, iterations, &threaded);
+    destroy_job_system(&job_system);
+    if (result->seconds[1] < 0.0)
+    {
+        free_mesh(single);
+        return false;
+    }
+
+    result->vertices = single->vertex_count;
+    result->triangles = single->index_count / 3;
+    bool same = same_mesh(single, &threaded);
+    free_mesh(&threaded);
+
+    printf("%-40s %8.1f MB  %9u verts  %9u tris  %8.1f MB/s 1 thread  %8.1f MB/s %d threads  %5.2fx%s\n",
+        path, result->size / 1e6, result->vertices, result->triangles, result->size / 1e6 / result->seconds[0],
+        result->size / 1e6 / result->seconds[1], threads, result->seconds[0] / result->seconds[1],
+        same ? "" : "  MISMATCH");
+    return same;
+}
+
+int main(int argc, char **argv)
+{
+    int threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    int iterations = MESH_BENCH_ITERATIONS;
+    int generated_mb = MESH_BENCH_GENERATED_MB;
+    const char *files[MESH_BENCH_MAX_FILES];
+    int file_count = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc)
+            iterations = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+            generated_mb = atoi(argv[++i]);
+        else if (file_count < MESH_BENCH_MAX_FILES)
+            files[file_count++] = argv[i];
+    }
+
+    if (threads < 2)
+        threads = 2;
+    if (iterations < 1)
+        iterations = 1;
+
+    bool ok = validate_float_parser();
+    MeshBenchResult result;
+
+    char mixed_path[] = "/tmp/mesh_bench_XXXXXX.glb";
+    int mixed_fd = mkstemps(mixed_path, 4);
+    if (mixed_fd >= 0)
+    {
+        close(mixed_fd);
+        ok &= check_mixed_glb(mixed_path);
+        unlink(mixed_path);
+    }
+
+    for (int i = 0; i < file_count; i++)
+    {
+        Mesh mesh;
+        if (bench_file(files[i], threads, iterations, &result, &mesh))
+            free_mesh(&mesh);
+        else
+            ok = false;
+    }
+
+    if (generated_mb > 0)
+    {
+        char obj_path[] = "/tmp/mesh_bench_XXXXXX.obj";
+        char glb_path[] = "/tmp/mesh_bench_XXXXXX.glb";
+        int obj_fd = mkstemps(obj_path, 4), glb_fd = mkstemps(glb_path, 4);
+        if (obj_fd < 0 || glb_fd < 0)
+        {
+            printf("Failed to create generated meshes\n");
+            return 1;
+        }
+        close(obj_fd);
+        close(glb_fd);
+
+        Mesh obj, glb;
+        if (generate_obj(obj_path, (size_t) generated_mb << 20) && bench_file(obj_path, threads, iterations, &result, &obj))
+        {
+            if (generate_glb(glb_path, &obj) && bench_file(glb_path, threads, iterations, &result, &glb))
+            {
+                if (!similar_mesh(&obj, &glb))
+                {
+                    printf("The generated GLB doesn't import to the same mesh as the OBJ it came from\n");
+                    ok = false;
+                }
+                free_mesh(&glb);
+            }
+            else
+                ok = false;
+            free_mesh(&obj);
+        }
+        else
+            ok = false;
+
+        unlink(obj_path);
+        unlink(glb_path);
+    }
+
+    return ok ? 0 : 1;
+}
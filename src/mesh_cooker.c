@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "jobs.h"
+#include "mesh.h"
+#include "mesh_import.h"
+#include "mesh_simplify.h"
+#include "meshlet.h"
+#include "vertex_compress.h"
+#include "cooked_mesh.h"
+
+// turns an OBJ, glTF or GLB into a cooked .mesh the renderer maps and
+// uploads without parsing, see cooked_mesh.h, with a chain of LODs from
+// mesh_simplify.h behind the full detail one, all split into meshlets for
+// the GPU to cull, see meshlet.h. the written file is mapped
+// back and compared with what was packed before it counts as cooked
+//
+//   mesh_cooker input.obj output.mesh
+
+double cook_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+bool check_cooked_mesh(const char *path, const Mesh *mesh, const PackedMesh *packed)
+{
+    CookedMesh cooked;
+    if (!map_cooked_mesh(path, &cooked))
+        return false;
+
+    bool same = cooked.header->vertex_count == packed->vertex_count && cooked.header->index_count == packed->index_count &&
+        memcmp(cooked.vertices, packed->vertices, sizeof(PackedVertex) * packed->vertex_count) == 0 &&
+        memcmp(cooked.indices, packed->indices, sizeof(uint32_t) * packed->index_count) == 0 &&
+        cooked.header->meshlet_count == mesh->meshlet_count &&
+        memcmp(cooked.meshlets, mesh->meshlets, sizeof(Meshlet) * mesh->meshlet_count) == 0;
+    unmap_cooked_mesh(&cooked);
+
+    if (!same)
+        printf("Cooked mesh %s doesn't read back as written\n", path);
+    return same;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 3)
+    {
+        printf("usage: %s input.(obj|gltf|glb) output.mesh\n", argv[0]);
+        return 1;
+    }
+
+    JobSystem job_system;
+    init_job_system(&job_system, 0);
+
+    double start = cook_time();
+    Mesh mesh;
+    if (!import_mesh(argv[1], &mesh))
+    {
+        destroy_job_system(&job_system);
+        return 1;
+    }
+    double imported = cook_time();
+
+    PackedMesh packed;
+    memset(&packed, 0, sizeof(PackedMesh));
+    VertexCompressionError error;
+    unsigned int full_detail = mesh.index_count;
+    bool ok = build_mesh_lods(&mesh) && build_mesh_meshlets(&mesh);
+    double simplified = cook_time();
+    ok = ok && compress_mesh(&mesh, &packed, &error);
+    if (ok)
+    {
+        print_mesh_lods(argv[1], &mesh);
+        print_mesh_meshlets(argv[1], &mesh);
+        print_vertex_compression(argv[1], &packed, &error);
+        ok = cook_mesh(argv[2], &mesh, &packed) && check_cooked_mesh(argv[2], &mesh, &packed);
+    }
+    double cooked = cook_time();
+
+    if (ok)
+        printf("Cooked %s into %s: %u vertices, %u triangles, %u submeshes, %u LODs, %u meshlets, import %.1f ms, LODs and meshlets %.1f ms, pack and write %.1f ms\n",
+            argv[1], argv[2], mesh.vertex_count, full_detail / 3, mesh.submesh_count, mesh.lod_count, mesh.meshlet_count,
+            (imported - start) * 1000.0, (simplified - imported) * 1000.0, (cooked - simplified) * 1000.0);
+
+    free_packed_mesh(&packed);
+    free_mesh(&mesh);
+    destroy_job_system(&job_system);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,1491 @@
+#ifndef MESH_IMPORT_H
+#define MESH_IMPORT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define IMPORT_X86 1
+#endif
+
+#include "jobs.h"
+#include "mesh.h"
+
+// mesh import defaults
+#define IMPORT_OBJ_CHUNK_SIZE (1 << 20) // bytes of OBJ text per parsing job
+#define IMPORT_VERTICES_PER_JOB 16384
+#define IMPORT_MAX_FLOAT_LENGTH 64
+#define IMPORT_MAX_PATH 1024
+
+// OBJ and glTF meshes read straight out of a memory mapped file and turned
+// into the indexed Mesh everything else takes. OBJ text is cut into chunks at
+// line breaks and parsed on the job system twice: once to count what each
+// chunk holds, so every chunk knows where its output goes and what its
+// relative indices point at, then again to parse straight into place. the
+// corners are welded into vertices in parallel too, keeping the order a
+// single thread would give, so the result doesn't depend on the thread count.
+// glTF is already indexed, its accessors are just converted in parallel.
+// node transforms aren't applied, every primitive comes out in mesh space
+
+typedef struct MappedFile {
+    const char *data;
+    size_t size;
+} MappedFile;
+
+// absolute 0 based indices, -1 where the face left one out
+typedef struct ObjCorner {
+    int position;
+    int uv;
+    int normal;
+} ObjCorner;
+
+// one line-aligned piece of the file and where its output goes
+typedef struct ObjChunk {
+    const char *begin;
+    const char *end;
+    unsigned int positions;
+    unsigned int uvs;
+    unsigned int normals;
+    unsigned int corners;
+    unsigned int position_base;
+    unsigned int uv_base;
+    unsigned int normal_base;
+    unsigned int corner_base;
+    // corners that start a new vertex, for numbering them in order
+    unsigned int firsts;
+    unsigned int first_base;
+    // vertices that came without a normal
+    unsigned int unnormaled;
+    bool failed;
+} ObjChunk;
+
+// shared state for one OBJ import's jobs
+typedef struct ObjImport {
+    const char *data;
+    size_t size;
+    ObjChunk *chunks;
+    unsigned int chunk_count;
+
+    float *positions;
+    float *uvs;
+    float *normals;
+    ObjCorner *corners;
+    unsigned int position_count;
+    unsigned int uv_count;
+    unsigned int normal_count;
+    unsigned int corner_count;
+
+    // open addressing over corners, a slot holds 1 + the lowest corner
+    // with its key, which becomes the vertex
+    _Atomic uint32_t *slots;
+    uint32_t *slot_vertex;
+    uint32_t slot_mask;
+    uint32_t *corner_slot;
+
+    Mesh *mesh;
+} ObjImport;
+
+typedef enum JsonType {
+    JSON_OBJECT,
+    JSON_ARRAY,
+    JSON_STRING,
+    JSON_PRIMITIVE
+} JsonType;
+
+// tokens are stored depth first, next is the index just past the token and
+// everything inside it, so siblings are one step apart. strings exclude quotes
+typedef struct JsonToken {
+    JsonType type;
+    int start;
+    int end;
+    int next;
+} JsonToken;
+
+typedef struct JsonDocument {
+    const char *text;
+    int length;
+    JsonToken *tokens;
+    int count;
+    int capacity;
+} JsonDocument;
+
+// one glTF accessor resolved to bytes
+typedef struct GltfAccessor {
+    const unsigned char *data;
+    unsigned int count;
+    unsigned int stride;
+    int components;
+    int component_type;
+    bool normalized;
+} GltfAccessor;
+
+// shared state for converting one primitive
+typedef struct GltfPrimitive {
+    GltfAccessor position;
+    GltfAccessor normal;
+    GltfAccessor tangent;
+    GltfAccessor uv;
+    GltfAccessor indices;
+    bool has_normal;
+    bool has_tangent;
+    bool has_uv;
+    bool has_indices;
+    unsigned int first_vertex;
+    unsigned int first_index;
+    unsigned int index_count;
+    atomic_bool out_of_range;
+    Mesh *mesh;
+} GltfPrimitive;
+
+bool map_file(const char *path, MappedFile *file);
+void unmap_file(MappedFile *file);
+bool import_mesh(const char *path, Mesh *mesh);
+bool import_obj(const char *data, size_t size, Mesh *mesh);
+bool import_gltf(const char *data, size_t size, const char *path, Mesh *mesh);
+const char *parse_obj_float(const char *p, const char *end, float *value);
+
+// read only and private, the pages come in as the parsers touch them
+bool map_file(const char *path, MappedFile *file)
+{
+    file->data = NULL;
+    file->size = 0;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        printf("Failed to open mesh %s\n", path);
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size <= 0)
+    {
+        printf("Mesh %s is empty\n", path);
+        close(fd);
+        return false;
+    }
+
+    void *data = mmap(NULL, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        printf("Failed to map mesh %s\n", path);
+        return false;
+    }
+
+    // every chunk is read front to back once. the advice values aren't
+    // flags, so this takes two calls
+    madvise(data, (size_t) info.st_size, MADV_SEQUENTIAL);
+    madvise(data, (size_t) info.st_size, MADV_WILLNEED);
+    file->data = (const char*)data;
+    file->size = (size_t) info.st_size;
+    return true;
+}
+
+void unmap_file(MappedFile *file)
+{
+    if (file->data != NULL)
+        munmap((void*)file->data, file->size);
+    file->data = NULL;
+    file->size = 0;
+}
+
+static bool path_has_extension(const char *path, const char *extension)
+{
+    size_t length = strlen(path), extension_length = strlen(extension);
+    return length >= extension_length && strcasecmp(path + length - extension_length, extension) == 0;
+}
+
+// picks the format from the extension, or the magic number for GLB
+bool import_mesh(const char *path, Mesh *mesh)
+{
+    memset(mesh, 0, sizeof(Mesh));
+
+    MappedFile file;
+    if (!map_file(path, &file))
+        return false;
+
+    bool imported;
+    if (path_has_extension(path, ".obj"))
+        imported = import_obj(file.data, file.size, mesh);
+    else if (path_has_extension(path, ".gltf") || path_has_extension(path, ".glb") || (file.size >= 4 && memcmp(file.data, "glTF", 4) == 0))
+        imported = import_gltf(file.data, file.size, path, mesh);
+    else
+    {
+        printf("Unknown mesh format %s\n", path);
+        imported = false;
+    }
+
+    unmap_file(&file);
+    if (!imported)
+        printf("Failed to import mesh %s\n", path);
+    return imported;
+}
+
+// numbers
+
+static const double import_powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static bool is_import_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+// how many decimal digits start at p, sixteen bytes at a time where there's room
+static int digit_run(const char *p, const char *end)
+{
+    int run = 0;
+#ifdef IMPORT_X86
+    const __m128i below = _mm_set1_epi8('0' - 1);
+    const __m128i above = _mm_set1_epi8('9' + 1);
+    while (end - p >= 16)
+    {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)p);
+        __m128i digits = _mm_and_si128(_mm_cmpgt_epi8(bytes, below), _mm_cmplt_epi8(bytes, above));
+        unsigned int others = ~(unsigned int) _mm_movemask_epi8(digits) & 0xFFFF;
+        if (others != 0)
+            return run + __builtin_ctz(others);
+        run += 16;
+        p += 16;
+    }
+#endif
+    while (p < end && *p >= '0' && *p <= '9')
+    {
+        run++;
+        p++;
+    }
+    return run;
+}
+
+// eight ASCII digits to their value with three multiplies, little endian only
+static uint32_t parse_eight_digits(const char *p)
+{
+    uint64_t value;
+    memcpy(&value, p, 8);
+    value = (value & 0x0F0F0F0F0F0F0F0Full) * 2561 >> 8;
+    value = (value & 0x00FF00FF00FF00FFull) * 6553601 >> 16;
+    return (uint32_t) ((value & 0x0000FFFF0000FFFFull) * 42949672960001ull >> 32);
+}
+
+static uint64_t accumulate_digits(uint64_t value, const char *p, int count)
+{
+    for (; count >= 8; count -= 8, p += 8)
+        value = value * 100000000u + parse_eight_digits(p);
+    for (; count > 0; count--, p++)
+        value = value * 10 + (uint64_t) (*p - '0');
+    return value;
+}
+
+// the rare number the fast path can't do exactly, or inf and nan
+static const char *parse_float_slow(const char *p, const char *end, float *value)
+{
+    char text[IMPORT_MAX_FLOAT_LENGTH];
+    int length = 0;
+    while (p + length < end && length < IMPORT_MAX_FLOAT_LENGTH - 1 && !is_import_space(p[length]) && p[length] != '\n' && p[length] != '/')
+    {
+        text[length] = p[length];
+        length++;
+    }
+    text[length] = '\0';
+
+    char *stop;
+    *value = strtof(text, &stop);
+    return stop == text ? NULL : p + (stop - text);
+}
+
+// a decimal float, returns just past it or NULL if there isn't one. the
+// digits go into one integer that is scaled by an exact power of ten in
+// double, so the float is at most an ulp from strtof's and almost always the
+// same. more than 19 digits or exponents past 22 go to strtof itself
+const char *parse_obj_float(const char *p, const char *end, float *value)
+{
+    const char *start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = *p == '-';
+        p++;
+    }
+
+    // counted before accumulating, more than 19 digits could overflow
+    int integer_digits = digit_run(p, end);
+    const char *fraction = p + integer_digits;
+    int fraction_digits = 0;
+    if (fraction < end && *fraction == '.')
+        fraction_digits = digit_run(++fraction, end);
+
+    if (integer_digits + fraction_digits == 0 || integer_digits + fraction_digits > 19)
+        return parse_float_slow(start, end, value);
+
+    uint64_t mantissa = accumulate_digits(0, p, integer_digits);
+    mantissa = accumulate_digits(mantissa, fraction, fraction_digits);
+    p = fraction + fraction_digits;
+
+    int exponent = -fraction_digits;
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        const char *e = p + 1;
+        bool negative_exponent = false;
+        if (e < end && (*e == '-' || *e == '+'))
+        {
+            negative_exponent = *e == '-';
+            e++;
+        }
+        int exponent_digits = digit_run(e, end);
+        if (exponent_digits == 0 || exponent_digits > 4)
+            return parse_float_slow(start, end, value);
+        int written = (int) accumulate_digits(0, e, exponent_digits);
+        exponent += negative_exponent ? -written : written;
+        p = e + exponent_digits;
+    }
+
+    double result = (double) mantissa;
+    if (mantissa != 0)
+    {
+        if (exponent < -22 || exponent > 22)
+            return parse_float_slow(start, end, value);
+        result = exponent < 0 ? result / import_powers_of_ten[-exponent] : result * import_powers_of_ten[exponent];
+    }
+
+    *value = (float) (negative ? -result : result);
+    return p;
+}
+
+// an OBJ index, 1 based or negative for counting back from the last element
+static const char *parse_obj_index(const char *p, const char *end, int *index)
+{
+    bool negative = false;
+    if (p < end && *p == '-')
+    {
+        negative = true;
+        p++;
+    }
+
+    int digits = digit_run(p, end);
+    if (digits == 0 || digits > 9)
+        return NULL;
+
+    int value = (int) accumulate_digits(0, p, digits);
+    *index = negative ? -value : value;
+    return p + digits;
+}
+
+// OBJ
+
+static const char *skip_import_spaces(const char *p, const char *end)
+{
+    while (p < end && is_import_space(*p))
+        p++;
+    return p;
+}
+
+static const char *next_import_line(const char *p, const char *end)
+{
+    const char *newline = (const char*)memchr(p, '\n', (size_t) (end - p));
+    return newline != NULL ? newline + 1 : end;
+}
+
+// chunks start at the line after each IMPORT_OBJ_CHUNK_SIZE boundary, worked
+// out independently by each chunk and its neighbour so they always agree
+static size_t obj_chunk_start(const ObjImport *import, size_t offset)
+{
+    if (offset == 0)
+        return 0;
+    if (offset >= import->size)
+        return import->size;
+    return (size_t) (next_import_line(import->data + offset - 1, import->data + import->size) - import->data);
+}
+
+// which statement a line is: v, vt, vn, f or something to skip
+enum {
+    OBJ_LINE_OTHER,
+    OBJ_LINE_POSITION,
+    OBJ_LINE_UV,
+    OBJ_LINE_NORMAL,
+    OBJ_LINE_FACE
+};
+
+static int obj_line_type(const char **line, const char *end)
+{
+    const char *p = skip_import_spaces(*line, end);
+    int type = OBJ_LINE_OTHER;
+    int length = 0;
+
+    if (end - p >= 2 && p[0] == 'v' && is_import_space(p[1]))
+    {
+        type = OBJ_LINE_POSITION;
+        length = 1;
+    }
+    else if (end - p >= 3 && p[0] == 'v' && p[1] == 't' && is_import_space(p[2]))
+    {
+        type = OBJ_LINE_UV;
+        length = 2;
+    }
+    else if (end - p >= 3 && p[0] == 'v' && p[1] == 'n' && is_import_space(p[2]))
+    {
+        type = OBJ_LINE_NORMAL;
+        length = 2;
+    }
+    else if (end - p >= 2 && p[0] == 'f' && is_import_space(p[1]))
+    {
+        type = OBJ_LINE_FACE;
+        length = 1;
+    }
+
+    *line = p + length;
+    return type;
+}
+
+// first pass, counts the statements in each chunk. faces are fanned into
+// triangles, so one with n corners makes 3 * (n - 2)
+static void count_obj_chunks(void *data, unsigned int begin, unsigned int end)
+{
+    ObjImport *import = (ObjImport*)data;
+
+    for (unsigned int c = begin; c < end; c++)
+    {
+        ObjChunk *chunk = &import->chunks[c];
+        chunk->begin = import->data + obj_chunk_start(import, (size_t) c * IMPORT_OBJ_CHUNK_SIZE);
+        chunk->end = import->data + obj_chunk_start(import, (size_t) (c + 1) * IMPORT_OBJ_CHUNK_SIZE);
+
+        const char *p = chunk->begin;
+        while (p < chunk->end)
+        {
+            const char *line_end = (const char*)memchr(p, '\n', (size_t) (chunk->end - p));
+            if (line_end == NULL)
+                line_end = chunk->end;
+
+            switch (obj_line_type(&p, line_end))
+            {
+            case OBJ_LINE_POSITION:
+                chunk->positions++;
+                break;
+            case OBJ_LINE_UV:
+                chunk->uvs++;
+                break;
+            case OBJ_LINE_NORMAL:
+                chunk->normals++;
+                break;
+            case OBJ_LINE_FACE:
+            {
+                unsigned int corners = 0;
+                p = skip_import_spaces(p, line_end);
+                while (p < line_end && *p != '#')
+                {
+                    corners++;
+                    while (p < line_end && !is_import_space(*p))
+                        p++;
+                    p = skip_import_spaces(p, line_end);
+                }
+                if (corners >= 3)
+                    chunk->corners += 3 * (corners - 2);
+                break;
+            }
+            }
+
+            p = line_end + 1;
+        }
+    }
+}
+
+static bool resolve_obj_index(int written, unsigned int defined, int *index)
+{
+    if (written > 0 && (unsigned int) written <= defined)
+        *index = written - 1;
+    else if (written < 0 && (unsigned int) -written <= defined)
+        *index = (int) defined + written;
+    else
+        return false;
+    return true;
+}
+
+// one v, v/vt, v//vn or v/vt/vn corner, relative indices resolved against
+// how many of each were defined before this line
+static const char *parse_obj_corner(const char *p, const char *end, const unsigned int *defined, ObjCorner *corner)
+{
+    int written;
+    corner->uv = -1;
+    corner->normal = -1;
+
+    p = parse_obj_index(p, end, &written);
+    if (p == NULL || !resolve_obj_index(written, defined[0], &corner->position))
+        return NULL;
+
+    if (p < end && *p == '/')
+    {
+        p++;
+        if (p < end && *p != '/')
+        {
+            p = parse_obj_index(p, end, &written);
+            if (p == NULL || !resolve_obj_index(written, defined[1], &corner->uv))
+                return NULL;
+        }
+        if (p < end && *p == '/')
+        {
+            p = parse_obj_index(p + 1, end, &written);
+            if (p == NULL || !resolve_obj_index(written, defined[2], &corner->normal))
+                return NULL;
+        }
+    }
+
+    if (p < end && !is_import_space(*p))
+        return NULL;
+    return p;
+}
+
+static const char *parse_obj_floats(const char *p, const char *end, float *values, int count, int required)
+{
+    for (int k = 0; k < count; k++)
+    {
+        p = skip_import_spaces(p, end);
+        const char *next = p < end ? parse_obj_float(p, end, &values[k]) : NULL;
+        if (next == NULL)
+        {
+            if (k < required)
+                return NULL;
+            values[k] = 0.0f;
+            continue;
+        }
+        p = next;
+    }
+    return p;
+}
+
+// second pass, parses each chunk straight into the shared arrays
+static void parse_obj_chunks(void *data, unsigned int begin, unsigned int end)
+{
+    ObjImport *import = (ObjImport*)data;
+
+    for (unsigned int c = begin; c < end; c++)
+    {
+        ObjChunk *chunk = &import->chunks[c];
+        float *position = import->positions + (size_t) chunk->position_base * 3;
+        float *uv = import->uvs + (size_t) chunk->uv_base * 2;
+        float *normal = import->normals + (size_t) chunk->normal_base * 3;
+        ObjCorner *corner = import->corners + chunk->corner_base;
+        unsigned int defined[3] = { chunk->position_base, chunk->uv_base, chunk->normal_base };
+
+        const char *p = chunk->begin, *line = p;
+        while (p < chunk->end && !chunk->failed)
+        {
+            const char *line_end = (const char*)memchr(p, '\n', (size_t) (chunk->end - p));
+            if (line_end == NULL)
+                line_end = chunk->end;
+            line = p;
+
+            switch (obj_line_type(&p, line_end))
+            {
+            case OBJ_LINE_POSITION:
+                chunk->failed = parse_obj_floats(p, line_end, position, 3, 3) == NULL;
+                position += 3;
+                defined[0]++;
+                break;
+            case OBJ_LINE_UV:
+                chunk->failed = parse_obj_floats(p, line_end, uv, 2, 1) == NULL;
+                uv += 2;
+                defined[1]++;
+                break;
+            case OBJ_LINE_NORMAL:
+                chunk->failed = parse_obj_floats(p, line_end, normal, 3, 3) == NULL;
+                normal += 3;
+                defined[2]++;
+                break;
+            case OBJ_LINE_FACE:
+            {
+                ObjCorner first, previous, current;
+                unsigned int corners = 0;
+                p = skip_import_spaces(p, line_end);
+                while (p < line_end && *p != '#' && !chunk->failed)
+                {
+                    p = parse_obj_corner(p, line_end, defined, &current);
+                    if (p == NULL)
+                    {
+                        chunk->failed = true;
+                        break;
+                    }
+                    p = skip_import_spaces(p, line_end);
+
+                    if (corners == 0)
+                        first = current;
+                    else if (corners >= 2)
+                    {
+                        corner[0] = first;
+                        corner[1] = previous;
+                        corner[2] = current;
+                        corner += 3;
+                    }
+                    previous = current;
+                    corners++;
+                }
+                break;
+            }
+            }
+
+            p = line_end + 1;
+        }
+
+        if (chunk->failed)
+        {
+            // count the lines up to here, for the error message only
+            unsigned int number = 1;
+            for (const char *q = import->data; q < line; q++)
+                number += *q == '\n';
+            printf("Malformed OBJ statement on line %u\n", number);
+        }
+    }
+}
+
+static uint32_t hash_obj_corner(const ObjCorner *corner)
+{
+    uint32_t hash = (uint32_t) corner->position * 0x9E3779B1u;
+    hash ^= ((uint32_t) corner->uv + 0x7F4A7C15u) * 0x85EBCA77u;
+    hash ^= ((uint32_t) corner->normal + 0x165667B1u) * 0xC2B2AE3Du;
+    return hash ^ (hash >> 15);
+}
+
+static bool same_obj_corner(const ObjCorner *a, const ObjCorner *b)
+{
+    return a->position == b->position && a->uv == b->uv && a->normal == b->normal;
+}
+
+// puts every corner in the table, leaving each slot with the lowest corner
+// that has its key. which thread gets there first doesn't matter
+static void insert_obj_corners(void *data, unsigned int begin, unsigned int end)
+{
+    ObjImport *import = (ObjImport*)data;
+
+    for (unsigned int c = begin; c < end; c++)
+    {
+        const ObjCorner *corner = &import->corners[c];
+        uint32_t slot = hash_obj_corner(corner) & import->slot_mask;
+        uint32_t claim = c + 1;
+
+        for (;;)
+        {
+            uint32_t held = atomic_load_explicit(&import->slots[slot], memory_order_relaxed);
+            if (held == 0)
+            {
+                if (atomic_compare_exchange_weak_explicit(&import->slots[slot], &held, claim, memory_order_relaxed, memory_order_relaxed))
+                    break;
+                // lost the race, look at whoever won
+                if (held == 0)
+                    continue;
+            }
+
+            if (same_obj_corner(&import->corners[held - 1], corner))
+            {
+                while (claim < held && !atomic_compare_exchange_weak_explicit(&import->slots[slot], &held, claim, memory_order_relaxed, memory_order_relaxed))
+                    ;
+                break;
+            }
+            slot = (slot + 1) & import->slot_mask;
+        }
+
+        import->corner_slot[c] = slot;
+    }
+}
+
+// the lowest corner with each key starts a vertex, counted per chunk so
+// they can be numbered in order
+static void count_obj_vertices(void *data, unsigned int begin, unsigned int end)
+{
+    ObjImport *import = (ObjImport*)data;
+
+    for (unsigned int k = begin; k < end; k++)
+    {
+        ObjChunk *chunk = &import->chunks[k];
+        chunk->firsts = 0;
+        for (unsigned int c = chunk->corner_base; c < chunk->corner_base + chunk->corners; c++)
+            chunk->firsts += atomic_load_explicit(&import->slots[import->corner_slot[c]], memory_order_relaxed) == c + 1;
+    }
+}
+
+// numbers the vertices, each chunk from where the last left off, and fills them in
+static void emit_obj_vertices(void *data, unsigned int begin, unsigned int end)
+{
+    ObjImport *import = (ObjImport*)data;
+    MeshVertex *vertices = import->mesh->vertices;
+
+    for (unsigned int k = begin; k < end; k++)
+    {
+        ObjChunk *chunk = &import->chunks[k];
+        unsigned int next = chunk->first_base;
+        for (unsigned int c = chunk->corner_base; c < chunk->corner_base + chunk->corners; c++)
+        {
+            uint32_t slot = import->corner_slot[c];
+            if (atomic_load_explicit(&import->slots[slot], memory_order_relaxed) != c + 1)
+                continue;
+
+            const ObjCorner *corner = &import->corners[c];
+            MeshVertex *vertex = &vertices[next];
+            memcpy(vertex->position, &import->positions[(size_t) corner->position * 3], sizeof(float) * 3);
+            if (corner->uv >= 0)
+                memcpy(vertex->uv, &import->uvs[(size_t) corner->uv * 2], sizeof(float) * 2);
+            if (corner->normal >= 0)
+                memcpy(vertex->normal, &import->normals[(size_t) corner->normal * 3], sizeof(float) * 3);
+            else
+                chunk->unnormaled++;
+            import->slot_vertex[slot] = next++;
+        }
+    }
+}
+
+static void emit_obj_indices(void *data, unsigned int begin, unsigned int end)
+{
+    ObjImport *import = (ObjImport*)data;
+    for (unsigned int c = begin; c < end; c++)
+        import->mesh->indices[c] = import->slot_vertex[import->corner_slot[c]];
+}
+
+// smooth normals for the vertices that came without one. the rest keep
+// theirs, which is how they come out of the importer: non-zero
+static void fill_missing_normals(Mesh *mesh, bool keep_existing)
+{
+    vec3 *given = keep_existing ? (vec3*)malloc(sizeof(vec3) * mesh->vertex_count) : NULL;
+    for (unsigned int i = 0; i < mesh->vertex_count && given != NULL; i++)
+        glm_vec3_copy(mesh->vertices[i].normal, given[i]);
+
+    compute_mesh_normals(mesh);
+
+    for (unsigned int i = 0; i < mesh->vertex_count && given != NULL; i++)
+    {
+        if (given[i][0] != 0.0f || given[i][1] != 0.0f || given[i][2] != 0.0f)
+            glm_vec3_copy(given[i], mesh->vertices[i].normal);
+    }
+    free(given);
+}
+
+// tangent frames for the vertices that came without one, the same way. an
+// authored tangent's w is always +-1, a missing one's is 0
+static void fill_missing_tangents(Mesh *mesh)
+{
+    vec4 *given = (vec4*)malloc(sizeof(vec4) * (mesh->vertex_count > 0 ? mesh->vertex_count : 1));
+    for (unsigned int i = 0; i < mesh->vertex_count && given != NULL; i++)
+        glm_vec4_copy(mesh->vertices[i].tangent, given[i]);
+
+    compute_mesh_tangents(mesh);
+
+    for (unsigned int i = 0; i < mesh->vertex_count && given != NULL; i++)
+    {
+        if (given[i][3] != 0.0f)
+            glm_vec4_copy(given[i], mesh->vertices[i].tangent);
+    }
+    free(given);
+}
+
+static void free_obj_import(ObjImport *import)
+{
+    free(import->chunks);
+    free(import->positions);
+    free(import->uvs);
+    free(import->normals);
+    free(import->corners);
+    free((void*)import->slots);
+    free(import->slot_vertex);
+    free(import->corner_slot);
+}
+
+// v, vt, vn and f, everything else is skipped. vertices without a normal
+// get smooth ones made for them, so give hard edges their own normals
+bool import_obj(const char *data, size_t size, Mesh *mesh)
+{
+    memset(mesh, 0, sizeof(Mesh));
+
+    ObjImport import;
+    memset(&import, 0, sizeof(ObjImport));
+    import.data = data;
+    import.size = size;
+    import.mesh = mesh;
+    import.chunk_count = (unsigned int) ((size + IMPORT_OBJ_CHUNK_SIZE - 1) / IMPORT_OBJ_CHUNK_SIZE);
+    import.chunks = (ObjChunk*)calloc(import.chunk_count > 0 ? import.chunk_count : 1, sizeof(ObjChunk));
+    if (import.chunks == NULL)
+        return false;
+
+    parallel_for(import.chunk_count, 1, count_obj_chunks, &import);
+
+    // prefix sums, so each chunk knows where its output starts
+    for (unsigned int c = 0; c < import.chunk_count; c++)
+    {
+        ObjChunk *chunk = &import.chunks[c];
+        chunk->position_base = import.position_count;
+        chunk->uv_base = import.uv_count;
+        chunk->normal_base = import.normal_count;
+        chunk->corner_base = import.corner_count;
+        import.position_count += chunk->positions;
+        import.uv_count += chunk->uvs;
+        import.normal_count += chunk->normals;
+        import.corner_count += chunk->corners;
+    }
+
+    if (import.corner_count == 0 || import.corner_count > (1u << 30))
+    {
+        printf("OBJ has %s faces\n", import.corner_count == 0 ? "no" : "too many");
+        free_obj_import(&import);
+        return false;
+    }
+
+    uint32_t capacity = 16;
+    while (capacity < import.corner_count * 2u)
+        capacity <<= 1;
+    import.slot_mask = capacity - 1;
+
+    import.positions = (float*)malloc(sizeof(float) * 3 * (import.position_count + 1));
+    import.uvs = (float*)malloc(sizeof(float) * 2 * (import.uv_count + 1));
+    import.normals = (float*)malloc(sizeof(float) * 3 * (import.normal_count + 1));
+    import.corners = (ObjCorner*)malloc(sizeof(ObjCorner) * import.corner_count);
+    import.slots = (_Atomic uint32_t*)calloc(capacity, sizeof(uint32_t));
+    import.slot_vertex = (uint32_t*)malloc(sizeof(uint32_t) * capacity);
+    import.corner_slot = (uint32_t*)malloc(sizeof(uint32_t) * import.corner_count);
+    if (import.positions == NULL || import.uvs == NULL || import.normals == NULL || import.corners == NULL ||
+        import.slots == NULL || import.slot_vertex == NULL || import.corner_slot == NULL)
+    {
+        printf("Out of memory importing OBJ\n");
+        free_obj_import(&import);
+        return false;
+    }
+
+    parallel_for(import.chunk_count, 1, parse_obj_chunks, &import);
+    for (unsigned int c = 0; c < import.chunk_count; c++)
+    {
+        if (import.chunks[c].failed)
+        {
+            free_obj_import(&import);
+            return false;
+        }
+    }
+
+    parallel_for(import.corner_count, IMPORT_VERTICES_PER_JOB, insert_obj_corners, &import);
+    parallel_for(import.chunk_count, 1, count_obj_vertices, &import);
+
+    unsigned int vertex_count = 0;
+    for (unsigned int c = 0; c < import.chunk_count; c++)
+    {
+        import.chunks[c].first_base = vertex_count;
+        vertex_count += import.chunks[c].firsts;
+    }
+
+    if (!init_mesh(mesh, vertex_count, import.corner_count))
+    {
+        printf("Out of memory importing OBJ\n");
+        free_obj_import(&import);
+        return false;
+    }
+
+    parallel_for(import.chunk_count, 1, emit_obj_vertices, &import);
+    parallel_for(import.corner_count, IMPORT_VERTICES_PER_JOB, emit_obj_indices, &import);
+
+    unsigned int unnormaled = 0;
+    for (unsigned int c = 0; c < import.chunk_count; c++)
+        unnormaled += import.chunks[c].unnormaled;
+    free_obj_import(&import);
+
+    if (unnormaled > 0)
+        fill_missing_normals(mesh, unnormaled < vertex_count);
+    compute_mesh_tangents(mesh);
+    compute_mesh_bounds(mesh);
+    return true;
+}
+
+// JSON, just enough for glTF: no escapes are decoded, which glTF's keys
+// and the few strings read here never need
+
+static int add_json_token(JsonDocument *doc, JsonType type, int start)
+{
+    if (doc->count == doc->capacity)
+    {
+        int capacity = doc->capacity > 0 ? doc->capacity * 2 : 256;
+        JsonToken *tokens = (JsonToken*)realloc(doc->tokens, sizeof(JsonToken) * capacity);
+        if (tokens == NULL)
+            return -1;
+        doc->tokens = tokens;
+        doc->capacity = capacity;
+    }
+
+    JsonToken *token = &doc->tokens[doc->count];
+    token->type = type;
+    token->start = start;
+    token->end = start;
+    token->next = doc->count + 1;
+    return doc->count++;
+}
+
+static int skip_json_space(const JsonDocument *doc, int p)
+{
+    while (p < doc->length && (doc->text[p] == ' ' || doc->text[p] == '\t' || doc->text[p] == '\n' || doc->text[p] == '\r'))
+        p++;
+    return p;
+}
+
+// returns where parsing stopped, or -1
+static int parse_json_value(JsonDocument *doc, int p, int depth)
+{
+    p = skip_json_space(doc, p);
+    if (p >= doc->length || depth > 64)
+        return -1;
+
+    char c = doc->text[p];
+    if (c == '{' || c == '[')
+    {
+        char close = c == '{' ? '}' : ']';
+        int token = add_json_token(doc, c == '{' ? JSON_OBJECT : JSON_ARRAY, p);
+        if (token < 0)
+            return -1;
+
+        p = skip_json_space(doc, p + 1);
+        bool first = true;
+        while (p < doc->length && doc->text[p] != close)
+        {
+            if (!first)
+            {
+                if (doc->text[p] != ',')
+                    return -1;
+                p++;
+            }
+            first = false;
+
+            if (c == '{')
+            {
+                // keys are strings stored as their own token before the value
+                p = skip_json_space(doc, p);
+                if (p >= doc->length || doc->text[p] != '"')
+                    return -1;
+                p = parse_json_value(doc, p, depth + 1);
+                if (p < 0)
+                    return -1;
+                p = skip_json_space(doc, p);
+                if (p >= doc->length || doc->text[p] != ':')
+                    return -1;
+                p++;
+            }
+
+            p = parse_json_value(doc, p, depth + 1);
+            if (p < 0)
+                return -1;
+            p = skip_json_space(doc, p);
+        }
+
+        if (p >= doc->length)
+            return -1;
+        doc->tokens[token].end = p + 1;
+        doc->tokens[token].next = doc->count;
+        return p + 1;
+    }
+
+    if (c == '"')
+    {
+        int token = add_json_token(doc, JSON_STRING, p + 1);
+        if (token < 0)
+            return -1;
+        for (p++; p < doc->length && doc->text[p] != '"'; p++)
+        {
+            if (doc->text[p] == '\\')
+                p++;
+        }
+        if (p >= doc->length)
+            return -1;
+        doc->tokens[token].end = p;
+        return p + 1;
+    }
+
+    // numbers, true, false and null
+    int token = add_json_token(doc, JSON_PRIMITIVE, p);
+    if (token < 0)
+        return -1;
+    while (p < doc->length && strchr(",]} \t\r\n", doc->text[p]) == NULL)
+        p++;
+    doc->tokens[token].end = p;
+    return p > doc->tokens[token].start ? p : -1;
+}
+
+static bool parse_json(JsonDocument *doc, const char *text, int length)
+{
+    memset(doc, 0, sizeof(JsonDocument));
+    doc->text = text;
+    doc->length = length;
+    return parse_json_value(doc, 0, 0) >= 0;
+}
+
+static bool json_equals(const JsonDocument *doc, int token, const char *text)
+{
+    const JsonToken *t = &doc->tokens[token];
+    int length = (int) strlen(text);
+    return t->end - t->start == length && memcmp(doc->text + t->start, text, (size_t) length) == 0;
+}
+
+// the value for key in an object, -1 if it's missing
+static int json_member(const JsonDocument *doc, int object, const char *key)
+{
+    if (object < 0 || doc->tokens[object].type != JSON_OBJECT)
+        return -1;
+
+    for (int k = object + 1; k < doc->tokens[object].next; k = doc->tokens[k + 1].next)
+    {
+        if (json_equals(doc, k, key))
+            return k + 1;
+    }
+    return -1;
+}
+
+static int json_element(const JsonDocument *doc, int array, int index)
+{
+    if (array < 0 || doc->tokens[array].type != JSON_ARRAY || index < 0)
+        return -1;
+
+    for (int k = array + 1; k < doc->tokens[array].next; k = doc->tokens[k].next)
+    {
+        if (index-- == 0)
+            return k;
+    }
+    return -1;
+}
+
+static long long json_integer(const JsonDocument *doc, int token, long long fallback)
+{
+    if (token < 0 || doc->tokens[token].type != JSON_PRIMITIVE)
+        return fallback;
+    return strtoll(doc->text + doc->tokens[token].start, NULL, 10);
+}
+
+// glTF
+
+enum {
+    GLTF_BYTE = 5120,
+    GLTF_UNSIGNED_BYTE = 5121,
+    GLTF_SHORT = 5122,
+    GLTF_UNSIGNED_SHORT = 5123,
+    GLTF_UNSIGNED_INT = 5125,
+    GLTF_FLOAT = 5126
+};
+
+#define GLB_MAGIC 0x46546C67u
+#define GLB_CHUNK_JSON 0x4E4F534Au
+#define GLB_CHUNK_BIN 0x004E4942u
+
+static int gltf_component_size(int component_type)
+{
+    switch (component_type)
+    {
+    case GLTF_BYTE:
+    case GLTF_UNSIGNED_BYTE:
+        return 1;
+    case GLTF_SHORT:
+    case GLTF_UNSIGNED_SHORT:
+        return 2;
+    case GLTF_UNSIGNED_INT:
+    case GLTF_FLOAT:
+        return 4;
+    }
+    return 0;
+}
+
+static void read_gltf_floats(const GltfAccessor *accessor, unsigned int index, float *out, int count)
+{
+    const unsigned char *element = accessor->data + (size_t) index * accessor->stride;
+    if (accessor->component_type == GLTF_FLOAT)
+    {
+        memcpy(out, element, sizeof(float) * (size_t) count);
+        return;
+    }
+
+    // normalized integers as the spec decodes them, plain ones as they are
+    for (int k = 0; k < count; k++)
+    {
+        float value = 0.0f;
+        switch (accessor->component_type)
+        {
+        case GLTF_BYTE:
+            value = (float) ((const int8_t*)element)[k];
+            value = accessor->normalized ? fmaxf(value / 127.0f, -1.0f) : value;
+            break;
+        case GLTF_UNSIGNED_BYTE:
+            value = (float) element[k];
+            value = accessor->normalized ? value / 255.0f : value;
+            break;
+        case GLTF_SHORT:
+        {
+            int16_t s;
+            memcpy(&s, element + k * 2, 2);
+            value = accessor->normalized ? fmaxf(s / 32767.0f, -1.0f) : (float) s;
+            break;
+        }
+        case GLTF_UNSIGNED_SHORT:
+        {
+            uint16_t u;
+            memcpy(&u, element + k * 2, 2);
+            value = accessor->normalized ? u / 65535.0f : (float) u;
+            break;
+        }
+        }
+        out[k] = value;
+    }
+}
+
+static uint32_t read_gltf_index(const GltfAccessor *accessor, unsigned int index)
+{
+    const unsigned char *element = accessor->data + (size_t) index * accessor->stride;
+    switch (accessor->component_type)
+    {
+    case GLTF_UNSIGNED_BYTE:
+        return element[0];
+    case GLTF_UNSIGNED_SHORT:
+    {
+        uint16_t u;
+        memcpy(&u, element, 2);
+        return u;
+    }
+    default:
+    {
+        uint32_t u;
+        memcpy(&u, element, 4);
+        return u;
+    }
+    }
+}
+
+// glTF puts the uv origin top left, GL bottom left. flipping v mirrors the
+// bitangent, so the tangent's sign goes with it
+static void convert_gltf_vertices(void *data, unsigned int begin, unsigned int end)
+{
+    GltfPrimitive *primitive = (GltfPrimitive*)data;
+
+    for (unsigned int i = begin; i < end; i++)
+    {
+        MeshVertex *vertex = &primitive->mesh->vertices[primitive->first_vertex + i];
+        read_gltf_floats(&primitive->position, i, vertex->position, 3);
+        if (primitive->has_normal)
+            read_gltf_floats(&primitive->normal, i, vertex->normal, 3);
+        if (primitive->has_uv)
+        {
+            read_gltf_floats(&primitive->uv, i, vertex->uv, 2);
+            vertex->uv[1] = 1.0f - vertex->uv[1];
+        }
+        if (primitive->has_tangent)
+        {
+            read_gltf_floats(&primitive->tangent, i, vertex->tangent, 4);
+            vertex->tangent[3] = vertex->tangent[3] < 0.0f ? 1.0f : -1.0f;
+        }
+    }
+}
+
+static void convert_gltf_indices(void *data, unsigned int begin, unsigned int end)
+{
+    GltfPrimitive *primitive = (GltfPrimitive*)data;
+    unsigned int *indices = primitive->mesh->indices + primitive->first_index;
+
+    for (unsigned int i = begin; i < end; i++)
+    {
+        uint32_t index = primitive->has_indices ? read_gltf_index(&primitive->indices, i) : i;
+        // one past its own primitive's vertices would read another's
+        if (index >= primitive->position.count)
+        {
+            atomic_store_explicit(&primitive->out_of_range, true, memory_order_relaxed);
+            index = 0;
+        }
+        indices[i] = primitive->first_vertex + index;
+    }
+}
+
+// resolves an accessor through its buffer view to bytes inside one of the
+// buffers, checking every element lands inside it
+static bool resolve_gltf_accessor(const JsonDocument *doc, int index, const MappedFile *buffers, int buffer_count, GltfAccessor *accessor)
+{
+    int root = 0;
+    int token = json_element(doc, json_member(doc, root, "accessors"), index);
+    if (token < 0 || json_member(doc, token, "sparse") >= 0)
+        return false;
+
+    int type = json_member(doc, token, "type");
+    static const char *types[] = { "SCALAR", "VEC2", "VEC3", "VEC4" };
+    accessor->components = 0;
+    for (int k = 0; k < 4; k++)
+    {
+        if (type >= 0 && json_equals(doc, type, types[k]))
+            accessor->components = k + 1;
+    }
+
+    accessor->component_type = (int) json_integer(doc, json_member(doc, token, "componentType"), 0);
+    accessor->count = (unsigned int) json_integer(doc, json_member(doc, token, "count"), 0);
+    int normalized = json_member(doc, token, "normalized");
+    accessor->normalized = normalized >= 0 && json_equals(doc, normalized, "true");
+
+    int view = json_element(doc, json_member(doc, root, "bufferViews"), (int) json_integer(doc, json_member(doc, token, "bufferView"), -1));
+    int component_size = gltf_component_size(accessor->component_type);
+    if (view < 0 || component_size == 0 || accessor->components == 0)
+        return false;
+
+    long long buffer = json_integer(doc, json_member(doc, view, "buffer"), -1);
+    long long view_offset = json_integer(doc, json_member(doc, view, "byteOffset"), 0);
+    long long view_length = json_integer(doc, json_member(doc, view, "byteLength"), 0);
+    long long offset = json_integer(doc, json_member(doc, token, "byteOffset"), 0);
+    long long element_size = (long long) component_size * accessor->components;
+    long long stride = json_integer(doc, json_member(doc, view, "byteStride"), 0);
+    accessor->stride = (unsigned int) (stride > 0 ? stride : element_size);
+
+    if (buffer < 0 || buffer >= buffer_count || view_offset < 0 || offset < 0)
+        return false;
+    long long last = accessor->count > 0 ? offset + (long long) (accessor->count - 1) * accessor->stride + element_size : 0;
+    if (last > view_length || (size_t) (view_offset + view_length) > buffers[buffer].size)
+        return false;
+
+    accessor->data = (const unsigned char*)buffers[buffer].data + view_offset + offset;
+    return true;
+}
+
+static bool resolve_gltf_attribute(const JsonDocument *doc, int attributes, const char *name, const MappedFile *buffers, int buffer_count,
+    unsigned int count, int components, GltfAccessor *accessor)
+{
+    int token = json_member(doc, attributes, name);
+    if (token < 0)
+        return false;
+
+    if (!resolve_gltf_accessor(doc, (int) json_integer(doc, token, -1), buffers, buffer_count, accessor) ||
+        accessor->count != count || accessor->components != components)
+    {
+        printf("Skipping unusable glTF %s accessor\n", name);
+        return false;
+    }
+    return true;
+}
+
+// external .bin files sit next to the .gltf, embedded data: uris aren't read
+static bool map_gltf_buffers(const JsonDocument *doc, const char *path, const char *glb_binary, size_t glb_binary_size,
+    MappedFile *buffers, bool *mapped, int buffer_count)
+{
+    int array = json_member(doc, 0, "buffers");
+    for (int b = 0; b < buffer_count; b++)
+    {
+        int uri = json_member(doc, json_element(doc, array, b), "uri");
+        if (uri < 0)
+        {
+            // the GLB's binary chunk
+            if (glb_binary == NULL)
+                return false;
+            buffers[b].data = glb_binary;
+            buffers[b].size = glb_binary_size;
+            continue;
+        }
+
+        const JsonToken *t = &doc->tokens[uri];
+        int length = t->end - t->start;
+        if (length >= 5 && memcmp(doc->text + t->start, "data:", 5) == 0)
+        {
+            printf("Embedded glTF buffers aren't supported, use a .glb or a .bin file\n");
+            return false;
+        }
+
+        char buffer_path[IMPORT_MAX_PATH];
+        const char *slash = strrchr(path, '/');
+        int directory = slash != NULL ? (int) (slash - path + 1) : 0;
+        if (directory + length >= IMPORT_MAX_PATH)
+            return false;
+        memcpy(buffer_path, path, (size_t) directory);
+        memcpy(buffer_path + directory, doc->text + t->start, (size_t) length);
+        buffer_path[directory + length] = '\0';
+
+        if (!map_file(buffer_path, &buffers[b]))
+            return false;
+        mapped[b] = true;
+    }
+    return true;
+}
+
+// positions and indices, which decide whether a primitive is used at all
+static bool resolve_gltf_primitive(const JsonDocument *doc, int token, const MappedFile *buffers, int buffer_count, bool report, GltfPrimitive *primitive)
+{
+    memset(primitive, 0, sizeof(GltfPrimitive));
+    if (json_integer(doc, json_member(doc, token, "mode"), 4) != 4)
+        return false;
+
+    int position = json_member(doc, json_member(doc, token, "attributes"), "POSITION");
+    if (position < 0 || !resolve_gltf_accessor(doc, (int) json_integer(doc, position, -1), buffers, buffer_count, &primitive->position) ||
+        primitive->position.components != 3)
+    {
+        if (report)
+            printf("Skipping glTF primitive without usable positions\n");
+        return false;
+    }
+
+    int indices = json_member(doc, token, "indices");
+    primitive->has_indices = indices >= 0;
+    if (primitive->has_indices &&
+        (!resolve_gltf_accessor(doc, (int) json_integer(doc, indices, -1), buffers, buffer_count, &primitive->indices) ||
+        primitive->indices.components != 1 || primitive->indices.component_type == GLTF_FLOAT))
+    {
+        if (report)
+            printf("Skipping glTF primitive with unusable indices\n");
+        return false;
+    }
+
+    primitive->index_count = primitive->has_indices ? primitive->indices.count : primitive->position.count;
+    primitive->index_count -= primitive->index_count % 3;
+    return true;
+}
+
+// every triangle list primitive of every mesh, appended into one Mesh as a
+// submesh each. the first pass only counts, so the mesh is allocated once
+static bool convert_gltf_meshes(const JsonDocument *doc, const MappedFile *buffers, int buffer_count, Mesh *mesh)
+{
+    int meshes = json_member(doc, 0, "meshes");
+    unsigned int vertex_count = 0, index_count = 0;
+    bool missing_normals = false, missing_tangents = false;
+
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (int m = json_element(doc, meshes, 0); m >= 0 && m < doc->tokens[meshes].next; m = doc->tokens[m].next)
+        {
+            int primitives = json_member(doc, m, "primitives");
+            for (int p = json_element(doc, primitives, 0); p >= 0 && p < doc->tokens[primitives].next; p = doc->tokens[p].next)
+            {
+                GltfPrimitive primitive;
+                if (!resolve_gltf_primitive(doc, p, buffers, buffer_count, pass == 0, &primitive))
+                    continue;
+
+                unsigned int count = primitive.position.count;
+                if (pass == 0)
+                {
+                    vertex_count += count;
+                    index_count += primitive.index_count;
+                    continue;
+                }
+
+                int attributes = json_member(doc, p, "attributes");
+                primitive.has_normal = resolve_gltf_attribute(doc, attributes, "NORMAL", buffers, buffer_count, count, 3, &primitive.normal);
+                primitive.has_tangent = resolve_gltf_attribute(doc, attributes, "TANGENT", buffers, buffer_count, count, 4, &primitive.tangent);
+                primitive.has_uv = resolve_gltf_attribute(doc, attributes, "TEXCOORD_0", buffers, buffer_count, count, 2, &primitive.uv);
+                missing_normals |= !primitive.has_normal;
+                missing_tangents |= !primitive.has_tangent;
+
+                primitive.first_vertex = vertex_count;
+                primitive.first_index = index_count;
+                primitive.mesh = mesh;
+                atomic_init(&primitive.out_of_range, false);
+                parallel_for(count, IMPORT_VERTICES_PER_JOB, convert_gltf_vertices, &primitive);
+                parallel_for(primitive.index_count, IMPORT_VERTICES_PER_JOB, convert_gltf_indices, &primitive);
+                if (atomic_load(&primitive.out_of_range))
+                {
+                    printf("glTF index out of range\n");
+                    return false;
+                }
+
+                if (!add_mesh_submesh(mesh, index_count, primitive.index_count, (int) json_integer(doc, json_member(doc, p, "material"), -1)))
+                    return false;
+
+                vertex_count += count;
+                index_count += primitive.index_count;
+            }
+        }
+
+        if (pass == 0)
+        {
+            if (index_count == 0)
+            {
+                printf("glTF has no triangles\n");
+                return false;
+            }
+            if (!init_mesh(mesh, vertex_count, index_count))
+            {
+                printf("Out of memory importing glTF\n");
+                return false;
+            }
+            vertex_count = 0;
+            index_count = 0;
+        }
+    }
+
+    // made for the whole mesh, so only worth it when something lacked them.
+    // primitives that had them keep theirs
+    if (missing_normals)
+        fill_missing_normals(mesh, true);
+    if (missing_tangents)
+        fill_missing_tangents(mesh);
+    compute_mesh_bounds(mesh);
+    return true;
+}
+
+// .gltf with .bin files beside it, or a self-contained .glb
+bool import_gltf(const char *data, size_t size, const char *path, Mesh *mesh)
+{
+    memset(mesh, 0, sizeof(Mesh));
+
+    const char *json = data;
+    size_t json_size = size;
+    const char *binary = NULL;
+    size_t binary_size = 0;
+
+    uint32_t header[5] = { 0, 0, 0, 0, 0 };
+    memcpy(header, data, size < 20 ? size : 20);
+    if (header[0] == GLB_MAGIC)
+    {
+        // 12 byte header, then a JSON chunk and an optional binary chunk,
+        // each with its length and type in front
+        if (header[1] != 2 || size < 20 || header[4] != GLB_CHUNK_JSON || header[3] > size - 20)
+        {
+            printf("Unsupported GLB\n");
+            return false;
+        }
+        json = data + 20;
+        json_size = header[3];
+
+        size_t next = 20 + (size_t) header[3];
+        uint32_t chunk[2];
+        if (next + 8 <= size)
+        {
+            memcpy(chunk, data + next, 8);
+            if (chunk[1] == GLB_CHUNK_BIN && chunk[0] <= size - next - 8)
+            {
+                binary = data + next + 8;
+                binary_size = chunk[0];
+            }
+        }
+    }
+
+    if (json_size > 0x7FFFFFFF)
+        return false;
+
+    JsonDocument doc;
+    if (!parse_json(&doc, json, (int) json_size) || doc.tokens[0].type != JSON_OBJECT)
+    {
+        printf("Malformed glTF JSON\n");
+        free(doc.tokens);
+        return false;
+    }
+
+    int buffer_array = json_member(&doc, 0, "buffers");
+    int buffer_count = 0;
+    for (int b = json_element(&doc, buffer_array, 0); b >= 0 && b < doc.tokens[buffer_array].next; b = doc.tokens[b].next)
+        buffer_count++;
+
+    MappedFile *buffers = (MappedFile*)calloc(buffer_count > 0 ? buffer_count : 1, sizeof(MappedFile));
+    bool *mapped = (bool*)calloc(buffer_count > 0 ? buffer_count : 1, sizeof(bool));
+    bool imported = buffers != NULL && mapped != NULL &&
+        map_gltf_buffers(&doc, path, binary, binary_size, buffers, mapped, buffer_count) &&
+        convert_gltf_meshes(&doc, buffers, buffer_count, mesh);
+
+    for (int b = 0; b < buffer_count && mapped != NULL; b++)
+    {
+        if (mapped[b])
+            unmap_file(&buffers[b]);
+    }
+    free(buffers);
+    free(mapped);
+    free(doc.tokens);
+
+    if (!imported)
+        free_mesh(mesh);
+    return imported;
+}
+
+#endif
@@ -0,0 +1,698 @@
+#ifndef MESH_SIMPLIFY_H
+#define MESH_SIMPLIFY_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include <cglm/cglm.h>
+
+#include "mesh.h"
+
+// simplifier defaults
+#define SIMPLIFY_MAX_PASSES 64
+#define SIMPLIFY_EDGE_WEIGHT 10.0 // how much harder borders and uv seams are to move than surfaces
+#define LOD_MAX_LEVELS 8          // LOD 0 included
+#define LOD_TRIANGLE_RATIO 0.5f   // each level aims for this fraction of the last one's triangles
+#define LOD_MIN_REDUCTION 0.85f   // a level keeping more of the last one's triangles than this isn't kept
+#define LOD_MAX_ERROR 0.05f       // of the bounds' diagonal, no level strays further
+
+// quadric error metric edge collapse. every collapse moves a vertex onto a
+// neighbour that already exists, so all LODs share LOD 0's vertex buffer and
+// only the index buffer grows. what each vertex may do depends on where it
+// sits, found from which of its edges have no opposite:
+//   manifold  inside a surface, can collapse onto any neighbour
+//   border    on an open edge, only slides along it onto other border vertices
+//   seam      one position split into two vertices with different uvs, both
+//             halves slide along the seam together so no texture tears open
+//   locked    corners of seams, non-manifold spots and anything shared with
+//             another submesh, never moves
+// borders and seams also add planes along their edges to the quadrics, so
+// moving off the line they trace costs more
+enum {
+    SIMPLIFY_MANIFOLD,
+    SIMPLIFY_BORDER,
+    SIMPLIFY_SEAM,
+    SIMPLIFY_LOCKED
+};
+
+#define SIMPLIFY_NO_EDGE 0xFFFFFFFFu
+#define SIMPLIFY_MANY_EDGES 0xFFFFFFFEu
+
+// symmetric 4x4 matrix of summed squared plane distances, w is the summed
+// weight so the error comes out as a mean squared distance
+typedef struct Quadric {
+    double a00, a11, a22;
+    double a10, a20, a21;
+    double b0, b1, b2;
+    double c;
+    double w;
+} Quadric;
+
+typedef struct EdgeCollapse {
+    unsigned int from;
+    unsigned int to;
+    float cost;
+} EdgeCollapse;
+
+// everything one simplify_mesh call works on, indexed by vertex
+typedef struct Simplifier {
+    const Mesh *mesh;
+    unsigned int *indices;
+    unsigned int index_count;
+
+    // first vertex with the same position, and the next one round the ring of them
+    unsigned int *remap;
+    unsigned int *wedge;
+    unsigned char *kind;
+    Quadric *quadrics;
+
+    // triangles around each vertex, rebuilt every pass
+    unsigned int *adjacency_offsets;
+    unsigned int *adjacency_counts;
+    unsigned int *adjacency;
+
+    unsigned int *collapse_remap;
+    unsigned char *collapse_locked;
+} Simplifier;
+
+float simplify_mesh(const Mesh *mesh, const unsigned int *indices, unsigned int index_count, unsigned int target_index_count,
+    float max_error, const unsigned char *locked, unsigned int *destination, unsigned int *result_count);
+bool build_mesh_lods(Mesh *mesh);
+void print_mesh_lods(const char *name, const Mesh *mesh);
+
+static void add_quadric(Quadric *q, const Quadric *r)
+{
+    q->a00 += r->a00;
+    q->a11 += r->a11;
+    q->a22 += r->a22;
+    q->a10 += r->a10;
+    q->a20 += r->a20;
+    q->a21 += r->a21;
+    q->b0 += r->b0;
+    q->b1 += r->b1;
+    q->b2 += r->b2;
+    q->c += r->c;
+    q->w += r->w;
+}
+
+// the plane n.x + d = 0, n unit length
+static void add_plane_quadric(Quadric *q, const double *n, double d, double weight)
+{
+    Quadric plane = {
+        n[0] * n[0] * weight, n[1] * n[1] * weight, n[2] * n[2] * weight,
+        n[1] * n[0] * weight, n[2] * n[0] * weight, n[2] * n[1] * weight,
+        n[0] * d * weight, n[1] * d * weight, n[2] * d * weight,
+        d * d * weight,
+        weight
+    };
+    add_quadric(q, &plane);
+}
+
+static float quadric_error(const Quadric *q, const float *p)
+{
+    double x = p[0], y = p[1], z = p[2];
+    double rx = q->a00 * x + q->a10 * y + q->a20 * z + 2.0 * q->b0;
+    double ry = q->a10 * x + q->a11 * y + q->a21 * z + 2.0 * q->b1;
+    double rz = q->a20 * x + q->a21 * y + q->a22 * z + 2.0 * q->b2;
+    double error = rx * x + ry * y + rz * z + q->c;
+    return q->w > 0.0 ? (float) (fabs(error) / q->w) : 0.0f;
+}
+
+static uint32_t hash_position(const float *position)
+{
+    uint32_t bits[3];
+    // -0 and 0 are the same place
+    float p[3] = { position[0] + 0.0f, position[1] + 0.0f, position[2] + 0.0f };
+    memcpy(bits, p, sizeof(bits));
+    uint32_t hash = bits[0] * 73856093u ^ bits[1] * 19349663u ^ bits[2] * 83492791u;
+    return hash ^ (hash >> 16);
+}
+
+// groups the vertices the indices use by position. remap points at the
+// first of each group and wedge links each group into a ring
+static bool build_position_remap(const Mesh *mesh, const unsigned int *indices, unsigned int index_count, unsigned int *remap, unsigned int *wedge)
+{
+    uint32_t capacity = 16;
+    while (capacity < index_count * 2u && capacity < (1u << 31))
+        capacity <<= 1;
+    uint32_t *slots = (uint32_t*)calloc(capacity, sizeof(uint32_t));
+    if (slots == NULL)
+        return false;
+
+    for (unsigned int i = 0; i < mesh->vertex_count; i++)
+    {
+        remap[i] = SIMPLIFY_NO_EDGE;
+        wedge[i] = i;
+    }
+
+    for (unsigned int i = 0; i < index_count; i++)
+    {
+        unsigned int v = indices[i];
+        if (remap[v] != SIMPLIFY_NO_EDGE)
+            continue;
+
+        const float *position = mesh->vertices[v].position;
+        uint32_t slot = hash_position(position) & (capacity - 1);
+        while (slots[slot] != 0 && !glm_vec3_eqv((float*)mesh->vertices[slots[slot] - 1].position, (float*)position))
+            slot = (slot + 1) & (capacity - 1);
+
+        if (slots[slot] == 0)
+        {
+            slots[slot] = v + 1;
+            remap[v] = v;
+            continue;
+        }
+
+        // into the ring just after the group's first vertex
+        unsigned int first = slots[slot] - 1;
+        remap[v] = first;
+        wedge[v] = wedge[first];
+        wedge[first] = v;
+    }
+
+    free(slots);
+    return true;
+}
+
+static void build_simplify_adjacency(Simplifier *s)
+{
+    unsigned int vertex_count = s->mesh->vertex_count;
+    memset(s->adjacency_counts, 0, sizeof(unsigned int) * vertex_count);
+    for (unsigned int i = 0; i < s->index_count; i++)
+        s->adjacency_counts[s->indices[i]]++;
+
+    unsigned int offset = 0;
+    for (unsigned int v = 0; v < vertex_count; v++)
+    {
+        s->adjacency_offsets[v] = offset;
+        offset += s->adjacency_counts[v];
+        s->adjacency_counts[v] = 0;
+    }
+
+    for (unsigned int i = 0; i < s->index_count; i++)
+    {
+        unsigned int v = s->indices[i];
+        s->adjacency[s->adjacency_offsets[v] + s->adjacency_counts[v]++] = i / 3;
+    }
+}
+
+// whether some triangle has the directed edge a -> b
+static bool simplify_has_edge(const Simplifier *s, unsigned int a, unsigned int b)
+{
+    for (unsigned int k = 0; k < s->adjacency_counts[a]; k++)
+    {
+        const unsigned int *triangle = &s->indices[s->adjacency[s->adjacency_offsets[a] + k] * 3];
+        for (int corner = 0; corner < 3; corner++)
+        {
+            if (triangle[corner] == a && triangle[(corner + 1) % 3] == b)
+                return true;
+        }
+    }
+    return false;
+}
+
+static void record_open_edge(unsigned int *open, unsigned int other)
+{
+    *open = *open == SIMPLIFY_NO_EDGE ? other : SIMPLIFY_MANY_EDGES;
+}
+
+static bool is_single_edge(unsigned int open)
+{
+    return open != SIMPLIFY_NO_EDGE && open != SIMPLIFY_MANY_EDGES;
+}
+
+// sorts every vertex into one of the kinds above from its open edges
+static void classify_simplify_vertices(Simplifier *s, const unsigned char *locked)
+{
+    unsigned int vertex_count = s->mesh->vertex_count;
+    unsigned int *open_in = (unsigned int*)malloc(sizeof(unsigned int) * vertex_count * 2);
+    unsigned int *open_out = open_in + vertex_count;
+    for (unsigned int v = 0; v < vertex_count * 2; v++)
+        open_in[v] = SIMPLIFY_NO_EDGE;
+
+    for (unsigned int i = 0; i < s->index_count; i++)
+    {
+        unsigned int v = s->indices[i];
+        unsigned int next = s->indices[i - i % 3 + (i + 1) % 3];
+        unsigned int prev = s->indices[i - i % 3 + (i + 2) % 3];
+        if (!simplify_has_edge(s, next, v))
+            record_open_edge(&open_out[v], next);
+        if (!simplify_has_edge(s, v, prev))
+            record_open_edge(&open_in[v], prev);
+    }
+
+    for (unsigned int v = 0; v < vertex_count; v++)
+    {
+        unsigned int w = s->wedge[v];
+        if (s->remap[v] == SIMPLIFY_NO_EDGE || (locked != NULL && locked[v]))
+            s->kind[v] = SIMPLIFY_LOCKED;
+        else if (w == v)
+        {
+            if (open_in[v] == SIMPLIFY_NO_EDGE && open_out[v] == SIMPLIFY_NO_EDGE)
+                s->kind[v] = SIMPLIFY_MANIFOLD;
+            else if (is_single_edge(open_in[v]) && is_single_edge(open_out[v]))
+                s->kind[v] = SIMPLIFY_BORDER;
+            else
+                s->kind[v] = SIMPLIFY_LOCKED;
+        }
+        else if (s->wedge[w] == v && is_single_edge(open_in[v]) && is_single_edge(open_out[v]) &&
+            is_single_edge(open_in[w]) && is_single_edge(open_out[w]) &&
+            s->remap[open_in[v]] == s->remap[open_out[w]] && s->remap[open_out[v]] == s->remap[open_in[w]])
+        {
+            // two halves whose open edges run along the same line
+            s->kind[v] = SIMPLIFY_SEAM;
+        }
+        else
+            s->kind[v] = SIMPLIFY_LOCKED;
+    }
+
+    free(open_in);
+}
+
+// each triangle's plane weighted by its area, plus planes standing up along
+// open edges, all summed per position
+static void fill_simplify_quadrics(Simplifier *s)
+{
+    memset(s->quadrics, 0, sizeof(Quadric) * s->mesh->vertex_count);
+
+    for (unsigned int t = 0; t < s->index_count; t += 3)
+    {
+        const unsigned int *triangle = &s->indices[t];
+        const float *p[3];
+        for (int k = 0; k < 3; k++)
+            p[k] = s->mesh->vertices[triangle[k]].position;
+
+        double e1[3], e2[3], n[3];
+        for (int k = 0; k < 3; k++)
+        {
+            e1[k] = (double) p[1][k] - p[0][k];
+            e2[k] = (double) p[2][k] - p[0][k];
+        }
+        n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+        n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+        n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+        double length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length == 0.0)
+            continue;
+        for (int k = 0; k < 3; k++)
+            n[k] /= length;
+
+        double d = -(n[0] * p[0][0] + n[1] * p[0][1] + n[2] * p[0][2]);
+        for (int k = 0; k < 3; k++)
+            add_plane_quadric(&s->quadrics[s->remap[triangle[k]]], n, d, length);
+
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int a = triangle[k], b = triangle[(k + 1) % 3];
+            if (simplify_has_edge(s, b, a))
+                continue;
+
+            // the plane through the edge at right angles to the triangle,
+            // weighted by length squared so it scales like the area weights
+            const float *pa = p[k], *pb = p[(k + 1) % 3];
+            double edge[3] = { (double) pb[0] - pa[0], (double) pb[1] - pa[1], (double) pb[2] - pa[2] };
+            double perpendicular[3] = {
+                edge[1] * n[2] - edge[2] * n[1],
+                edge[2] * n[0] - edge[0] * n[2],
+                edge[0] * n[1] - edge[1] * n[0]
+            };
+            double edge_length = sqrt(edge[0] * edge[0] + edge[1] * edge[1] + edge[2] * edge[2]);
+            if (edge_length == 0.0)
+                continue;
+            for (int j = 0; j < 3; j++)
+                perpendicular[j] /= edge_length;
+
+            double edge_d = -(perpendicular[0] * pa[0] + perpendicular[1] * pa[1] + perpendicular[2] * pa[2]);
+            double weight = edge_length * edge_length * SIMPLIFY_EDGE_WEIGHT;
+            add_plane_quadric(&s->quadrics[s->remap[a]], perpendicular, edge_d, weight);
+            add_plane_quadric(&s->quadrics[s->remap[b]], perpendicular, edge_d, weight);
+        }
+    }
+}
+
+// the rules above. open is whether the edge between them has no opposite
+static bool can_collapse(const Simplifier *s, unsigned int from, unsigned int to, bool open)
+{
+    unsigned char kind = s->kind[to];
+    switch (s->kind[from])
+    {
+    case SIMPLIFY_MANIFOLD:
+        return true;
+    case SIMPLIFY_BORDER:
+        return open && (kind == SIMPLIFY_BORDER || kind == SIMPLIFY_LOCKED);
+    case SIMPLIFY_SEAM:
+        return open && (kind == SIMPLIFY_SEAM || kind == SIMPLIFY_LOCKED);
+    }
+    return false;
+}
+
+// the vertex at to's position that from's seam partner shares an edge with,
+// where the partner goes so both halves of the seam move together
+static unsigned int seam_partner_target(const Simplifier *s, unsigned int from, unsigned int to)
+{
+    unsigned int partner = s->wedge[from];
+    unsigned int v = to;
+    do
+    {
+        if (v != to && (simplify_has_edge(s, partner, v) || simplify_has_edge(s, v, partner)))
+            return v;
+        v = s->wedge[v];
+    } while (v != to);
+    return SIMPLIFY_NO_EDGE;
+}
+
+static void triangle_normal(const Mesh *mesh, unsigned int a, unsigned int b, unsigned int c, vec3 normal)
+{
+    vec3 ab, ac;
+    glm_vec3_sub(mesh->vertices[b].position, mesh->vertices[a].position, ab);
+    glm_vec3_sub(mesh->vertices[c].position, mesh->vertices[a].position, ac);
+    glm_vec3_cross(ab, ac, normal);
+}
+
+// whether moving from onto to turns any of from's triangles over, with
+// the collapses already made this pass applied
+static bool collapse_flips(const Simplifier *s, unsigned int from, unsigned int to)
+{
+    for (unsigned int k = 0; k < s->adjacency_counts[from]; k++)
+    {
+        const unsigned int *triangle = &s->indices[s->adjacency[s->adjacency_offsets[from] + k] * 3];
+        unsigned int before[3], after[3];
+        bool degenerate = false;
+        for (int c = 0; c < 3; c++)
+        {
+            before[c] = s->collapse_remap[triangle[c]];
+            after[c] = triangle[c] == from ? to : before[c];
+        }
+        for (int c = 0; c < 3; c++)
+            degenerate |= s->remap[after[c]] == s->remap[after[(c + 1) % 3]];
+        if (degenerate)
+            continue;
+
+        vec3 n0, n1;
+        triangle_normal(s->mesh, before[0], before[1], before[2], n0);
+        triangle_normal(s->mesh, after[0], after[1], after[2], n1);
+        if (glm_vec3_dot(n0, n1) <= 0.0f)
+            return true;
+    }
+    return false;
+}
+
+// triangles a collapse removes, the ones with both ends of the edge
+static unsigned int collapse_removes(const Simplifier *s, unsigned int from, unsigned int to)
+{
+    unsigned int removed = 0;
+    for (unsigned int k = 0; k < s->adjacency_counts[from]; k++)
+    {
+        const unsigned int *triangle = &s->indices[s->adjacency[s->adjacency_offsets[from] + k] * 3];
+        for (int c = 0; c < 3; c++)
+            removed += s->remap[triangle[c]] == s->remap[to];
+    }
+    return removed;
+}
+
+static int compare_collapses(const void *a, const void *b)
+{
+    float x = ((const EdgeCollapse*)a)->cost, y = ((const EdgeCollapse*)b)->cost;
+    return x < y ? -1 : x > y;
+}
+
+// one candidate per edge, in whichever direction is allowed and cheaper
+static unsigned int pick_collapses(const Simplifier *s, EdgeCollapse *collapses)
+{
+    unsigned int count = 0;
+    for (unsigned int i = 0; i < s->index_count; i++)
+    {
+        unsigned int a = s->indices[i], b = s->indices[i - i % 3 + (i + 1) % 3];
+        bool open = !simplify_has_edge(s, b, a);
+        // edges with an opposite come up twice, take them once
+        if (!open && a > b)
+            continue;
+
+        EdgeCollapse best = { 0, 0, INFINITY };
+        for (int direction = 0; direction < 2; direction++)
+        {
+            unsigned int from = direction == 0 ? a : b, to = direction == 0 ? b : a;
+            if (!can_collapse(s, from, to, open))
+                continue;
+
+            float cost = quadric_error(&s->quadrics[s->remap[from]], s->mesh->vertices[to].position);
+            if (cost < best.cost)
+                best = (EdgeCollapse) { from, to, cost };
+        }
+
+        if (best.cost < INFINITY)
+            collapses[count++] = best;
+    }
+    return count;
+}
+
+static void free_simplifier(Simplifier *s)
+{
+    free(s->remap);
+    free(s->wedge);
+    free(s->kind);
+    free(s->quadrics);
+    free(s->adjacency_offsets);
+    free(s->adjacency_counts);
+    free(s->adjacency);
+    free(s->collapse_remap);
+    free(s->collapse_locked);
+}
+
+// simplifies the triangles in indices towards target_index_count indices
+// into destination, stopping early rather than letting any collapse stray
+// further than max_error. locked marks vertices that mustn't move, NULL for
+// none. returns how far the result strays, in mesh units
+float simplify_mesh(const Mesh *mesh, const unsigned int *indices, unsigned int index_count, unsigned int target_index_count,
+    float max_error, const unsigned char *locked, unsigned int *destination, unsigned int *result_count)
+{
+    Simplifier s;
+    memset(&s, 0, sizeof(Simplifier));
+    unsigned int vertex_count = mesh->vertex_count > 0 ? mesh->vertex_count : 1;
+    s.mesh = mesh;
+    s.indices = destination;
+    s.index_count = index_count - index_count % 3;
+    memmove(destination, indices, sizeof(unsigned int) * s.index_count);
+    *result_count = s.index_count;
+
+    s.remap = (unsigned int*)malloc(sizeof(unsigned int) * vertex_count);
+    s.wedge = (unsigned int*)malloc(sizeof(unsigned int) * vertex_count);
+    s.kind = (unsigned char*)malloc(vertex_count);
+    s.quadrics = (Quadric*)malloc(sizeof(Quadric) * vertex_count);
+    s.adjacency_offsets = (unsigned int*)malloc(sizeof(unsigned int) * vertex_count);
+    s.adjacency_counts = (unsigned int*)malloc(sizeof(unsigned int) * vertex_count);
+    s.adjacency = (unsigned int*)malloc(sizeof(unsigned int) * (s.index_count + 1));
+    s.collapse_remap = (unsigned int*)malloc(sizeof(unsigned int) * vertex_count);
+    s.collapse_locked = (unsigned char*)malloc(vertex_count);
+    EdgeCollapse *collapses = (EdgeCollapse*)malloc(sizeof(EdgeCollapse) * (s.index_count + 1));
+    if (s.remap == NULL || s.wedge == NULL || s.kind == NULL || s.quadrics == NULL || s.adjacency_offsets == NULL ||
+        s.adjacency_counts == NULL || s.adjacency == NULL || s.collapse_remap == NULL || s.collapse_locked == NULL || collapses == NULL ||
+        !build_position_remap(mesh, s.indices, s.index_count, s.remap, s.wedge))
+    {
+        free(collapses);
+        free_simplifier(&s);
+        return 0.0f;
+    }
+
+    build_simplify_adjacency(&s);
+    classify_simplify_vertices(&s, locked);
+    fill_simplify_quadrics(&s);
+
+    float max_cost = max_error > 0.0f ? max_error * max_error : 0.0f;
+    float result_cost = 0.0f;
+    for (int pass = 0; pass < SIMPLIFY_MAX_PASSES && s.index_count > target_index_count; pass++)
+    {
+        if (pass > 0)
+            build_simplify_adjacency(&s);
+
+        unsigned int candidates = pick_collapses(&s, collapses);
+        qsort(collapses, candidates, sizeof(EdgeCollapse), compare_collapses);
+
+        for (unsigned int v = 0; v < mesh->vertex_count; v++)
+            s.collapse_remap[v] = v;
+        memset(s.collapse_locked, 0, mesh->vertex_count);
+
+        // cheapest first, each position moved or moved onto at most once a
+        // pass so the costs and flip checks stay right
+        unsigned int goal = (s.index_count - target_index_count) / 3, removed = 0, collapsed = 0;
+        for (unsigned int c = 0; c < candidates && removed < goal; c++)
+        {
+            EdgeCollapse *collapse = &collapses[c];
+            if (collapse->cost > max_cost)
+                break;
+
+            unsigned int from = collapse->from, to = collapse->to;
+            if (s.collapse_locked[s.remap[from]] || s.collapse_locked[s.remap[to]])
+                continue;
+
+            unsigned int partner = SIMPLIFY_NO_EDGE, partner_to = SIMPLIFY_NO_EDGE;
+            if (s.kind[from] == SIMPLIFY_SEAM)
+            {
+                partner = s.wedge[from];
+                partner_to = seam_partner_target(&s, from, to);
+                if (partner_to == SIMPLIFY_NO_EDGE)
+                    continue;
+            }
+
+            if (collapse_flips(&s, from, to) || (partner != SIMPLIFY_NO_EDGE && collapse_flips(&s, partner, partner_to)))
+                continue;
+
+            removed += collapse_removes(&s, from, to);
+            s.collapse_remap[from] = to;
+            if (partner != SIMPLIFY_NO_EDGE)
+            {
+                removed += collapse_removes(&s, partner, partner_to);
+                s.collapse_remap[partner] = partner_to;
+            }
+
+            add_quadric(&s.quadrics[s.remap[to]], &s.quadrics[s.remap[from]]);
+            s.collapse_locked[s.remap[from]] = 1;
+            s.collapse_locked[s.remap[to]] = 1;
+            if (collapse->cost > result_cost)
+                result_cost = collapse->cost;
+            collapsed++;
+        }
+
+        if (collapsed == 0)
+            break;
+
+        // apply the pass, dropping triangles that lost a corner
+        unsigned int kept = 0;
+        for (unsigned int i = 0; i < s.index_count; i += 3)
+        {
+            unsigned int a = s.collapse_remap[s.indices[i]], b = s.collapse_remap[s.indices[i + 1]], c = s.collapse_remap[s.indices[i + 2]];
+            if (s.remap[a] == s.remap[b] || s.remap[b] == s.remap[c] || s.remap[c] == s.remap[a])
+                continue;
+            s.indices[kept++] = a;
+            s.indices[kept++] = b;
+            s.indices[kept++] = c;
+        }
+        s.index_count = kept;
+    }
+
+    *result_count = s.index_count;
+    free(collapses);
+    free_simplifier(&s);
+    return sqrtf(result_cost);
+}
+
+// vertices whose position another submesh also uses, moving them would open cracks
+static unsigned char *lock_submesh_borders(const Mesh *mesh)
+{
+    unsigned int vertex_count = mesh->vertex_count > 0 ? mesh->vertex_count : 1;
+    unsigned char *locked = (unsigned char*)calloc(vertex_count, 1);
+    unsigned int *remap = (unsigned int*)malloc(sizeof(unsigned int) * vertex_count);
+    unsigned int *wedge = (unsigned int*)malloc(sizeof(unsigned int) * vertex_count);
+    unsigned int *owner = (unsigned int*)malloc(sizeof(unsigned int) * vertex_count);
+    if (locked == NULL || remap == NULL || wedge == NULL || owner == NULL ||
+        !build_position_remap(mesh, mesh->indices, mesh->index_count, remap, wedge))
+    {
+        free(remap);
+        free(wedge);
+        free(owner);
+        return locked;
+    }
+
+    for (unsigned int v = 0; v < mesh->vertex_count; v++)
+        owner[v] = SIMPLIFY_NO_EDGE;
+    for (unsigned int s = 0; s < mesh->submesh_count; s++)
+    {
+        const MeshSubmesh *submesh = &mesh->submeshes[s];
+        for (unsigned int i = submesh->first_index; i < submesh->first_index + submesh->index_count; i++)
+        {
+            unsigned int group = remap[mesh->indices[i]];
+            if (owner[group] == SIMPLIFY_NO_EDGE)
+                owner[group] = s;
+            else if (owner[group] != s)
+                locked[group] = 1;
+        }
+    }
+
+    for (unsigned int v = 0; v < mesh->vertex_count; v++)
+    {
+        if (remap[v] != SIMPLIFY_NO_EDGE)
+            locked[v] = locked[remap[v]];
+    }
+
+    free(remap);
+    free(wedge);
+    free(owner);
+    return locked;
+}
+
+// appends coarser versions of the mesh to its index buffer, each aiming for
+// LOD_TRIANGLE_RATIO of the last one's triangles, until a level stops
+// shrinking or strays past LOD_MAX_ERROR. every level is simplified from the
+// one before, so its error is the sum of the steps. submeshes are simplified
+// one at a time so their materials stay apart
+bool build_mesh_lods(Mesh *mesh)
+{
+    if (mesh->lod_count > 1 || mesh->index_count == 0)
+        return true;
+    if (mesh->submesh_count == 0 && !add_mesh_submesh(mesh, 0, mesh->index_count, -1))
+        return false;
+
+    unsigned int submesh_count = mesh->submesh_count;
+    MeshLod *lods = (MeshLod*)realloc(mesh->lods, sizeof(MeshLod) * LOD_MAX_LEVELS);
+    if (lods == NULL)
+        return false;
+    mesh->lods = lods;
+    mesh->lods[0] = (MeshLod) { 0, mesh->index_count, 0.0f, 0, 0 };
+    mesh->lod_count = 1;
+
+    MeshSubmesh *submeshes = (MeshSubmesh*)realloc(mesh->submeshes, sizeof(MeshSubmesh) * submesh_count * LOD_MAX_LEVELS);
+    if (submeshes == NULL)
+        return false;
+    mesh->submeshes = submeshes;
+
+    unsigned char *locked = submesh_count > 1 ? lock_submesh_borders(mesh) : NULL;
+    float limit = LOD_MAX_ERROR * glm_vec3_distance(mesh->bounds[0], mesh->bounds[1]);
+
+    for (int lod = 1; lod < LOD_MAX_LEVELS; lod++)
+    {
+        const MeshLod *previous = &mesh->lods[lod - 1];
+        unsigned int *indices = (unsigned int*)realloc(mesh->indices, sizeof(unsigned int) * (mesh->index_count + previous->index_count));
+        if (indices == NULL)
+            break;
+        mesh->indices = indices;
+
+        unsigned int start = mesh->index_count, written = start;
+        float error = 0.0f;
+        for (unsigned int s = 0; s < submesh_count; s++)
+        {
+            const MeshSubmesh *source = &mesh->submeshes[(lod - 1) * submesh_count + s];
+            unsigned int target = (unsigned int) (source->index_count / 3 * LOD_TRIANGLE_RATIO) * 3;
+            unsigned int count;
+            float step = simplify_mesh(mesh, mesh->indices + source->first_index, source->index_count, target,
+                limit - previous->error, locked, mesh->indices + written, &count);
+
+            mesh->submeshes[lod * submesh_count + s] = (MeshSubmesh) { written, count, source->material };
+            written += count;
+            error = fmaxf(error, previous->error + step);
+        }
+
+        unsigned int count = written - start;
+        if (count == 0 || count > previous->index_count * LOD_MIN_REDUCTION)
+            break;
+
+        mesh->lods[lod] = (MeshLod) { start, count, error, 0, 0 };
+        mesh->lod_count++;
+        mesh->index_count = written;
+    }
+
+    free(locked);
+    return true;
+}
+
+void print_mesh_lods(const char *name, const Mesh *mesh)
+{
+    for (unsigned int lod = 1; lod < mesh->lod_count; lod++)
+        printf("Mesh %s: LOD %u has %u triangles (%.1f%%), error %g\n", name, lod, mesh->lods[lod].index_count / 3,
+            100.0f * mesh->lods[lod].index_count / mesh->lods[0].index_count, mesh->lods[lod].error);
+}
+
+#endif
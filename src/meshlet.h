@@ -0,0 +1,336 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include <cglm/cglm.h>
+
+#include "mesh.h"
+
+// meshlet defaults
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+#define MESHLET_MIN_CONE_DOT 0.1f // normals spread wider than this and the cone can't cull anything
+
+#define MESHLET_NONE 0xFFFFFFFFu
+
+// splits every LOD into meshlets, small clusters of nearby triangles the GPU
+// culls one by one against the frustum and their normal cones, see the
+// meshlet culling pass in render_queue.h. each one's triangles are moved
+// together within their LOD and submesh, so those index runs still hold
+// the same triangles, and a meshlet is just a shorter run of indices
+typedef struct MeshletBuilder {
+    const Mesh *mesh;
+    const unsigned int *indices;
+    unsigned int triangle_count;
+
+    // triangles around each vertex
+    unsigned int *adjacency_offsets;
+    unsigned int *adjacency;
+    bool *used;
+
+    // which meshlet each vertex was last added to, and the current one's vertices
+    unsigned int *vertex_meshlet;
+    unsigned int vertices[MESHLET_MAX_VERTICES];
+    unsigned int vertex_count;
+    unsigned int triangles[MESHLET_MAX_TRIANGLES];
+    unsigned int current_triangles;
+    vec3 centroid;
+} MeshletBuilder;
+
+bool build_mesh_meshlets(Mesh *mesh);
+void print_mesh_meshlets(const char *name, const Mesh *mesh);
+
+// bounding sphere and normal cone of the triangles in a run of indices
+static void compute_meshlet_bounds(const Mesh *mesh, Meshlet *meshlet)
+{
+    const unsigned int *indices = mesh->indices + meshlet->first_index;
+    vec3 bounds[2];
+    glm_vec3_copy(mesh->vertices[indices[0]].position, bounds[0]);
+    glm_vec3_copy(mesh->vertices[indices[0]].position, bounds[1]);
+    for (unsigned int i = 1; i < meshlet->index_count; i++)
+    {
+        glm_vec3_minv(bounds[0], mesh->vertices[indices[i]].position, bounds[0]);
+        glm_vec3_maxv(bounds[1], mesh->vertices[indices[i]].position, bounds[1]);
+    }
+
+    vec3 center;
+    glm_vec3_center(bounds[0], bounds[1], center);
+    float radius = 0.0f;
+    for (unsigned int i = 0; i < meshlet->index_count; i++)
+        radius = fmaxf(radius, glm_vec3_distance(center, mesh->vertices[indices[i]].position));
+    glm_vec3_copy(center, meshlet->center);
+    meshlet->radius = radius;
+
+    // the axis averages the unit normals, so big triangles don't drown out small ones
+    vec3 axis = { 0.0f, 0.0f, 0.0f };
+    for (unsigned int i = 0; i + 2 < meshlet->index_count; i += 3)
+    {
+        vec3 ab, ac, normal;
+        glm_vec3_sub(mesh->vertices[indices[i + 1]].position, mesh->vertices[indices[i]].position, ab);
+        glm_vec3_sub(mesh->vertices[indices[i + 2]].position, mesh->vertices[indices[i]].position, ac);
+        glm_vec3_cross(ab, ac, normal);
+        if (glm_vec3_norm2(normal) > 0.0f)
+        {
+            glm_vec3_normalize(normal);
+            glm_vec3_add(axis, normal, axis);
+        }
+    }
+
+    // no cone, never culled by it
+    glm_vec3_zero(meshlet->cone_axis);
+    glm_vec3_copy(center, meshlet->cone_apex);
+    meshlet->cone_cutoff = 1.0f;
+    if (glm_vec3_norm2(axis) == 0.0f)
+        return;
+    glm_vec3_normalize(axis);
+
+    // the widest normal sets the cone's angle, and the apex goes back along
+    // the axis until every triangle's plane has it on the back side
+    float min_dot = 1.0f, max_t = 0.0f;
+    for (unsigned int i = 0; i + 2 < meshlet->index_count; i += 3)
+    {
+        const float *p0 = mesh->vertices[indices[i]].position;
+        vec3 ab, ac, normal, to_center;
+        glm_vec3_sub(mesh->vertices[indices[i + 1]].position, (float*)p0, ab);
+        glm_vec3_sub(mesh->vertices[indices[i + 2]].position, (float*)p0, ac);
+        glm_vec3_cross(ab, ac, normal);
+        if (glm_vec3_norm2(normal) == 0.0f)
+            continue;
+        glm_vec3_normalize(normal);
+
+        float dot = glm_vec3_dot(axis, normal);
+        min_dot = fminf(min_dot, dot);
+        if (dot <= MESHLET_MIN_CONE_DOT)
+            return;
+
+        glm_vec3_sub(center, (float*)p0, to_center);
+        max_t = fmaxf(max_t, glm_vec3_dot(to_center, normal) / dot);
+    }
+
+    glm_vec3_copy(axis, meshlet->cone_axis);
+    glm_vec3_muladds(axis, -max_t, meshlet->cone_apex);
+    // sine of the cone's half angle, past it the eye is behind every triangle
+    meshlet->cone_cutoff = sqrtf(1.0f - min_dot * min_dot);
+}
+
+static void add_meshlet_triangle(MeshletBuilder *builder, unsigned int meshlet, unsigned int triangle)
+{
+    const unsigned int *corners = &builder->indices[triangle * 3];
+    for (int k = 0; k < 3; k++)
+    {
+        unsigned int v = corners[k];
+        if (builder->vertex_meshlet[v] == meshlet)
+            continue;
+
+        builder->vertex_meshlet[v] = meshlet;
+        builder->vertices[builder->vertex_count] = v;
+        // running mean of the vertices, candidates near it keep meshlets round
+        glm_vec3_scale(builder->centroid, (float) builder->vertex_count, builder->centroid);
+        glm_vec3_add(builder->centroid, builder->mesh->vertices[v].position, builder->centroid);
+        builder->vertex_count++;
+        glm_vec3_scale(builder->centroid, 1.0f / builder->vertex_count, builder->centroid);
+    }
+
+    builder->used[triangle] = true;
+    builder->triangles[builder->current_triangles++] = triangle;
+}
+
+// the unused triangle next to the current meshlet that brings the fewest
+// new vertices, the nearest one when several do. MESHLET_NONE when nothing
+// next to it fits
+static unsigned int next_meshlet_triangle(const MeshletBuilder *builder, unsigned int meshlet)
+{
+    unsigned int best = MESHLET_NONE, best_extra = 4;
+    float best_distance = INFINITY;
+    for (unsigned int i = 0; i < builder->vertex_count; i++)
+    {
+        unsigned int v = builder->vertices[i];
+        for (unsigned int k = builder->adjacency_offsets[v]; k < builder->adjacency_offsets[v + 1]; k++)
+        {
+            unsigned int triangle = builder->adjacency[k];
+            if (builder->used[triangle])
+                continue;
+
+            const unsigned int *corners = &builder->indices[triangle * 3];
+            unsigned int extra = 0;
+            vec3 centroid = { 0.0f, 0.0f, 0.0f };
+            for (int c = 0; c < 3; c++)
+            {
+                extra += builder->vertex_meshlet[corners[c]] != meshlet;
+                glm_vec3_add(centroid, builder->mesh->vertices[corners[c]].position, centroid);
+            }
+            if (builder->vertex_count + extra > MESHLET_MAX_VERTICES || extra > best_extra)
+                continue;
+
+            glm_vec3_scale(centroid, 1.0f / 3.0f, centroid);
+            float distance = glm_vec3_distance2(centroid, (float*)builder->centroid);
+            if (extra < best_extra || distance < best_distance)
+            {
+                best = triangle;
+                best_extra = extra;
+                best_distance = distance;
+            }
+        }
+    }
+    return best;
+}
+
+// greedy, grows each meshlet from a seed over neighbouring triangles until
+// it's full or runs out of them. the run's indices are rewritten meshlet by meshlet
+static bool build_run_meshlets(Mesh *mesh, unsigned int first_index, unsigned int index_count, unsigned int *vertex_meshlet,
+    unsigned int *capacity)
+{
+    MeshletBuilder builder;
+    memset(&builder, 0, sizeof(MeshletBuilder));
+    builder.mesh = mesh;
+    builder.triangle_count = index_count / 3;
+    builder.vertex_meshlet = vertex_meshlet;
+    if (builder.triangle_count == 0)
+        return true;
+
+    unsigned int *source = (unsigned int*)malloc(sizeof(unsigned int) * builder.triangle_count * 3);
+    builder.adjacency_offsets = (unsigned int*)calloc(mesh->vertex_count + 1, sizeof(unsigned int));
+    builder.adjacency = (unsigned int*)malloc(sizeof(unsigned int) * builder.triangle_count * 3);
+    builder.used = (bool*)calloc(builder.triangle_count, sizeof(bool));
+    bool ok = source != NULL && builder.adjacency_offsets != NULL && builder.adjacency != NULL && builder.used != NULL;
+    if (ok)
+    {
+        memcpy(source, mesh->indices + first_index, sizeof(unsigned int) * builder.triangle_count * 3);
+        builder.indices = source;
+
+        // counts shifted up one, so after the prefix sum offsets[v] is where v's list starts
+        for (unsigned int i = 0; i < builder.triangle_count * 3; i++)
+            builder.adjacency_offsets[source[i] + 1]++;
+        for (unsigned int v = 0; v < mesh->vertex_count; v++)
+            builder.adjacency_offsets[v + 1] += builder.adjacency_offsets[v];
+        for (unsigned int i = 0; i < builder.triangle_count * 3; i++)
+            builder.adjacency[builder.adjacency_offsets[source[i]]++] = i / 3;
+        for (unsigned int v = mesh->vertex_count; v > 0; v--)
+            builder.adjacency_offsets[v] = builder.adjacency_offsets[v - 1];
+        builder.adjacency_offsets[0] = 0;
+    }
+
+    unsigned int seed = 0, written = first_index;
+    while (ok)
+    {
+        while (seed < builder.triangle_count && builder.used[seed])
+            seed++;
+        if (seed == builder.triangle_count)
+            break;
+
+        if (mesh->meshlet_count == *capacity)
+        {
+            unsigned int grown = *capacity > 0 ? *capacity * 2 : 64;
+            Meshlet *meshlets = (Meshlet*)realloc(mesh->meshlets, sizeof(Meshlet) * grown);
+            if (meshlets == NULL)
+            {
+                ok = false;
+                break;
+            }
+            mesh->meshlets = meshlets;
+            *capacity = grown;
+        }
+
+        // numbered by where they go in the mesh, so vertex_meshlet never needs clearing
+        unsigned int meshlet = mesh->meshlet_count;
+        builder.vertex_count = 0;
+        builder.current_triangles = 0;
+        glm_vec3_zero(builder.centroid);
+
+        unsigned int triangle = seed;
+        while (triangle != MESHLET_NONE)
+        {
+            add_meshlet_triangle(&builder, meshlet, triangle);
+            triangle = builder.current_triangles < MESHLET_MAX_TRIANGLES ? next_meshlet_triangle(&builder, meshlet) : MESHLET_NONE;
+        }
+
+        Meshlet *out = &mesh->meshlets[mesh->meshlet_count++];
+        memset(out, 0, sizeof(Meshlet));
+        out->first_index = written;
+        out->index_count = builder.current_triangles * 3;
+        for (unsigned int t = 0; t < builder.current_triangles; t++)
+        {
+            memcpy(mesh->indices + written, &source[builder.triangles[t] * 3], sizeof(unsigned int) * 3);
+            written += 3;
+        }
+        compute_meshlet_bounds(mesh, out);
+    }
+
+    free(source);
+    free(builder.adjacency_offsets);
+    free(builder.adjacency);
+    free(builder.used);
+    return ok;
+}
+
+// meshlets for every LOD's submeshes, a mesh without LODs gets LOD 0 first
+bool build_mesh_meshlets(Mesh *mesh)
+{
+    if (mesh->meshlet_count > 0 || mesh->index_count == 0)
+        return true;
+    if (mesh->lod_count == 0)
+    {
+        mesh->lods = (MeshLod*)calloc(1, sizeof(MeshLod));
+        if (mesh->lods == NULL)
+            return false;
+        mesh->lods[0] = (MeshLod) { 0, mesh->index_count, 0.0f, 0, 0 };
+        mesh->lod_count = 1;
+    }
+
+    unsigned int *vertex_meshlet = (unsigned int*)malloc(sizeof(unsigned int) * (mesh->vertex_count > 0 ? mesh->vertex_count : 1));
+    if (vertex_meshlet == NULL)
+        return false;
+    for (unsigned int v = 0; v < mesh->vertex_count; v++)
+        vertex_meshlet[v] = MESHLET_NONE;
+
+    bool ok = true;
+    unsigned int capacity = 0;
+    for (unsigned int lod = 0; lod < mesh->lod_count && ok; lod++)
+    {
+        MeshLod *level = &mesh->lods[lod];
+        level->first_meshlet = mesh->meshlet_count;
+        if (mesh->submesh_count == 0)
+            ok = build_run_meshlets(mesh, level->first_index, level->index_count, vertex_meshlet, &capacity);
+        for (unsigned int s = 0; s < mesh->submesh_count && ok; s++)
+        {
+            const MeshSubmesh *submesh = &mesh->submeshes[lod * mesh->submesh_count + s];
+            ok = build_run_meshlets(mesh, submesh->first_index, submesh->index_count, vertex_meshlet, &capacity);
+        }
+        level->meshlet_count = mesh->meshlet_count - level->first_meshlet;
+    }
+
+    free(vertex_meshlet);
+    if (!ok)
+    {
+        free(mesh->meshlets);
+        mesh->meshlets = NULL;
+        mesh->meshlet_count = 0;
+        for (unsigned int lod = 0; lod < mesh->lod_count; lod++)
+            mesh->lods[lod].meshlet_count = 0;
+    }
+    return ok;
+}
+
+void print_mesh_meshlets(const char *name, const Mesh *mesh)
+{
+    for (unsigned int lod = 0; lod < mesh->lod_count; lod++)
+    {
+        const MeshLod *level = &mesh->lods[lod];
+        if (level->meshlet_count == 0)
+            continue;
+
+        unsigned int cones = 0;
+        for (unsigned int m = level->first_meshlet; m < level->first_meshlet + level->meshlet_count; m++)
+            cones += mesh->meshlets[m].cone_cutoff < 1.0f;
+        printf("Mesh %s: LOD %u has %u meshlets, %.1f triangles each, %u with normal cones\n", name, lod, level->meshlet_count,
+            (float) level->index_count / 3.0f / level->meshlet_count, cones);
+    }
+}
+
+#endif
@@ -0,0 +1,467 @@
+#ifndef MIPMAP_H
+#define MIPMAP_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include <glad/glad.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MIP_X86 1
+#endif
+
+#include "jobs.h"
+#include "profiler.h"
+#include "render_stats.h"
+#include "texture_format.h"
+
+// mip generator defaults
+#define MIP_MAX_LEVELS 16
+#define MIP_DEFAULT_FILTER MIP_FILTER_KAISER
+#define MIP_ROWS_PER_JOB 8
+#define MIP_MAX_TAPS 32
+#define MIP_ENCODE_LUT_SIZE 16384
+
+typedef enum MipFilter {
+    MIP_FILTER_BOX,
+    MIP_FILTER_KAISER,
+    MIP_FILTER_LANCZOS
+} MipFilter;
+
+// level 0 is the caller's image, the rest are owned by the chain
+typedef struct MipChain {
+    int levels;
+    int channels;
+    int width[MIP_MAX_LEVELS];
+    int height[MIP_MAX_LEVELS];
+    unsigned char *data[MIP_MAX_LEVELS];
+} MipChain;
+
+// one output sample's taps into the source row/column
+typedef struct MipTaps {
+    int start;
+    int count;
+    float weights[MIP_MAX_TAPS];
+} MipTaps;
+
+// shared state for one level's worth of jobs
+typedef struct MipLevelBuild {
+    const float *src;
+    int src_width;
+    int src_height;
+    float *dst;
+    unsigned char *encoded;
+    int dst_width;
+    int dst_height;
+    int channels;
+    bool srgb;
+    const MipTaps *columns;
+    const MipTaps *rows;
+} MipLevelBuild;
+
+float srgb_to_linear_lut[256];
+unsigned char linear_to_srgb_lut[MIP_ENCODE_LUT_SIZE];
+bool mip_luts_ready = false;
+bool mip_use_avx2 = false;
+
+bool generate_mip_chain(const unsigned char *pixels, int width, int height, int channels, bool srgb, MipFilter filter, int max_levels, MipChain *chain);
+void free_mip_chain(MipChain *chain);
+void upload_mip_chain(GLuint texture, GLenum target, GLint layer, const MipChain *chain);
+
+void init_mip_luts(void)
+{
+    if (mip_luts_ready)
+        return;
+
+    for (int i = 0; i < 256; i++)
+    {
+        float c = i / 255.0f;
+        srgb_to_linear_lut[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+    }
+
+    for (int i = 0; i < MIP_ENCODE_LUT_SIZE; i++)
+    {
+        float l = (i + 0.5f) / MIP_ENCODE_LUT_SIZE;
+        float c = l <= 0.0031308f ? l * 12.92f : 1.055f * powf(l, 1.0f / 2.4f) - 0.055f;
+        linear_to_srgb_lut[i] = (unsigned char) (c * 255.0f + 0.5f);
+    }
+
+#ifdef MIP_X86
+    __builtin_cpu_init();
+    mip_use_avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+
+    mip_luts_ready = true;
+}
+
+float sinc(float x)
+{
+    if (fabsf(x) < 1e-6f)
+        return 1.0f;
+    x *= (float) M_PI;
+    return sinf(x) / x;
+}
+
+// zeroth order modified Bessel function of the first kind
+float bessel_i0(float x)
+{
+    float sum = 1.0f, term = 1.0f;
+    for (int k = 1; k < 32; k++)
+    {
+        term *= (x / (2.0f * k)) * (x / (2.0f * k));
+        sum += term;
+        if (term < sum * 1e-8f)
+            break;
+    }
+    return sum;
+}
+
+float mip_filter_radius(MipFilter filter)
+{
+    switch (filter)
+    {
+        case MIP_FILTER_KAISER: return 3.0f;
+        case MIP_FILTER_LANCZOS: return 3.0f;
+        default: return 0.5f;
+    }
+}
+
+float mip_filter_weight(MipFilter filter, float x)
+{
+    switch (filter)
+    {
+        case MIP_FILTER_KAISER:
+        {
+            // kaiser windowed sinc, alpha 4 over the filter width
+            const float alpha = 4.0f, width = 3.0f;
+            float t = x / width;
+            if (fabsf(t) >= 1.0f)
+                return 0.0f;
+            return sinc(x) * bessel_i0(alpha * sqrtf(1.0f - t * t)) / bessel_i0(alpha);
+        }
+
+        case MIP_FILTER_LANCZOS:
+            return fabsf(x) < 3.0f ? sinc(x) * sinc(x / 3.0f) : 0.0f;
+
+        default:
+            return fabsf(x) <= 0.5f ? 1.0f : 0.0f;
+    }
+}
+
+// normalized taps for resampling src samples to dst samples along one axis
+void build_mip_taps(MipFilter filter, int src, int dst, MipTaps *taps)
+{
+    float scale = (float) src / dst;
+    float support = mip_filter_radius(filter) * scale;
+
+    for (int i = 0; i < dst; i++)
+    {
+        MipTaps *t = &taps[i];
+        float center = (i + 0.5f) * scale;
+        int first = (int) floorf(center - support);
+        int last = (int) ceilf(center + support);
+        if (last - first > MIP_MAX_TAPS)
+        {
+            first = (int) center - MIP_MAX_TAPS / 2;
+            last = first + MIP_MAX_TAPS;
+        }
+
+        // edge taps are clamped to the image so weights stay in range
+        float total = 0.0f;
+        t->count = 0;
+        t->start = first < 0 ? 0 : first;
+        int end = last > src ? src : last;
+        for (int s = t->start; s < end; s++)
+        {
+            float w = mip_filter_weight(filter, (s + 0.5f - center) / scale);
+            t->weights[t->count++] = w;
+            total += w;
+        }
+
+        if (t->count == 0)
+        {
+            t->start = (int) center < src ? (int) center : src - 1;
+            t->weights[0] = 1.0f;
+            t->count = 1;
+            total = 1.0f;
+        }
+
+        for (int k = 0; k < t->count; k++)
+            t->weights[k] /= total;
+    }
+}
+
+// dst[j] = sum over taps of weight * rows[tap][j]
+void mip_vertical_scalar(float *dst, const float *src, int stride, const MipTaps *taps, int count)
+{
+    for (int j = 0; j < count; j++)
+    {
+        float sum = 0.0f;
+        for (int k = 0; k < taps->count; k++)
+            sum += taps->weights[k] * src[(size_t) (taps->start + k) * stride + j];
+        dst[j] = sum;
+    }
+}
+
+// every pixel is 4 floats wide internally, so one pixel is one register
+void mip_horizontal_scalar(float *dst, const float *src, const MipTaps *columns, int width)
+{
+    for (int x = 0; x < width; x++)
+    {
+        const MipTaps *taps = &columns[x];
+        float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        for (int k = 0; k < taps->count; k++)
+        {
+            const float *p = &src[(size_t) (taps->start + k) * 4];
+            for (int c = 0; c < 4; c++)
+                sum[c] += taps->weights[k] * p[c];
+        }
+        memcpy(&dst[(size_t) x * 4], sum, sizeof(sum));
+    }
+}
+
+#ifdef MIP_X86
+__attribute__((target("avx2,fma")))
+void mip_vertical_avx2(float *dst, const float *src, int stride, const MipTaps *taps, int count)
+{
+    int j = 0;
+    for (; j + 16 <= count; j += 16)
+    {
+        __m256 a = _mm256_setzero_ps();
+        __m256 b = _mm256_setzero_ps();
+        for (int k = 0; k < taps->count; k++)
+        {
+            const float *row = &src[(size_t) (taps->start + k) * stride + j];
+            __m256 w = _mm256_set1_ps(taps->weights[k]);
+            a = _mm256_fmadd_ps(w, _mm256_loadu_ps(row), a);
+            b = _mm256_fmadd_ps(w, _mm256_loadu_ps(row + 8), b);
+        }
+        _mm256_storeu_ps(&dst[j], a);
+        _mm256_storeu_ps(&dst[j + 8], b);
+    }
+
+    if (j < count)
+        mip_vertical_scalar(&dst[j], &src[j], stride, taps, count - j);
+}
+
+__attribute__((target("avx2,fma")))
+void mip_horizontal_avx2(float *dst, const float *src, const MipTaps *columns, int width)
+{
+    int x = 0;
+    // two output pixels per 256 bit register
+    for (; x + 2 <= width; x += 2)
+    {
+        const MipTaps *t0 = &columns[x];
+        const MipTaps *t1 = &columns[x + 1];
+        __m256 sum = _mm256_setzero_ps();
+        int taps = t0->count > t1->count ? t0->count : t1->count;
+
+        for (int k = 0; k < taps; k++)
+        {
+            __m128 p0 = k < t0->count ? _mm_loadu_ps(&src[(size_t) (t0->start + k) * 4]) : _mm_setzero_ps();
+            __m128 p1 = k < t1->count ? _mm_loadu_ps(&src[(size_t) (t1->start + k) * 4]) : _mm_setzero_ps();
+            __m256 p = _mm256_insertf128_ps(_mm256_castps128_ps256(p0), p1, 1);
+            __m256 w = _mm256_setr_ps(
+                k < t0->count ? t0->weights[k] : 0.0f, k < t0->count ? t0->weights[k] : 0.0f,
+                k < t0->count ? t0->weights[k] : 0.0f, k < t0->count ? t0->weights[k] : 0.0f,
+                k < t1->count ? t1->weights[k] : 0.0f, k < t1->count ? t1->weights[k] : 0.0f,
+                k < t1->count ? t1->weights[k] : 0.0f, k < t1->count ? t1->weights[k] : 0.0f);
+            sum = _mm256_fmadd_ps(w, p, sum);
+        }
+        _mm256_storeu_ps(&dst[(size_t) x * 4], sum);
+    }
+
+    if (x < width)
+        mip_horizontal_scalar(&dst[(size_t) x * 4], src, &columns[x], width - x);
+}
+#endif
+
+unsigned char encode_mip_value(float value, bool srgb)
+{
+    if (value <= 0.0f)
+        return 0;
+    if (value >= 1.0f)
+        return 255;
+    if (srgb)
+        return linear_to_srgb_lut[(int) (value * MIP_ENCODE_LUT_SIZE)];
+    return (unsigned char) (value * 255.0f + 0.5f);
+}
+
+// filter output rows [begin, end) of one level and encode them back to bytes
+void build_mip_rows_job(void *data, unsigned int begin, unsigned int end)
+{
+    PROFILE_SCOPE("build_mip_rows");
+
+    MipLevelBuild *build = (MipLevelBuild*)data;
+    int src_stride = build->src_width * 4;
+    float *column = (float*)malloc(sizeof(float) * src_stride);
+
+    for (unsigned int y = begin; y < end; y++)
+    {
+        float *dst = &build->dst[(size_t) y * build->dst_width * 4];
+
+#ifdef MIP_X86
+        if (mip_use_avx2)
+        {
+            mip_vertical_avx2(column, build->src, src_stride, &build->rows[y], src_stride);
+            mip_horizontal_avx2(dst, column, build->columns, build->dst_width);
+        }
+        else
+#endif
+        {
+            mip_vertical_scalar(column, build->src, src_stride, &build->rows[y], src_stride);
+            mip_horizontal_scalar(dst, column, build->columns, build->dst_width);
+        }
+
+        unsigned char *out = &build->encoded[(size_t) y * build->dst_width * build->channels];
+        for (int x = 0; x < build->dst_width; x++)
+        {
+            for (int c = 0; c < build->channels; c++)
+            {
+                // alpha is always linear
+                bool srgb = build->srgb && !(c == 3 || (build->channels == 2 && c == 1));
+                out[x * build->channels + c] = encode_mip_value(dst[x * 4 + c], srgb);
+            }
+        }
+    }
+
+    free(column);
+}
+
+typedef struct MipDecodeBuild {
+    const unsigned char *pixels;
+    float *linear;
+    int width;
+    int channels;
+    bool srgb;
+} MipDecodeBuild;
+
+// bytes to 4 channel linear floats, a row at a time
+void decode_mip_rows_job(void *data, unsigned int begin, unsigned int end)
+{
+    MipDecodeBuild *build = (MipDecodeBuild*)data;
+
+    for (unsigned int y = begin; y < end; y++)
+    {
+        const unsigned char *src = &build->pixels[(size_t) y * build->width * build->channels];
+        float *dst = &build->linear[(size_t) y * build->width * 4];
+
+        for (int x = 0; x < build->width; x++, src += build->channels, dst += 4)
+        {
+            float v[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+            for (int c = 0; c < build->channels; c++)
+            {
+                bool alpha = c == 3 || (build->channels == 2 && c == 1);
+                v[c] = build->srgb && !alpha ? srgb_to_linear_lut[src[c]] : src[c] / 255.0f;
+            }
+            memcpy(dst, v, sizeof(v));
+        }
+    }
+}
+
+// builds up to max_levels levels counting level 0, filtering in linear light
+// when srgb is set, must be called from a job system thread
+bool generate_mip_chain(const unsigned char *pixels, int width, int height, int channels, bool srgb, MipFilter filter, int max_levels, MipChain *chain)
+{
+    PROFILE_SCOPE("generate_mip_chain");
+    init_mip_luts();
+
+    memset(chain, 0, sizeof(MipChain));
+    if (max_levels <= 0 || max_levels > MIP_MAX_LEVELS)
+        max_levels = MIP_MAX_LEVELS;
+    chain->channels = channels;
+    chain->levels = 1;
+    chain->width[0] = width;
+    chain->height[0] = height;
+    chain->data[0] = (unsigned char*)pixels;
+
+    float *src = (float*)malloc(sizeof(float) * 4 * (size_t) width * height);
+    if (src == NULL)
+        return false;
+
+    MipDecodeBuild decode = { pixels, src, width, channels, srgb };
+    parallel_for((unsigned int) height, MIP_ROWS_PER_JOB, decode_mip_rows_job, &decode);
+
+    int src_width = width, src_height = height;
+    while ((src_width > 1 || src_height > 1) && chain->levels < max_levels)
+    {
+        int dst_width = src_width > 1 ? src_width / 2 : 1;
+        int dst_height = src_height > 1 ? src_height / 2 : 1;
+
+        float *dst = (float*)malloc(sizeof(float) * 4 * (size_t) dst_width * dst_height);
+        unsigned char *encoded = (unsigned char*)malloc((size_t) dst_width * dst_height * channels);
+        MipTaps *columns = (MipTaps*)malloc(sizeof(MipTaps) * dst_width);
+        MipTaps *rows = (MipTaps*)malloc(sizeof(MipTaps) * dst_height);
+        if (dst == NULL || encoded == NULL || columns == NULL || rows == NULL)
+        {
+            free(dst);
+            free(encoded);
+            free(columns);
+            free(rows);
+            break;
+        }
+
+        build_mip_taps(filter, src_width, dst_width, columns);
+        build_mip_taps(filter, src_height, dst_height, rows);
+
+        MipLevelBuild build = {
+            src, src_width, src_height, dst, encoded, dst_width, dst_height, channels, srgb, columns, rows
+        };
+        parallel_for((unsigned int) dst_height, MIP_ROWS_PER_JOB, build_mip_rows_job, &build);
+
+        int level = chain->levels++;
+        chain->width[level] = dst_width;
+        chain->height[level] = dst_height;
+        chain->data[level] = encoded;
+
+        free(columns);
+        free(rows);
+        free(src);
+
+        // keep filtering from the unquantized level
+        src = dst;
+        src_width = dst_width;
+        src_height = dst_height;
+    }
+
+    free(src);
+    return true;
+}
+
+void free_mip_chain(MipChain *chain)
+{
+    for (int i = 1; i < chain->levels; i++)
+        free(chain->data[i]);
+    memset(chain, 0, sizeof(MipChain));
+}
+
+// upload levels 1 and up into storage that already exists, target is the
+// one texture was created with, layer is ignored for 2D textures
+void upload_mip_chain(GLuint texture, GLenum target, GLint layer, const MipChain *chain)
+{
+    GLint alignment = 4;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+
+    for (int level = 1; level < chain->levels; level++)
+    {
+        TextureFormat format = choose_texture_format(chain->channels, chain->width[level]);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, format.alignment);
+
+        if (target == GL_TEXTURE_2D_ARRAY)
+            glTextureSubImage3D(texture, level, 0, 0, layer, chain->width[level], chain->height[level], 1,
+                format.format, format.type, chain->data[level]);
+        else
+            glTextureSubImage2D(texture, level, 0, 0, chain->width[level], chain->height[level],
+                format.format, format.type, chain->data[level]);
+
+        render_stats.frame.texture_bytes += (uint64_t) chain->width[level] * chain->height[level] * chain->channels;
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+}
+
+#endif
@@ -0,0 +1,392 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <stdatomic.h>
+
+#include <glad/glad.h>
+
+// profiler defaults
+#define PROFILE_EVENTS_PER_THREAD 16384 // must be a power of two
+#define PROFILE_MAX_DEPTH 32
+#define PROFILE_GPU_FRAMES 4 // frames of queries in flight before we read them back
+#define PROFILE_GPU_MAX_SCOPES 64
+#define PROFILE_GPU_EVENTS 16384 // must be a power of two
+#define PROFILE_GPU_TRACK 1000   // fake thread id for the GPU in the trace
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+// closes itself at the end of the enclosing block
+#define PROFILE_SCOPE(name) \
+    int PROFILE_CONCAT(profile_scope_, __LINE__) __attribute__((cleanup(profile_scope_end))) = profile_begin(name)
+
+typedef struct ProfileEvent {
+    const char *name;
+    uint64_t begin;
+    uint64_t end;
+    uint32_t depth;
+    uint32_t frame;
+} ProfileEvent;
+
+// written only by its own thread, read by the exporter
+typedef struct ProfileThread {
+    ProfileEvent *events;
+    atomic_uint_fast64_t head;
+    uint32_t id;
+
+    // open scopes, completed events are only published on end
+    const char *open_names[PROFILE_MAX_DEPTH];
+    uint64_t open_begins[PROFILE_MAX_DEPTH];
+    uint32_t depth;
+
+    struct ProfileThread *next;
+} ProfileThread;
+
+typedef struct GpuScope {
+    const char *name;
+    uint32_t depth;
+    // its end query was issued, scopes left open at the end of a frame have none
+    bool closed;
+} GpuScope;
+
+// one frame worth of timestamp queries, reused every PROFILE_GPU_FRAMES frames
+typedef struct GpuFrame {
+    unsigned int queries[PROFILE_GPU_MAX_SCOPES * 2];
+    GpuScope scopes[PROFILE_GPU_MAX_SCOPES];
+    uint32_t scope_count;
+    // issued after every other query of the frame, so the last to finish.
+    // with nested scopes that's an outer scope's end, not the last scope's
+    unsigned int last_query;
+    uint32_t frame;
+    bool pending;
+} GpuFrame;
+
+typedef struct Profiler {
+    atomic_bool enabled;
+    atomic_uint frame;
+    uint64_t start;
+
+    // lock-free list of every thread that ever recorded a scope
+    _Atomic(ProfileThread*) threads;
+    atomic_uint thread_count;
+
+    // GPU side, main thread only
+    bool gpu_enabled;
+    GpuFrame gpu_frames[PROFILE_GPU_FRAMES];
+    uint32_t gpu_frame_index;
+    uint32_t gpu_stack[PROFILE_MAX_DEPTH];
+    uint32_t gpu_depth;
+    // CPU nanoseconds minus GPU nanoseconds, measured once at startup
+    int64_t gpu_offset;
+    ProfileEvent *gpu_events;
+    uint64_t gpu_event_count;
+    uint64_t gpu_dropped;
+} Profiler;
+
+Profiler profiler;
+_Thread_local ProfileThread *profile_thread = NULL;
+
+uint64_t profile_now(void);
+void init_profiler(bool gpu);
+void destroy_profiler(void);
+void profile_frame(void);
+int profile_begin(const char *name);
+void profile_end(void);
+void profile_scope_end(int *scope);
+ProfileThread *get_profile_thread(void);
+void gpu_profile_begin(const char *name);
+void gpu_profile_end(void);
+bool write_chrome_trace(const char *path);
+
+uint64_t profile_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+// gpu timing needs a current GL context, call from the render thread
+void init_profiler(bool gpu)
+{
+    memset(&profiler, 0, sizeof(Profiler));
+    atomic_init(&profiler.enabled, true);
+    atomic_init(&profiler.frame, 0);
+    atomic_init(&profiler.threads, NULL);
+    atomic_init(&profiler.thread_count, 0);
+    profiler.start = profile_now();
+
+    // register the calling thread first so it shows up as thread 0
+    profile_thread = NULL;
+    get_profile_thread();
+
+    profiler.gpu_enabled = gpu;
+    if (!gpu)
+        return;
+
+    for (int i = 0; i < PROFILE_GPU_FRAMES; i++)
+        glGenQueries(PROFILE_GPU_MAX_SCOPES * 2, profiler.gpu_frames[i].queries);
+
+    profiler.gpu_events = (ProfileEvent*)malloc(sizeof(ProfileEvent) * PROFILE_GPU_EVENTS);
+
+    // line up the GPU clock with ours, the one place we're allowed to wait
+    GLint64 gpu_time;
+    glGetInteger64v(GL_TIMESTAMP, &gpu_time);
+    profiler.gpu_offset = (int64_t) profile_now() - (int64_t) gpu_time;
+}
+
+void destroy_profiler(void)
+{
+    atomic_store(&profiler.enabled, false);
+
+    if (profiler.gpu_enabled)
+    {
+        for (int i = 0; i < PROFILE_GPU_FRAMES; i++)
+            glDeleteQueries(PROFILE_GPU_MAX_SCOPES * 2, profiler.gpu_frames[i].queries);
+        free(profiler.gpu_events);
+        profiler.gpu_events = NULL;
+        profiler.gpu_enabled = false;
+    }
+
+    // thread buffers stay alive, worker threads may still hold them
+}
+
+ProfileThread *get_profile_thread(void)
+{
+    if (profile_thread != NULL)
+        return profile_thread;
+
+    ProfileThread *thread = (ProfileThread*)calloc(1, sizeof(ProfileThread));
+    thread->events = (ProfileEvent*)malloc(sizeof(ProfileEvent) * PROFILE_EVENTS_PER_THREAD);
+    atomic_init(&thread->head, 0);
+    thread->id = atomic_fetch_add(&profiler.thread_count, 1);
+
+    // push onto the thread list
+    ProfileThread *head = atomic_load(&profiler.threads);
+    do
+    {
+        thread->next = head;
+    } while (!atomic_compare_exchange_weak(&profiler.threads, &head, thread));
+
+    profile_thread = thread;
+    return thread;
+}
+
+// always returns 0, the value only exists so PROFILE_SCOPE has something to clean up
+int profile_begin(const char *name)
+{
+    if (!atomic_load_explicit(&profiler.enabled, memory_order_relaxed))
+        return 0;
+
+    ProfileThread *thread = get_profile_thread();
+    if (thread->depth < PROFILE_MAX_DEPTH)
+    {
+        thread->open_names[thread->depth] = name;
+        thread->open_begins[thread->depth] = profile_now();
+    }
+    thread->depth++;
+    return 0;
+}
+
+void profile_end(void)
+{
+    ProfileThread *thread = profile_thread;
+    if (thread == NULL || thread->depth == 0)
+        return;
+
+    thread->depth--;
+    if (thread->depth >= PROFILE_MAX_DEPTH)
+        return;
+
+    uint64_t head = atomic_load_explicit(&thread->head, memory_order_relaxed);
+    ProfileEvent *event = &thread->events[head & (PROFILE_EVENTS_PER_THREAD - 1)];
+    event->name = thread->open_names[thread->depth];
+    event->begin = thread->open_begins[thread->depth];
+    event->end = profile_now();
+    event->depth = thread->depth;
+    event->frame = atomic_load_explicit(&profiler.frame, memory_order_relaxed);
+
+    // publish, the exporter never reads past head
+    atomic_store_explicit(&thread->head, head + 1, memory_order_release);
+}
+
+void profile_scope_end(int *scope)
+{
+    (void) scope;
+    profile_end();
+}
+
+void gpu_profile_begin(const char *name)
+{
+    // debug groups show up in RenderDoc/Nsight even when timing is off
+    glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, name);
+
+    if (!profiler.gpu_enabled || !atomic_load_explicit(&profiler.enabled, memory_order_relaxed))
+        return;
+
+    GpuFrame *frame = &profiler.gpu_frames[profiler.gpu_frame_index];
+    if (frame->scope_count < PROFILE_GPU_MAX_SCOPES && profiler.gpu_depth < PROFILE_MAX_DEPTH)
+    {
+        uint32_t scope = frame->scope_count++;
+        frame->scopes[scope].name = name;
+        frame->scopes[scope].depth = profiler.gpu_depth;
+        frame->scopes[scope].closed = false;
+        glQueryCounter(frame->queries[scope * 2], GL_TIMESTAMP);
+        frame->last_query = frame->queries[scope * 2];
+        profiler.gpu_stack[profiler.gpu_depth] = scope;
+    }
+    else if (profiler.gpu_depth < PROFILE_MAX_DEPTH)
+    {
+        profiler.gpu_stack[profiler.gpu_depth] = UINT32_MAX;
+    }
+    profiler.gpu_depth++;
+}
+
+void gpu_profile_end(void)
+{
+    if (profiler.gpu_enabled && profiler.gpu_depth > 0)
+    {
+        profiler.gpu_depth--;
+        if (profiler.gpu_depth < PROFILE_MAX_DEPTH)
+        {
+            uint32_t scope = profiler.gpu_stack[profiler.gpu_depth];
+            if (scope != UINT32_MAX)
+            {
+                GpuFrame *frame = &profiler.gpu_frames[profiler.gpu_frame_index];
+                glQueryCounter(frame->queries[scope * 2 + 1], GL_TIMESTAMP);
+                frame->scopes[scope].closed = true;
+                frame->last_query = frame->queries[scope * 2 + 1];
+            }
+        }
+    }
+
+    glPopDebugGroup();
+}
+
+// pull finished queries out of a frame slot, returns false if the GPU isn't done yet
+bool collect_gpu_frame(GpuFrame *frame)
+{
+    if (!frame->pending)
+        return true;
+
+    if (frame->scope_count > 0)
+    {
+        // timestamps land in order, so once the last one issued is there they all are
+        GLint available = 0;
+        glGetQueryObjectiv(frame->last_query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return false;
+    }
+
+    for (uint32_t i = 0; i < frame->scope_count; i++)
+    {
+        if (!frame->scopes[i].closed)
+            continue;
+
+        GLuint64 begin, end;
+        glGetQueryObjectui64v(frame->queries[i * 2], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(frame->queries[i * 2 + 1], GL_QUERY_RESULT, &end);
+
+        ProfileEvent *event = &profiler.gpu_events[profiler.gpu_event_count++ & (PROFILE_GPU_EVENTS - 1)];
+        event->name = frame->scopes[i].name;
+        event->begin = (uint64_t) ((int64_t) begin + profiler.gpu_offset);
+        event->end = (uint64_t) ((int64_t) end + profiler.gpu_offset);
+        event->depth = frame->scopes[i].depth;
+        event->frame = frame->frame;
+    }
+
+    frame->pending = false;
+    frame->scope_count = 0;
+    return true;
+}
+
+// call once per frame on the render thread, before any scopes of the new frame
+void profile_frame(void)
+{
+    uint32_t frame_number = atomic_fetch_add(&profiler.frame, 1) + 1;
+
+    if (!profiler.gpu_enabled)
+        return;
+
+    // close the current slot and move on to the oldest one
+    GpuFrame *current = &profiler.gpu_frames[profiler.gpu_frame_index];
+    current->pending = current->scope_count > 0;
+    profiler.gpu_frame_index = (profiler.gpu_frame_index + 1) % PROFILE_GPU_FRAMES;
+    profiler.gpu_depth = 0;
+
+    // results from PROFILE_GPU_FRAMES frames ago are normally ready by now,
+    // if not drop them rather than stall the pipeline
+    GpuFrame *next = &profiler.gpu_frames[profiler.gpu_frame_index];
+    if (!collect_gpu_frame(next))
+    {
+        profiler.gpu_dropped++;
+        next->pending = false;
+        next->scope_count = 0;
+    }
+    next->frame = frame_number;
+}
+
+void write_trace_events(FILE *file, ProfileEvent *events, uint64_t head, uint64_t capacity, uint32_t tid, bool *first)
+{
+    uint64_t count = head < capacity ? head : capacity;
+    // leave some slack at the tail, the owner may be overwriting it right now
+    if (count == capacity && count > 64)
+        count -= 64;
+
+    for (uint64_t i = head - count; i < head; i++)
+    {
+        ProfileEvent *event = &events[i & (capacity - 1)];
+        uint64_t begin = event->begin > profiler.start ? event->begin - profiler.start : 0;
+        uint64_t duration = event->end > event->begin ? event->end - event->begin : 0;
+
+        fprintf(file, "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{\"frame\":%u,\"depth\":%u}}",
+            *first ? "" : ",", event->name, tid == PROFILE_GPU_TRACK ? "gpu" : "cpu",
+            begin / 1000.0, duration / 1000.0, tid, event->frame, event->depth);
+        *first = false;
+    }
+}
+
+// dump everything still in the buffers as chrome://tracing / Perfetto JSON
+bool write_chrome_trace(const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if (file == NULL)
+    {
+        printf("Failed to open trace file %s\n", path);
+        return false;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    bool first = true;
+
+    for (ProfileThread *thread = atomic_load(&profiler.threads); thread != NULL; thread = thread->next)
+    {
+        fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s %u\"}}",
+            first ? "" : ",", thread->id, thread->id == 0 ? "main" : "thread", thread->id);
+        first = false;
+
+        uint64_t head = atomic_load_explicit(&thread->head, memory_order_acquire);
+        write_trace_events(file, thread->events, head, PROFILE_EVENTS_PER_THREAD, thread->id, &first);
+    }
+
+    if (profiler.gpu_enabled)
+    {
+        fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"GPU\"}}",
+            first ? "" : ",", PROFILE_GPU_TRACK);
+        first = false;
+        write_trace_events(file, profiler.gpu_events, profiler.gpu_event_count, PROFILE_GPU_EVENTS, PROFILE_GPU_TRACK, &first);
+    }
+
+    fprintf(file, "\n]}\n");
+    fclose(file);
+
+    printf("Wrote trace to %s (%llu GPU frames dropped)\n", path, (unsigned long long) profiler.gpu_dropped);
+    return true;
+}
+
+#endif
@@ -0,0 +1,405 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include <glad/glad.h>
+
+#include <cglm/cglm.h>
+
+#include "camera.h"
+#include "gl_resources.h"
+#include "jobs.h"
+#include "mesh.h"
+#include "profiler.h"
+#include "render_stats.h"
+#include "shader.h"
+#include "timestep.h"
+
+// objects handed to one job when building the queue
+#define RENDER_QUEUE_GRAIN 64
+#define DRAW_BUFFER_BINDING 1
+#define RENDER_QUEUE_MAX_LODS 8
+#define RENDER_QUEUE_LOD_PIXELS 1.0f // how far on screen a LOD may stray from full detail
+
+// meshlet culling, see cull_render_queue_meshlets
+#define MESHLET_CULL_SHADER_PATH "src/shaders/meshlet_cull_compute_shader.glsl"
+#define MESHLET_CULL_GROUP_SIZE 64
+#define MESHLET_BUFFER_BINDING 2
+#define CLUSTER_COMMAND_BINDING 3
+#define CLUSTER_COUNT_BINDING 4
+#define RENDER_QUEUE_MAX_CLUSTERS (1 << 20) // meshlet draws a frame, 20 bytes each
+
+// uploaded as is, matches `struct DrawData` in the vertex shader (std430)
+typedef struct DrawCommand {
+    mat4 model;
+    unsigned int material;
+    unsigned int object;
+    unsigned int first;
+    unsigned int count;
+    unsigned int first_meshlet;
+    unsigned int meshlet_count;
+    unsigned int reserved[2];
+} DrawCommand;
+
+// layout fixed by glMultiDrawElementsIndirect
+typedef struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instance_count;
+    GLuint first_index;
+    GLint base_vertex;
+    GLuint base_instance;
+} DrawElementsIndirectCommand;
+
+// an index range of the bound mesh and the meshlets covering it, error is
+// how far it strays from LOD 0 in mesh units
+typedef struct QueueLod {
+    unsigned int first;
+    unsigned int count;
+    float error;
+    unsigned int first_meshlet;
+    unsigned int meshlet_count;
+} QueueLod;
+
+// what every object draws, LODs of the bound mesh from full detail down,
+// and its local bounds
+typedef struct QueueMesh {
+    QueueLod lods[RENDER_QUEUE_MAX_LODS];
+    unsigned int lod_count;
+    vec3 bounds[2];
+    vec3 center;
+    float radius;
+} QueueMesh;
+
+// one slot per object, filled in parallel and compacted before submission
+typedef struct RenderQueue {
+    DrawCommand *commands;
+    DrawElementsIndirectCommand *indirect;
+    bool *visible;
+    unsigned int capacity;
+    unsigned int count;
+    unsigned int culled;
+    QueueMesh mesh;
+
+    // GPU copies of commands and indirect, a fresh slice every frame
+    StreamBuffer draw_buffer;
+    StreamBuffer indirect_buffer;
+
+    // with the mesh's meshlets uploaded objects are drawn meshlet by meshlet,
+    // the ones surviving the GPU's culling appending their draws to
+    // cluster_buffer and counting them in cluster_count_buffer
+    Shader cull_shader;
+    bool cull_ready;
+    GLuint meshlet_buffer;
+    GLuint cluster_buffer;
+    GLuint cluster_count_buffer;
+    unsigned int cluster_capacity;
+    // most meshlets in any LOD, one thread each
+    unsigned int max_meshlets;
+    vec4 planes[6];
+    vec3 eye;
+} RenderQueue;
+
+// inputs shared by every job while building a frame's queue
+typedef struct RenderQueueBuild {
+    const SimState *frame;
+    vec3 *positions;
+    unsigned int *materials;
+    vec4 planes[6];
+    vec3 eye;
+    // pixels a mesh unit covers one unit away from the eye
+    float lod_scale;
+    RenderQueue *queue;
+} RenderQueueBuild;
+
+void init_render_queue(RenderQueue *queue, unsigned int capacity);
+void set_render_queue_mesh(RenderQueue *queue, unsigned int first, unsigned int count, vec3 bounds[2]);
+void add_render_queue_lod(RenderQueue *queue, unsigned int first, unsigned int count, float error);
+void set_render_queue_lod_meshlets(RenderQueue *queue, unsigned int lod, unsigned int first_meshlet, unsigned int meshlet_count);
+bool upload_render_queue_meshlets(RenderQueue *queue, const Meshlet *meshlets, unsigned int meshlet_count);
+void destroy_render_queue(RenderQueue *queue);
+void build_render_queue(RenderQueue *queue, const SimState *frame, vec3 *positions, unsigned int *materials, mat4 view_projection,
+    const Camera *camera, float screen_height);
+void submit_render_queue(RenderQueue *queue);
+void draw_render_queue(RenderQueue *queue);
+
+void init_render_queue(RenderQueue *queue, unsigned int capacity)
+{
+    queue->commands = (DrawCommand*)aligned_alloc(16, sizeof(DrawCommand) * capacity);
+    queue->indirect = (DrawElementsIndirectCommand*)malloc(sizeof(DrawElementsIndirectCommand) * capacity);
+    queue->visible = (bool*)calloc(capacity, sizeof(bool));
+    queue->capacity = capacity;
+    queue->count = 0;
+    queue->culled = 0;
+    memset(&queue->mesh, 0, sizeof(QueueMesh));
+    queue->cull_ready = false;
+    queue->meshlet_buffer = 0;
+    queue->cluster_buffer = 0;
+    queue->cluster_count_buffer = 0;
+    queue->cluster_capacity = 0;
+    queue->max_meshlets = 0;
+
+    init_stream_buffer(&queue->draw_buffer, sizeof(DrawCommand) * capacity);
+    init_stream_buffer(&queue->indirect_buffer, sizeof(DrawElementsIndirectCommand) * capacity);
+}
+
+// nothing is drawn until this is set, the range is LOD 0
+void set_render_queue_mesh(RenderQueue *queue, unsigned int first, unsigned int count, vec3 bounds[2])
+{
+    queue->mesh.lods[0] = (QueueLod) { first, count, 0.0f, 0, 0 };
+    queue->mesh.lod_count = 1;
+    glm_vec3_copy(bounds[0], queue->mesh.bounds[0]);
+    glm_vec3_copy(bounds[1], queue->mesh.bounds[1]);
+    glm_aabb_center(queue->mesh.bounds, queue->mesh.center);
+    queue->mesh.radius = glm_aabb_radius(queue->mesh.bounds);
+}
+
+// the next coarser LOD after the mesh, each added after the last
+void add_render_queue_lod(RenderQueue *queue, unsigned int first, unsigned int count, float error)
+{
+    if (queue->mesh.lod_count < RENDER_QUEUE_MAX_LODS)
+        queue->mesh.lods[queue->mesh.lod_count++] = (QueueLod) { first, count, error, 0, 0 };
+}
+
+// which of the uploaded meshlets cover a LOD, set for every LOD before uploading them
+void set_render_queue_lod_meshlets(RenderQueue *queue, unsigned int lod, unsigned int first_meshlet, unsigned int meshlet_count)
+{
+    if (lod >= queue->mesh.lod_count)
+        return;
+    queue->mesh.lods[lod].first_meshlet = first_meshlet;
+    queue->mesh.lods[lod].meshlet_count = meshlet_count;
+}
+
+// the mesh's meshlets as build_mesh_meshlets lays them out. false, and
+// objects stay whole draws, when there are none or the culling shader
+// didn't build
+bool upload_render_queue_meshlets(RenderQueue *queue, const Meshlet *meshlets, unsigned int meshlet_count)
+{
+    queue->max_meshlets = 0;
+    for (unsigned int lod = 0; lod < queue->mesh.lod_count; lod++)
+    {
+        if (queue->mesh.lods[lod].meshlet_count > queue->max_meshlets)
+            queue->max_meshlets = queue->mesh.lods[lod].meshlet_count;
+    }
+    if (meshlet_count == 0 || queue->max_meshlets == 0)
+        return false;
+
+    queue->cull_ready = init_compute_shader(&queue->cull_shader, MESHLET_CULL_SHADER_PATH);
+    if (!queue->cull_ready)
+    {
+        glDeleteProgram(queue->cull_shader.ID);
+        printf("Meshlet culling shader unavailable, drawing whole meshes\n");
+        return false;
+    }
+
+    uint64_t capacity = (uint64_t) queue->capacity * queue->max_meshlets;
+    queue->cluster_capacity = capacity < RENDER_QUEUE_MAX_CLUSTERS ? (unsigned int) capacity : RENDER_QUEUE_MAX_CLUSTERS;
+    queue->meshlet_buffer = create_buffer((GLsizeiptr) (sizeof(Meshlet) * meshlet_count), meshlets, 0);
+    queue->cluster_buffer = create_buffer((GLsizeiptr) (sizeof(DrawElementsIndirectCommand) * queue->cluster_capacity), NULL, 0);
+    queue->cluster_count_buffer = create_buffer(sizeof(GLuint), NULL, 0);
+
+    render_stats.frame.buffer_bytes += sizeof(Meshlet) * meshlet_count +
+        sizeof(DrawElementsIndirectCommand) * queue->cluster_capacity + sizeof(GLuint);
+    return true;
+}
+
+void destroy_render_queue(RenderQueue *queue)
+{
+    destroy_stream_buffer(&queue->draw_buffer);
+    destroy_stream_buffer(&queue->indirect_buffer);
+    if (queue->cull_ready)
+    {
+        glDeleteProgram(queue->cull_shader.ID);
+        glDeleteBuffers(1, &queue->meshlet_buffer);
+        glDeleteBuffers(1, &queue->cluster_buffer);
+        glDeleteBuffers(1, &queue->cluster_count_buffer);
+    }
+    queue->cull_ready = false;
+
+    free(queue->commands);
+    free(queue->indirect);
+    free(queue->visible);
+    queue->commands = NULL;
+    queue->indirect = NULL;
+    queue->visible = NULL;
+    queue->capacity = 0;
+    queue->count = 0;
+}
+
+// transform, cull and record commands for objects [begin, end)
+void build_render_queue_job(void *data, unsigned int begin, unsigned int end)
+{
+    PROFILE_SCOPE("build_render_queue_job");
+
+    RenderQueueBuild *build = (RenderQueueBuild*)data;
+    RenderQueue *queue = build->queue;
+
+    for (unsigned int i = begin; i < end; i++)
+    {
+        DrawCommand *command = &queue->commands[i];
+
+        glm_mat4_identity(command->model);
+        glm_translate(command->model, build->positions[i]);
+        glm_rotate(command->model, build->frame->angles[i], (vec3) { 1.0f, 0.3f, 0.5f });
+
+        vec3 world_bounds[2];
+        glm_aabb_transform(queue->mesh.bounds, command->model, world_bounds);
+        queue->visible[i] = glm_aabb_frustum(world_bounds, build->planes);
+
+        // the coarsest LOD whose error covers less than RENDER_QUEUE_LOD_PIXELS
+        // at the nearest the bounding sphere gets to the eye
+        vec3 center;
+        glm_mat4_mulv3(command->model, queue->mesh.center, 1.0f, center);
+        float distance = glm_vec3_distance(center, build->eye) - queue->mesh.radius;
+        unsigned int lod = 0;
+        while (distance > 0.0f && lod + 1 < queue->mesh.lod_count &&
+            queue->mesh.lods[lod + 1].error * build->lod_scale <= RENDER_QUEUE_LOD_PIXELS * distance)
+            lod++;
+
+        command->material = build->materials[i];
+        command->object = i;
+        command->first = queue->mesh.lods[lod].first;
+        command->count = queue->mesh.lods[lod].count;
+        command->first_meshlet = queue->mesh.lods[lod].first_meshlet;
+        command->meshlet_count = queue->mesh.lods[lod].meshlet_count;
+    }
+}
+
+void build_render_queue(RenderQueue *queue, const SimState *frame, vec3 *positions, unsigned int *materials, mat4 view_projection,
+    const Camera *camera, float screen_height)
+{
+    PROFILE_SCOPE("build_render_queue");
+
+    unsigned int object_count = frame->object_count;
+    if (object_count > queue->capacity)
+        object_count = queue->capacity;
+
+    RenderQueueBuild build;
+    build.frame = frame;
+    build.positions = positions;
+    build.materials = materials;
+    glm_frustum_planes(view_projection, build.planes);
+    glm_vec3_copy(camera->position, build.eye);
+    build.lod_scale = 0.5f * screen_height / tanf(glm_rad(camera->zoom) * 0.5f);
+    build.queue = queue;
+
+    // the meshlet culling pass tests against the same frustum
+    memcpy(queue->planes, build.planes, sizeof(queue->planes));
+    glm_vec3_copy(build.eye, queue->eye);
+
+    parallel_for(object_count, RENDER_QUEUE_GRAIN, build_render_queue_job, &build);
+
+    // squeeze out culled objects, keeps submission order stable
+    unsigned int visible = 0;
+    for (unsigned int i = 0; i < object_count; i++)
+    {
+        if (!queue->visible[i])
+            continue;
+
+        if (visible != i)
+            queue->commands[visible] = queue->commands[i];
+
+        // baseInstance tells the vertex shader which DrawData is ours
+        DrawElementsIndirectCommand *indirect = &queue->indirect[visible];
+        indirect->count = queue->commands[visible].count;
+        indirect->instance_count = 1;
+        indirect->first_index = queue->commands[visible].first;
+        indirect->base_vertex = 0;
+        indirect->base_instance = visible;
+
+        visible++;
+    }
+
+    queue->count = visible;
+    queue->culled = object_count - visible;
+}
+
+// one thread per meshlet of every queued object's LOD. meshlets outside the
+// frustum or facing away from the eye are dropped, the rest append their
+// index runs to cluster_buffer as draws of the object's DrawData
+static void cull_render_queue_meshlets(RenderQueue *queue)
+{
+    PROFILE_SCOPE("cull_render_queue_meshlets");
+
+    GLint program = 0;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+
+    glClearNamedBufferData(queue->cluster_count_buffer, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+    use_shader(&queue->cull_shader);
+    glUniform4fv(glGetUniformLocation(queue->cull_shader.ID, "planes"), 6, (const GLfloat*)queue->planes);
+    glUniform3fv(glGetUniformLocation(queue->cull_shader.ID, "eye"), 1, queue->eye);
+    glUniform1ui(glGetUniformLocation(queue->cull_shader.ID, "max_clusters"), queue->cluster_capacity);
+
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, DRAW_BUFFER_BINDING, queue->draw_buffer.id,
+        stream_frame_offset(&queue->draw_buffer), (GLsizeiptr) (sizeof(DrawCommand) * queue->count));
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MESHLET_BUFFER_BINDING, queue->meshlet_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_COMMAND_BINDING, queue->cluster_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_COUNT_BINDING, queue->cluster_count_buffer);
+    glDispatchCompute((queue->max_meshlets + MESHLET_CULL_GROUP_SIZE - 1) / MESHLET_CULL_GROUP_SIZE, queue->count, 1);
+
+    // the draws read what it wrote as their arguments and count
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+    glUseProgram((GLuint) program);
+
+    render_stats.frame.shader_switches += 2;
+    render_stats.frame.state_changes += 5;
+}
+
+// one upload and one multi-draw for the whole queue, expects the mesh's VAO
+// and the program to be bound already. with meshlets the multi-draw is of
+// whatever meshlets the GPU didn't cull
+void submit_render_queue(RenderQueue *queue)
+{
+    if (queue->count == 0)
+        return;
+
+    // last frame's slices stay with the GPU until it's done with them
+    memcpy(next_stream_frame(&queue->draw_buffer), queue->commands, sizeof(DrawCommand) * queue->count);
+    memcpy(next_stream_frame(&queue->indirect_buffer), queue->indirect, sizeof(DrawElementsIndirectCommand) * queue->count);
+
+    render_stats.frame.buffer_bytes += (sizeof(DrawCommand) + sizeof(DrawElementsIndirectCommand)) * queue->count;
+
+    if (queue->cull_ready)
+        cull_render_queue_meshlets(queue);
+    draw_render_queue(queue);
+}
+
+// draw what the last submit uploaded again, for extra passes over the same scene
+void draw_render_queue(RenderQueue *queue)
+{
+    if (queue->count == 0)
+        return;
+
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, DRAW_BUFFER_BINDING, queue->draw_buffer.id,
+        stream_frame_offset(&queue->draw_buffer), (GLsizeiptr) (sizeof(DrawCommand) * queue->count));
+    if (queue->cull_ready)
+    {
+        // as many draws as the culling pass counted, capped at the buffer's size
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, queue->cluster_buffer);
+        glBindBuffer(GL_PARAMETER_BUFFER, queue->cluster_count_buffer);
+        glMultiDrawElementsIndirectCount(GL_TRIANGLES, GL_UNSIGNED_INT, NULL, 0, (GLsizei) queue->cluster_capacity, 0);
+        glBindBuffer(GL_PARAMETER_BUFFER, 0);
+        render_stats.frame.state_changes += 2;
+    }
+    else
+    {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, queue->indirect_buffer.id);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)stream_frame_offset(&queue->indirect_buffer),
+            (GLsizei) queue->count, 0);
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    // what was queued, the meshlets the GPU culls stay counted. reading its
+    // count back would stall on the frame
+    uint64_t vertices = 0;
+    for (unsigned int i = 0; i < queue->count; i++)
+        vertices += queue->indirect[i].count;
+
+    count_draws(GL_TRIANGLES, queue->count, vertices);
+    render_stats.frame.state_changes += 2;
+}
+
+#endif
@@ -0,0 +1,184 @@
+#ifndef RENDER_STATS_H
+#define RENDER_STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <glad/glad.h>
+
+#include "gl_extensions.h"
+
+// stats defaults
+#define STATS_WINDOW 120 // frames in the rolling average
+#define STATS_REPORT_INTERVAL 5.0 // seconds between CSV rows
+
+// everything counted during a single frame
+typedef struct RenderCounters {
+    uint64_t draw_calls;
+    uint64_t triangles;
+    uint64_t vertices;
+    uint64_t state_changes;
+    uint64_t shader_switches;
+    uint64_t buffer_bytes;
+    uint64_t texture_bytes;
+    uint64_t visible;
+    uint64_t culled;
+} RenderCounters;
+
+#define STATS_COUNTER_COUNT (sizeof(RenderCounters) / sizeof(uint64_t))
+
+typedef enum GpuMemoryQuery {
+    GPU_MEMORY_NONE,
+    GPU_MEMORY_NVX,
+    GPU_MEMORY_ATI
+} GpuMemoryQuery;
+
+typedef struct RenderStats {
+    // the frame being counted right now
+    RenderCounters frame;
+
+    // last STATS_WINDOW frames and their running sum
+    RenderCounters history[STATS_WINDOW];
+    double frame_times[STATS_WINDOW];
+    RenderCounters sum;
+    double frame_time_sum;
+    uint64_t frames;
+
+    // lifetime totals, for spotting leaks in long sessions
+    RenderCounters total;
+
+    GpuMemoryQuery memory_query;
+    // in KB, -1 when the driver doesn't tell us
+    int64_t gpu_memory_total;
+    int64_t gpu_memory_available;
+
+    FILE *csv;
+    double last_report;
+} RenderStats;
+
+RenderStats render_stats;
+
+void init_render_stats(const char *csv_path);
+void destroy_render_stats(void);
+void end_stats_frame(double frame_time, double now);
+void query_gpu_memory(void);
+void count_draws(GLenum mode, uint64_t draws, uint64_t vertices);
+void stats_draw_arrays(GLenum mode, GLint first, GLsizei count);
+
+void init_render_stats(const char *csv_path)
+{
+    memset(&render_stats, 0, sizeof(RenderStats));
+    render_stats.gpu_memory_total = -1;
+    render_stats.gpu_memory_available = -1;
+
+    if (has_gl_extension("GL_NVX_gpu_memory_info"))
+        render_stats.memory_query = GPU_MEMORY_NVX;
+    else if (has_gl_extension("GL_ATI_meminfo"))
+        render_stats.memory_query = GPU_MEMORY_ATI;
+
+    if (csv_path == NULL)
+        return;
+
+    render_stats.csv = fopen(csv_path, "w");
+    if (render_stats.csv == NULL)
+    {
+        printf("Failed to open stats file %s\n", csv_path);
+        return;
+    }
+
+    fprintf(render_stats.csv, "time,frames,frame_ms,draw_calls,triangles,vertices,state_changes,shader_switches,"
+        "buffer_bytes,texture_bytes,visible,culled,total_buffer_bytes,total_texture_bytes,gpu_memory_total_kb,gpu_memory_available_kb\n");
+    fflush(render_stats.csv);
+}
+
+void destroy_render_stats(void)
+{
+    if (render_stats.csv != NULL)
+        fclose(render_stats.csv);
+    render_stats.csv = NULL;
+}
+
+void query_gpu_memory(void)
+{
+    GLint values[4] = { -1, -1, -1, -1 };
+
+    switch (render_stats.memory_query)
+    {
+        case GPU_MEMORY_NVX:
+            glGetIntegerv(GL_GPU_MEMORY_INFO_TOTAL_AVAILABLE_MEMORY_NVX, &values[0]);
+            glGetIntegerv(GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX, &values[1]);
+            render_stats.gpu_memory_total = values[0];
+            render_stats.gpu_memory_available = values[1];
+            break;
+
+        case GPU_MEMORY_ATI:
+            // first value is the total free pool, ATI doesn't report a total
+            glGetIntegerv(GL_TEXTURE_FREE_MEMORY_ATI, values);
+            render_stats.gpu_memory_available = values[0];
+            break;
+
+        default:
+            break;
+    }
+}
+
+// a multi-draw counts every command it contains as a draw
+void count_draws(GLenum mode, uint64_t draws, uint64_t vertices)
+{
+    render_stats.frame.draw_calls += draws;
+    render_stats.frame.vertices += vertices;
+    if (mode == GL_TRIANGLES)
+        render_stats.frame.triangles += vertices / 3;
+    else if ((mode == GL_TRIANGLE_STRIP || mode == GL_TRIANGLE_FAN) && vertices > 2 * draws)
+        render_stats.frame.triangles += vertices - 2 * draws;
+}
+
+void stats_draw_arrays(GLenum mode, GLint first, GLsizei count)
+{
+    glDrawArrays(mode, first, count);
+    count_draws(mode, 1, (uint64_t) count);
+}
+
+// roll this frame into the window and start counting the next one
+void end_stats_frame(double frame_time, double now)
+{
+    RenderStats *stats = &render_stats;
+    uint32_t slot = (uint32_t) (stats->frames % STATS_WINDOW);
+
+    uint64_t *frame = (uint64_t*)&stats->frame;
+    uint64_t *old = (uint64_t*)&stats->history[slot];
+    uint64_t *sum = (uint64_t*)&stats->sum;
+    uint64_t *total = (uint64_t*)&stats->total;
+    for (size_t i = 0; i < STATS_COUNTER_COUNT; i++)
+    {
+        sum[i] += frame[i] - old[i];
+        total[i] += frame[i];
+    }
+
+    stats->frame_time_sum += frame_time - stats->frame_times[slot];
+    stats->frame_times[slot] = frame_time;
+    stats->history[slot] = stats->frame;
+    stats->frames++;
+    memset(&stats->frame, 0, sizeof(RenderCounters));
+
+    if (stats->csv == NULL || now - stats->last_report < STATS_REPORT_INTERVAL)
+        return;
+    stats->last_report = now;
+
+    // driver memory queries can be slow, only ask when writing a row
+    query_gpu_memory();
+
+    double n = (double) (stats->frames < STATS_WINDOW ? stats->frames : STATS_WINDOW);
+    RenderCounters *s = &stats->sum;
+    fprintf(stats->csv, "%.3f,%llu,%.3f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%llu,%llu,%lld,%lld\n",
+        now, (unsigned long long) stats->frames, stats->frame_time_sum / n * 1000.0,
+        s->draw_calls / n, s->triangles / n, s->vertices / n, s->state_changes / n, s->shader_switches / n,
+        s->buffer_bytes / n, s->texture_bytes / n, s->visible / n, s->culled / n,
+        (unsigned long long) stats->total.buffer_bytes, (unsigned long long) stats->total.texture_bytes,
+        (long long) stats->gpu_memory_total, (long long) stats->gpu_memory_available);
+    fflush(stats->csv);
+}
+
+#endif
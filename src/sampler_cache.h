@@ -0,0 +1,155 @@
+#ifndef SAMPLER_CACHE_H
+#define SAMPLER_CACHE_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <glad/glad.h>
+
+#include "render_stats.h"
+
+// sampler defaults
+#define MAX_SAMPLERS 64
+#define MAX_SAMPLER_UNITS 32
+
+// core since 4.6, older glad headers only have the EXT names
+#ifndef GL_TEXTURE_MAX_ANISOTROPY
+#define GL_TEXTURE_MAX_ANISOTROPY 0x84FE
+#define GL_MAX_TEXTURE_MAX_ANISOTROPY 0x84FF
+#endif
+
+typedef enum SamplerFilter {
+    SAMPLER_FILTER_NEAREST,
+    SAMPLER_FILTER_BILINEAR,
+    SAMPLER_FILTER_TRILINEAR,
+    SAMPLER_FILTER_ANISOTROPIC
+} SamplerFilter;
+
+// everything a sampler object holds, compared bytewise so always build one
+// with make_sampler_desc
+typedef struct SamplerDesc {
+    GLint min_filter;
+    GLint mag_filter;
+    GLint wrap_s;
+    GLint wrap_t;
+    float max_anisotropy;
+    float lod_bias;
+} SamplerDesc;
+
+typedef struct SamplerCache {
+    SamplerDesc descs[MAX_SAMPLERS];
+    GLuint ids[MAX_SAMPLERS];
+    unsigned int count;
+
+    // 1 when the driver has no anisotropic filtering
+    float max_anisotropy;
+
+    // what each texture unit has bound, to skip redundant binds
+    GLuint bound[MAX_SAMPLER_UNITS];
+} SamplerCache;
+
+SamplerDesc make_sampler_desc(SamplerFilter filter, GLint wrap, float anisotropy);
+void init_sampler_cache(SamplerCache *cache);
+GLuint get_sampler(SamplerCache *cache, const SamplerDesc *desc);
+void bind_sampler(SamplerCache *cache, GLuint unit, GLuint sampler);
+void destroy_sampler_cache(SamplerCache *cache);
+
+SamplerDesc make_sampler_desc(SamplerFilter filter, GLint wrap, float anisotropy)
+{
+    SamplerDesc desc;
+    memset(&desc, 0, sizeof(SamplerDesc));
+    desc.wrap_s = wrap;
+    desc.wrap_t = wrap;
+    desc.max_anisotropy = 1.0f;
+
+    switch (filter)
+    {
+        case SAMPLER_FILTER_NEAREST:
+            desc.min_filter = GL_NEAREST_MIPMAP_NEAREST;
+            desc.mag_filter = GL_NEAREST;
+            break;
+
+        case SAMPLER_FILTER_BILINEAR:
+            desc.min_filter = GL_LINEAR_MIPMAP_NEAREST;
+            desc.mag_filter = GL_LINEAR;
+            break;
+
+        case SAMPLER_FILTER_TRILINEAR:
+            desc.min_filter = GL_LINEAR_MIPMAP_LINEAR;
+            desc.mag_filter = GL_LINEAR;
+            break;
+
+        case SAMPLER_FILTER_ANISOTROPIC:
+            desc.min_filter = GL_LINEAR_MIPMAP_LINEAR;
+            desc.mag_filter = GL_LINEAR;
+            desc.max_anisotropy = anisotropy > 1.0f ? anisotropy : 1.0f;
+            break;
+    }
+
+    return desc;
+}
+
+void init_sampler_cache(SamplerCache *cache)
+{
+    memset(cache, 0, sizeof(SamplerCache));
+
+    GLfloat max_anisotropy = 1.0f;
+    glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY, &max_anisotropy);
+    cache->max_anisotropy = max_anisotropy > 1.0f ? max_anisotropy : 1.0f;
+}
+
+// same description, same sampler object
+GLuint get_sampler(SamplerCache *cache, const SamplerDesc *desc)
+{
+    SamplerDesc key = *desc;
+    if (key.max_anisotropy > cache->max_anisotropy)
+        key.max_anisotropy = cache->max_anisotropy;
+
+    for (unsigned int i = 0; i < cache->count; i++)
+    {
+        if (memcmp(&cache->descs[i], &key, sizeof(SamplerDesc)) == 0)
+            return cache->ids[i];
+    }
+
+    if (cache->count == MAX_SAMPLERS)
+    {
+        printf("Sampler cache is full, reusing the first sampler\n");
+        return cache->count > 0 ? cache->ids[0] : 0;
+    }
+
+    GLuint sampler;
+    glGenSamplers(1, &sampler);
+    glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, key.min_filter);
+    glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, key.mag_filter);
+    glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, key.wrap_s);
+    glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, key.wrap_t);
+    glSamplerParameterf(sampler, GL_TEXTURE_LOD_BIAS, key.lod_bias);
+    if (cache->max_anisotropy > 1.0f)
+        glSamplerParameterf(sampler, GL_TEXTURE_MAX_ANISOTROPY, key.max_anisotropy);
+
+    cache->descs[cache->count] = key;
+    cache->ids[cache->count++] = sampler;
+    return sampler;
+}
+
+void bind_sampler(SamplerCache *cache, GLuint unit, GLuint sampler)
+{
+    if (unit < MAX_SAMPLER_UNITS && cache->bound[unit] == sampler)
+        return;
+
+    glBindSampler(unit, sampler);
+    render_stats.frame.state_changes++;
+
+    if (unit < MAX_SAMPLER_UNITS)
+        cache->bound[unit] = sampler;
+}
+
+void destroy_sampler_cache(SamplerCache *cache)
+{
+    if (cache->count > 0)
+        glDeleteSamplers((GLsizei) cache->count, cache->ids);
+    memset(cache, 0, sizeof(SamplerCache));
+}
+
+#endif
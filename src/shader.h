@@ -13,6 +13,7 @@ typedef struct Shader {
     unsigned int ID;
     const char *vs_source;
     const char *fs_source;
+    const char *cs_source;
 } Shader;
 
 char *file_path_to_str(const char *string);
@@ -76,6 +77,47 @@ void init_shader(Shader *shader, const char *vs_path, const char *fs_path)
     shader->ID = shaderProgram;
     shader->vs_source = vs_source;
     shader->fs_source = fs_source;
+    shader->cs_source = NULL;
+}
+
+// compute programs are a single stage, returns false if it didn't build
+bool init_compute_shader(Shader *shader, const char *cs_path)
+{
+    const char *cs_source = file_path_to_str(cs_path);
+
+    unsigned int compute_shader = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(compute_shader, 1, &cs_source, NULL);
+    glCompileShader(compute_shader);
+
+    int success;
+    char infoLog[512];
+
+    glGetShaderiv(compute_shader, GL_COMPILE_STATUS, &success);
+    if (!success)
+    {
+        glGetShaderInfoLog(compute_shader, 512, NULL, infoLog);
+        printf("Failed to compile compute shader: %s\n", infoLog);
+    }
+
+    unsigned int shaderProgram = glCreateProgram();
+    glAttachShader(shaderProgram, compute_shader);
+    glLinkProgram(shaderProgram);
+
+    int linked;
+    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &linked);
+    if (!linked)
+    {
+        glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
+        printf("Failed to link compute program: %s\n", infoLog);
+    }
+
+    glDeleteShader(compute_shader);
+
+    shader->ID = shaderProgram;
+    shader->vs_source = NULL;
+    shader->fs_source = NULL;
+    shader->cs_source = cs_source;
+    return success && linked;
 }
 
 void use_shader(Shader *shader)
@@ -111,8 +153,8 @@ char *file_path_to_str(const char *string)
     // get filesize
     fseek(file, 0L, SEEK_END);
     size_t size = ftell(file);
-    // allocate space
-    str = (char*)calloc(1, size);
+    // allocate space, plus the terminator glShaderSource looks for
+    str = (char*)calloc(1, size + 1);
     // go back to beginning
     rewind(file);
     // read file into block
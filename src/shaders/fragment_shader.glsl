@@ -4,12 +4,80 @@ out vec4 FragColor;
 
 // in vec3 ourColor;
 in vec2 TexCoord;
+flat in uint MaterialIndex;
 
-uniform sampler2D texture1;
-uniform sampler2D texture2;
+// fallback when bindless textures aren't available: every texture is a
+// layer of a texture array or a rect in an atlas page, see
+// fragment_shader_bindless.glsl for the fast path
+struct Material {
+    uvec2 base;
+    uvec2 overlay;
+    vec4 base_uv;
+    vec4 overlay_uv;
+    uint base_layer;
+    uint overlay_layer;
+    uint base_slot;
+    uint overlay_slot;
+    float mix_factor;
+    // 1 + index of a virtual texture replacing base, 0 for none
+    uint virtual_texture;
+};
+
+layout (std430, binding = 0) readonly buffer Materials {
+    Material materials[];
+};
+
+// uniform sampler2D texture1;
+// uniform sampler2D texture2;
+// array + sampler pairs, must match MAX_TEXTURE_SLOTS
+uniform sampler2DArray textures[8];
+
+// virtual textures, see virtual_texture.h. vt_info is width, height, mip
+// count and whether the texture is sparse
+#define VT_PAGE_PAYLOAD 128.0
+#define VT_PAGE_BORDER 4.0
+#define VT_PAGE_SIZE 136.0
+uniform sampler2D vt_page_tables[4];
+uniform sampler2D vt_physical[4];
+uniform vec4 vt_info[4];
+
+vec4 sample_virtual(uint id, vec2 uv)
+{
+    vec4 info = vt_info[id];
+    vec2 texel = clamp(uv, 0.0, 1.0) * info.xy;
+    texel = min(texel, info.xy - 0.5);
+
+    float lod = log2(max(length(dFdx(texel)), length(dFdy(texel))));
+    int mip = int(clamp(lod, 0.0, info.z - 1.0));
+
+    // finest resident page covering this one
+    ivec2 page = ivec2(texel / (VT_PAGE_PAYLOAD * float(1 << mip)));
+    vec4 entry = texelFetch(vt_page_tables[id], page, mip);
+    int data_mip = int(entry.b * 255.0 + 0.5);
+
+    if (info.w > 0.5)
+        return textureLod(vt_physical[id], texel / vec2(textureSize(vt_physical[id], 0)), float(data_mip));
+
+    vec2 data_texel = texel / float(1 << data_mip);
+    vec2 in_page = data_texel - floor(data_texel / VT_PAGE_PAYLOAD) * VT_PAGE_PAYLOAD;
+    vec2 physical = entry.rg * 255.0 * VT_PAGE_SIZE + VT_PAGE_BORDER + in_page;
+    return textureLod(vt_physical[id], physical / vec2(textureSize(vt_physical[id], 0)), 0.0);
+}
 
 void main()
 {
+    Material material = materials[MaterialIndex];
+
+    vec2 base_uv = TexCoord * material.base_uv.xy + material.base_uv.zw;
+    vec2 overlay_uv = TexCoord * material.overlay_uv.xy + material.overlay_uv.zw;
+
     // FragColor = mix(texture(texture1, TexCoord) * vec4(ourColor, 1.0), t exture(texture2, TexCoord), 0.3);
-    FragColor = mix(texture(texture1, TexCoord), texture(texture2, TexCoord), 0.3);
-}
\ No newline at end of file
+    // the slot index is per material, so it is uniform within each draw
+    vec4 base = material.virtual_texture != 0u
+        ? sample_virtual(material.virtual_texture - 1u, TexCoord)
+        : texture(textures[material.base_slot], vec3(base_uv, material.base_layer));
+
+    FragColor = mix(base,
+                    texture(textures[material.overlay_slot], vec3(overlay_uv, material.overlay_layer)),
+                    material.mix_factor);
+}
@@ -0,0 +1,75 @@
+#version 460 core
+#extension GL_ARB_bindless_texture : require
+
+out vec4 FragColor;
+
+in vec2 TexCoord;
+flat in uint MaterialIndex;
+
+// resident texture handles, one entry per material
+struct Material {
+    uvec2 base;
+    uvec2 overlay;
+    vec4 base_uv;
+    vec4 overlay_uv;
+    uint base_layer;
+    uint overlay_layer;
+    uint base_slot;
+    uint overlay_slot;
+    float mix_factor;
+    // 1 + index of a virtual texture replacing base, 0 for none
+    uint virtual_texture;
+};
+
+layout (std430, binding = 0) readonly buffer Materials {
+    Material materials[];
+};
+
+// virtual textures, see virtual_texture.h. vt_info is width, height, mip
+// count and whether the texture is sparse
+#define VT_PAGE_PAYLOAD 128.0
+#define VT_PAGE_BORDER 4.0
+#define VT_PAGE_SIZE 136.0
+uniform sampler2D vt_page_tables[4];
+uniform sampler2D vt_physical[4];
+uniform vec4 vt_info[4];
+
+vec4 sample_virtual(uint id, vec2 uv)
+{
+    vec4 info = vt_info[id];
+    vec2 texel = clamp(uv, 0.0, 1.0) * info.xy;
+    texel = min(texel, info.xy - 0.5);
+
+    float lod = log2(max(length(dFdx(texel)), length(dFdy(texel))));
+    int mip = int(clamp(lod, 0.0, info.z - 1.0));
+
+    // finest resident page covering this one
+    ivec2 page = ivec2(texel / (VT_PAGE_PAYLOAD * float(1 << mip)));
+    vec4 entry = texelFetch(vt_page_tables[id], page, mip);
+    int data_mip = int(entry.b * 255.0 + 0.5);
+
+    if (info.w > 0.5)
+        return textureLod(vt_physical[id], texel / vec2(textureSize(vt_physical[id], 0)), float(data_mip));
+
+    vec2 data_texel = texel / float(1 << data_mip);
+    vec2 in_page = data_texel - floor(data_texel / VT_PAGE_PAYLOAD) * VT_PAGE_PAYLOAD;
+    vec2 physical = entry.rg * 255.0 * VT_PAGE_SIZE + VT_PAGE_BORDER + in_page;
+    return textureLod(vt_physical[id], physical / vec2(textureSize(vt_physical[id], 0)), 0.0);
+}
+
+void main()
+{
+    // MaterialIndex comes from the draw, so it is uniform within each draw
+    Material material = materials[MaterialIndex];
+
+    vec2 base_uv = TexCoord * material.base_uv.xy + material.base_uv.zw;
+    vec2 overlay_uv = TexCoord * material.overlay_uv.xy + material.overlay_uv.zw;
+
+    vec4 base = material.virtual_texture != 0u
+        ? sample_virtual(material.virtual_texture - 1u, TexCoord)
+        : texture(sampler2D(material.base), base_uv);
+
+    FragColor = mix(base,
+                    texture(sampler2D(material.overlay), overlay_uv),
+                    material.mix_factor);
+}
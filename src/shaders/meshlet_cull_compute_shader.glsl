@@ -0,0 +1,90 @@
+#version 460 core
+
+// culls the meshlets of every queued object, see render_queue.h. one thread
+// per meshlet of the object's LOD, workgroup y picks the object
+layout (local_size_x = 64) in;
+
+// matches DrawCommand in render_queue.h
+struct DrawData {
+    mat4 model;
+    uint material;
+    uint object;
+    uint first;
+    uint count;
+    uint first_meshlet;
+    uint meshlet_count;
+    uint reserved0;
+    uint reserved1;
+};
+
+// matches Meshlet in mesh.h, in mesh space
+struct Meshlet {
+    vec3 center;
+    float radius;
+    vec3 cone_axis;
+    float cone_cutoff;
+    vec3 cone_apex;
+    uint first_index;
+    uint index_count;
+    uint reserved0;
+    uint reserved1;
+    uint reserved2;
+};
+
+// layout fixed by glMultiDrawElementsIndirectCount
+struct DrawElementsIndirectCommand {
+    uint count;
+    uint instance_count;
+    uint first_index;
+    int base_vertex;
+    uint base_instance;
+};
+
+layout (std430, binding = 1) readonly buffer Draws {
+    DrawData draws[];
+};
+
+layout (std430, binding = 2) readonly buffer Meshlets {
+    Meshlet meshlets[];
+};
+
+layout (std430, binding = 3) writeonly buffer Clusters {
+    DrawElementsIndirectCommand clusters[];
+};
+
+layout (std430, binding = 4) buffer ClusterCount {
+    uint cluster_count;
+};
+
+// world space, normalized so the distance to each comes out in world units
+uniform vec4 planes[6];
+uniform vec3 eye;
+uniform uint max_clusters;
+
+void main()
+{
+    uint object = gl_WorkGroupID.y;
+    DrawData draw = draws[object];
+    if (gl_GlobalInvocationID.x >= draw.meshlet_count)
+        return;
+
+    Meshlet meshlet = meshlets[draw.first_meshlet + gl_GlobalInvocationID.x];
+
+    // models only rotate and translate, spheres keep their radius
+    vec3 center = (draw.model * vec4(meshlet.center, 1.0)).xyz;
+    for (int i = 0; i < 6; i++)
+    {
+        if (dot(planes[i].xyz, center) + planes[i].w < -meshlet.radius)
+            return;
+    }
+
+    // the eye is behind every triangle in it
+    vec3 apex = (draw.model * vec4(meshlet.cone_apex, 1.0)).xyz;
+    vec3 axis = mat3(draw.model) * meshlet.cone_axis;
+    if (dot(normalize(apex - eye), axis) >= meshlet.cone_cutoff)
+        return;
+
+    uint slot = atomicAdd(cluster_count, 1u);
+    if (slot < max_clusters)
+        clusters[slot] = DrawElementsIndirectCommand(meshlet.index_count, 1u, meshlet.first_index, 0, object);
+}
@@ -1,20 +1,66 @@
 #version 460 core
 
+// packed vertices, see vertex_compress.h
+// unorm16 inside the mesh bounds
 layout (location = 0) in vec3 aPos;
-// layout (location = 1) in vec3 aColor;
+// snorm 10_10_10_2, w is the bitangent sign
+layout (location = 1) in vec4 aTangent;
+// half float
 layout (location = 2) in vec2 aTexCoord;
+// octahedral snorm16
+layout (location = 3) in vec2 aNormal;
 
-// out vec3 ourColor;
 out vec2 TexCoord;
+out vec3 Normal;
+out vec4 Tangent;
+flat out uint MaterialIndex;
+
+// per-object data, indexed by the baseInstance of each multi-draw command,
+// one command per object or one per meshlet that survived culling
+struct DrawData {
+    mat4 model;
+    uint material;
+    uint object;
+    uint first;
+    uint count;
+    uint first_meshlet;
+    uint meshlet_count;
+    uint reserved0;
+    uint reserved1;
+};
+
+layout (std430, binding = 1) readonly buffer Draws {
+    DrawData draws[];
+};
 
 // uniform mat4 transform;
-uniform mat4 model;
+// uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+// the mesh bounds, positions decode as position_offset + aPos * position_scale
+uniform vec3 position_offset;
+uniform vec3 position_scale;
+
+vec3 decode_octahedral(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+
 void main()
 {
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
-    // ourColor = aColor;
+    DrawData draw = draws[gl_BaseInstance];
+
+    vec3 position = position_offset + aPos * position_scale;
+    gl_Position = projection * view * draw.model * vec4(position, 1.0);
     TexCoord = aTexCoord;
-}
\ No newline at end of file
+
+    // models only rotate and translate, so their upper 3x3 is fine for directions
+    mat3 rotation = mat3(draw.model);
+    Normal = rotation * decode_octahedral(aNormal);
+    Tangent = vec4(rotation * normalize(aTangent.xyz), aTangent.w);
+    MaterialIndex = draw.material;
+}
@@ -0,0 +1,52 @@
+#version 460 core
+
+layout (location = 0) out uint Feedback;
+
+in vec2 TexCoord;
+flat in uint MaterialIndex;
+
+// only virtual_texture is read here, the rest must still match the layout
+struct Material {
+    uvec2 base;
+    uvec2 overlay;
+    vec4 base_uv;
+    vec4 overlay_uv;
+    uint base_layer;
+    uint overlay_layer;
+    uint base_slot;
+    uint overlay_slot;
+    float mix_factor;
+    uint virtual_texture;
+};
+
+layout (std430, binding = 0) readonly buffer Materials {
+    Material materials[];
+};
+
+// must match virtual_texture.h
+#define VT_PAGE_PAYLOAD 128.0
+#define VT_NO_PAGE 0xFFFFFFFFu
+uniform vec4 vt_info[4];
+// this pass runs at a fraction of the screen size, log2 of that fraction
+uniform float vt_lod_bias;
+
+// which page of which mip the main pass will want here, packed like VT_KEY
+void main()
+{
+    Material material = materials[MaterialIndex];
+    if (material.virtual_texture == 0u)
+    {
+        Feedback = VT_NO_PAGE;
+        return;
+    }
+
+    uint id = material.virtual_texture - 1u;
+    vec4 info = vt_info[id];
+    vec2 texel = min(clamp(TexCoord, 0.0, 1.0) * info.xy, info.xy - 0.5);
+
+    float lod = log2(max(length(dFdx(texel)), length(dFdy(texel)))) + vt_lod_bias;
+    uint mip = uint(clamp(lod, 0.0, info.z - 1.0));
+    uvec2 page = uvec2(texel / (VT_PAGE_PAYLOAD * float(1u << mip)));
+
+    Feedback = (id << 30) | (mip << 26) | (page.y << 13) | page.x;
+}
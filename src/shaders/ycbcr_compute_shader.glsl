@@ -0,0 +1,56 @@
+#version 460 core
+
+// a JPEG's Y, Cb and Cr planes to RGBA8, see ycbcr_texture.h
+layout (local_size_x = 8, local_size_y = 8) in;
+
+layout (rgba8, binding = 0) writeonly uniform image2D result;
+
+uniform sampler2D planes[3];
+// greyscale JPEGs only have the Y plane
+uniform int plane_count;
+// pixels to plane samples, 1 / how many pixels a sample covers
+uniform vec2 plane_scale[3];
+// JPEGs are stored top row first, GL wants the bottom row first
+uniform bool flip;
+
+// samples sit centred on the pixels they cover, so bilinear filtering
+// upsamples chroma the way stb_image does. fetched by hand so whatever
+// sampler is bound to the unit doesn't matter
+float sample_plane(int plane, vec2 pixel_centre)
+{
+    vec2 position = pixel_centre * plane_scale[plane] - 0.5;
+    ivec2 last = textureSize(planes[plane], 0) - 1;
+    ivec2 base = ivec2(floor(position));
+    vec2 f = position - vec2(base);
+
+    ivec2 p0 = clamp(base, ivec2(0), last);
+    ivec2 p1 = clamp(base + 1, ivec2(0), last);
+    float a = texelFetch(planes[plane], p0, 0).r;
+    float b = texelFetch(planes[plane], ivec2(p1.x, p0.y), 0).r;
+    float c = texelFetch(planes[plane], ivec2(p0.x, p1.y), 0).r;
+    float d = texelFetch(planes[plane], p1, 0).r;
+    return mix(mix(a, b, f.x), mix(c, d, f.x), f.y);
+}
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 size = imageSize(result);
+    if (any(greaterThanEqual(pixel, size)))
+        return;
+
+    vec2 centre = vec2(pixel) + 0.5;
+    float y = sample_plane(0, centre);
+    vec3 rgb = vec3(y);
+    if (plane_count == 3)
+    {
+        // full range BT.601 as JFIF defines it, the same as stb_image's conversion
+        float cb = sample_plane(1, centre) - 128.0 / 255.0;
+        float cr = sample_plane(2, centre) - 128.0 / 255.0;
+        rgb = vec3(y + 1.402 * cr, y - 0.344136 * cb - 0.714136 * cr, y + 1.772 * cb);
+    }
+
+    if (flip)
+        pixel.y = size.y - 1 - pixel.y;
+    imageStore(result, pixel, vec4(clamp(rgb, 0.0, 1.0), 1.0));
+}
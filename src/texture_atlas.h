@@ -0,0 +1,429 @@
+#ifndef TEXTURE_ATLAS_H
+#define TEXTURE_ATLAS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <glad/glad.h>
+
+#include <cglm/cglm.h>
+
+#include "gl_resources.h"
+#include "mipmap.h"
+#include "render_stats.h"
+#include "texture_format.h"
+
+// atlas defaults
+#define ATLAS_PAGE_SIZE 2048
+#define ATLAS_MAX_PAGES 16
+#define ATLAS_MAX_NODES 1024
+// mips that are guaranteed not to bleed between neighbours, rects are
+// padded and aligned to 1 << ATLAS_SAFE_MIPS texels
+#define ATLAS_SAFE_MIPS 4
+#define MAX_TEXTURE_ARRAYS 8
+
+typedef struct AtlasImage {
+    const unsigned char *pixels;
+    int width;
+    int height;
+    int channels;
+} AtlasImage;
+
+// where an image ended up, uv maps the image's [0, 1] range into its layer
+typedef struct AtlasPlacement {
+    unsigned int array;
+    unsigned int layer;
+    int x;
+    int y;
+    // xy = scale, zw = offset
+    vec4 uv;
+} AtlasPlacement;
+
+// the top edge of everything packed so far, as a list of horizontal segments
+typedef struct SkylineNode {
+    int x;
+    int y;
+    int width;
+} SkylineNode;
+
+typedef struct SkylinePacker {
+    int width;
+    int height;
+    SkylineNode nodes[ATLAS_MAX_NODES];
+    int node_count;
+} SkylinePacker;
+
+typedef struct TextureArray {
+    unsigned int id;
+    int width;
+    int height;
+    int layers;
+    int levels;
+} TextureArray;
+
+typedef struct TextureArraySet {
+    TextureArray arrays[MAX_TEXTURE_ARRAYS];
+    unsigned int count;
+} TextureArraySet;
+
+void init_skyline(SkylinePacker *packer, int width, int height);
+bool skyline_pack(SkylinePacker *packer, int width, int height, int *x, int *y);
+bool build_texture_arrays(const AtlasImage *images, unsigned int count, TextureArraySet *set, AtlasPlacement *placements);
+void destroy_texture_arrays(TextureArraySet *set);
+
+void init_skyline(SkylinePacker *packer, int width, int height)
+{
+    packer->width = width;
+    packer->height = height;
+    packer->nodes[0].x = 0;
+    packer->nodes[0].y = 0;
+    packer->nodes[0].width = width;
+    packer->node_count = 1;
+}
+
+// lowest y a width wide rect can sit at when its left edge is on node i, -1 if it doesn't fit
+int skyline_fit(SkylinePacker *packer, int i, int width, int height)
+{
+    int x = packer->nodes[i].x;
+    if (x + width > packer->width)
+        return -1;
+
+    int y = 0;
+    int remaining = width;
+    while (remaining > 0)
+    {
+        if (i == packer->node_count)
+            return -1;
+        if (packer->nodes[i].y > y)
+            y = packer->nodes[i].y;
+        if (y + height > packer->height)
+            return -1;
+
+        remaining -= packer->nodes[i].width;
+        i++;
+    }
+
+    return y;
+}
+
+// bottom-left rule: lowest resulting top edge wins, narrowest segment breaks ties
+bool skyline_pack(SkylinePacker *packer, int width, int height, int *x, int *y)
+{
+    int best = -1, best_y = 0, best_top = packer->height + 1, best_width = packer->width + 1;
+
+    for (int i = 0; i < packer->node_count; i++)
+    {
+        int fit = skyline_fit(packer, i, width, height);
+        if (fit < 0)
+            continue;
+
+        if (fit + height < best_top || (fit + height == best_top && packer->nodes[i].width < best_width))
+        {
+            best = i;
+            best_y = fit;
+            best_top = fit + height;
+            best_width = packer->nodes[i].width;
+        }
+    }
+
+    if (best < 0 || packer->node_count == ATLAS_MAX_NODES)
+        return false;
+
+    *x = packer->nodes[best].x;
+    *y = best_y;
+
+    // insert the new segment and eat whatever it covers
+    memmove(&packer->nodes[best + 1], &packer->nodes[best], sizeof(SkylineNode) * (packer->node_count - best));
+    packer->nodes[best].x = *x;
+    packer->nodes[best].y = best_y + height;
+    packer->nodes[best].width = width;
+    packer->node_count++;
+
+    int right = *x + width;
+    for (int i = best + 1; i < packer->node_count; )
+    {
+        SkylineNode *node = &packer->nodes[i];
+        if (node->x >= right)
+            break;
+
+        int overlap = right - node->x;
+        if (overlap < node->width)
+        {
+            node->x += overlap;
+            node->width -= overlap;
+            break;
+        }
+
+        memmove(&packer->nodes[i], &packer->nodes[i + 1], sizeof(SkylineNode) * (packer->node_count - i - 1));
+        packer->node_count--;
+    }
+
+    // merge neighbours at the same height
+    for (int i = 0; i + 1 < packer->node_count; )
+    {
+        if (packer->nodes[i].y == packer->nodes[i + 1].y)
+        {
+            packer->nodes[i].width += packer->nodes[i + 1].width;
+            memmove(&packer->nodes[i + 1], &packer->nodes[i + 2], sizeof(SkylineNode) * (packer->node_count - i - 2));
+            packer->node_count--;
+        }
+        else
+        {
+            i++;
+        }
+    }
+
+    return true;
+}
+
+int align_up(int value, int alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+int mip_count(int width, int height)
+{
+    int levels = 1;
+    while ((width | height) >> levels)
+        levels++;
+    return levels;
+}
+
+// copy an image into an RGBA page and smear its edges out into the padding
+// so filtering at lower mips only ever sees the image's own border colours
+void blit_padded(unsigned char *page, int page_width, const AtlasImage *image, int x, int y, int pad)
+{
+    for (int row = -pad; row < image->height + pad; row++)
+    {
+        int src_row = row < 0 ? 0 : (row >= image->height ? image->height - 1 : row);
+        unsigned char *dst = page + ((size_t) (y + row) * page_width + (x - pad)) * 4;
+
+        for (int col = -pad; col < image->width + pad; col++, dst += 4)
+        {
+            int src_col = col < 0 ? 0 : (col >= image->width ? image->width - 1 : col);
+            const unsigned char *src = image->pixels + ((size_t) src_row * image->width + src_col) * image->channels;
+
+            switch (image->channels)
+            {
+                case 1: dst[0] = dst[1] = dst[2] = src[0]; dst[3] = 255; break;
+                case 2: dst[0] = dst[1] = dst[2] = src[0]; dst[3] = src[1]; break;
+                case 3: dst[0] = src[0]; dst[1] = src[1]; dst[2] = src[2]; dst[3] = 255; break;
+                default: memcpy(dst, src, 4); break;
+            }
+        }
+    }
+}
+
+unsigned int create_texture_array(TextureArraySet *set, int width, int height, int layers, int levels)
+{
+    if (set->count == MAX_TEXTURE_ARRAYS)
+        return MAX_TEXTURE_ARRAYS;
+
+    TextureArray *array = &set->arrays[set->count];
+    array->width = width;
+    array->height = height;
+    array->layers = layers;
+    array->levels = levels;
+
+    // atlas pages are RGBA, and so is what the library decodes for arrays
+    TextureFormat format = choose_texture_format(4, width);
+    check_texture_format(GL_TEXTURE_2D_ARRAY, &format);
+
+    array->id = create_texture(GL_TEXTURE_2D_ARRAY, levels, format.internal_format, width, height, layers);
+    // filtering and wrapping come from sampler objects bound next to the array
+    glTextureParameteri(array->id, GL_TEXTURE_MAX_LEVEL, levels - 1);
+
+    return set->count++;
+}
+
+// same-size images become layers of one array per size, everything else is
+// packed into atlas pages that are themselves layers of an array. on failure
+// the images that didn't make it keep array == MAX_TEXTURE_ARRAYS
+bool build_texture_arrays(const AtlasImage *images, unsigned int count, TextureArraySet *set, AtlasPlacement *placements)
+{
+    memset(set, 0, sizeof(TextureArraySet));
+
+    for (unsigned int i = 0; i < count; i++)
+    {
+        memset(&placements[i], 0, sizeof(AtlasPlacement));
+        placements[i].array = MAX_TEXTURE_ARRAYS;
+        glm_vec4_copy((vec4) { 1.0f, 1.0f, 0.0f, 0.0f }, placements[i].uv);
+    }
+
+    bool *grouped = (bool*)calloc(count, sizeof(bool));
+    unsigned int *order = (unsigned int*)malloc(sizeof(unsigned int) * count);
+    bool ok = true;
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    // texture arrays for every size shared by two or more images
+    for (unsigned int i = 0; i < count; i++)
+    {
+        if (grouped[i])
+            continue;
+
+        unsigned int members = 0;
+        for (unsigned int j = i; j < count; j++)
+        {
+            if (!grouped[j] && images[j].width == images[i].width && images[j].height == images[i].height)
+                order[members++] = j;
+        }
+        if (members < 2)
+            continue;
+
+        unsigned int array = create_texture_array(set, images[i].width, images[i].height, (int) members,
+            mip_count(images[i].width, images[i].height));
+        if (array == MAX_TEXTURE_ARRAYS)
+        {
+            ok = false;
+            break;
+        }
+
+        for (unsigned int m = 0; m < members; m++)
+        {
+            const AtlasImage *image = &images[order[m]];
+            TextureFormat format = choose_texture_format(image->channels, image->width);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, format.alignment);
+            glTextureSubImage3D(set->arrays[array].id, 0, 0, 0, (GLint) m, image->width, image->height, 1,
+                format.format, format.type, image->pixels);
+            render_stats.frame.texture_bytes += (uint64_t) image->width * image->height * image->channels;
+
+            MipChain chain;
+            if (generate_mip_chain(image->pixels, image->width, image->height, image->channels, true, MIP_DEFAULT_FILTER, 0, &chain))
+            {
+                upload_mip_chain(set->arrays[array].id, GL_TEXTURE_2D_ARRAY, (GLint) m, &chain);
+                free_mip_chain(&chain);
+            }
+
+            AtlasPlacement *placement = &placements[order[m]];
+            placement->array = array;
+            placement->layer = m;
+            placement->x = 0;
+            placement->y = 0;
+            glm_vec4_copy((vec4) { 1.0f, 1.0f, 0.0f, 0.0f }, placement->uv);
+            grouped[order[m]] = true;
+        }
+    }
+
+    // the odd sizes go into atlas pages, tallest first packs tighter
+    unsigned int loose = 0;
+    for (unsigned int i = 0; i < count && ok; i++)
+    {
+        if (!grouped[i])
+            order[loose++] = i;
+    }
+    for (unsigned int i = 1; i < loose; i++)
+    {
+        unsigned int key = order[i];
+        unsigned int j = i;
+        while (j > 0 && images[order[j - 1]].height < images[key].height)
+        {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = key;
+    }
+
+    if (loose > 0 && ok)
+    {
+        int pad = 1 << ATLAS_SAFE_MIPS;
+        SkylinePacker *packer = (SkylinePacker*)malloc(sizeof(SkylinePacker));
+
+        // pack every image first to know how many pages we need
+        int pages = 1;
+        init_skyline(packer, ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE);
+        for (unsigned int i = 0; i < loose; i++)
+        {
+            const AtlasImage *image = &images[order[i]];
+            AtlasPlacement *placement = &placements[order[i]];
+
+            // padding on both sides, rounded so the origin stays mip aligned
+            int w = align_up(image->width + 2 * pad, pad);
+            int h = align_up(image->height + 2 * pad, pad);
+            if (w > ATLAS_PAGE_SIZE || h > ATLAS_PAGE_SIZE)
+            {
+                printf("Image of %dx%d is too big for a %d atlas page\n", image->width, image->height, ATLAS_PAGE_SIZE);
+                ok = false;
+                break;
+            }
+
+            int x, y;
+            if (!skyline_pack(packer, w, h, &x, &y))
+            {
+                if (pages == ATLAS_MAX_PAGES)
+                {
+                    printf("Ran out of atlas pages\n");
+                    ok = false;
+                    break;
+                }
+
+                pages++;
+                init_skyline(packer, ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE);
+                skyline_pack(packer, w, h, &x, &y);
+            }
+
+            placement->layer = (unsigned int) pages - 1;
+            placement->x = x + pad;
+            placement->y = y + pad;
+            glm_vec4_copy((vec4) {
+                (float) image->width / ATLAS_PAGE_SIZE, (float) image->height / ATLAS_PAGE_SIZE,
+                (float) (x + pad) / ATLAS_PAGE_SIZE, (float) (y + pad) / ATLAS_PAGE_SIZE
+            }, placement->uv);
+        }
+        free(packer);
+
+        unsigned int array = ok ? create_texture_array(set, ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE, pages, ATLAS_SAFE_MIPS + 1) : MAX_TEXTURE_ARRAYS;
+        if (array == MAX_TEXTURE_ARRAYS)
+            ok = false;
+
+        // compose and upload one page at a time
+        unsigned char *page = ok ? (unsigned char*)malloc((size_t) ATLAS_PAGE_SIZE * ATLAS_PAGE_SIZE * 4) : NULL;
+        for (int p = 0; p < pages && ok; p++)
+        {
+            memset(page, 0, (size_t) ATLAS_PAGE_SIZE * ATLAS_PAGE_SIZE * 4);
+            for (unsigned int i = 0; i < loose; i++)
+            {
+                AtlasPlacement *placement = &placements[order[i]];
+                if (placement->layer != (unsigned int) p)
+                    continue;
+
+                placement->array = array;
+                blit_padded(page, ATLAS_PAGE_SIZE, &images[order[i]], placement->x, placement->y, pad);
+            }
+
+            glTextureSubImage3D(set->arrays[array].id, 0, 0, 0, p, ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE, 1,
+                GL_RGBA, GL_UNSIGNED_BYTE, page);
+            render_stats.frame.texture_bytes += (uint64_t) ATLAS_PAGE_SIZE * ATLAS_PAGE_SIZE * 4;
+
+            // a box filter never reaches past the padding, wider kernels would
+            // pull the neighbours in at the last safe mip
+            MipChain chain;
+            if (generate_mip_chain(page, ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE, 4, true, MIP_FILTER_BOX, ATLAS_SAFE_MIPS + 1, &chain))
+            {
+                upload_mip_chain(set->arrays[array].id, GL_TEXTURE_2D_ARRAY, p, &chain);
+                free_mip_chain(&chain);
+            }
+        }
+        free(page);
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    free(grouped);
+    free(order);
+
+    if (!ok)
+        printf("Failed to build texture arrays\n");
+    return ok;
+}
+
+void destroy_texture_arrays(TextureArraySet *set)
+{
+    for (unsigned int i = 0; i < set->count; i++)
+        glDeleteTextures(1, &set->arrays[i].id);
+    set->count = 0;
+}
+
+#endif
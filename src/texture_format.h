@@ -0,0 +1,144 @@
+#ifndef TEXTURE_FORMAT_H
+#define TEXTURE_FORMAT_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#include <glad/glad.h>
+
+// the implementation is pulled in once by hello_world.c
+#ifndef STBI_INCLUDE_STB_IMAGE_H
+#include "stb_image/stb_image.h"
+#endif
+
+// texture format defaults
+#define MAX_CHECKED_FORMATS 16
+
+// how decoded pixels go up, picked so the driver can copy them as they are.
+// 8-bit RGB has no native layout on current hardware, drivers pad it to RGBA
+// on every upload, so three channel images are decoded as four instead
+typedef struct TextureFormat {
+    // what the pixels have, and what stb_image is asked for
+    int channels;
+    GLenum internal_format;
+    GLenum format;
+    GLenum type;
+    // the largest unpack alignment the rows are a multiple of
+    GLint alignment;
+} TextureFormat;
+
+// the answer for every internal format asked about so far, the query is slow
+typedef struct CheckedFormat {
+    GLenum target;
+    GLenum internal_format;
+    GLenum format;
+    GLenum type;
+    bool direct;
+} CheckedFormat;
+
+CheckedFormat checked_formats[MAX_CHECKED_FORMATS];
+unsigned int checked_format_count = 0;
+
+int texture_upload_channels(int file_channels);
+TextureFormat choose_texture_format(int channels, int width);
+unsigned char *load_texture_pixels(const char *path, int desired_channels, int *width, int *height, int *channels);
+void set_texture_swizzle(GLuint texture, const TextureFormat *format);
+bool check_texture_format(GLenum target, const TextureFormat *format);
+
+int texture_upload_channels(int file_channels)
+{
+    return file_channels == 3 ? 4 : file_channels;
+}
+
+TextureFormat choose_texture_format(int channels, int width)
+{
+    TextureFormat format;
+    format.channels = channels;
+    format.type = GL_UNSIGNED_BYTE;
+
+    switch (channels)
+    {
+        case 1: format.internal_format = GL_R8; format.format = GL_RED; break;
+        case 2: format.internal_format = GL_RG8; format.format = GL_RG; break;
+        case 3: format.internal_format = GL_RGB8; format.format = GL_RGB; break;
+        default: format.internal_format = GL_RGBA8; format.format = GL_RGBA; break;
+    }
+
+    int row_bytes = width * channels;
+    format.alignment = row_bytes % 8 == 0 ? 8 : row_bytes % 4 == 0 ? 4 : row_bytes % 2 == 0 ? 2 : 1;
+    return format;
+}
+
+// decodes straight into the layout the upload wants. desired_channels works
+// like stbi_load's, except 0 means texture_upload_channels of the file's
+// count rather than the count itself. channels is what the pixels have
+unsigned char *load_texture_pixels(const char *path, int desired_channels, int *width, int *height, int *channels)
+{
+    if (desired_channels == 0)
+    {
+        int file_channels;
+        if (!stbi_info(path, width, height, &file_channels))
+            return NULL;
+        desired_channels = texture_upload_channels(file_channels);
+    }
+
+    int file_channels;
+    unsigned char *pixels = stbi_load(path, width, height, &file_channels, desired_channels);
+    *channels = desired_channels;
+    return pixels;
+}
+
+// one and two channel textures are grey and grey + alpha, like they were when
+// they were expanded to RGBA. texture state, so it's baked into bindless handles
+void set_texture_swizzle(GLuint texture, const TextureFormat *format)
+{
+    if (format->channels == 1)
+    {
+        GLint swizzle[4] = { GL_RED, GL_RED, GL_RED, GL_ONE };
+        glTextureParameteriv(texture, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+    }
+    else if (format->channels == 2)
+    {
+        GLint swizzle[4] = { GL_RED, GL_RED, GL_RED, GL_GREEN };
+        glTextureParameteriv(texture, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+    }
+}
+
+// asks the driver whether uploads in this format go straight in or get
+// converted first, and says so once per format if they don't
+bool check_texture_format(GLenum target, const TextureFormat *format)
+{
+    for (unsigned int i = 0; i < checked_format_count; i++)
+    {
+        CheckedFormat *checked = &checked_formats[i];
+        if (checked->target == target && checked->internal_format == format->internal_format
+            && checked->format == format->format && checked->type == format->type)
+            return checked->direct;
+    }
+
+    // each query leaves 0 behind when the driver doesn't know
+    GLint preferred = 0, image_format = 0, image_type = 0;
+    glGetInternalformativ(target, format->internal_format, GL_INTERNALFORMAT_PREFERRED, 1, &preferred);
+    glGetInternalformativ(target, format->internal_format, GL_TEXTURE_IMAGE_FORMAT, 1, &image_format);
+    glGetInternalformativ(target, format->internal_format, GL_TEXTURE_IMAGE_TYPE, 1, &image_type);
+
+    bool direct = (preferred == 0 || (GLenum) preferred == format->internal_format)
+        && (image_format == 0 || (GLenum) image_format == format->format)
+        && (image_type == 0 || (GLenum) image_type == format->type);
+    if (!direct)
+        printf("Driver converts %d channel texture uploads: stores 0x%04X as 0x%04X, wants 0x%04X/0x%04X data, got 0x%04X/0x%04X\n",
+            format->channels, format->internal_format, preferred, image_format, image_type, format->format, format->type);
+
+    if (checked_format_count < MAX_CHECKED_FORMATS)
+    {
+        CheckedFormat *checked = &checked_formats[checked_format_count++];
+        checked->target = target;
+        checked->internal_format = format->internal_format;
+        checked->format = format->format;
+        checked->type = format->type;
+        checked->direct = direct;
+    }
+    return direct;
+}
+
+#endif
@@ -0,0 +1,432 @@
+#ifndef TEXTURE_MANAGER_H
+#define TEXTURE_MANAGER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include <glad/glad.h>
+
+#include <cglm/cglm.h>
+
+#include "arena.h"
+#include "camera.h"
+#include "gl_resources.h"
+#include "jobs.h"
+#include "materials.h"
+#include "mipmap.h"
+#include "profiler.h"
+#include "render_queue.h"
+#include "render_stats.h"
+#include "texture_format.h"
+
+// residency defaults
+#define TEXTURE_BUDGET_DEFAULT (64ull << 20)
+// mips at or below this size are never evicted, so every material always
+// has something to sample
+#define TEXTURE_TAIL_SIZE 64
+#define TEXTURE_STREAMS_PER_FRAME 1 // also how many can be decoding at once
+// bounding sphere of the unit cube
+#define TEXTURE_OBJECT_RADIUS 0.866f
+
+typedef struct ManagedTexture {
+    int width;
+    int height;
+    int levels;
+    // coarsest base we'll evict down to
+    int tail_base;
+    // first mip on the GPU, and the finest one anything visible asked for
+    int resident_base;
+    int wanted_base;
+    uint64_t bytes;
+    uint64_t last_used;
+} ManagedTexture;
+
+// a texture being decoded and mipped on the job system, the main thread
+// only uploads the finished chain
+typedef struct TextureStream {
+    bool active;
+    unsigned int index;
+    int base;
+    // copied from the library so the job never reads it
+    const char *path;
+    int width;
+    int height;
+    int channels;
+    int levels;
+    // not from the pool, the main thread could reuse a pool slot while a
+    // long decode is still running
+    Job job;
+    JobCounter counter;
+    // written by the job, read once counter drains
+    bool ok;
+    MipChain chain;
+} TextureStream;
+
+// keeps the library's textures within a memory budget by dropping the top
+// mips of whatever was used least recently and streaming them back in when
+// something gets close enough to need them
+typedef struct TextureManager {
+    TextureLibrary *library;
+    // only bindless textures can be resized one by one, arrays are just counted
+    bool enabled;
+
+    ManagedTexture textures[MAX_TEXTURES];
+    unsigned int count;
+
+    uint64_t budget;
+    uint64_t resident_bytes;
+    uint64_t frame;
+
+    uint64_t evicted_bytes;
+    uint64_t streamed_bytes;
+
+    TextureStream streams[TEXTURE_STREAMS_PER_FRAME];
+} TextureManager;
+
+void init_texture_manager(TextureManager *manager, TextureLibrary *library, uint64_t budget);
+void request_texture_size(TextureManager *manager, int texture, float pixels);
+void update_texture_manager(TextureManager *manager, const RenderQueue *queue, const Camera *camera, float screen_height);
+void finish_texture_streams(TextureManager *manager);
+
+// drivers pad RGB8 out to four bytes a texel, so count everything as RGBA8
+uint64_t mip_chain_bytes(int width, int height, int base, int levels)
+{
+    uint64_t bytes = 0;
+    for (int level = base; level < levels; level++)
+    {
+        uint64_t w = width >> level > 0 ? width >> level : 1;
+        uint64_t h = height >> level > 0 ? height >> level : 1;
+        bytes += w * h * 4;
+    }
+    return bytes;
+}
+
+void init_texture_manager(TextureManager *manager, TextureLibrary *library, uint64_t budget)
+{
+    memset(manager, 0, sizeof(TextureManager));
+    manager->library = library;
+    manager->enabled = library->bindless;
+    manager->budget = budget;
+
+    if (!manager->enabled)
+    {
+        for (unsigned int i = 0; i < library->arrays.count; i++)
+        {
+            TextureArray *array = &library->arrays.arrays[i];
+            manager->resident_bytes += mip_chain_bytes(array->width, array->height, 0, array->levels) * array->layers;
+        }
+
+        if (manager->resident_bytes > budget)
+            printf("Texture arrays use %llu KB, over the %llu KB budget\n",
+                (unsigned long long) (manager->resident_bytes >> 10), (unsigned long long) (budget >> 10));
+        return;
+    }
+
+    for (unsigned int i = 0; i < library->texture_count; i++)
+    {
+        LibraryTexture *texture = &library->textures[i];
+        ManagedTexture *managed = &manager->textures[i];
+
+        managed->width = texture->width;
+        managed->height = texture->height;
+        managed->levels = mip_count(texture->width, texture->height);
+
+        managed->tail_base = 0;
+        while (managed->tail_base + 1 < managed->levels
+            && (texture->width > texture->height ? texture->width : texture->height) >> managed->tail_base > TEXTURE_TAIL_SIZE)
+            managed->tail_base++;
+
+        // the library uploads everything at full resolution
+        managed->resident_base = 0;
+        managed->wanted_base = managed->tail_base;
+        managed->bytes = mip_chain_bytes(texture->width, texture->height, 0, managed->levels);
+        manager->resident_bytes += managed->bytes;
+    }
+    manager->count = library->texture_count;
+}
+
+// pixels is how big the texture shows up on screen at most, along its longest side
+void request_texture_size(TextureManager *manager, int texture, float pixels)
+{
+    if (!manager->enabled || texture < 0 || (unsigned int) texture >= manager->count)
+        return;
+
+    ManagedTexture *managed = &manager->textures[texture];
+    managed->last_used = manager->frame;
+
+    int size = managed->width > managed->height ? managed->width : managed->height;
+    int base = pixels > 1.0f ? (int) floorf(log2f(size / pixels)) : managed->tail_base;
+    if (base < 0)
+        base = 0;
+    if (base > managed->tail_base)
+        base = managed->tail_base;
+
+    if (base < managed->wanted_base)
+        managed->wanted_base = base;
+}
+
+GLuint create_managed_texture(const LibraryTexture *texture, int base, int levels)
+{
+    int w = texture->width >> base > 0 ? texture->width >> base : 1;
+    int h = texture->height >> base > 0 ? texture->height >> base : 1;
+
+    TextureFormat format = choose_texture_format(texture->channels, w);
+
+    GLuint id = create_texture(GL_TEXTURE_2D, levels - base, format.internal_format, w, h, 1);
+    set_texture_swizzle(id, &format);
+    return id;
+}
+
+// drop mips from the top, the lower ones are copied over on the GPU
+void evict_texture_mips(TextureManager *manager, unsigned int index, int base)
+{
+    ManagedTexture *managed = &manager->textures[index];
+    LibraryTexture *texture = &manager->library->textures[index];
+
+    GLuint id = create_managed_texture(texture, base, managed->levels);
+    for (int level = base; level < managed->levels; level++)
+    {
+        int w = texture->width >> level > 0 ? texture->width >> level : 1;
+        int h = texture->height >> level > 0 ? texture->height >> level : 1;
+        glCopyImageSubData(texture->id, GL_TEXTURE_2D, level - managed->resident_base, 0, 0, 0,
+            id, GL_TEXTURE_2D, level - base, 0, 0, 0, w, h, 1);
+    }
+
+    replace_library_texture(manager->library, index, id);
+
+    uint64_t bytes = mip_chain_bytes(texture->width, texture->height, base, managed->levels);
+    manager->evicted_bytes += managed->bytes - bytes;
+    manager->resident_bytes -= managed->bytes - bytes;
+    managed->bytes = bytes;
+    managed->resident_base = base;
+}
+
+bool texture_streaming(const TextureManager *manager, unsigned int index)
+{
+    for (int i = 0; i < TEXTURE_STREAMS_PER_FRAME; i++)
+    {
+        if (manager->streams[i].active && manager->streams[i].index == index)
+            return true;
+    }
+    return false;
+}
+
+// runs on a worker, the CPU copy is gone by now so the file is decoded again
+void decode_texture_stream_job(void *data, unsigned int begin, unsigned int end)
+{
+    (void) begin;
+    (void) end;
+    PROFILE_SCOPE("decode_texture_stream");
+
+    TextureStream *stream = (TextureStream*)data;
+    stream->ok = false;
+
+    int width, height, channels;
+    stbi_set_flip_vertically_on_load_thread(true);
+    begin_arena_scope();
+    unsigned char *pixels = end_arena_scope(load_texture_pixels(stream->path, stream->channels, &width, &height, &channels));
+    if (pixels == NULL || width != stream->width || height != stream->height || channels != stream->channels)
+    {
+        printf("Failed to stream texture %s!\n", stream->path);
+        if (pixels != NULL)
+            stbi_image_free(pixels);
+        return;
+    }
+
+    stream->ok = generate_mip_chain(pixels, width, height, channels, true, MIP_DEFAULT_FILTER, stream->levels, &stream->chain);
+    stbi_image_free(pixels);
+}
+
+// decode and mip generation go to the job system, or run here without one
+void start_texture_stream(TextureManager *manager, TextureStream *stream, unsigned int index, int base)
+{
+    const LibraryTexture *texture = &manager->library->textures[index];
+
+    stream->active = true;
+    stream->index = index;
+    stream->base = base;
+    stream->path = texture->path;
+    stream->width = texture->width;
+    stream->height = texture->height;
+    stream->channels = texture->channels;
+    stream->levels = manager->textures[index].levels;
+    init_job_counter(&stream->counter, NULL);
+    atomic_fetch_add_explicit(&stream->counter.pending, 1, memory_order_relaxed);
+
+    stream->job = (Job) { decode_texture_stream_job, stream, 0, 1, 1, &stream->counter };
+    run_job(&stream->job);
+}
+
+// upload from base down, only whole chains ever reach the GPU
+void upload_texture_stream(TextureManager *manager, TextureStream *stream)
+{
+    PROFILE_SCOPE("upload_texture_stream");
+
+    stream->active = false;
+    if (!stream->ok)
+        return;
+
+    ManagedTexture *managed = &manager->textures[stream->index];
+    LibraryTexture *texture = &manager->library->textures[stream->index];
+    MipChain *chain = &stream->chain;
+
+    GLuint id = create_managed_texture(texture, stream->base, managed->levels);
+    for (int level = stream->base; level < chain->levels; level++)
+    {
+        TextureFormat format = choose_texture_format(texture->channels, chain->width[level]);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, format.alignment);
+        glTextureSubImage2D(id, level - stream->base, 0, 0, chain->width[level], chain->height[level],
+            format.format, format.type, chain->data[level]);
+        render_stats.frame.texture_bytes += (uint64_t) chain->width[level] * chain->height[level] * texture->channels;
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    free_mip_chain(chain);
+
+    replace_library_texture(manager->library, stream->index, id);
+
+    uint64_t bytes = mip_chain_bytes(texture->width, texture->height, stream->base, managed->levels);
+    manager->streamed_bytes += bytes - managed->bytes;
+    manager->resident_bytes += bytes - managed->bytes;
+    managed->bytes = bytes;
+    managed->resident_base = stream->base;
+}
+
+// uploads whatever the workers have finished, never waits on them
+void collect_texture_streams(TextureManager *manager)
+{
+    for (int i = 0; i < TEXTURE_STREAMS_PER_FRAME; i++)
+    {
+        TextureStream *stream = &manager->streams[i];
+        if (stream->active && atomic_load_explicit(&stream->counter.pending, memory_order_acquire) == 0)
+            upload_texture_stream(manager, stream);
+    }
+}
+
+// waits for streams still decoding and drops their results, call before
+// the job system goes away
+void finish_texture_streams(TextureManager *manager)
+{
+    for (int i = 0; i < TEXTURE_STREAMS_PER_FRAME; i++)
+    {
+        TextureStream *stream = &manager->streams[i];
+        if (!stream->active)
+            continue;
+
+        wait_for_counter(&stream->counter);
+        if (stream->ok)
+            free_mip_chain(&stream->chain);
+        stream->active = false;
+    }
+}
+
+// least recently used texture that still has mips above its tail, textures
+// holding more than anything asked for this frame go first
+int find_eviction_victim(TextureManager *manager, bool allow_wanted)
+{
+    int victim = -1;
+    for (unsigned int i = 0; i < manager->count; i++)
+    {
+        ManagedTexture *managed = &manager->textures[i];
+        if (managed->resident_base >= managed->tail_base || texture_streaming(manager, i))
+            continue;
+        if (!allow_wanted && managed->resident_base >= managed->wanted_base)
+            continue;
+
+        if (victim < 0 || managed->last_used < manager->textures[victim].last_used)
+            victim = (int) i;
+    }
+    return victim;
+}
+
+// call once a frame after the queue is built, sizes come from the visible draws
+void update_texture_manager(TextureManager *manager, const RenderQueue *queue, const Camera *camera, float screen_height)
+{
+    if (!manager->enabled)
+        return;
+
+    PROFILE_SCOPE("update_texture_manager");
+    manager->frame++;
+
+    collect_texture_streams(manager);
+
+    for (unsigned int i = 0; i < manager->count; i++)
+        manager->textures[i].wanted_base = manager->textures[i].tail_base;
+
+    // projected diameter of each visible object's bounding sphere
+    float focal = 1.0f / tanf(glm_rad(camera->zoom) * 0.5f);
+    for (unsigned int i = 0; i < queue->count; i++)
+    {
+        const DrawCommand *command = &queue->commands[i];
+        float distance = glm_vec3_distance((float*)command->model[3], camera->position);
+        float pixels = distance > TEXTURE_OBJECT_RADIUS
+            ? TEXTURE_OBJECT_RADIUS / distance * focal * screen_height
+            : screen_height;
+
+        const MaterialTextures *source = &manager->library->material_textures[command->material];
+        request_texture_size(manager, source->base, pixels);
+        request_texture_size(manager, source->overlay, pixels);
+    }
+
+    // over budget: shed mips nobody needs first, then the least recently used
+    while (manager->resident_bytes > manager->budget)
+    {
+        int victim = find_eviction_victim(manager, false);
+        if (victim < 0)
+            victim = find_eviction_victim(manager, true);
+        if (victim < 0)
+            break;
+
+        ManagedTexture *managed = &manager->textures[victim];
+        int base = managed->wanted_base > managed->resident_base ? managed->wanted_base : managed->resident_base + 1;
+        evict_texture_mips(manager, (unsigned int) victim, base);
+    }
+
+    // bring back detail for whatever is short by the most mips
+    for (int slot = 0; slot < TEXTURE_STREAMS_PER_FRAME; slot++)
+    {
+        if (manager->streams[slot].active)
+            continue;
+
+        int best = -1, best_deficit = 0;
+        for (unsigned int i = 0; i < manager->count; i++)
+        {
+            ManagedTexture *managed = &manager->textures[i];
+            int deficit = managed->resident_base - managed->wanted_base;
+            if (deficit > best_deficit && !texture_streaming(manager, i))
+            {
+                best = (int) i;
+                best_deficit = deficit;
+            }
+        }
+        if (best < 0)
+            break;
+
+        // make room from mips nobody wants, then take as much of what was
+        // asked for as the budget allows
+        ManagedTexture *managed = &manager->textures[best];
+        uint64_t needed = mip_chain_bytes(managed->width, managed->height, managed->wanted_base, managed->levels) - managed->bytes;
+        while (manager->resident_bytes + needed > manager->budget)
+        {
+            int victim = find_eviction_victim(manager, false);
+            if (victim < 0)
+                break;
+
+            ManagedTexture *idle = &manager->textures[victim];
+            evict_texture_mips(manager, (unsigned int) victim, idle->wanted_base);
+        }
+
+        int base = managed->wanted_base;
+        while (base < managed->resident_base
+            && manager->resident_bytes - managed->bytes + mip_chain_bytes(managed->width, managed->height, base, managed->levels) > manager->budget)
+            base++;
+
+        if (base == managed->resident_base)
+            break;
+        start_texture_stream(manager, &manager->streams[slot], (unsigned int) best, base);
+    }
+}
+
+#endif
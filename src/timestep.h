@@ -0,0 +1,277 @@
+#ifndef TIMESTEP_H
+#define TIMESTEP_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include <cglm/cglm.h>
+
+#include "camera.h"
+#include "profiler.h"
+
+// simulation defaults
+#define SIM_TICK_RATE 120.0
+#define SIM_MAX_OBJECTS 1024
+// clamp on ticks per update so a long stall can't snowball (spiral of death)
+#define SIM_MAX_TICKS_PER_UPDATE 8
+
+// keys held down during a frame, sampled on the main thread
+typedef enum SimKey {
+    SIM_KEY_FORWARD = 1 << 0,
+    SIM_KEY_BACKWARD = 1 << 1,
+    SIM_KEY_LEFT = 1 << 2,
+    SIM_KEY_RIGHT = 1 << 3
+} SimKey;
+
+// everything a tick needs from the outside world, copied so the
+// simulation never reads the live camera from another thread
+typedef struct SimInput {
+    unsigned int keys;
+    vec3 front;
+    vec3 right;
+    float movement_speed;
+} SimInput;
+
+typedef struct SimState {
+    double time;
+    unsigned long long tick;
+
+    vec3 camera_position;
+
+    // rotation angle (radians) and angular velocity (radians/s) per object
+    unsigned int object_count;
+    float angles[SIM_MAX_OBJECTS];
+    float angular_velocity[SIM_MAX_OBJECTS];
+} SimState;
+
+typedef struct Simulation {
+    double tick_length;
+    double accumulator;
+    double last_time;
+
+    // previous and current simulation state, rendering blends between them
+    SimState previous;
+    SimState current;
+
+    SimInput input;
+
+    // threaded mode
+    bool threaded;
+    atomic_bool running;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    // time source shared by both threads, must be callable from any thread
+    double (*clock)(void);
+    // clock time at which `current` became due
+    double current_due;
+} Simulation;
+
+void init_simulation(Simulation *sim, const SimState *initial, double tick_rate, double (*clock)(void));
+void sim_step(SimState *state, const SimInput *input, double dt);
+void sim_set_input(Simulation *sim, const SimInput *input);
+void sim_update(Simulation *sim);
+void sim_interpolate(Simulation *sim, SimState *out);
+bool start_sim_thread(Simulation *sim);
+void stop_sim_thread(Simulation *sim);
+
+void init_simulation(Simulation *sim, const SimState *initial, double tick_rate, double (*clock)(void))
+{
+    memset(sim, 0, sizeof(Simulation));
+
+    sim->tick_length = 1.0 / tick_rate;
+    sim->clock = clock;
+    sim->last_time = clock();
+    sim->current_due = sim->last_time;
+
+    sim->previous = *initial;
+    sim->current = *initial;
+
+    atomic_init(&sim->running, false);
+    pthread_mutex_init(&sim->lock, NULL);
+}
+
+// advance a state by one fixed tick, only ever called with dt == tick_length
+void sim_step(SimState *state, const SimInput *input, double dt)
+{
+    PROFILE_SCOPE("sim_step");
+
+    // reuse the camera movement code on the simulated position
+    Camera cam;
+    memset(&cam, 0, sizeof(Camera));
+    cam.position = state->camera_position;
+    cam.front = (float*)input->front;
+    cam.right = (float*)input->right;
+    cam.movement_speed = input->movement_speed;
+
+    if (input->keys & SIM_KEY_FORWARD)
+        process_keyboard(&cam, FORWARD, (float) dt);
+    if (input->keys & SIM_KEY_BACKWARD)
+        process_keyboard(&cam, BACKWARD, (float) dt);
+    if (input->keys & SIM_KEY_LEFT)
+        process_keyboard(&cam, LEFT, (float) dt);
+    if (input->keys & SIM_KEY_RIGHT)
+        process_keyboard(&cam, RIGHT, (float) dt);
+
+    for (unsigned int i = 0; i < state->object_count; i++)
+    {
+        // keep angles small so float precision doesn't degrade over long sessions
+        state->angles[i] = fmodf(state->angles[i] + state->angular_velocity[i] * (float) dt, 2.0f * GLM_PIf);
+    }
+
+    state->time += dt;
+    state->tick++;
+}
+
+void sim_set_input(Simulation *sim, const SimInput *input)
+{
+    if (sim->threaded)
+        pthread_mutex_lock(&sim->lock);
+
+    sim->input = *input;
+
+    if (sim->threaded)
+        pthread_mutex_unlock(&sim->lock);
+}
+
+// single threaded mode: run however many ticks fit in the elapsed time
+void sim_update(Simulation *sim)
+{
+    if (sim->threaded)
+        return;
+
+    double now = sim->clock();
+    sim->accumulator += now - sim->last_time;
+    sim->last_time = now;
+
+    unsigned int ticks = 0;
+    while (sim->accumulator >= sim->tick_length)
+    {
+        if (ticks == SIM_MAX_TICKS_PER_UPDATE)
+        {
+            // drop the backlog instead of trying to catch up forever
+            sim->accumulator = 0.0;
+            break;
+        }
+
+        sim->previous = sim->current;
+        sim_step(&sim->current, &sim->input, sim->tick_length);
+        sim->accumulator -= sim->tick_length;
+        ticks++;
+    }
+}
+
+// blend the last two states by how far we are into the next tick
+void sim_interpolate(Simulation *sim, SimState *out)
+{
+    SimState previous, current;
+    double alpha;
+
+    if (sim->threaded)
+    {
+        pthread_mutex_lock(&sim->lock);
+        previous = sim->previous;
+        current = sim->current;
+        alpha = (sim->clock() - sim->current_due) / sim->tick_length;
+        pthread_mutex_unlock(&sim->lock);
+    }
+    else
+    {
+        previous = sim->previous;
+        current = sim->current;
+        alpha = sim->accumulator / sim->tick_length;
+    }
+
+    float t = glm_clamp((float) alpha, 0.0f, 1.0f);
+
+    *out = current;
+    out->time = previous.time + (current.time - previous.time) * t;
+    glm_vec3_lerp(previous.camera_position, current.camera_position, t, out->camera_position);
+
+    for (unsigned int i = 0; i < current.object_count; i++)
+    {
+        float from = previous.angles[i];
+        float to = current.angles[i];
+
+        // take the short way around when the angle wrapped this tick
+        if (to - from > GLM_PIf)
+            from += 2.0f * GLM_PIf;
+        else if (from - to > GLM_PIf)
+            from -= 2.0f * GLM_PIf;
+
+        out->angles[i] = from + (to - from) * t;
+    }
+}
+
+void *sim_thread_main(void *arg)
+{
+    Simulation *sim = (Simulation*)arg;
+
+    while (atomic_load(&sim->running))
+    {
+        double now = sim->clock();
+
+        pthread_mutex_lock(&sim->lock);
+        SimInput input = sim->input;
+        double due = sim->current_due + sim->tick_length;
+        pthread_mutex_unlock(&sim->lock);
+
+        if (now < due)
+        {
+            // sleep until the next tick is due
+            double wait = due - now;
+            struct timespec ts = { (time_t) wait, (long) ((wait - (double)(time_t) wait) * 1e9) };
+            nanosleep(&ts, NULL);
+            continue;
+        }
+
+        // fell too far behind, skip ahead rather than bursting ticks
+        if (now - due > sim->tick_length * SIM_MAX_TICKS_PER_UPDATE)
+            due = now;
+
+        // step a private copy so the render thread never waits on a tick
+        SimState next = sim->current;
+        sim_step(&next, &input, sim->tick_length);
+
+        pthread_mutex_lock(&sim->lock);
+        sim->previous = sim->current;
+        sim->current = next;
+        sim->current_due = due;
+        pthread_mutex_unlock(&sim->lock);
+    }
+
+    return NULL;
+}
+
+bool start_sim_thread(Simulation *sim)
+{
+    sim->current_due = sim->clock();
+    sim->threaded = true;
+    atomic_store(&sim->running, true);
+
+    if (pthread_create(&sim->thread, NULL, sim_thread_main, sim) != 0)
+    {
+        printf("Failed to start simulation thread, running on main thread\n");
+        sim->threaded = false;
+        atomic_store(&sim->running, false);
+        sim->last_time = sim->clock();
+        return false;
+    }
+
+    return true;
+}
+
+void stop_sim_thread(Simulation *sim)
+{
+    if (!sim->threaded)
+        return;
+
+    atomic_store(&sim->running, false);
+    pthread_join(sim->thread, NULL);
+    sim->threaded = false;
+}
+
+#endif
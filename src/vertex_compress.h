@@ -0,0 +1,360 @@
+#ifndef VERTEX_COMPRESS_H
+#define VERTEX_COMPRESS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include <glad/glad.h>
+
+#include <cglm/cglm.h>
+
+#include "gl_resources.h"
+#include "mesh.h"
+#include "render_stats.h"
+
+// vertex compression defaults
+#define PACKED_VERTEX_ATTRIBS 4
+#define HALF_MAX 65504.0f
+
+// 20 bytes a vertex, a MeshVertex uploaded as floats is 48:
+//   position  unorm16 x3 inside the mesh bounds, the 4th keeps uv 4 byte aligned
+//   uv        half float x2
+//   normal    octahedral snorm16 x2
+//   tangent   snorm 10_10_10_2, w is the bitangent sign
+// vertex_shader.glsl decodes it, the bounds come in as uniforms
+typedef struct PackedVertex {
+    uint16_t position[4];
+    uint16_t uv[2];
+    int16_t normal[2];
+    uint32_t tangent;
+} PackedVertex;
+
+// positions decode as position_offset + unorm * position_scale
+typedef struct PackedMesh {
+    PackedVertex *vertices;
+    unsigned int vertex_count;
+    unsigned int *indices;
+    unsigned int index_count;
+    vec3 position_offset;
+    vec3 position_scale;
+} PackedMesh;
+
+// the worst each attribute came out after a round trip through the packed form
+typedef struct VertexCompressionError {
+    // distance in mesh units, and as a fraction of the bounds' diagonal
+    float position;
+    float position_relative;
+    float uv;
+    // degrees
+    float normal;
+    float tangent;
+    // uvs past what a half float holds, clamped to it
+    unsigned int clamped_uvs;
+} VertexCompressionError;
+
+typedef struct GpuMesh {
+    GLuint vertex_buffer;
+    GLuint index_buffer;
+    GLuint vao;
+    unsigned int index_count;
+    vec3 position_offset;
+    vec3 position_scale;
+} GpuMesh;
+
+VertexAttrib packed_vertex_attribs[PACKED_VERTEX_ATTRIBS] = {
+    { 0, 3, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(PackedVertex, position) },
+    { 1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, offsetof(PackedVertex, tangent) },
+    { 2, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(PackedVertex, uv) },
+    { 3, 2, GL_SHORT, GL_TRUE, offsetof(PackedVertex, normal) },
+};
+
+uint16_t float_to_half(float value);
+float half_to_float(uint16_t half);
+void encode_octahedral(const float *normal, int16_t *encoded);
+void decode_octahedral(const int16_t *encoded, float *normal);
+uint32_t encode_tangent(const float *tangent);
+void decode_tangent(uint32_t encoded, float *tangent);
+bool compress_mesh(const Mesh *mesh, PackedMesh *packed, VertexCompressionError *error);
+void print_vertex_compression(const char *name, const PackedMesh *packed, const VertexCompressionError *error);
+void free_packed_mesh(PackedMesh *packed);
+void upload_packed_mesh(const PackedMesh *packed, GpuMesh *gpu);
+void bind_gpu_mesh(const GpuMesh *gpu, unsigned int program);
+void destroy_gpu_mesh(GpuMesh *gpu);
+
+// round to nearest even, too large goes to the largest finite half rather
+// than infinity, too small to a denormal or zero
+uint16_t float_to_half(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    uint16_t sign = (uint16_t) ((bits >> 16) & 0x8000);
+    uint32_t magnitude = bits & 0x7FFFFFFF;
+
+    if (magnitude > 0x7F800000)
+        return sign | 0x7E00; // NaN
+    if (magnitude >= 0x477FF000)
+        return sign | 0x7BFF; // rounds past 65504
+
+    if (magnitude < 0x38800000)
+    {
+        // denormal half, shift the mantissa with its implicit bit down into place
+        if (magnitude < 0x33000000)
+            return sign;
+        uint32_t exponent = magnitude >> 23;
+        uint32_t mantissa = (magnitude & 0x7FFFFF) | 0x800000;
+        uint32_t shift = 126 - exponent;
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1)))
+            half++;
+        return sign | (uint16_t) half;
+    }
+
+    // rebias the exponent, then round off the 13 low mantissa bits
+    uint32_t half = (magnitude - 0x38000000) >> 13;
+    uint32_t rest = magnitude & 0x1FFF;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+        half++;
+    return sign | (uint16_t) half;
+}
+
+float half_to_float(uint16_t half)
+{
+    uint32_t sign = (uint32_t) (half & 0x8000) << 16;
+    uint32_t exponent = (half >> 10) & 0x1F;
+    uint32_t mantissa = half & 0x3FF;
+
+    float value;
+    if (exponent == 0)
+        value = ldexpf((float) mantissa, -24);
+    else if (exponent == 31)
+        value = mantissa != 0 ? NAN : INFINITY;
+    else
+        value = ldexpf((float) (mantissa | 0x400), (int) exponent - 25);
+
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    bits |= sign;
+    memcpy(&value, &bits, sizeof(bits));
+    return value;
+}
+
+static float sign_not_zero(float value)
+{
+    return value < 0.0f ? -1.0f : 1.0f;
+}
+
+static int16_t to_snorm16(float value)
+{
+    return (int16_t) lroundf(glm_clamp(value, -1.0f, 1.0f) * 32767.0f);
+}
+
+void decode_octahedral(const int16_t *encoded, float *normal)
+{
+    // what the GL does with a normalized short, then what the shader does
+    float x = fmaxf(encoded[0] / 32767.0f, -1.0f);
+    float y = fmaxf(encoded[1] / 32767.0f, -1.0f);
+    vec3 n = { x, y, 1.0f - fabsf(x) - fabsf(y) };
+    if (n[2] < 0.0f)
+    {
+        n[0] = (1.0f - fabsf(y)) * sign_not_zero(x);
+        n[1] = (1.0f - fabsf(x)) * sign_not_zero(y);
+    }
+    glm_vec3_normalize(n);
+    glm_vec3_copy(n, normal);
+}
+
+// the unit normal projected onto an octahedron and unfolded into a square.
+// of the four roundings around the exact spot, the one that decodes closest wins
+void encode_octahedral(const float *normal, int16_t *encoded)
+{
+    float l1 = fabsf(normal[0]) + fabsf(normal[1]) + fabsf(normal[2]);
+    float x = l1 > 0.0f ? normal[0] / l1 : 0.0f;
+    float y = l1 > 0.0f ? normal[1] / l1 : 0.0f;
+    if (normal[2] < 0.0f)
+    {
+        float folded_x = (1.0f - fabsf(y)) * sign_not_zero(x);
+        float folded_y = (1.0f - fabsf(x)) * sign_not_zero(y);
+        x = folded_x;
+        y = folded_y;
+    }
+
+    float best = -2.0f;
+    for (int i = 0; i < 4; i++)
+    {
+        float cx = (i & 1 ? ceilf(x * 32767.0f) : floorf(x * 32767.0f)) / 32767.0f;
+        float cy = (i & 2 ? ceilf(y * 32767.0f) : floorf(y * 32767.0f)) / 32767.0f;
+        int16_t candidate[2] = { to_snorm16(cx), to_snorm16(cy) };
+
+        vec3 decoded;
+        decode_octahedral(candidate, decoded);
+        float similarity = glm_vec3_dot(decoded, (float*)normal);
+        if (similarity > best)
+        {
+            best = similarity;
+            encoded[0] = candidate[0];
+            encoded[1] = candidate[1];
+        }
+    }
+}
+
+// x, y and z as 10 bit snorm from the low bits up, w as 2 bit two's
+// complement on top (1 is 01, -1 is 11), GL_INT_2_10_10_10_REV's layout
+uint32_t encode_tangent(const float *tangent)
+{
+    uint32_t packed = 0;
+    for (int k = 0; k < 3; k++)
+    {
+        int32_t c = (int32_t) lroundf(glm_clamp(tangent[k], -1.0f, 1.0f) * 511.0f);
+        packed |= ((uint32_t) c & 0x3FF) << (10 * k);
+    }
+    packed |= (tangent[3] < 0.0f ? 3u : 1u) << 30;
+    return packed;
+}
+
+void decode_tangent(uint32_t encoded, float *tangent)
+{
+    for (int k = 0; k < 3; k++)
+    {
+        // sign extend the 10 bits
+        int32_t c = (int32_t) ((encoded >> (10 * k)) & 0x3FF);
+        if (c & 0x200)
+            c -= 0x400;
+        tangent[k] = fmaxf(c / 511.0f, -1.0f);
+    }
+    tangent[3] = (encoded >> 30) == 1 ? 1.0f : -1.0f;
+    glm_vec3_normalize(tangent);
+}
+
+// atan2 rather than acos, which can't resolve the tiny angles we're after in floats
+static float angle_between(const float *a, const float *b)
+{
+    vec3 cross;
+    glm_vec3_cross((float*)a, (float*)b, cross);
+    return glm_deg(atan2f(glm_vec3_norm(cross), glm_vec3_dot((float*)a, (float*)b)));
+}
+
+// packs every vertex and measures what it cost. the mesh's bounds need to be
+// current, compute_mesh_bounds does that
+bool compress_mesh(const Mesh *mesh, PackedMesh *packed, VertexCompressionError *error)
+{
+    memset(packed, 0, sizeof(PackedMesh));
+    memset(error, 0, sizeof(VertexCompressionError));
+
+    packed->vertices = (PackedVertex*)malloc(sizeof(PackedVertex) * (mesh->vertex_count > 0 ? mesh->vertex_count : 1));
+    packed->indices = (unsigned int*)malloc(sizeof(unsigned int) * (mesh->index_count > 0 ? mesh->index_count : 1));
+    if (packed->vertices == NULL || packed->indices == NULL)
+    {
+        free_packed_mesh(packed);
+        return false;
+    }
+    packed->vertex_count = mesh->vertex_count;
+    packed->index_count = mesh->index_count;
+    memcpy(packed->indices, mesh->indices, sizeof(unsigned int) * mesh->index_count);
+
+    glm_vec3_copy((float*)mesh->bounds[0], packed->position_offset);
+    for (int k = 0; k < 3; k++)
+        packed->position_scale[k] = mesh->bounds[1][k] - mesh->bounds[0][k];
+
+    for (unsigned int i = 0; i < mesh->vertex_count; i++)
+    {
+        const MeshVertex *v = &mesh->vertices[i];
+        PackedVertex *p = &packed->vertices[i];
+
+        vec3 position;
+        for (int k = 0; k < 3; k++)
+        {
+            float extent = packed->position_scale[k];
+            float t = extent > 0.0f ? (v->position[k] - packed->position_offset[k]) / extent : 0.0f;
+            p->position[k] = (uint16_t) lroundf(glm_clamp(t, 0.0f, 1.0f) * 65535.0f);
+            position[k] = packed->position_offset[k] + p->position[k] / 65535.0f * extent;
+        }
+        p->position[3] = 0;
+        error->position = fmaxf(error->position, glm_vec3_distance(position, (float*)v->position));
+
+        for (int k = 0; k < 2; k++)
+        {
+            if (fabsf(v->uv[k]) > HALF_MAX)
+                error->clamped_uvs++;
+            p->uv[k] = float_to_half(v->uv[k]);
+            error->uv = fmaxf(error->uv, fabsf(half_to_float(p->uv[k]) - v->uv[k]));
+        }
+
+        vec3 normal;
+        encode_octahedral(v->normal, p->normal);
+        decode_octahedral(p->normal, normal);
+        error->normal = fmaxf(error->normal, angle_between(normal, v->normal));
+
+        vec4 tangent;
+        p->tangent = encode_tangent(v->tangent);
+        decode_tangent(p->tangent, tangent);
+        float tangent_error = angle_between(tangent, v->tangent);
+        if (tangent[3] != (v->tangent[3] < 0.0f ? -1.0f : 1.0f))
+            tangent_error = 180.0f;
+        error->tangent = fmaxf(error->tangent, tangent_error);
+    }
+
+    float diagonal = glm_vec3_norm(packed->position_scale);
+    error->position_relative = diagonal > 0.0f ? error->position / diagonal : 0.0f;
+    return true;
+}
+
+void print_vertex_compression(const char *name, const PackedMesh *packed, const VertexCompressionError *error)
+{
+    printf("Mesh %s: %u vertices at %zu bytes (%zu unpacked), max error position %g (%.5f%% of bounds), uv %g, normal %.4f deg, tangent %.4f deg\n",
+        name, packed->vertex_count, sizeof(PackedVertex), sizeof(MeshVertex), error->position,
+        error->position_relative * 100.0f, error->uv, error->normal, error->tangent);
+    if (error->clamped_uvs > 0)
+        printf("Mesh %s: %u uv components past +-%g were clamped\n", name, error->clamped_uvs, HALF_MAX);
+}
+
+void free_packed_mesh(PackedMesh *packed)
+{
+    free(packed->vertices);
+    free(packed->indices);
+    packed->vertices = NULL;
+    packed->indices = NULL;
+    packed->vertex_count = 0;
+    packed->index_count = 0;
+}
+
+void upload_packed_mesh(const PackedMesh *packed, GpuMesh *gpu)
+{
+    gpu->vertex_buffer = create_buffer(sizeof(PackedVertex) * packed->vertex_count, packed->vertices, 0);
+    gpu->index_buffer = create_buffer(sizeof(unsigned int) * packed->index_count, packed->indices, 0);
+    gpu->vao = create_vertex_array(gpu->vertex_buffer, sizeof(PackedVertex), packed_vertex_attribs, PACKED_VERTEX_ATTRIBS, gpu->index_buffer);
+    gpu->index_count = packed->index_count;
+    glm_vec3_copy((float*)packed->position_offset, gpu->position_offset);
+    glm_vec3_copy((float*)packed->position_scale, gpu->position_scale);
+
+    render_stats.frame.buffer_bytes += sizeof(PackedVertex) * packed->vertex_count + sizeof(unsigned int) * packed->index_count;
+}
+
+// the VAO plus the bounds the positions decode against, program has to be current
+void bind_gpu_mesh(const GpuMesh *gpu, unsigned int program)
+{
+    glBindVertexArray(gpu->vao);
+    glUniform3fv(glGetUniformLocation(program, "position_offset"), 1, gpu->position_offset);
+    glUniform3fv(glGetUniformLocation(program, "position_scale"), 1, gpu->position_scale);
+    render_stats.frame.state_changes++;
+}
+
+void destroy_gpu_mesh(GpuMesh *gpu)
+{
+    glDeleteVertexArrays(1, &gpu->vao);
+    glDeleteBuffers(1, &gpu->vertex_buffer);
+    glDeleteBuffers(1, &gpu->index_buffer);
+    gpu->vao = 0;
+    gpu->vertex_buffer = 0;
+    gpu->index_buffer = 0;
+    gpu->index_count = 0;
+}
+
+#endif
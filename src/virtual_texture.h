@@ -0,0 +1,988 @@
+#ifndef VIRTUAL_TEXTURE_H
+#define VIRTUAL_TEXTURE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <glad/glad.h>
+
+// the implementation is pulled in once by hello_world.c
+#ifndef STBI_INCLUDE_STB_IMAGE_H
+#include "stb_image/stb_image.h"
+#endif
+
+#include "arena.h"
+#include "gl_extensions.h"
+#include "gl_resources.h"
+#include "mipmap.h"
+#include "profiler.h"
+#include "render_stats.h"
+
+// virtual texture defaults
+#define VT_MAX_TEXTURES 4 // must match the arrays in the fragment shaders
+#define VT_MAX_MIPS 14
+#define VT_PAGE_PAYLOAD 128 // texels per page side, also the sparse page size we ask for
+#define VT_PAGE_BORDER 4 // so bilinear filtering never reads a neighbouring slot
+#define VT_PAGE_SIZE (VT_PAGE_PAYLOAD + 2 * VT_PAGE_BORDER)
+#define VT_PAGE_BYTES (VT_PAGE_SIZE * VT_PAGE_SIZE * 4)
+#define VT_CACHE_SLOTS_X 15 // 15 * 136 = 2040 texels of physical cache per side
+#define VT_CACHE_SLOTS (VT_CACHE_SLOTS_X * VT_CACHE_SLOTS_X)
+#define VT_STAGING_PAGES 32 // pages the loader thread can have in flight
+#define VT_UPLOADS_PER_FRAME 16
+#define VT_FEEDBACK_DIVISOR 8 // feedback is rendered at 1/8 of the screen size
+#define VT_FEEDBACK_BUFFERS 3 // frames of readback latency, so mapping never stalls
+#define VT_NO_PAGE 0xFFFFFFFFu
+#define VT_MAX_PROGRAMS 4 // programs bind_virtual_textures keeps uniform locations for
+
+// what the feedback pass writes and how pages are named everywhere else:
+// 2 bits texture, 4 bits mip, 13 bits y, 13 bits x
+#define VT_KEY(id, mip, x, y) (((uint32_t) (id) << 30) | ((uint32_t) (mip) << 26) | ((uint32_t) (y) << 13) | (uint32_t) (x))
+#define VT_KEY_ID(key) ((key) >> 30)
+#define VT_KEY_MIP(key) (((key) >> 26) & 0xF)
+#define VT_KEY_Y(key) (((key) >> 13) & 0x1FFF)
+#define VT_KEY_X(key) ((key) & 0x1FFF)
+
+// fills a VT_PAGE_SIZE square RGBA page, border included, for texels
+// [x * VT_PAGE_PAYLOAD - VT_PAGE_BORDER, ...) of the given mip. Runs on
+// the loader thread
+typedef bool (*PageLoader)(void *source, int mip, int x, int y, unsigned char *page);
+
+typedef void (APIENTRYP TexPageCommitmentProc)(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint zoffset,
+    GLsizei width, GLsizei height, GLsizei depth, GLboolean commit);
+
+typedef enum PageState {
+    PAGE_ABSENT,
+    PAGE_PENDING,
+    PAGE_RESIDENT,
+    PAGE_FAILED
+} PageState;
+
+typedef struct VirtualTexture {
+    int width;
+    int height;
+    int mips;
+
+    // page grid per mip, sized like the page table's GL levels
+    int pages_x[VT_MAX_MIPS];
+    int pages_y[VT_MAX_MIPS];
+    size_t page_offset[VT_MAX_MIPS];
+    size_t page_count;
+
+    // per page: cache slot or -1, state, and the resolved page table entry
+    int32_t *page_slot;
+    uint8_t *page_state;
+    unsigned char *entries;
+    bool dirty;
+
+    // RGBA8, one level per mip: slot x, slot y, mip the data comes from, valid
+    GLuint page_table;
+
+    // sparse backend, the texture itself at full virtual size
+    bool sparse;
+    GLuint sparse_texture;
+    int sparse_levels;
+
+    PageLoader load;
+    void *source;
+    void (*release)(void *source);
+} VirtualTexture;
+
+typedef struct CacheSlot {
+    uint32_t key;
+    uint64_t last_used;
+    bool locked;
+} CacheSlot;
+
+typedef enum StagingState {
+    STAGING_FREE,
+    STAGING_LOADING,
+    STAGING_IN_FLIGHT
+} StagingState;
+
+typedef struct PageRequest {
+    uint32_t key;
+    int staging;
+    bool ok;
+} PageRequest;
+
+typedef struct VtProgram {
+    GLuint program;
+    GLuint first_unit;
+    GLint page_tables;
+    GLint physical;
+    GLint info;
+    // textures whose vt_info this program has seen
+    unsigned int info_count;
+} VtProgram;
+
+// pages are decoded on a background thread straight into persistently mapped
+// staging memory, the main thread only issues the copies into the cache
+typedef struct VirtualTextureSystem {
+    VirtualTexture textures[VT_MAX_TEXTURES];
+    unsigned int count;
+    uint64_t frame;
+
+    // sparse backend when GL_ARB_sparse_texture has 128x128 RGBA8 pages
+    bool sparse;
+    GLint sparse_max_size;
+    TexPageCommitmentProc page_commitment;
+
+    // physical cache shared by every non-sparse texture, sparse textures
+    // only use the slots to count against the same budget
+    GLuint cache;
+    CacheSlot slots[VT_CACHE_SLOTS];
+
+    GLuint staging_buffer;
+    unsigned char *staging_memory;
+    StagingState staging_state[VT_STAGING_PAGES];
+    GLsync staging_fence[VT_STAGING_PAGES];
+
+    // loader thread, both rings hold at most VT_STAGING_PAGES entries
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    bool running;
+    PageRequest requests[VT_STAGING_PAGES];
+    unsigned int request_head;
+    unsigned int request_count;
+    PageRequest done[VT_STAGING_PAGES];
+    unsigned int done_head;
+    unsigned int done_count;
+
+    // feedback pass, sized from the screen at init, and the viewport it
+    // replaces while it runs
+    GLint saved_viewport[4];
+    int feedback_width;
+    int feedback_height;
+    GLuint feedback_fbo;
+    GLuint feedback_texture;
+    GLuint feedback_depth;
+    GLuint feedback_pbos[VT_FEEDBACK_BUFFERS];
+    uint64_t feedback_frames;
+
+    // dedup of one frame's feedback, open addressing
+    uint32_t *seen;
+    uint32_t seen_mask;
+    uint32_t seen_count;
+    uint32_t *wanted;
+    unsigned int wanted_count;
+
+    VtProgram programs[VT_MAX_PROGRAMS];
+    unsigned int program_count;
+    GLint max_units;
+} VirtualTextureSystem;
+
+typedef struct ImagePageSource {
+    unsigned char *pixels;
+    MipChain chain;
+} ImagePageSource;
+
+typedef struct TilePageSource {
+    char directory[256];
+} TilePageSource;
+
+void init_virtual_textures(VirtualTextureSystem *system, bool allow_sparse, int screen_width, int screen_height, GLADloadproc load);
+int add_virtual_texture(VirtualTextureSystem *system, int width, int height, PageLoader load, void *source);
+int add_virtual_texture_image(VirtualTextureSystem *system, const char *path);
+int add_virtual_texture_tiles(VirtualTextureSystem *system, const char *directory, int width, int height);
+void begin_vt_feedback(VirtualTextureSystem *system);
+void end_vt_feedback(VirtualTextureSystem *system);
+void update_virtual_textures(VirtualTextureSystem *system);
+void bind_virtual_textures(VirtualTextureSystem *system, unsigned int program, GLuint first_unit);
+void destroy_virtual_textures(VirtualTextureSystem *system);
+
+void *vt_loader_main(void *data)
+{
+    VirtualTextureSystem *system = (VirtualTextureSystem*)data;
+
+    // tiles are stored the way they look, GL wants the bottom row first
+    stbi_set_flip_vertically_on_load_thread(true);
+
+    for (;;)
+    {
+        pthread_mutex_lock(&system->lock);
+        while (system->running && system->request_count == 0)
+            pthread_cond_wait(&system->wake, &system->lock);
+        if (!system->running)
+        {
+            pthread_mutex_unlock(&system->lock);
+            break;
+        }
+
+        PageRequest request = system->requests[system->request_head];
+        system->request_head = (system->request_head + 1) % VT_STAGING_PAGES;
+        system->request_count--;
+        pthread_mutex_unlock(&system->lock);
+
+        {
+            PROFILE_SCOPE("load_vt_page");
+            VirtualTexture *vt = &system->textures[VT_KEY_ID(request.key)];
+            request.ok = vt->load(vt->source, (int) VT_KEY_MIP(request.key), (int) VT_KEY_X(request.key), (int) VT_KEY_Y(request.key),
+                system->staging_memory + (size_t) request.staging * VT_PAGE_BYTES);
+        }
+
+        pthread_mutex_lock(&system->lock);
+        system->done[(system->done_head + system->done_count) % VT_STAGING_PAGES] = request;
+        system->done_count++;
+        pthread_mutex_unlock(&system->lock);
+    }
+
+    release_thread_arena();
+    return NULL;
+}
+
+// sparse needs the extension and a 128x128 page size for RGBA8
+bool init_sparse_backend(VirtualTextureSystem *system, GLADloadproc load)
+{
+    if (!has_gl_extension("GL_ARB_sparse_texture"))
+        return false;
+
+    system->page_commitment = (TexPageCommitmentProc) load("glTexPageCommitmentARB");
+    if (system->page_commitment == NULL)
+        return false;
+
+    GLint sizes = 0;
+    glGetInternalformativ(GL_TEXTURE_2D, GL_RGBA8, GL_NUM_VIRTUAL_PAGE_SIZES_ARB, 1, &sizes);
+    if (sizes <= 0 || sizes > 16)
+        return false;
+
+    GLint xs[16], ys[16];
+    glGetInternalformativ(GL_TEXTURE_2D, GL_RGBA8, GL_VIRTUAL_PAGE_SIZE_X_ARB, sizes, xs);
+    glGetInternalformativ(GL_TEXTURE_2D, GL_RGBA8, GL_VIRTUAL_PAGE_SIZE_Y_ARB, sizes, ys);
+    for (GLint i = 0; i < sizes; i++)
+    {
+        if (xs[i] == VT_PAGE_PAYLOAD && ys[i] == VT_PAGE_PAYLOAD)
+        {
+            glGetIntegerv(GL_MAX_SPARSE_TEXTURE_SIZE_ARB, &system->sparse_max_size);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void init_virtual_textures(VirtualTextureSystem *system, bool allow_sparse, int screen_width, int screen_height, GLADloadproc load)
+{
+    memset(system, 0, sizeof(VirtualTextureSystem));
+    for (unsigned int i = 0; i < VT_CACHE_SLOTS; i++)
+        system->slots[i].key = VT_NO_PAGE;
+
+    system->sparse = allow_sparse && init_sparse_backend(system, load);
+    if (allow_sparse && !system->sparse)
+        printf("Sparse textures unavailable, virtual textures use the page cache\n");
+
+    system->cache = create_texture(GL_TEXTURE_2D, 1, GL_RGBA8, VT_CACHE_SLOTS_X * VT_PAGE_SIZE, VT_CACHE_SLOTS_X * VT_PAGE_SIZE, 1);
+    set_texture_sampling(system->cache, GL_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE);
+
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    system->staging_buffer = create_buffer((GLsizeiptr) VT_STAGING_PAGES * VT_PAGE_BYTES, NULL, flags);
+    system->staging_memory = (unsigned char*)glMapNamedBufferRange(system->staging_buffer, 0, (GLsizeiptr) VT_STAGING_PAGES * VT_PAGE_BYTES, flags);
+
+    // feedback target, one packed page key per texel
+    system->feedback_width = (screen_width + VT_FEEDBACK_DIVISOR - 1) / VT_FEEDBACK_DIVISOR;
+    system->feedback_height = (screen_height + VT_FEEDBACK_DIVISOR - 1) / VT_FEEDBACK_DIVISOR;
+
+    system->feedback_texture = create_texture(GL_TEXTURE_2D, 1, GL_R32UI, system->feedback_width, system->feedback_height, 1);
+
+    glCreateRenderbuffers(1, &system->feedback_depth);
+    glNamedRenderbufferStorage(system->feedback_depth, GL_DEPTH_COMPONENT24, system->feedback_width, system->feedback_height);
+
+    glCreateFramebuffers(1, &system->feedback_fbo);
+    glNamedFramebufferTexture(system->feedback_fbo, GL_COLOR_ATTACHMENT0, system->feedback_texture, 0);
+    glNamedFramebufferRenderbuffer(system->feedback_fbo, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, system->feedback_depth);
+    if (glCheckNamedFramebufferStatus(system->feedback_fbo, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        printf("Virtual texture feedback framebuffer is incomplete\n");
+
+    // read back on the CPU, so the driver is told to keep them in system memory
+    size_t feedback_bytes = sizeof(uint32_t) * system->feedback_width * system->feedback_height;
+    for (int i = 0; i < VT_FEEDBACK_BUFFERS; i++)
+        system->feedback_pbos[i] = create_buffer((GLsizeiptr) feedback_bytes, NULL, GL_MAP_READ_BIT | GL_CLIENT_STORAGE_BIT);
+
+    // every texel plus its ancestors, at half load
+    uint32_t capacity = 1;
+    while (capacity < (uint32_t) (system->feedback_width * system->feedback_height) * 4)
+        capacity <<= 1;
+    system->seen = (uint32_t*)malloc(sizeof(uint32_t) * capacity);
+    system->seen_mask = capacity - 1;
+    system->wanted = (uint32_t*)malloc(sizeof(uint32_t) * capacity);
+
+    pthread_mutex_init(&system->lock, NULL);
+    pthread_cond_init(&system->wake, NULL);
+    system->running = true;
+    pthread_create(&system->thread, NULL, vt_loader_main, system);
+}
+
+size_t page_index(const VirtualTexture *vt, int mip, int x, int y)
+{
+    return vt->page_offset[mip] + (size_t) y * vt->pages_x[mip] + x;
+}
+
+// slot to put a new page in: a free one, else the least recently used page
+// nobody asked for this frame, -1 if the cache is all in use
+int find_cache_slot(VirtualTextureSystem *system)
+{
+    int best = -1;
+    for (int i = 0; i < VT_CACHE_SLOTS; i++)
+    {
+        CacheSlot *slot = &system->slots[i];
+        if (slot->key == VT_NO_PAGE)
+            return i;
+        if (slot->locked || slot->last_used >= system->frame)
+            continue;
+        if (best < 0 || slot->last_used < system->slots[best].last_used)
+            best = i;
+    }
+    return best;
+}
+
+int vt_level_size(int size, int mip)
+{
+    return size >> mip > 0 ? size >> mip : 1;
+}
+
+void evict_cache_slot(VirtualTextureSystem *system, int index)
+{
+    CacheSlot *slot = &system->slots[index];
+    if (slot->key == VT_NO_PAGE)
+        return;
+
+    VirtualTexture *vt = &system->textures[VT_KEY_ID(slot->key)];
+    int mip = (int) VT_KEY_MIP(slot->key), x = (int) VT_KEY_X(slot->key), y = (int) VT_KEY_Y(slot->key);
+    size_t page = page_index(vt, mip, x, y);
+    vt->page_slot[page] = -1;
+    vt->page_state[page] = PAGE_ABSENT;
+    vt->dirty = true;
+
+    // the mip tail is committed as a whole for the texture's lifetime
+    if (vt->sparse && mip < vt->sparse_levels)
+    {
+        glBindTexture(GL_TEXTURE_2D, vt->sparse_texture);
+        system->page_commitment(GL_TEXTURE_2D, mip, x * VT_PAGE_PAYLOAD, y * VT_PAGE_PAYLOAD, 0,
+            VT_PAGE_PAYLOAD, VT_PAGE_PAYLOAD, 1, GL_FALSE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    slot->key = VT_NO_PAGE;
+}
+
+// copy a loaded page into its home, pixels is an offset into the bound
+// unpack buffer or a client pointer when none is bound
+bool place_page(VirtualTextureSystem *system, uint32_t key, const void *pixels, bool locked)
+{
+    int index = find_cache_slot(system);
+    if (index < 0)
+        return false;
+    evict_cache_slot(system, index);
+
+    VirtualTexture *vt = &system->textures[VT_KEY_ID(key)];
+    int mip = (int) VT_KEY_MIP(key), x = (int) VT_KEY_X(key), y = (int) VT_KEY_Y(key);
+
+    if (vt->sparse)
+    {
+        // commitment is the one thing here with no DSA entry point
+        if (mip < vt->sparse_levels)
+        {
+            glBindTexture(GL_TEXTURE_2D, vt->sparse_texture);
+            system->page_commitment(GL_TEXTURE_2D, mip, x * VT_PAGE_PAYLOAD, y * VT_PAGE_PAYLOAD, 0,
+                VT_PAGE_PAYLOAD, VT_PAGE_PAYLOAD, 1, GL_TRUE);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+
+        // no borders in a sparse texture, the hardware filters across pages
+        int w = vt_level_size(vt->width, mip) - x * VT_PAGE_PAYLOAD;
+        int h = vt_level_size(vt->height, mip) - y * VT_PAGE_PAYLOAD;
+        w = w < 1 ? 1 : w;
+        h = h < 1 ? 1 : h;
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, VT_PAGE_SIZE);
+        glPixelStorei(GL_UNPACK_SKIP_PIXELS, VT_PAGE_BORDER);
+        glPixelStorei(GL_UNPACK_SKIP_ROWS, VT_PAGE_BORDER);
+        glTextureSubImage2D(vt->sparse_texture, mip, x * VT_PAGE_PAYLOAD, y * VT_PAGE_PAYLOAD,
+            w < VT_PAGE_PAYLOAD ? w : VT_PAGE_PAYLOAD, h < VT_PAGE_PAYLOAD ? h : VT_PAGE_PAYLOAD,
+            GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+        glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+    }
+    else
+    {
+        glTextureSubImage2D(system->cache, 0, (index % VT_CACHE_SLOTS_X) * VT_PAGE_SIZE, (index / VT_CACHE_SLOTS_X) * VT_PAGE_SIZE,
+            VT_PAGE_SIZE, VT_PAGE_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    }
+    render_stats.frame.texture_bytes += VT_PAGE_BYTES;
+
+    CacheSlot *slot = &system->slots[index];
+    slot->key = key;
+    slot->last_used = system->frame;
+    slot->locked = locked;
+
+    size_t page = page_index(vt, mip, x, y);
+    vt->page_slot[page] = index;
+    vt->page_state[page] = PAGE_RESIDENT;
+    vt->dirty = true;
+    return true;
+}
+
+// register a texture and load its coarsest mip, which never leaves the cache
+int add_virtual_texture(VirtualTextureSystem *system, int width, int height, PageLoader load, void *source)
+{
+    if (system->count == VT_MAX_TEXTURES)
+    {
+        printf("Too many virtual textures\n");
+        return -1;
+    }
+
+    // power of two page grids so every mip's grid is a GL level of the page table
+    int grid_x = 1, grid_y = 1;
+    while (grid_x * VT_PAGE_PAYLOAD < width)
+        grid_x <<= 1;
+    while (grid_y * VT_PAGE_PAYLOAD < height)
+        grid_y <<= 1;
+    if (grid_x > 0x1FFF || grid_y > 0x1FFF)
+    {
+        printf("Virtual texture of %dx%d is too big\n", width, height);
+        return -1;
+    }
+
+    int id = (int) system->count;
+    VirtualTexture *vt = &system->textures[id];
+    memset(vt, 0, sizeof(VirtualTexture));
+    vt->width = width;
+    vt->height = height;
+    vt->load = load;
+    vt->source = source;
+
+    // down to the mip that fits in a single page
+    vt->mips = 1;
+    while ((width >> (vt->mips - 1) > VT_PAGE_PAYLOAD || height >> (vt->mips - 1) > VT_PAGE_PAYLOAD) && vt->mips < VT_MAX_MIPS)
+        vt->mips++;
+
+    for (int mip = 0; mip < vt->mips; mip++)
+    {
+        vt->pages_x[mip] = vt_level_size(grid_x, mip);
+        vt->pages_y[mip] = vt_level_size(grid_y, mip);
+        vt->page_offset[mip] = vt->page_count;
+        vt->page_count += (size_t) vt->pages_x[mip] * vt->pages_y[mip];
+    }
+
+    vt->page_slot = (int32_t*)malloc(sizeof(int32_t) * vt->page_count);
+    vt->page_state = (uint8_t*)calloc(vt->page_count, sizeof(uint8_t));
+    vt->entries = (unsigned char*)calloc(vt->page_count, 4);
+    for (size_t i = 0; i < vt->page_count; i++)
+        vt->page_slot[i] = -1;
+
+    vt->page_table = create_texture(GL_TEXTURE_2D, vt->mips, GL_RGBA8, grid_x, grid_y, 1);
+    glTextureParameteri(vt->page_table, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTextureParameteri(vt->page_table, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    vt->sparse = system->sparse && grid_x * VT_PAGE_PAYLOAD <= system->sparse_max_size && grid_y * VT_PAGE_PAYLOAD <= system->sparse_max_size;
+    if (vt->sparse)
+    {
+        // sparse has to be set before the storage exists, so no create_texture
+        glCreateTextures(GL_TEXTURE_2D, 1, &vt->sparse_texture);
+        glTextureParameteri(vt->sparse_texture, GL_TEXTURE_SPARSE_ARB, GL_TRUE);
+        glTextureStorage2D(vt->sparse_texture, vt->mips, GL_RGBA8, grid_x * VT_PAGE_PAYLOAD, grid_y * VT_PAGE_PAYLOAD);
+        glTextureParameteri(vt->sparse_texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
+        glTextureParameteri(vt->sparse_texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glGetTextureParameteriv(vt->sparse_texture, GL_NUM_SPARSE_LEVELS_ARB, &vt->sparse_levels);
+
+        glBindTexture(GL_TEXTURE_2D, vt->sparse_texture);
+        for (int mip = vt->sparse_levels; mip < vt->mips; mip++)
+            system->page_commitment(GL_TEXTURE_2D, mip, 0, 0, 0,
+                vt_level_size(grid_x * VT_PAGE_PAYLOAD, mip), vt_level_size(grid_y * VT_PAGE_PAYLOAD, mip), 1, GL_TRUE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    system->count++;
+
+    unsigned char *page = (unsigned char*)malloc(VT_PAGE_BYTES);
+    uint32_t top = VT_KEY(id, vt->mips - 1, 0, 0);
+    if (!load(source, vt->mips - 1, 0, 0, page) || !place_page(system, top, page, true))
+        printf("Failed to load the top mip of virtual texture %d\n", id);
+    free(page);
+
+    return id;
+}
+
+// coarse to fine, pages that aren't resident borrow their parent's entry
+void resolve_page_table(VirtualTexture *vt)
+{
+    for (int mip = vt->mips - 1; mip >= 0; mip--)
+    {
+        for (int y = 0; y < vt->pages_y[mip]; y++)
+        {
+            for (int x = 0; x < vt->pages_x[mip]; x++)
+            {
+                size_t page = page_index(vt, mip, x, y);
+                unsigned char *entry = &vt->entries[page * 4];
+
+                if (vt->page_state[page] == PAGE_RESIDENT)
+                {
+                    entry[0] = (unsigned char) (vt->page_slot[page] % VT_CACHE_SLOTS_X);
+                    entry[1] = (unsigned char) (vt->page_slot[page] / VT_CACHE_SLOTS_X);
+                    entry[2] = (unsigned char) mip;
+                    entry[3] = 255;
+                }
+                else if (mip + 1 < vt->mips)
+                {
+                    memcpy(entry, &vt->entries[page_index(vt, mip + 1, x / 2, y / 2) * 4], 4);
+                }
+                else
+                {
+                    entry[0] = entry[1] = 0;
+                    entry[2] = (unsigned char) mip;
+                    entry[3] = 0;
+                }
+            }
+        }
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (int mip = 0; mip < vt->mips; mip++)
+        glTextureSubImage2D(vt->page_table, mip, 0, 0, vt->pages_x[mip], vt->pages_y[mip],
+            GL_RGBA, GL_UNSIGNED_BYTE, &vt->entries[vt->page_offset[mip] * 4]);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    render_stats.frame.texture_bytes += vt->page_count * 4;
+    vt->dirty = false;
+}
+
+void begin_vt_feedback(VirtualTextureSystem *system)
+{
+    const GLuint clear[4] = { VT_NO_PAGE, 0, 0, 0 };
+
+    // the window may have been resized since init, so put back whatever was set
+    glGetIntegerv(GL_VIEWPORT, system->saved_viewport);
+    glBindFramebuffer(GL_FRAMEBUFFER, system->feedback_fbo);
+    glViewport(0, 0, system->feedback_width, system->feedback_height);
+    glClearBufferuiv(GL_COLOR, 0, clear);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    render_stats.frame.state_changes += 2;
+}
+
+// queue the readback, update_virtual_textures picks it up a few frames later
+void end_vt_feedback(VirtualTextureSystem *system)
+{
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, system->feedback_pbos[system->feedback_frames % VT_FEEDBACK_BUFFERS]);
+    glReadPixels(0, 0, system->feedback_width, system->feedback_height, GL_RED_INTEGER, GL_UNSIGNED_INT, (void*)0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    system->feedback_frames++;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(system->saved_viewport[0], system->saved_viewport[1], system->saved_viewport[2], system->saved_viewport[3]);
+    render_stats.frame.state_changes += 2;
+}
+
+// true the first time a key is seen this frame
+bool vt_mark_seen(VirtualTextureSystem *system, uint32_t key)
+{
+    // past half full, drop the rest of this frame's feedback
+    if (system->seen_count > system->seen_mask / 2)
+        return false;
+
+    uint32_t slot = (key * 2654435761u) & system->seen_mask;
+    while (system->seen[slot] != VT_NO_PAGE)
+    {
+        if (system->seen[slot] == key)
+            return false;
+        slot = (slot + 1) & system->seen_mask;
+    }
+    system->seen[slot] = key;
+    system->seen_count++;
+    return true;
+}
+
+// a page and every page above it, so fallbacks are kept warm and arrive first
+void vt_touch_page(VirtualTextureSystem *system, uint32_t key)
+{
+    unsigned int id = VT_KEY_ID(key);
+    if (id >= system->count)
+        return;
+
+    VirtualTexture *vt = &system->textures[id];
+    int mip = (int) VT_KEY_MIP(key), x = (int) VT_KEY_X(key), y = (int) VT_KEY_Y(key);
+    if (mip >= vt->mips || x >= vt->pages_x[mip] || y >= vt->pages_y[mip])
+        return;
+
+    for (; mip < vt->mips; mip++, x /= 2, y /= 2)
+    {
+        uint32_t page_key = VT_KEY(id, mip, x, y);
+        if (!vt_mark_seen(system, page_key))
+            return;
+
+        size_t page = page_index(vt, mip, x, y);
+        if (vt->page_state[page] == PAGE_RESIDENT)
+            system->slots[vt->page_slot[page]].last_used = system->frame;
+        else if (vt->page_state[page] == PAGE_ABSENT)
+            system->wanted[system->wanted_count++] = page_key;
+    }
+}
+
+int compare_wanted_pages(const void *a, const void *b)
+{
+    // coarsest mip first
+    uint32_t mip_a = VT_KEY_MIP(*(const uint32_t*)a), mip_b = VT_KEY_MIP(*(const uint32_t*)b);
+    return (int) mip_b - (int) mip_a;
+}
+
+// read back old feedback, queue loads for missing pages and upload what the
+// loader finished, call once a frame after end_vt_feedback
+void update_virtual_textures(VirtualTextureSystem *system)
+{
+    if (system->count == 0)
+        return;
+
+    PROFILE_SCOPE("update_virtual_textures");
+    system->frame++;
+
+    // staging pages whose copy the GPU has finished with
+    for (int i = 0; i < VT_STAGING_PAGES; i++)
+    {
+        if (system->staging_state[i] != STAGING_IN_FLIGHT)
+            continue;
+
+        GLenum status = glClientWaitSync(system->staging_fence[i], 0, 0);
+        if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+        {
+            glDeleteSync(system->staging_fence[i]);
+            system->staging_fence[i] = NULL;
+            system->staging_state[i] = STAGING_FREE;
+        }
+    }
+
+    // the oldest readback has had VT_FEEDBACK_BUFFERS - 1 frames to land
+    system->wanted_count = 0;
+    if (system->feedback_frames >= VT_FEEDBACK_BUFFERS)
+    {
+        GLuint pbo = system->feedback_pbos[system->feedback_frames % VT_FEEDBACK_BUFFERS];
+        size_t texels = (size_t) system->feedback_width * system->feedback_height;
+        const uint32_t *feedback = (const uint32_t*)glMapNamedBufferRange(pbo, 0,
+            (GLsizeiptr) (texels * sizeof(uint32_t)), GL_MAP_READ_BIT);
+
+        if (feedback != NULL)
+        {
+            memset(system->seen, 0xFF, sizeof(uint32_t) * (system->seen_mask + 1));
+            system->seen_count = 0;
+            uint32_t last = VT_NO_PAGE;
+            for (size_t i = 0; i < texels; i++)
+            {
+                // neighbouring texels mostly want the same page
+                if (feedback[i] == VT_NO_PAGE || feedback[i] == last)
+                    continue;
+                last = feedback[i];
+                vt_touch_page(system, feedback[i]);
+            }
+            glUnmapNamedBuffer(pbo);
+        }
+    }
+
+    // hand as many missing pages to the loader as there is staging for
+    qsort(system->wanted, system->wanted_count, sizeof(uint32_t), compare_wanted_pages);
+    unsigned int next = 0;
+    pthread_mutex_lock(&system->lock);
+    for (int i = 0; i < VT_STAGING_PAGES && next < system->wanted_count; i++)
+    {
+        if (system->staging_state[i] != STAGING_FREE)
+            continue;
+
+        uint32_t key = system->wanted[next++];
+        VirtualTexture *vt = &system->textures[VT_KEY_ID(key)];
+        vt->page_state[page_index(vt, (int) VT_KEY_MIP(key), (int) VT_KEY_X(key), (int) VT_KEY_Y(key))] = PAGE_PENDING;
+
+        system->staging_state[i] = STAGING_LOADING;
+        PageRequest *request = &system->requests[(system->request_head + system->request_count) % VT_STAGING_PAGES];
+        request->key = key;
+        request->staging = i;
+        request->ok = false;
+        system->request_count++;
+    }
+    if (system->request_count > 0)
+        pthread_cond_signal(&system->wake);
+    pthread_mutex_unlock(&system->lock);
+
+    // copy finished pages into the cache straight from staging memory
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, system->staging_buffer);
+    for (int uploads = 0; uploads < VT_UPLOADS_PER_FRAME; uploads++)
+    {
+        pthread_mutex_lock(&system->lock);
+        if (system->done_count == 0)
+        {
+            pthread_mutex_unlock(&system->lock);
+            break;
+        }
+        PageRequest done = system->done[system->done_head];
+        system->done_head = (system->done_head + 1) % VT_STAGING_PAGES;
+        system->done_count--;
+        pthread_mutex_unlock(&system->lock);
+
+        VirtualTexture *vt = &system->textures[VT_KEY_ID(done.key)];
+        size_t page = page_index(vt, (int) VT_KEY_MIP(done.key), (int) VT_KEY_X(done.key), (int) VT_KEY_Y(done.key));
+
+        const void *offset = (const void*)((size_t) done.staging * VT_PAGE_BYTES);
+        if (!done.ok)
+        {
+            vt->page_state[page] = PAGE_FAILED;
+        }
+        else if (!place_page(system, done.key, offset, false))
+        {
+            // cache is full of pages in use, ask again next time it's seen
+            vt->page_state[page] = PAGE_ABSENT;
+        }
+
+        system->staging_fence[done.staging] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        system->staging_state[done.staging] = STAGING_IN_FLIGHT;
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    for (unsigned int i = 0; i < system->count; i++)
+    {
+        if (system->textures[i].dirty)
+            resolve_page_table(&system->textures[i]);
+    }
+}
+
+// uniform locations are looked up once per program, and the sampler units
+// only set again if first_unit moves
+VtProgram *get_vt_program(VirtualTextureSystem *system, unsigned int program, GLuint first_unit)
+{
+    VtProgram *entry = NULL;
+    for (unsigned int i = 0; i < system->program_count && entry == NULL; i++)
+    {
+        if (system->programs[i].program == program)
+            entry = &system->programs[i];
+    }
+
+    if (entry == NULL)
+    {
+        if (system->program_count == VT_MAX_PROGRAMS)
+        {
+            printf("Too many programs sample virtual textures\n");
+            return NULL;
+        }
+
+        entry = &system->programs[system->program_count++];
+        entry->program = program;
+        entry->first_unit = (GLuint) -1;
+        entry->page_tables = glGetUniformLocation(program, "vt_page_tables");
+        entry->physical = glGetUniformLocation(program, "vt_physical");
+        entry->info = glGetUniformLocation(program, "vt_info");
+    }
+
+    if (entry->first_unit != first_unit)
+    {
+        GLint units[2 * VT_MAX_TEXTURES];
+        for (int i = 0; i < 2 * VT_MAX_TEXTURES; i++)
+            units[i] = (GLint) first_unit + i;
+
+        if (entry->page_tables >= 0)
+            glUniform1iv(entry->page_tables, VT_MAX_TEXTURES, units);
+        if (entry->physical >= 0)
+            glUniform1iv(entry->physical, VT_MAX_TEXTURES, units + VT_MAX_TEXTURES);
+        entry->first_unit = first_unit;
+        entry->info_count = 0;
+    }
+
+    return entry;
+}
+
+// page tables and physical textures go on units after whatever the material
+// path already uses, every sampler gets a unit even when unused so none of
+// them alias a unit with a different sampler type. the program must be in use
+void bind_virtual_textures(VirtualTextureSystem *system, unsigned int program, GLuint first_unit)
+{
+    if (system->max_units == 0)
+        glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &system->max_units);
+    if (first_unit + 2 * VT_MAX_TEXTURES > (GLuint) system->max_units)
+    {
+        if (system->count > 0)
+            printf("Virtual textures need units up to %u, only %d are available\n",
+                first_unit + 2 * VT_MAX_TEXTURES, system->max_units);
+        return;
+    }
+
+    // the units are set even without textures, unset samplers would alias unit 0
+    VtProgram *entry = get_vt_program(system, program, first_unit);
+    if (entry == NULL || system->count == 0)
+        return;
+
+    // width, height, mip count, sparse, only changes when a texture is added
+    if (entry->info >= 0 && entry->info_count != system->count)
+    {
+        GLfloat info[4 * VT_MAX_TEXTURES];
+        for (unsigned int i = 0; i < VT_MAX_TEXTURES; i++)
+        {
+            VirtualTexture *vt = i < system->count ? &system->textures[i] : NULL;
+            info[i * 4 + 0] = vt != NULL ? (float) vt->width : 1.0f;
+            info[i * 4 + 1] = vt != NULL ? (float) vt->height : 1.0f;
+            info[i * 4 + 2] = vt != NULL ? (float) vt->mips : 1.0f;
+            info[i * 4 + 3] = vt != NULL && vt->sparse ? 1.0f : 0.0f;
+        }
+        glUniform4fv(entry->info, VT_MAX_TEXTURES, info);
+        entry->info_count = system->count;
+    }
+
+    // the feedback pass only reads vt_info
+    if (entry->page_tables < 0 && entry->physical < 0)
+        return;
+
+    for (unsigned int i = 0; i < system->count; i++)
+    {
+        VirtualTexture *vt = &system->textures[i];
+        glBindTextureUnit(first_unit + i, vt->page_table);
+        glBindTextureUnit(first_unit + VT_MAX_TEXTURES + i, vt->sparse ? vt->sparse_texture : system->cache);
+        render_stats.frame.state_changes += 2;
+    }
+}
+
+void destroy_virtual_textures(VirtualTextureSystem *system)
+{
+    if (system->running)
+    {
+        pthread_mutex_lock(&system->lock);
+        system->running = false;
+        pthread_cond_signal(&system->wake);
+        pthread_mutex_unlock(&system->lock);
+        pthread_join(system->thread, NULL);
+
+        pthread_mutex_destroy(&system->lock);
+        pthread_cond_destroy(&system->wake);
+    }
+
+    for (unsigned int i = 0; i < system->count; i++)
+    {
+        VirtualTexture *vt = &system->textures[i];
+        glDeleteTextures(1, &vt->page_table);
+        if (vt->sparse_texture != 0)
+            glDeleteTextures(1, &vt->sparse_texture);
+        free(vt->page_slot);
+        free(vt->page_state);
+        free(vt->entries);
+        if (vt->release != NULL)
+            vt->release(vt->source);
+    }
+
+    for (int i = 0; i < VT_STAGING_PAGES; i++)
+    {
+        if (system->staging_fence[i] != NULL)
+            glDeleteSync(system->staging_fence[i]);
+    }
+
+    if (system->staging_buffer != 0)
+    {
+        glUnmapNamedBuffer(system->staging_buffer);
+        glDeleteBuffers(1, &system->staging_buffer);
+    }
+
+    glDeleteTextures(1, &system->cache);
+    glDeleteTextures(1, &system->feedback_texture);
+    glDeleteRenderbuffers(1, &system->feedback_depth);
+    glDeleteFramebuffers(1, &system->feedback_fbo);
+    glDeleteBuffers(VT_FEEDBACK_BUFFERS, system->feedback_pbos);
+
+    free(system->seen);
+    free(system->wanted);
+    system->count = 0;
+}
+
+// whole image in memory, for textures that do fit, cut into pages on demand
+bool load_image_page(void *data, int mip, int x, int y, unsigned char *page)
+{
+    ImagePageSource *source = (ImagePageSource*)data;
+    if (mip >= source->chain.levels)
+        return false;
+
+    int width = source->chain.width[mip];
+    int height = source->chain.height[mip];
+    const unsigned char *pixels = source->chain.data[mip];
+
+    // clamp to the image edge, which also fills the border
+    for (int row = 0; row < VT_PAGE_SIZE; row++)
+    {
+        int src_y = y * VT_PAGE_PAYLOAD - VT_PAGE_BORDER + row;
+        src_y = src_y < 0 ? 0 : (src_y >= height ? height - 1 : src_y);
+
+        for (int col = 0; col < VT_PAGE_SIZE; col++)
+        {
+            int src_x = x * VT_PAGE_PAYLOAD - VT_PAGE_BORDER + col;
+            src_x = src_x < 0 ? 0 : (src_x >= width ? width - 1 : src_x);
+            memcpy(&page[((size_t) row * VT_PAGE_SIZE + col) * 4], &pixels[((size_t) src_y * width + src_x) * 4], 4);
+        }
+    }
+
+    return true;
+}
+
+// pre-cut pages on disk, <directory>/<mip>_<x>_<y>.png, each VT_PAGE_SIZE
+// square with its border already baked in
+bool load_tile_page(void *data, int mip, int x, int y, unsigned char *page)
+{
+    TilePageSource *source = (TilePageSource*)data;
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%d_%d_%d.png", source->directory, mip, x, y);
+
+    int width, height, channels;
+    begin_arena_scope();
+    unsigned char *pixels = end_arena_scope(stbi_load(path, &width, &height, &channels, 4));
+    if (pixels == NULL)
+        return false;
+
+    bool ok = width == VT_PAGE_SIZE && height == VT_PAGE_SIZE;
+    if (ok)
+        memcpy(page, pixels, VT_PAGE_BYTES);
+    else
+        printf("Virtual texture page %s is %dx%d, expected %d\n", path, width, height, VT_PAGE_SIZE);
+
+    stbi_image_free(pixels);
+    return ok;
+}
+
+void release_image_source(void *data)
+{
+    ImagePageSource *source = (ImagePageSource*)data;
+    free_mip_chain(&source->chain);
+    stbi_image_free(source->pixels);
+    free(source);
+}
+
+int add_virtual_texture_image(VirtualTextureSystem *system, const char *path)
+{
+    ImagePageSource *source = (ImagePageSource*)calloc(1, sizeof(ImagePageSource));
+
+    int width, height, channels;
+    stbi_set_flip_vertically_on_load(true);
+    source->pixels = stbi_load(path, &width, &height, &channels, 4);
+    if (source->pixels == NULL)
+    {
+        printf("Failed to load texture %s!\n", path);
+        free(source);
+        return -1;
+    }
+
+    generate_mip_chain(source->pixels, width, height, 4, true, MIP_DEFAULT_FILTER, VT_MAX_MIPS, &source->chain);
+
+    int id = add_virtual_texture(system, width, height, load_image_page, source);
+    if (id < 0)
+        release_image_source(source);
+    else
+        system->textures[id].release = release_image_source;
+    return id;
+}
+
+int add_virtual_texture_tiles(VirtualTextureSystem *system, const char *directory, int width, int height)
+{
+    TilePageSource *source = (TilePageSource*)calloc(1, sizeof(TilePageSource));
+    snprintf(source->directory, sizeof(source->directory), "%s", directory);
+
+    int id = add_virtual_texture(system, width, height, load_tile_page, source);
+    if (id < 0)
+        free(source);
+    else
+        system->textures[id].release = free;
+    return id;
+}
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef YCBCR_TEXTURE_H
+#define YCBCR_TEXTURE_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#include <glad/glad.h>
+
+// the implementation is pulled in once by hello_world.c
+#ifndef STBI_INCLUDE_STB_IMAGE_H
+#include "stb_image/stb_image.h"
+#endif
+
+#include "arena.h"
+#include "gl_resources.h"
+#include "render_stats.h"
+#include "shader.h"
+#include "texture_format.h"
+
+// ycbcr defaults
+#define YCBCR_SHADER_PATH "src/shaders/ycbcr_compute_shader.glsl"
+#define YCBCR_GROUP_SIZE 8 // must match local_size in the shader
+
+// JPEGs uploaded as their raw Y, Cb and Cr planes, one R8 texture each, and
+// converted to RGBA8 by a compute pass. that skips stb_image's chroma
+// upsampling and color conversion, and 4:2:0 files upload half the bytes of
+// RGB. the result is an ordinary texture. its mips are generated through an
+// sRGB view so they're averaged in linear space like the CPU chains, but with
+// the driver's box filter rather than MIP_DEFAULT_FILTER
+typedef struct YcbcrConverter {
+    Shader shader;
+    bool ready;
+} YcbcrConverter;
+
+bool init_ycbcr_converter(YcbcrConverter *converter);
+bool load_ycbcr_planes(const char *path, stbi_jpeg_planes *planes);
+GLuint convert_ycbcr_texture(YcbcrConverter *converter, const stbi_jpeg_planes *planes, bool flip, int levels);
+void destroy_ycbcr_converter(YcbcrConverter *converter);
+
+bool init_ycbcr_converter(YcbcrConverter *converter)
+{
+    converter->ready = init_compute_shader(&converter->shader, YCBCR_SHADER_PATH);
+    if (!converter->ready)
+    {
+        glDeleteProgram(converter->shader.ID);
+        printf("YCbCr conversion shader unavailable, decoding JPEGs on the CPU\n");
+    }
+    return converter->ready;
+}
+
+// false for anything that isn't a greyscale or YCbCr JPEG. decoded in an
+// arena scope like the library's other loads; the planes are one
+// allocation, so they move together when the scope compacts
+bool load_ycbcr_planes(const char *path, stbi_jpeg_planes *planes)
+{
+    begin_arena_scope();
+    bool loaded = stbi_load_jpeg_planes(path, planes);
+    unsigned char *start = (unsigned char*)end_arena_scope(loaded ? planes->plane[0] : NULL);
+    if (!loaded)
+        return false;
+
+    // plane 0 last, the others are found from where it was
+    for (int k = planes->plane_count - 1; k >= 0; k--)
+        planes->plane[k] = start + (planes->plane[k] - planes->plane[0]);
+    return true;
+}
+
+// returns an RGBA8 texture with levels mips, leaves texture units 0-2 empty
+GLuint convert_ycbcr_texture(YcbcrConverter *converter, const stbi_jpeg_planes *planes, bool flip, int levels)
+{
+    GLint alignment = 4;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+
+    GLuint plane_ids[3] = { 0, 0, 0 };
+    GLint units[3];
+    GLfloat scale[6];
+    for (int k = 0; k < planes->plane_count; k++)
+    {
+        TextureFormat format = choose_texture_format(1, planes->plane_w[k]);
+        plane_ids[k] = create_texture(GL_TEXTURE_2D, 1, format.internal_format, planes->plane_w[k], planes->plane_h[k], 1);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, format.alignment);
+        glTextureSubImage2D(plane_ids[k], 0, 0, 0, planes->plane_w[k], planes->plane_h[k], format.format, format.type, planes->plane[k]);
+        glBindTextureUnit(k, plane_ids[k]);
+        render_stats.frame.texture_bytes += (uint64_t) planes->plane_w[k] * planes->plane_h[k];
+
+        units[k] = k;
+        scale[k * 2] = 1.0f / planes->plane_hs[k];
+        scale[k * 2 + 1] = 1.0f / planes->plane_vs[k];
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+
+    TextureFormat rgba = choose_texture_format(4, planes->width);
+    GLuint id = create_texture(GL_TEXTURE_2D, levels, rgba.internal_format, planes->width, planes->height, 1);
+    glBindImageTexture(0, id, 0, GL_FALSE, 0, GL_WRITE_ONLY, rgba.internal_format);
+
+    use_shader(&converter->shader);
+    glUniform1iv(glGetUniformLocation(converter->shader.ID, "planes"), planes->plane_count, units);
+    glUniform2fv(glGetUniformLocation(converter->shader.ID, "plane_scale"), planes->plane_count, scale);
+    set_int(&converter->shader, "plane_count", planes->plane_count);
+    set_bool(&converter->shader, "flip", flip);
+    glDispatchCompute((GLuint) (planes->width + YCBCR_GROUP_SIZE - 1) / YCBCR_GROUP_SIZE,
+        (GLuint) (planes->height + YCBCR_GROUP_SIZE - 1) / YCBCR_GROUP_SIZE, 1);
+
+    // the mips are made however the driver likes, so make the stores visible to all of it
+    glMemoryBarrier(GL_ALL_BARRIER_BITS);
+    if (levels > 1)
+    {
+        // the texels are sRGB encoded, filtering them as RGBA8 would average
+        // in gamma space and darken the mips. views need a name that was
+        // never bound, so glGenTextures rather than glCreateTextures
+        GLuint view;
+        glGenTextures(1, &view);
+        glTextureView(view, GL_TEXTURE_2D, id, GL_SRGB8_ALPHA8, 0, (GLuint) levels, 0, 1);
+        glGenerateTextureMipmap(view);
+        glDeleteTextures(1, &view);
+    }
+
+    glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, rgba.internal_format);
+    glUseProgram(0);
+    for (int k = 0; k < planes->plane_count; k++)
+        glBindTextureUnit(k, 0);
+    glDeleteTextures(planes->plane_count, plane_ids);
+    return id;
+}
+
+void destroy_ycbcr_converter(YcbcrConverter *converter)
+{
+    if (converter->ready)
+        glDeleteProgram(converter->shader.ID);
+    converter->ready = false;
+}
+
+#endif